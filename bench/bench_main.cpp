@@ -0,0 +1,315 @@
+/*
+Kernel Benchmarks
+=================
+
+Times the capture-path kernels on one block of synthetic INMP441 samples:
+the per-sample conversion, PCM packing (scalar reference, the build's
+packAudioBlock - PIE on ESP32-S3 - and the fixed-size AudioProfile kernel),
+codec conversion, the voice filter, AGC and two-mic beamformer, the payload CRC32, the ADPCM encoder and, with
+-DBENCH_USE_OPUS=1, one Opus frame. The block is the build profile's
+AUDIO_BUFFER_SIZE (audio_pipeline.h).
+
+  pio run -e native -t exec          host, steady clock
+  pio run -e esp32s3_bench -t upload device, CPU cycle counter, results on
+  pio device monitor                 serial every BENCH_REPEAT_MS
+
+Columns: ns/sample and ns/block for every kernel; cycles/block on the device
+only (the host column shows "-"). Each kernel runs BENCH_ROUNDS rounds of
+BENCH_ITERATIONS blocks and the fastest round is reported, which filters out
+preemption and cache warm-up. Before timing, packAudioBlock and
+AudioProfile::pack are checked byte-for-byte against packAudioBlockScalar, so
+a new kernel is compared against the scalar baseline and not only timed.
+*/
+
+#include "audio_dsp.h"
+#include "audio_pipeline.h"
+#include "adpcm.h"
+#include "voice_filter.h"
+#include "agc.h"
+#include "beamformer.h"
+#include "esp_rom_crc.h"
+#include <string.h>
+
+#ifndef BENCH_USE_OPUS
+#define BENCH_USE_OPUS 0
+#endif
+#if BENCH_USE_OPUS
+#include <opus.h>
+#endif
+
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 2000
+#endif
+#define BENCH_ROUNDS 5
+#define BENCH_BLOCK AudioProfile::blockSamples
+#define BENCH_SAMPLE_RATE 16000
+#define BENCH_OPUS_FRAME (BENCH_SAMPLE_RATE / 50) // 20 ms
+#define BENCH_REPEAT_MS 10000
+#define BENCH_TASK_STACK 32768 // Opus needs a deep stack, as in main.cpp
+
+#ifdef ARDUINO
+#include <esp_cpu.h>
+#define BENCH_HAS_CYCLES 1
+#define benchPrintf Serial.printf
+static inline uint64_t benchTicks() { return esp_cpu_get_ccount(); }
+#else
+#include <chrono>
+#include <stdio.h>
+#define BENCH_HAS_CYCLES 0
+#define benchPrintf printf
+static inline uint64_t benchTicks()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch())
+        .count();
+}
+#endif
+
+static int32_t input32[BENCH_BLOCK] __attribute__((aligned(AUDIO_DSP_ALIGN)));
+static int32_t filtered32[BENCH_BLOCK]; // Filtered in place, round after round
+static int16_t samples16[BENCH_BLOCK] __attribute__((aligned(AUDIO_DSP_ALIGN)));
+static uint8_t payload[BENCH_BLOCK * 2] __attribute__((aligned(AUDIO_DSP_ALIGN)));
+static uint8_t reference[BENCH_BLOCK * 2] __attribute__((aligned(AUDIO_DSP_ALIGN)));
+static uint8_t codes[BENCH_BLOCK / 2 + 1];
+static volatile uint32_t sink; // Keeps results observable
+#if BENCH_USE_OPUS
+static OpusEncoder *opusEncoder = NULL;
+static uint8_t opusPacket[1276];
+#endif
+
+// Speech-like test signal: two tones plus noise, 24 bits left-justified in 32
+// like the INMP441's I2S frames, at a level the default gain does not clip
+static void fillInput()
+{
+    uint32_t noise = 12345;
+    int32_t phaseA = 0, phaseB = 0;
+    for (int i = 0; i < BENCH_BLOCK; i++)
+    {
+        noise = noise * 1103515245 + 12345;
+        phaseA = (phaseA + 1) % 80; // 200 Hz triangle
+        phaseB = (phaseB + 1) % 11; // ~1.45 kHz triangle
+        int32_t a = (phaseA < 40 ? phaseA : 80 - phaseA) * 60 - 1200;
+        int32_t b = (phaseB < 6 ? phaseB : 11 - phaseB) * 150 - 450;
+        int32_t n = (int32_t)((noise >> 16) & 0xFF) - 128;
+        input32[i] = (a + b + n) << 16;
+    }
+}
+
+static void runProcessSample()
+{
+    for (int i = 0; i < BENCH_BLOCK; i++)
+        processAudioSample(input32[i], &samples16[i]);
+    sink = samples16[BENCH_BLOCK - 1];
+}
+
+static void runPackScalar()
+{
+    AudioBlockStats stats;
+    packAudioBlockScalar(input32, BENCH_BLOCK, payload, &stats);
+    sink = stats.crc;
+}
+
+static void runPack()
+{
+    AudioBlockStats stats;
+    packAudioBlock(input32, BENCH_BLOCK, payload, &stats);
+    sink = stats.crc;
+}
+
+static void runPackFixed()
+{
+    AudioBlockStats stats;
+    AudioProfile::pack(input32, payload, &stats);
+    sink = stats.crc;
+}
+
+static void runConvertFixed()
+{
+    AudioBlockStats stats;
+    AudioProfile::convert(input32, samples16, &stats);
+    sink = stats.maxAbs;
+}
+
+static void runVoiceFilter()
+{
+    voiceFilterProcess(filtered32, BENCH_BLOCK, 1, AudioProfile::sampleRate);
+    sink = filtered32[0];
+}
+
+static void runAgc()
+{
+    agcProcess(filtered32, BENCH_BLOCK, 1, AudioProfile::sampleRate);
+    sink = filtered32[0];
+}
+
+// BENCH_BLOCK slots as BENCH_BLOCK / 2 stereo frames
+static void runBeamformer()
+{
+    beamformerSetDelay(1);
+    beamformerProcess(filtered32, BENCH_BLOCK / 2);
+    sink = filtered32[0];
+}
+
+static void runConvert()
+{
+    AudioBlockStats stats;
+    convertAudioBlock(input32, BENCH_BLOCK, samples16, &stats);
+    sink = stats.maxAbs;
+}
+
+static void runCrc()
+{
+    sink = esp_rom_crc32_le(0, payload, sizeof(payload));
+}
+
+static void runAdpcm()
+{
+    AdpcmState state;
+    adpcmReset(&state);
+    sink = adpcmEncode(&state, samples16, BENCH_BLOCK, codes);
+}
+
+#if BENCH_USE_OPUS
+static void runOpus()
+{
+    sink = opus_encode(opusEncoder, samples16, BENCH_OPUS_FRAME, opusPacket, sizeof(opusPacket));
+}
+#endif
+
+struct BenchResult
+{
+    uint64_t ticks; // Fastest round: nanoseconds on the host, cycles on the device
+};
+
+static BenchResult measure(void (*kernel)())
+{
+    for (int i = 0; i < 16; i++) // Warm caches and branch predictors
+        kernel();
+
+    uint64_t best = UINT64_MAX;
+    for (int round = 0; round < BENCH_ROUNDS; round++)
+    {
+        uint64_t total = 0;
+        for (int i = 0; i < BENCH_ITERATIONS; i++)
+        {
+            // Per call, so the 32-bit cycle counter cannot wrap inside a measurement
+            uint64_t start = benchTicks();
+            kernel();
+            total += (uint32_t)(benchTicks() - start);
+        }
+        if (total < best)
+            best = total;
+    }
+    return {best};
+}
+
+static void report(const char *name, int samples, void (*kernel)())
+{
+    BenchResult result = measure(kernel);
+    double perBlock = (double)result.ticks / BENCH_ITERATIONS;
+#if BENCH_HAS_CYCLES
+    double ns = perBlock * 1000.0 / getCpuFrequencyMhz();
+    benchPrintf("%-24s %7d %10.2f %11.0f %13.0f\n", name, samples, ns / samples, ns, perBlock);
+#else
+    benchPrintf("%-24s %7d %10.2f %11.0f %13s\n", name, samples, perBlock / samples, perBlock, "-");
+#endif
+}
+
+// A packer must match the scalar reference exactly, payload and stats
+static bool checkPacker(void (*pack)(const int32_t *, uint8_t *, AudioBlockStats *))
+{
+    AudioBlockStats expected, actual;
+    packAudioBlockScalar(input32, BENCH_BLOCK, reference, &expected);
+    memset(payload, 0, sizeof(payload));
+    pack(input32, payload, &actual);
+    return memcmp(reference, payload, sizeof(payload)) == 0 && expected.maxAbs == actual.maxAbs &&
+           expected.sumSquared == actual.sumSquared && expected.crc == actual.crc;
+}
+
+static void packGeneric(const int32_t *in, uint8_t *out, AudioBlockStats *stats)
+{
+    packAudioBlock(in, BENCH_BLOCK, out, stats);
+}
+
+static void runBenchmarks()
+{
+    fillInput();
+    bool packOk = checkPacker(packGeneric);
+    bool fixedOk = checkPacker(AudioProfile::pack);
+    benchPrintf("\nKernel benchmarks: %d-sample blocks at %u Hz, %d x %d iterations\n", BENCH_BLOCK,
+                AudioProfile::sampleRate, BENCH_ROUNDS, BENCH_ITERATIONS);
+    benchPrintf("packAudioBlock %s (%s), AudioProfile::pack (%s)\n", AUDIO_DSP_HAS_PIE ? "PIE" : "scalar",
+                packOk ? "matches scalar" : "MISMATCH against scalar",
+                fixedOk ? "matches scalar" : "MISMATCH against scalar");
+    benchPrintf("%-24s %7s %10s %11s %13s\n", "kernel", "samples", "ns/sample", "ns/block", "cycles/block");
+
+    report("processAudioSample", BENCH_BLOCK, runProcessSample);
+    report("packAudioBlockScalar", BENCH_BLOCK, runPackScalar);
+    report("packAudioBlock", BENCH_BLOCK, runPack);
+    report("AudioProfile::pack", BENCH_BLOCK, runPackFixed);
+    report("convertAudioBlock", BENCH_BLOCK, runConvert);
+    report("AudioProfile::convert", BENCH_BLOCK, runConvertFixed);
+    memcpy(filtered32, input32, sizeof(filtered32));
+    report("voiceFilterProcess", BENCH_BLOCK, runVoiceFilter);
+    report("agcProcess", BENCH_BLOCK, runAgc);
+    report("beamformerProcess", BENCH_BLOCK / 2, runBeamformer);
+    report("crc32 payload", BENCH_BLOCK, runCrc);
+    report("adpcmEncode", BENCH_BLOCK, runAdpcm);
+#if BENCH_USE_OPUS
+    if (opusEncoder)
+        report("opus_encode 20 ms", BENCH_OPUS_FRAME, runOpus);
+#endif
+}
+
+static void benchSetup()
+{
+#if BENCH_USE_OPUS
+    // Same settings as the Opus stage, see opus_stage.cpp
+    int err = OPUS_OK;
+    opusEncoder = opus_encoder_create(BENCH_SAMPLE_RATE, 1, OPUS_APPLICATION_VOIP, &err);
+    if (err != OPUS_OK)
+    {
+        benchPrintf("opus_encoder_create failed: %s\n", opus_strerror(err));
+        opusEncoder = NULL;
+    }
+    else
+    {
+        opus_encoder_ctl(opusEncoder, OPUS_SET_VBR(1));
+        opus_encoder_ctl(opusEncoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+        opus_encoder_ctl(opusEncoder, OPUS_SET_COMPLEXITY(3));
+        opus_encoder_ctl(opusEncoder, OPUS_SET_BITRATE(16000));
+    }
+#endif
+}
+
+#ifdef ARDUINO
+static void benchTask(void *)
+{
+    benchSetup();
+    for (;;)
+    {
+        runBenchmarks();
+        vTaskDelay(pdMS_TO_TICKS(BENCH_REPEAT_MS));
+    }
+}
+
+void setup()
+{
+    Serial.begin(115200);
+    delay(2000);
+    // Own task for the stack depth; core 1 like the capture task
+    xTaskCreatePinnedToCore(benchTask, "Bench", BENCH_TASK_STACK, NULL, 1, NULL, 1);
+}
+
+void loop()
+{
+    vTaskDelay(portMAX_DELAY);
+}
+#else
+int main()
+{
+    benchSetup();
+    runBenchmarks();
+    return 0;
+}
+#endif
@@ -0,0 +1,42 @@
+/*
+Host stand-in for the ESP32 ROM CRC
+===================================
+
+Only on the include path of the native benchmark env (platformio.ini), so
+audio_dsp.cpp builds unchanged off-device. Same contract as the ROM's
+esp_rom_crc32_le: CRC32 (IEEE, as zlib), and passing the previous result as
+`crc` continues it over the next piece.
+
+Table-driven, a byte at a time, built on first use - a plain C reference the
+ROM function would be compared against - not tuned for the host.
+*/
+
+#ifndef BENCH_HOST_ESP_ROM_CRC_H
+#define BENCH_HOST_ESP_ROM_CRC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+inline uint32_t esp_rom_crc32_le(uint32_t crc, const uint8_t *buf, uint32_t len)
+{
+    static uint32_t table[256];
+    static bool ready = false;
+    if (!ready)
+    {
+        for (uint32_t n = 0; n < 256; n++)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; k++)
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            table[n] = c;
+        }
+        ready = true;
+    }
+
+    crc = ~crc;
+    for (uint32_t i = 0; i < len; i++)
+        crc = table[(crc ^ buf[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+#endif // BENCH_HOST_ESP_ROM_CRC_H
@@ -2,12 +2,21 @@
 Level 1: WiFi Auto-Connect with Multiple Passwords
 Description: Ye program available WiFi networks ko scan karta hai aur predefined passwords
             se connect hone ki koshish karta hai.
+            Fast reconnect: last successful network (SSID, password, BSSID, channel aur IP lease)
+            RTC memory aur NVS me save hota hai. Agli baar seedha usi AP aur channel par connect
+            karte hain - scan nahi. Deep sleep se jaagne par IP lease bhi reuse hota hai (DHCP
+            nahi). Restart/power on par RTC data reset ho jata hai - tab NVS wala AP, lease nahi.
+            Fast connect fail ho to hi scan + multi-password wala tareeka chalta hai.
+            Credential store: har SSID ke liye yaad rakhte hain ki kaunsa password chala tha.
+            Scan background me chalta hai (LED blink hoti rehti hai), phir networks ko known-good
+            history aur signal strength (RSSI) se rank karke best wale pehle try karte hain.
 Author: Your Name
 Date: Current Date
 */
 
 #include <Arduino.h> // Arduino ke basic functions ke liye
 #include <WiFi.h>    // WiFi functions ke liye
+#include <Preferences.h> // NVS (flash) me fast-reconnect cache ke liye
 
 // Passwords ki list - in passwords se WiFi connect karne ki koshish karenge
 const char *passwords[] = {
@@ -15,11 +24,50 @@ const char *passwords[] = {
     "ashish20032300", // Password 2
     "Aa@20032300"     // Password 3
 };
-const int NUM_PASSWORDS = 3; // Total passwords ki count
+const int NUM_PASSWORDS = sizeof(passwords) / sizeof(passwords[0]); // Total passwords ki count - array se hi nikalte hain
 
 // ESP32-CAM ka built-in LED pin - isse hum status indicate karenge
 const int LED_BUILTIN = 33; // GPIO 33 pin LED ke liye use karenge
 
+// Fast reconnect cache - last successful connection ki details
+#define WIFI_CACHE_MAGIC 0x57464331 // Cache valid hai ya nahi pehchanne ke liye
+#define FAST_CONNECT_TIMEOUT_MS 3000 // Cached AP par itne time me IP nahi mila to scan karenge
+struct WiFiCache
+{
+    uint32_t magic;
+    char ssid[33];      // Network ka naam
+    int passwordIndex;  // passwords[] me kaunsa password chala tha
+    uint8_t bssid[6];   // AP ka MAC address
+    int32_t channel;    // AP ka channel
+    uint32_t ip;        // IP lease - sirf RTC copy me, 0 matlab DHCP karo
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+};
+RTC_DATA_ATTR WiFiCache rtcCache; // Sirf deep sleep wake tak - restart par bootloader ise reset karta hai
+Preferences prefs;                // Power off ke baad bhi - NVS me
+
+// Credential store - SSID ke hisaab se kaunsa password chala tha (NVS me "creds" blob)
+#define MAX_KNOWN_NETWORKS 8  // Itne networks yaad rakhenge, purane wale hat jayenge
+#define KNOWN_NETWORK_BONUS 30 // Known-good network ko itne dBm ka fayda ranking me
+#define MAX_KNOWN_SUCCESSES 10 // Ranking me itne successes tak gine jaate hain, aage count nahi badhta
+#define MAX_CANDIDATES 16     // Ek scan me itne networks tak try karenge
+struct KnownNetwork
+{
+    char ssid[33];       // Network ka naam, "" matlab khali slot
+    int8_t passwordIndex; // passwords[] me jo password chala tha
+    uint8_t successes;   // Kitni baar connect ho chuke hain (max MAX_KNOWN_SUCCESSES)
+};
+KnownNetwork knownNetworks[MAX_KNOWN_NETWORKS];
+
+// Scan me mila ek network - har SSID ka sirf sabse strong AP rakhte hain
+struct Candidate
+{
+    int scanIndex; // WiFi.SSID(i) wala index
+    int score;     // Ranking - zyada matlab pehle try karenge
+    int known;     // knownNetworks[] ka index, -1 agar naya network hai
+};
+
 // WiFi ke different status codes ko human readable format me convert karne ka function
 void printWiFiStatus(wl_status_t status)
 {
@@ -52,22 +100,166 @@ void printWiFiStatus(wl_status_t status)
     }
 }
 
-// WiFi se connect karne ka function - ye ek network aur password ke saath connection try karta hai
-bool tryConnectWiFi(const char *ssid, const char *password)
+// Successful connection ki details cache me save karte hain
+void saveWiFiCache(const char *ssid, int passwordIndex)
+{
+    WiFiCache entry = {};
+    entry.magic = WIFI_CACHE_MAGIC;
+    strncpy(entry.ssid, ssid, sizeof(entry.ssid) - 1);
+    entry.passwordIndex = passwordIndex;
+    memcpy(entry.bssid, WiFi.BSSID(), sizeof(entry.bssid));
+    entry.channel = WiFi.channel();
+    entry.ip = WiFi.localIP();
+    entry.gateway = WiFi.gatewayIP();
+    entry.subnet = WiFi.subnetMask();
+    entry.dns = WiFi.dnsIP(0);
+    rtcCache = entry; // RTC copy me lease ke saath
+
+    // NVS me lease nahi rakhte - lambe power off ke baad wo IP kisi aur ko mil chuka ho sakta hai.
+    // Flash wear bachane ke liye sirf tab likhte hain jab AP badla ho.
+    entry.ip = entry.gateway = entry.subnet = entry.dns = 0;
+    WiFiCache saved;
+    prefs.begin("wifi", false);
+    if (prefs.getBytes("cache", &saved, sizeof(saved)) != sizeof(saved) || memcmp(&saved, &entry, sizeof(entry)) != 0)
+    {
+        prefs.putBytes("cache", &entry, sizeof(entry));
+    }
+    prefs.end();
+}
+
+// NVS se credential store load karte hain
+void loadKnownNetworks()
+{
+    memset(knownNetworks, 0, sizeof(knownNetworks));
+    prefs.begin("wifi", true);
+    if (prefs.getBytes("creds", knownNetworks, sizeof(knownNetworks)) != sizeof(knownNetworks))
+    {
+        memset(knownNetworks, 0, sizeof(knownNetworks)); // Purana ya kharab data - khali se shuru
+    }
+    prefs.end();
+}
+
+// SSID ka known-good entry dhundte hain, -1 agar nahi mila
+int findKnownNetwork(const char *ssid)
+{
+    for (int i = 0; i < MAX_KNOWN_NETWORKS; i++)
+    {
+        if (knownNetworks[i].ssid[0] != '\0' && strcmp(knownNetworks[i].ssid, ssid) == 0)
+            return i;
+    }
+    return -1;
+}
+
+// Jo password chala usse yaad rakhte hain - naya network ho to sabse kam use hua slot replace karte hain.
+// Har connect par call hota hai (fast path bhi), par NVS me sirf tab likhte hain jab SSID, password
+// ya ranking badle - count MAX_KNOWN_SUCCESSES par ruk jata hai, uske baad flash write nahi.
+void rememberCredential(const char *ssid, int passwordIndex)
+{
+    int slot = findKnownNetwork(ssid);
+    if (slot >= 0 && knownNetworks[slot].passwordIndex == passwordIndex &&
+        knownNetworks[slot].successes >= MAX_KNOWN_SUCCESSES)
+        return; // Kuch badla nahi - flash write nahi karenge
+
+    if (slot < 0)
+    {
+        slot = 0;
+        for (int i = 1; i < MAX_KNOWN_NETWORKS; i++)
+        {
+            if (knownNetworks[i].successes < knownNetworks[slot].successes)
+                slot = i;
+        }
+        memset(&knownNetworks[slot], 0, sizeof(KnownNetwork));
+        strncpy(knownNetworks[slot].ssid, ssid, sizeof(knownNetworks[slot].ssid) - 1);
+    }
+    if (knownNetworks[slot].passwordIndex != passwordIndex)
+        knownNetworks[slot].successes = 0; // Password badal gaya - history nayi
+    knownNetworks[slot].passwordIndex = passwordIndex;
+    if (knownNetworks[slot].successes < MAX_KNOWN_SUCCESSES)
+        knownNetworks[slot].successes++;
+
+    prefs.begin("wifi", false);
+    prefs.putBytes("creds", knownNetworks, sizeof(knownNetworks));
+    prefs.end();
+}
+
+// Cache bekaar nikla - dono jagah se hata dete hain
+void clearWiFiCache()
+{
+    rtcCache.magic = 0;
+    prefs.begin("wifi", false);
+    prefs.remove("cache");
+    prefs.end();
+}
+
+// Cached AP par seedha connect - scan nahi, channel aur BSSID pinned
+bool tryCachedConnect()
+{
+    WiFiCache cache = rtcCache;
+    if (cache.magic != WIFI_CACHE_MAGIC)
+    {
+        // RTC me kuch nahi (power on ya restart) - NVS se AP lete hain, lease nahi
+        prefs.begin("wifi", true);
+        size_t size = prefs.getBytes("cache", &cache, sizeof(cache));
+        prefs.end();
+        if (size != sizeof(cache) || cache.magic != WIFI_CACHE_MAGIC)
+            return false; // Koi cache nahi
+        cache.ip = 0;
+    }
+    if (cache.passwordIndex < 0 || cache.passwordIndex >= NUM_PASSWORDS)
+        return false;
+
+    Serial.printf("\nCached network '%s' (channel %d) par fast connect try kar rahe hain\n", cache.ssid, cache.channel);
+    unsigned long start = millis();
+
+    // Lease bacha hai to static IP - DHCP ka wait nahi
+    if (cache.ip != 0)
+        WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+    WiFi.begin(cache.ssid, passwords[cache.passwordIndex], cache.channel, cache.bssid);
+
+    while (WiFi.status() != WL_CONNECTED && millis() - start < FAST_CONNECT_TIMEOUT_MS)
+    {
+        delay(20); // Chhota wait - yahan har millisecond count hota hai
+    }
+
+    if (WiFi.status() == WL_CONNECTED)
+    {
+        digitalWrite(LED_BUILTIN, LOW); // LED on - connected
+        Serial.printf("Fast connect ho gaya %lu ms me! IP Address: %s\n", millis() - start, WiFi.localIP().toString().c_str());
+        saveWiFiCache(cache.ssid, cache.passwordIndex); // Naya lease RTC me
+        rememberCredential(cache.ssid, cache.passwordIndex);
+        return true;
+    }
+
+    // Fail - cache hata ke DHCP wapas on karte hain, aage normal scan chalega
+    Serial.println("Fast connect fail ho gaya - full scan karenge");
+    WiFi.disconnect();
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+    clearWiFiCache();
+    return false;
+}
+
+// WiFi se connect karne ka function - ye ek network aur password ke saath connection try karta hai.
+// Scan me mila AP (BSSID + channel) pinned hai, to driver dobara scan nahi karta.
+bool tryConnectWiFi(const char *ssid, const char *password, int32_t channel, const uint8_t *bssid)
 {
     Serial.printf("\nNetwork '%s' ke saath password '%s' try kar rahe hain\n", ssid, password);
 
     // WiFi connection start karte hain
-    WiFi.begin(ssid, password);
+    WiFi.begin(ssid, password, channel, bssid);
 
-    // 10 seconds (20 attempts * 500ms) tak wait karenge connection ke liye
-    int attempts = 0;
-    while (WiFi.status() != WL_CONNECTED && attempts < 20)
+    // 10 seconds tak wait karenge connection ke liye - par galat password ya AP gayab ho to
+    // driver turant bata deta hai, tab poora wait nahi karenge
+    unsigned long start = millis();
+    while (WiFi.status() != WL_CONNECTED && millis() - start < 10000)
     {
+        wl_status_t status = WiFi.status();
+        if (millis() - start > 500 && (status == WL_CONNECT_FAILED || status == WL_NO_SSID_AVAIL))
+            break; // Shuru ke 500ms purane attempt ka status ho sakta hai, uske baad bharosa karte hain
+
         digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN)); // LED ko blink karte hain
-        delay(500);                                           // Half second wait
-        Serial.print(".");                                    // Progress dikhane ke liye dots print karte hain
-        attempts++;
+        delay(100);                                           // Chhota wait - fail jaldi pakadne ke liye
+        if ((millis() - start) % 500 < 100)
+            Serial.print("."); // Progress dikhane ke liye dots print karte hain
     }
 
     // Check karte hain ki connection successful hua ya nahi
@@ -103,22 +295,30 @@ void setup()
 
     // WiFi ko station mode me set karte hain (means WiFi network se connect hone ke liye)
     WiFi.mode(WIFI_STA);
-    WiFi.disconnect(true); // Pehle disconnect kar dete hain agar connected ho
-    delay(1000);           // 1 second wait
+    WiFi.persistent(false); // Credentials hum khud cache karte hain, driver ka flash write nahi chahiye
+    loadKnownNetworks();    // Kaunse network par kaunsa password chala tha
 
-    bool connected = false; // Connection status track karne ke liye variable
+    // Sabse pehle last successful AP par seedha connect try karte hain
+    bool connected = tryCachedConnect(); // Connection status track karne ke liye variable
 
     // Jab tak successful connection nahi hota, tab tak try karte rahenge
     while (!connected)
     {
-        // Available WiFi networks scan karte hain
+        // Available WiFi networks background me scan karte hain - tab tak LED status dikhati rehti hai
         Serial.println("\nWiFi networks scan kar rahe hain...");
-        int numNetworks = WiFi.scanNetworks();
+        WiFi.scanNetworks(true); // true = async, turant return karta hai
+        int numNetworks;
+        while ((numNetworks = WiFi.scanComplete()) == WIFI_SCAN_RUNNING)
+        {
+            digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN)); // Scan chal raha hai - fast blink
+            delay(50);
+        }
 
-        // Agar koi network nahi mila
-        if (numNetworks == 0)
+        // Agar koi network nahi mila (ya scan fail ho gaya)
+        if (numNetworks <= 0)
         {
             Serial.println("Koi WiFi network nahi mila!");
+            WiFi.scanDelete();
             delay(5000); // 5 second wait karke dobara try karenge
             continue;
         }
@@ -126,19 +326,76 @@ void setup()
         // Mile hue networks ki list print karte hain
         Serial.printf("\n%d networks mile hain:\n", numNetworks);
 
-        // Har ek network ke liye try karte hain
-        for (int i = 0; i < numNetworks && !connected; i++)
+        // Candidates banate hain - har SSID ka strongest AP, score = RSSI + known-good bonus
+        Candidate candidates[MAX_CANDIDATES];
+        int numCandidates = 0;
+        for (int i = 0; i < numNetworks; i++)
         {
+            String ssid = WiFi.SSID(i);
+            if (ssid.length() == 0)
+                continue; // Hidden network - naam hi nahi pata
+
+            int known = findKnownNetwork(ssid.c_str());
+            int score = WiFi.RSSI(i);
+            if (known >= 0)
+                score += KNOWN_NETWORK_BONUS + min((int)knownNetworks[known].successes, MAX_KNOWN_SUCCESSES);
+
+            // Same SSID pehle mil chuka hai? To sirf strong wala rakhte hain
+            int existing = -1;
+            for (int c = 0; c < numCandidates; c++)
+            {
+                if (WiFi.SSID(candidates[c].scanIndex) == ssid)
+                    existing = c;
+            }
+            if (existing >= 0)
+            {
+                if (score > candidates[existing].score)
+                    candidates[existing] = {i, score, known};
+            }
+            else if (numCandidates < MAX_CANDIDATES)
+            {
+                candidates[numCandidates++] = {i, score, known};
+            }
+        }
+
+        // Best score pehle - chhoti list hai, insertion sort kaafi hai
+        for (int a = 1; a < numCandidates; a++)
+        {
+            Candidate item = candidates[a];
+            int b = a - 1;
+            while (b >= 0 && candidates[b].score < item.score)
+            {
+                candidates[b + 1] = candidates[b];
+                b--;
+            }
+            candidates[b + 1] = item;
+        }
+
+        // Har ek network ke liye try karte hain, ranking ke order me
+        for (int c = 0; c < numCandidates && !connected; c++)
+        {
+            int i = candidates[c].scanIndex;
             String ssid = WiFi.SSID(i); // Network ka naam
             int rssi = WiFi.RSSI(i);    // Signal strength
+            int known = candidates[c].known;
 
-            Serial.printf("\n%d. Testing network: %s (Signal Strength: %d dBm)\n", i + 1, ssid.c_str(), rssi);
+            Serial.printf("\n%d. Testing network: %s (Signal Strength: %d dBm)%s\n", c + 1, ssid.c_str(), rssi,
+                          known >= 0 ? " [known]" : "");
 
-            // Har ek password try karte hain is network ke saath
-            for (int j = 0; j < NUM_PASSWORDS && !connected; j++)
+            // Known network ho to jo password pehle chala tha wahi pehle, baaki baad me
+            int first = known >= 0 ? knownNetworks[known].passwordIndex : 0;
+            if (first < 0 || first >= NUM_PASSWORDS)
+                first = 0;
+            for (int k = 0; k < NUM_PASSWORDS && !connected; k++)
             {
-                connected = tryConnectWiFi(ssid.c_str(), passwords[j]);
-                if (!connected)
+                int j = (first + k) % NUM_PASSWORDS;
+                connected = tryConnectWiFi(ssid.c_str(), passwords[j], WiFi.channel(i), WiFi.BSSID(i));
+                if (connected)
+                {
+                    saveWiFiCache(ssid.c_str(), j); // Agli baar fast connect ke liye
+                    rememberCredential(ssid.c_str(), j);
+                }
+                else
                 {
                     Serial.printf("Password '%s' fail ho gaya network '%s' ke liye\n", passwords[j], ssid.c_str());
                 }
@@ -2,6 +2,29 @@
 Level 2: WiFi Auto-Connect + Camera Capture
 Description: Level 1 ke WiFi auto-connect ke saath camera functionality add ki hai.
             Ab ESP32-CAM photos capture kar sakta hai aur serial monitor par status dikhata hai.
+            Capture engine: sensor lagatar stream karta hai (CAMERA_GRAB_LATEST, PSRAM me 3
+            frame buffers) aur ek alag capture task hamesha sabse naya frame ready rakhta hai.
+            Photo lene wale ko sensor ka wait nahi karna padta - frame turant mil jata hai.
+            Bina PSRAM ke ek hi buffer hai - tab frames on demand lete hain (flash wala photo bhi).
+            Motion mode (MOTION_DETECT): fixed timer ki jagah har MOTION_SAMPLE_MS par frame ko
+            1/8 scale par decode karke 8x8 blocks ka SAD background model se compare karte hain.
+            High-res photos sirf motion par save hote hain, motion se pehle ke kuch frames
+            (pre-trigger ring) ke saath - shaant scene me storage/uplink lagbhag zero.
+            Storage: photos SD card (SD_MMC 4-bit) ya LittleFS par files banke save hote hain.
+            Capture path sirf JPEG copy karke queue me daalta hai aur buffer turant wapas deta hai;
+            ek writer task bade aligned chunks me likhta hai. Queue bhari = naya frame drop,
+            capture kabhi flash ki write latency ka wait nahi karta.
+            Recorder: burst (sensor ki poori fps) ya timelapse (har N second ek frame) - dono
+            capture task ke isi producer se, ek hi MJPEG-AVI file me append. Per frame file
+            open/close aur directory update nahi; index (idx1) aur header file band karte waqt.
+            Serial commands: "burst <sec>", "timelapse <sec>", "stop", "brightness <n>", "contrast <n>".
+            Battery mode (DUTY_CYCLE): timer ya PIR se jaag ke sensor state restore, photo, fast
+            reconnect se WiFi, ek hi connection par upload (POST /upload) aur wapas deep sleep.
+            Sequence number aur failure counters RTC memory me; fail hone par sleep lamba hota hai.
+            Warm-up: AE/AGC/AWB settle hone par sensor ke exposure, gain aur (OV3660/OV5640 par)
+            AWB gain registers brightness/contrast ke saath NVS me save hote hain. Boot par wahi
+            values pehle kuch frames ke liye manual likhte hain, phir auto loops wahan se chalte
+            hain - pehla frame hi theek exposed, seconds ka convergence nahi.
 Author: Your Name
 Date: Current Date
 */
@@ -9,15 +32,23 @@ Date: Current Date
 #include <Arduino.h>          // Arduino ke basic functions ke liye
 #include <WiFi.h>             // WiFi functions ke liye
 #include "esp_camera.h"       // ESP32 Camera ke functions ke liye
+#include "esp_timer.h"        // Frame timestamps ke liye (microseconds)
+#include "img_converters.h"   // JPEG ko chhote RGB565 me decode karne ke liye (motion detection)
+#include "FS.h"               // Storage ke file functions
+#include "SD_MMC.h"           // SD card (4-bit SDMMC)
+#include "LittleFS.h"         // SD card na ho to internal flash
+#include <Preferences.h>      // Boot number NVS me, har boot ka alag folder
 #include "soc/soc.h"          // ESP32 brownout ke liye
 #include "soc/rtc_cntl_reg.h" // ESP32 brownout ke liye
+#include "esp_sleep.h"        // Battery mode (DUTY_CYCLE) ki deep sleep
+#include "driver/gpio.h"      // Sleep me sensor power-down aur flash pins hold
 
 // Passwords ki list - in passwords se WiFi connect karne ki koshish karenge
 const char *passwords[] = {
     "ashish20032300", // Password 2
     "Aa@20032300"     // Password 3
 };
-const int NUM_PASSWORDS = 3; // Total passwords ki count
+const int NUM_PASSWORDS = sizeof(passwords) / sizeof(passwords[0]); // Total passwords ki count - array se hi nikalte hain
 
 // ESP32-CAM ke pins define karte hain
 #define PWDN_GPIO_NUM 32
@@ -41,6 +72,174 @@ const int NUM_PASSWORDS = 3; // Total passwords ki count
 const int LED_BUILTIN = 33; // GPIO 33 pin LED ke liye use karenge
 const int FLASH_LED = 4;    // Flash LED ka pin
 
+// Capture engine - sensor lagatar chalta hai, latestFrame me hamesha sabse naya frame
+#define CAMERA_FB_COUNT 3        // PSRAM me itne frame buffers (ek capture task ke paas, ek consumer, ek sensor)
+#define CAPTURE_TASK_CORE 0      // WiFi core 0 par bhi hai, par capture task zyada time wait me rehta hai
+#define CAPTURE_TASK_PRIORITY 2
+SemaphoreHandle_t frameLock = NULL; // latestFrame ko protect karta hai
+camera_fb_t *latestFrame = NULL;    // Sabse naya frame, jab tak koi consumer le na le
+volatile uint32_t framesCaptured = 0;
+bool singleFrameBuffer = false;    // PSRAM nahi - ek hi buffer, frames on demand (takeLatestFrame)
+
+// Sensor warm-up - pichhli baar ke converged AE/AGC/AWB registers NVS se, pehle frame se sahi exposure
+#define SENSOR_STATE_RESTORE 1
+#define SENSOR_STATE_NAMESPACE "camstate"
+#define SENSOR_STATE_MAGIC 0x43535431     // "CST1" - layout badle to naya magic
+#define SENSOR_STATE_MAX_REGS 12
+#define SENSOR_STATE_HOLD_FRAMES 2        // Itne frames restore ki values par, phir auto loops
+#define SENSOR_STATE_CHECK_MS 5000        // Registers itne time me ek baar padhte hain
+#define SENSOR_STATE_STABLE_PCT 5         // Do checks ke beech isse kam badla = converged
+#define SENSOR_STATE_MIN_CHANGE_PCT 10    // Saved se itna alag ho tabhi NVS write - flash wear kam
+#define SENSOR_STATE_SAVE_MIN_MS 600000   // Boot ke pehle save ke baad 10 minute me ek write se zyada nahi
+#define SERIAL_BOOT_WAIT_MS 100           // Pehle 2 s tha - camera ka pehla frame utna late hota tha
+#define MOTION_WARMUP_RESTORED 3          // State restore hua to background jaldi settle
+
+// Battery mode - loop() ki jagah: jaago (timer ya PIR), photo, upload, deep sleep. Radio aur sensor
+// sirf jaagte waqt on - mahino ki battery. Motion/storage/recorder is mode me nahi chalte.
+#define DUTY_CYCLE 0                      // 1 = battery mode
+#define DUTY_SLEEP_S 300                  // Timer wake har itne second
+#define DUTY_PIR_GPIO 13                  // PIR output (RTC GPIO, HIGH = motion); -1 = sirf timer.
+                                          // 13 4-bit SD ki data line hai, is mode me SD use nahi hota
+#define DUTY_PIR_FRAMES 2                 // PIR wake par itne frames (ek fb driver ke liye chhod ke)
+#define DUTY_SETTLE_MAX_FRAMES 6          // Restore ke baad AE/AWB itne frames me settle na ho to bhi photo
+#define DUTY_COLD_FRAMES 15               // Saved state na ho to AE ko itne frames
+#define DUTY_SCAN_AFTER_FAILURES 3        // Cached AP itni wakes lagatar na mile to cache hata ke full scan
+#define DUTY_BACKOFF_MAX 4                // Lagatar fail par sleep double hota hai, max 16x
+#define DUTY_STATE_MAGIC 0x44545932       // "DTY2" - DutyState badle to badlo
+#define UPLOAD_HOST "192.168.1.100"       // server/server.js - POST /upload
+#define UPLOAD_PORT 3012
+#define UPLOAD_PATH "/upload"
+#define UPLOAD_TIMEOUT_S 5
+
+enum SensorGroup : uint8_t
+{
+    SENSOR_GROUP_EXPOSURE,
+    SENSOR_GROUP_GAIN,
+    SENSOR_GROUP_AWB_RED,
+    SENSOR_GROUP_AWB_GREEN,
+    SENSOR_GROUP_AWB_BLUE,
+    SENSOR_GROUP_COUNT
+};
+
+// Motion detection mode - fixed timer ki jagah sirf motion par high-res photo
+#define MOTION_DETECT 1            // 0 = purana mode, har CAPTURE_INTERVAL par photo
+#define MOTION_SAMPLE_MS 200       // Itne ms me ek frame check karte hain
+#define MOTION_BLOCK 8             // 8x8 pixel blocks par SAD
+#define MOTION_BLOCK_DIFF 12       // Block ka average per-pixel difference isse zyada = changed block
+#define MOTION_MIN_BLOCKS 3        // Itne changed blocks = motion
+#define MOTION_LIGHTING_PCT 80     // Itne % blocks ek saath badle = light/exposure change, motion nahi
+#define MOTION_BG_SHIFT 4          // Background har sample me 1/16 naye frame ki taraf jata hai
+#define MOTION_WARMUP_SAMPLES 15   // Shuru me background settle hone tak trigger nahi
+#define MOTION_HOLD_MS 2000        // Motion rukne ke baad itni der tak frames save hote rehte hain
+#define MOTION_PRETRIGGER_FRAMES 3 // Motion se pehle ke itne frames bhi save honge
+#define MOTION_MAX_W 200           // UXGA / 8
+#define MOTION_MAX_H 150
+#define MOTION_TASK_CORE 1
+#define MOTION_TASK_PRIORITY 1
+
+// Pre-trigger ring ka ek frame - JPEG ki copy PSRAM me
+struct RingFrame
+{
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    uint16_t width;
+    uint16_t height;
+    int64_t timestampUs;
+    bool saved; // Is frame ko already save kar chuke hain
+};
+
+#define MOTION_RING_SIZE (MOTION_PRETRIGGER_FRAMES + 1) // +1: abhi wala frame
+RingFrame motionRing[MOTION_RING_SIZE];
+int ringHead = 0; // Agla slot jisme likhna hai
+int ringCount = 0;
+
+uint8_t *motionRgb = NULL; // 1/8 scale decode (RGB565)
+uint16_t *motionBg = NULL; // Background model - grayscale, Q8 fixed point
+int motionW = 0;
+int motionH = 0;
+bool motionReseed = true; // Agla frame seedha background ban jayega
+uint32_t motionSamples = 0;
+volatile uint32_t motionEvents = 0;
+volatile uint32_t motionFramesSaved = 0;
+volatile int lastChangedBlocks = 0;
+
+// Storage pipeline - capture path copy karke queue me, writer task file likhta hai
+#define STORAGE_ENABLED 1
+#define STORAGE_SD_4BIT 1                // 4-bit SD_MMC; is mode me GPIO 4 (flash LED) SD ka data pin hai
+#define STORAGE_QUEUE_DEPTH 4            // Itne frames line me; bhari ho to naya frame drop
+#define STORAGE_CHUNK_SIZE (16 * 1024)   // Internal RAM ka aligned chunk - SD ko bade sequential writes
+#define STORAGE_MIN_FREE (256 * 1024)    // Isse kam jagah bachi to likhna band
+#define STORAGE_FREE_CHECK_EVERY 16      // Free space har itni files par check (SD par ye slow hai)
+#define STORAGE_TASK_CORE 0
+#define STORAGE_TASK_PRIORITY 1          // Capture task se neeche - write latency capture ko nahi rokti
+
+// Ek file write ka kaam - buffer job ke saath reuse hota hai
+struct StorageJob
+{
+    uint8_t *buf; // JPEG copy (PSRAM)
+    size_t cap;
+    size_t len;
+    int64_t timestampUs;
+    uint16_t width;
+    uint16_t height;
+    char tag; // File name me: 'p' photo, 'm' motion, 'r' pre-trigger; 'a' = AVI recording ka frame
+};
+#define STORAGE_CLOSE_AVI -1 // storageQueue par ye index = recording file band karo
+
+StorageJob storageJobs[STORAGE_QUEUE_DEPTH];
+QueueHandle_t storageFree = NULL;  // Khali jobs ke index
+QueueHandle_t storageQueue = NULL; // Likhne ke liye ready jobs ke index
+fs::FS *storageFs = NULL;
+const char *storageName = "none";
+bool storageSd = false;
+uint32_t storageBoot = 0; // Is boot ka folder number
+uint32_t storageFileIndex = 0;
+volatile uint32_t storageWritten = 0;
+volatile uint32_t storageDropped = 0; // Queue bhari, memory nahi, ya jagah khatam
+volatile uint32_t storageErrors = 0;
+volatile uint32_t storageLastWriteMs = 0;
+
+// MJPEG-AVI recorder - ek recording = ek file, frames append, index close par
+#define RECORD_MAX_FRAMES 3600       // Itne frames ke baad file band karke nayi (index PSRAM me 8 bytes/frame)
+#define RECORD_FLUSH_FRAMES 30       // Itne frames par flush - power jaye to bhi zyada data na khoye
+#define RECORD_TIMELAPSE_FPS 10      // Timelapse video is fps par chalega
+#define AVI_HEADER_SIZE 224          // RIFF + hdrl (avih, strl: strh, strf) + movi LIST header
+#define AVI_MOVI_OFFSET 220          // 'movi' fourcc ki position - idx1 offsets isi se
+
+enum RecordMode : uint8_t
+{
+    RECORD_OFF,
+    RECORD_BURST,     // Har frame jo sensor deta hai
+    RECORD_TIMELAPSE  // Har recordIntervalMs me ek frame
+};
+
+// Capture task (producer) ki taraf ki state
+volatile RecordMode recordMode = RECORD_OFF;
+volatile uint32_t recordIntervalMs = 0;
+volatile unsigned long recordUntilMs = 0; // Burst kab tak, 0 = stop tak
+unsigned long recordLastFrameMs = 0;
+volatile uint32_t recordQueued = 0;
+
+// Writer task ki taraf ki state - sirf storageTask chhuta hai
+struct AviWriter
+{
+    File file;
+    bool open;
+    bool timelapse;
+    uint32_t number;       // Is boot me kaunsi recording
+    uint32_t frames;
+    uint32_t moviBytes;    // 'movi' ke baad likhe bytes
+    uint32_t maxFrameBytes;
+    uint16_t width;
+    uint16_t height;
+    int64_t firstUs;
+    int64_t lastUs;
+    uint32_t *index;       // Har frame: offset, size
+};
+AviWriter avi = {};
+volatile uint32_t recordingsClosed = 0;
+
 // Camera initialize karne ka function
 bool initCamera()
 {
@@ -73,15 +272,20 @@ bool initCamera()
     // Image quality set karte hain based on available memory
     if (psramFound())
     {
-        config.frame_size = FRAMESIZE_UXGA; // UXGA resolution (1600x1200)
-        config.jpeg_quality = 10;           // Best quality (0-63, where lower is better)
-        config.fb_count = 2;                // 2 frame buffers
+        config.frame_size = FRAMESIZE_UXGA;        // UXGA resolution (1600x1200)
+        config.jpeg_quality = 10;                  // Best quality (0-63, where lower is better)
+        config.fb_count = CAMERA_FB_COUNT;         // 3 frame buffers - sensor kabhi rukta nahi
+        config.fb_location = CAMERA_FB_IN_PSRAM;   // Bade frames PSRAM me
+        config.grab_mode = CAMERA_GRAB_LATEST;     // Purane frames chhod ke hamesha naya frame
     }
     else
     {
-        config.frame_size = FRAMESIZE_SVGA; // SVGA resolution (800x600)
-        config.jpeg_quality = 12;           // Good quality
-        config.fb_count = 1;                // 1 frame buffer
+        config.frame_size = FRAMESIZE_SVGA;        // SVGA resolution (800x600)
+        config.jpeg_quality = 12;                  // Good quality
+        config.fb_count = 1;                       // 1 frame buffer - DRAM me jagah kam hai
+        config.fb_location = CAMERA_FB_IN_DRAM;
+        config.grab_mode = CAMERA_GRAB_WHEN_EMPTY; // Ek buffer ke saath LATEST kaam nahi karta
+        singleFrameBuffer = true;                  // Buffer wapas milne par hi agla exposure shuru
     }
 
     // Camera initialize karte hain
@@ -96,19 +300,831 @@ bool initCamera()
     return true;
 }
 
+bool recordOffer(const camera_fb_t *fb); // Recorder ko frame chahiye to copy - neeche storage ke saath
+extern volatile int sensorHoldFrames;    // Sensor warm-up state - neeche
+static void releaseSensorHold();
+
+// Har naye frame par - recorder ki copy aur sensor warm-up ki ginti
+static void onFrameCaptured(camera_fb_t *fb)
+{
+    // Recording chal rahi ho to frame ki copy queue me (burst me har frame)
+    if (recordMode != RECORD_OFF)
+        recordOffer(fb);
+
+    // Restore ki values par itne frames ho gaye - ab auto exposure/AWB yahin se
+    if (sensorHoldFrames > 0 && --sensorHoldFrames == 0)
+        releaseSensorHold();
+    framesCaptured++;
+}
+
+// Capture task - sensor se lagatar frames leta hai aur latestFrame ko update karta hai.
+// Purana frame (jo kisi ne nahi liya) turant driver ko wapas de dete hain.
+// Ek buffer wale mode me frame pakad ke nahi rakhte - driver agla exposure tabhi shuru karta
+// hai jab buffer wapas mile, to flash ke baad wala frame kabhi nahi aata. Tab task sirf
+// recording ke dauran frames leta hai aur turant wapas deta hai; baaki frames on demand.
+void captureTask(void *parameter)
+{
+    while (true)
+    {
+        if (singleFrameBuffer)
+        {
+            if (recordMode == RECORD_OFF)
+            {
+                vTaskDelay(pdMS_TO_TICKS(20));
+                continue;
+            }
+            xSemaphoreTake(frameLock, portMAX_DELAY);
+            camera_fb_t *fb = esp_camera_fb_get();
+            if (fb)
+            {
+                onFrameCaptured(fb);
+                esp_camera_fb_return(fb);
+            }
+            xSemaphoreGive(frameLock);
+            if (!fb)
+                vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
+        }
+
+        camera_fb_t *fb = esp_camera_fb_get(); // Agle frame tak wait karta hai
+        if (!fb)
+        {
+            vTaskDelay(pdMS_TO_TICKS(10)); // Sensor ready nahi - thoda ruk ke dobara
+            continue;
+        }
+        onFrameCaptured(fb);
+
+        xSemaphoreTake(frameLock, portMAX_DELAY);
+        camera_fb_t *old = latestFrame;
+        latestFrame = fb;
+        xSemaphoreGive(frameLock);
+
+        if (old)
+            esp_camera_fb_return(old);
+    }
+}
+
+// Capture engine start karte hain
+bool startCaptureEngine()
+{
+    frameLock = xSemaphoreCreateMutex();
+    if (!frameLock)
+        return false;
+    if (singleFrameBuffer)
+        Serial.println("PSRAM nahi - ek frame buffer, photos on demand (flash ke baad naya exposure)");
+    return xTaskCreatePinnedToCore(captureTask, "CameraCapture", 4096, NULL,
+                                   CAPTURE_TASK_PRIORITY, NULL, CAPTURE_TASK_CORE) == pdPASS;
+}
+
+static int64_t frameTimeUs(const camera_fb_t *fb)
+{
+    return (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+}
+
+// Ek buffer wala mode: driver se seedha frame. Purana frame (notBeforeUs se pehle shuru hua)
+// wapas dete hi driver naya exposure shuru karta hai, to agla frame flash ke baad ka hai.
+static camera_fb_t *grabFrameOnDemand(int64_t notBeforeUs, uint32_t timeoutMs)
+{
+    unsigned long start = millis();
+    while (millis() - start < timeoutMs)
+    {
+        if (xSemaphoreTake(frameLock, pdMS_TO_TICKS(timeoutMs)) != pdTRUE)
+            return NULL;
+        camera_fb_t *fb = esp_camera_fb_get();
+        xSemaphoreGive(frameLock);
+        if (!fb)
+            continue;
+        onFrameCaptured(fb);
+        if (frameTimeUs(fb) >= notBeforeUs)
+            return fb;
+        esp_camera_fb_return(fb); // Bahut purana - agla exposure isi ke baad
+    }
+    return NULL;
+}
+
+// Sabse naya frame le lete hain - kaam hone par esp_camera_fb_return() se wapas dena hai.
+// notBeforeUs: isse pehle shuru hua frame nahi chahiye (jaise flash on hone se pehle wala)
+camera_fb_t *takeLatestFrame(int64_t notBeforeUs, uint32_t timeoutMs)
+{
+    if (singleFrameBuffer)
+        return grabFrameOnDemand(notBeforeUs, timeoutMs);
+
+    unsigned long start = millis();
+    while (millis() - start < timeoutMs)
+    {
+        xSemaphoreTake(frameLock, portMAX_DELAY);
+        camera_fb_t *fb = latestFrame;
+        if (fb && frameTimeUs(fb) < notBeforeUs)
+        {
+            fb = NULL; // Bahut purana - agle frame ka wait
+        }
+        else
+        {
+            latestFrame = NULL; // Ab ye frame consumer ka hai
+        }
+        xSemaphoreGive(frameLock);
+
+        if (fb)
+            return fb;
+        vTaskDelay(pdMS_TO_TICKS(5));
+    }
+    return NULL;
+}
+
+// Sensor warm-up state - converged AE/AGC/AWB registers aur user ki brightness/contrast NVS me.
+// Boot par ye values manual hold karke pehle frames lete hain, phir auto loops yahin se chalte
+// hain - shuru ke over/under exposed frames nahi, motion/deep-sleep units ko pehla frame hi theek.
+struct SensorStateReg
+{
+    uint16_t reg;  // get_reg/set_reg address (OV2640: 0x100 | reg = sensor bank)
+    uint8_t mask;  // Register ke sirf ye bits hamare (baaki flip/mirror jaise)
+    uint8_t group; // SENSOR_GROUP_* - ek group ke registers mil ke ek value (high byte pehle)
+};
+
+struct SensorStateTable
+{
+    uint16_t pid;
+    const SensorStateReg *regs;
+    uint8_t count;
+    uint16_t awbManualReg; // AWB gains manual karne ka bit (0x01), 0 = sensor gains nahi deta
+};
+
+// OV2640: AEC[15:10] REG45, AEC[9:2] AEC, AEC[1:0] REG04, gain GAIN. AWB gains bahar nahi aate,
+// par AWB kuch hi frames me settle ho jata hai
+static const SensorStateReg ov2640StateRegs[] = {
+    {0x145, 0x3F, SENSOR_GROUP_EXPOSURE}, {0x110, 0xFF, SENSOR_GROUP_EXPOSURE}, {0x104, 0x03, SENSOR_GROUP_EXPOSURE},
+    {0x100, 0xFF, SENSOR_GROUP_GAIN}};
+// OV3660/OV5640: exposure 0x3500-0x3502, gain 0x350A-0x350B, AWB R/G/B gains 0x3400-0x3405
+static const SensorStateReg ov5640StateRegs[] = {
+    {0x3500, 0x0F, SENSOR_GROUP_EXPOSURE}, {0x3501, 0xFF, SENSOR_GROUP_EXPOSURE}, {0x3502, 0xFF, SENSOR_GROUP_EXPOSURE},
+    {0x350A, 0x03, SENSOR_GROUP_GAIN}, {0x350B, 0xFF, SENSOR_GROUP_GAIN},
+    {0x3400, 0x0F, SENSOR_GROUP_AWB_RED}, {0x3401, 0xFF, SENSOR_GROUP_AWB_RED},
+    {0x3402, 0x0F, SENSOR_GROUP_AWB_GREEN}, {0x3403, 0xFF, SENSOR_GROUP_AWB_GREEN},
+    {0x3404, 0x0F, SENSOR_GROUP_AWB_BLUE}, {0x3405, 0xFF, SENSOR_GROUP_AWB_BLUE}};
+static const SensorStateTable sensorStateTables[] = {
+    {OV2640_PID, ov2640StateRegs, sizeof(ov2640StateRegs) / sizeof(ov2640StateRegs[0]), 0},
+    {OV3660_PID, ov5640StateRegs, sizeof(ov5640StateRegs) / sizeof(ov5640StateRegs[0]), 0x3406},
+    {OV5640_PID, ov5640StateRegs, sizeof(ov5640StateRegs) / sizeof(ov5640StateRegs[0]), 0x3406}};
+
+// NVS me yahi struct - magic aur pid na mile (naya layout ya dusra sensor) to restore nahi
+struct SensorState
+{
+    uint32_t magic;
+    uint16_t pid;
+    int8_t brightness;
+    int8_t contrast;
+    uint8_t values[SENSOR_STATE_MAX_REGS];
+};
+
+static const SensorStateTable *sensorTable = NULL;
+SensorState savedSensorState = {};
+bool sensorStateValid = false;          // savedSensorState NVS se aaya ya save hua
+volatile bool sensorStateRestored = false;
+volatile int sensorHoldFrames = 0;      // Capture task ginta hai, 0 par auto loops wapas
+bool sensorHoldAec = true;              // Hold se pehle auto exposure/gain/AWB on the?
+bool sensorHoldAgc = true;
+bool sensorStateDirty = false;          // Brightness/contrast badla - agle check par save
+SensorState lastSensorCheck = {};
+bool lastSensorCheckValid = false;
+unsigned long lastSensorSaveMs = 0;
+bool sensorSavedThisBoot = false;
+
+// Sensor se abhi ke registers - false agar koi register read na ho
+static bool readSensorState(sensor_t *s, SensorState *state)
+{
+    if (!sensorTable)
+        return false;
+    state->magic = SENSOR_STATE_MAGIC;
+    state->pid = sensorTable->pid;
+    state->brightness = s->status.brightness;
+    state->contrast = s->status.contrast;
+    for (int i = 0; i < sensorTable->count; i++)
+    {
+        int value = s->get_reg(s, sensorTable->regs[i].reg, sensorTable->regs[i].mask);
+        if (value < 0)
+            return false;
+        state->values[i] = value;
+    }
+    return true;
+}
+
+// Ek group ke registers jod ke ek number - har register ke mask jitne bits
+static uint32_t sensorGroupValue(const SensorState &state, uint8_t group)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < sensorTable->count; i++)
+    {
+        if (sensorTable->regs[i].group != group)
+            continue;
+        value = (value << __builtin_popcount(sensorTable->regs[i].mask)) | state.values[i];
+    }
+    return value;
+}
+
+// Har group ki value dusre se pct % ke andar?
+static bool sensorStatesClose(const SensorState &a, const SensorState &b, int pct)
+{
+    for (uint8_t group = 0; group < SENSOR_GROUP_COUNT; group++)
+    {
+        int64_t va = sensorGroupValue(a, group);
+        int64_t vb = sensorGroupValue(b, group);
+        if (llabs(va - vb) * 100 > max(va, vb) * pct)
+            return false;
+    }
+    return true;
+}
+
+// Boot par - initCamera ke baad, capture engine se pehle. Saved values manual hold me likhte hain.
+bool restoreSensorState()
+{
+    sensor_t *s = esp_camera_sensor_get();
+    if (!s)
+        return false;
+    for (const SensorStateTable &table : sensorStateTables)
+    {
+        if (table.pid == s->id.PID)
+            sensorTable = &table;
+    }
+    if (!sensorTable)
+        return false; // Is sensor ke registers pata nahi
+
+    Preferences prefs;
+    if (!prefs.begin(SENSOR_STATE_NAMESPACE, true))
+        return false;
+    sensorStateValid = prefs.getBytes("state", &savedSensorState, sizeof(savedSensorState)) == sizeof(savedSensorState) &&
+                       savedSensorState.magic == SENSOR_STATE_MAGIC && savedSensorState.pid == sensorTable->pid;
+    prefs.end();
+    if (!sensorStateValid)
+        return false;
+
+    s->set_brightness(s, savedSensorState.brightness);
+    s->set_contrast(s, savedSensorState.contrast);
+
+    // Auto loops rok ke converged values - unke bina sensor default exposure se shuru karta
+    sensorHoldAec = s->status.aec;
+    sensorHoldAgc = s->status.agc;
+    s->set_exposure_ctrl(s, 0);
+    s->set_gain_ctrl(s, 0);
+    if (sensorTable->awbManualReg)
+        s->set_reg(s, sensorTable->awbManualReg, 0x01, 1);
+    for (int i = 0; i < sensorTable->count; i++)
+        s->set_reg(s, sensorTable->regs[i].reg, sensorTable->regs[i].mask, savedSensorState.values[i]);
+
+    sensorHoldFrames = SENSOR_STATE_HOLD_FRAMES;
+    sensorStateRestored = true;
+    Serial.printf("Sensor state restore: exposure %u, gain %u\n", sensorGroupValue(savedSensorState, SENSOR_GROUP_EXPOSURE),
+                  sensorGroupValue(savedSensorState, SENSOR_GROUP_GAIN));
+    return true;
+}
+
+// Capture task se - hold ke frames ho gaye, auto loops restore ki values se aage chalte hain
+static void releaseSensorHold()
+{
+    sensor_t *s = esp_camera_sensor_get();
+    if (!s)
+        return;
+    s->set_exposure_ctrl(s, sensorHoldAec);
+    s->set_gain_ctrl(s, sensorHoldAgc);
+    if (sensorTable->awbManualReg)
+        s->set_reg(s, sensorTable->awbManualReg, 0x01, 0);
+}
+
+// NVS me likhte hain - agle boot ka restore yahi padhega
+static bool saveSensorState(const SensorState &state)
+{
+    Preferences prefs;
+    if (!prefs.begin(SENSOR_STATE_NAMESPACE, false))
+        return false;
+    prefs.putBytes("state", &state, sizeof(state));
+    prefs.end();
+    savedSensorState = state;
+    sensorStateValid = true;
+    sensorStateDirty = false;
+    sensorSavedThisBoot = true;
+    lastSensorSaveMs = millis();
+    Serial.printf("Sensor state save: exposure %u, gain %u\n", sensorGroupValue(state, SENSOR_GROUP_EXPOSURE),
+                  sensorGroupValue(state, SENSOR_GROUP_GAIN));
+    return true;
+}
+
+// loop() se har second - SENSOR_STATE_CHECK_MS par registers padhte hain. Do checks ke beech
+// stable = converged; saved se kaafi alag ho to NVS me. Boot ke baad pehla converged state turant
+// (deep-sleep units itni der hi jagte hain), uske baad SENSOR_STATE_SAVE_MIN_MS me ek baar.
+void sensorStateLoop()
+{
+    static unsigned long lastCheckMs = 0;
+    unsigned long now = millis();
+    if (!sensorTable || sensorHoldFrames > 0 || now - lastCheckMs < SENSOR_STATE_CHECK_MS)
+        return;
+    lastCheckMs = now;
+    if (digitalRead(FLASH_LED) == HIGH && flashAvailable())
+    {
+        lastSensorCheckValid = false; // Flash ki exposure save nahi karni
+        return;
+    }
+
+    sensor_t *s = esp_camera_sensor_get();
+    SensorState current = {};
+    if (!s || !readSensorState(s, &current))
+        return;
+    bool converged = lastSensorCheckValid && sensorStatesClose(current, lastSensorCheck, SENSOR_STATE_STABLE_PCT);
+    lastSensorCheck = current;
+    lastSensorCheckValid = true;
+    if (!converged)
+        return;
+
+    bool changed = !sensorStateValid || sensorStateDirty ||
+                   !sensorStatesClose(current, savedSensorState, SENSOR_STATE_MIN_CHANGE_PCT);
+    bool due = !sensorSavedThisBoot || sensorStateDirty || now - lastSensorSaveMs >= SENSOR_STATE_SAVE_MIN_MS;
+    if (changed && due)
+        saveSensorState(current);
+}
+
+// Storage mount - pehle SD card, na ho to internal flash par LittleFS
+bool mountStorage()
+{
+    if (SD_MMC.begin("/sdcard", !STORAGE_SD_4BIT) && SD_MMC.cardType() != CARD_NONE)
+    {
+        storageFs = &SD_MMC;
+        storageSd = true;
+        storageName = "SD card";
+    }
+    else if (LittleFS.begin(true)) // Pehli baar format
+    {
+        storageFs = &LittleFS;
+        storageName = "LittleFS";
+    }
+    else
+    {
+        return false;
+    }
+
+    // Boot number NVS me - har boot ka naya folder, purani files kabhi overwrite nahi hoti
+    Preferences prefs;
+    prefs.begin("storage", false);
+    storageBoot = prefs.getUInt("boot", 0) + 1;
+    prefs.putUInt("boot", storageBoot);
+    prefs.end();
+
+    char dir[16];
+    snprintf(dir, sizeof(dir), "/cap%04u", storageBoot % 10000);
+    storageFs->mkdir(dir);
+    return true;
+}
+
+uint64_t storageFreeBytes()
+{
+    if (storageSd)
+        return SD_MMC.totalBytes() - SD_MMC.usedBytes();
+    return LittleFS.totalBytes() - LittleFS.usedBytes();
+}
+
+// 4-bit SD me GPIO 4 data line hai - tab flash LED ko chhoona SD writes kharab karega
+bool flashAvailable()
+{
+    return !(storageSd && STORAGE_SD_4BIT);
+}
+
+// Poora buffer file me - internal RAM ke chunk ke through (chunk NULL ho to seedha)
+bool writeChunked(File &file, const uint8_t *data, size_t len, uint8_t *chunk)
+{
+    for (size_t offset = 0; offset < len; offset += STORAGE_CHUNK_SIZE)
+    {
+        size_t n = min((size_t)STORAGE_CHUNK_SIZE, len - offset);
+        const uint8_t *src = data + offset;
+        if (chunk)
+        {
+            memcpy(chunk, src, n);
+            src = chunk;
+        }
+        if (file.write(src, n) != n)
+            return false;
+    }
+    return true;
+}
+
+static void putU32(uint8_t *p, uint32_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+    p[2] = v >> 16;
+    p[3] = v >> 24;
+}
+
+static void putU16(uint8_t *p, uint16_t v)
+{
+    p[0] = v;
+    p[1] = v >> 8;
+}
+
+// AVI header - open par placeholders ke saath, close par asli counts ke saath dobara
+static void buildAviHeader(uint8_t *h, const AviWriter &w)
+{
+    uint32_t usPerFrame;
+    if (w.timelapse)
+        usPerFrame = 1000000 / RECORD_TIMELAPSE_FPS;
+    else if (w.frames > 1)
+        usPerFrame = (uint32_t)((w.lastUs - w.firstUs) / (w.frames - 1)); // Burst: asli fps
+    else
+        usPerFrame = 100000;
+    if (usPerFrame == 0)
+        usPerFrame = 1;
+    uint32_t fileBytes = AVI_HEADER_SIZE + w.moviBytes + 8 + w.frames * 16; // idx1 ke saath
+
+    memset(h, 0, AVI_HEADER_SIZE);
+    memcpy(h + 0, "RIFF", 4);
+    putU32(h + 4, fileBytes - 8);
+    memcpy(h + 8, "AVI ", 4);
+    memcpy(h + 12, "LIST", 4);
+    putU32(h + 16, 192);
+    memcpy(h + 20, "hdrl", 4);
+
+    // avih - main header
+    memcpy(h + 24, "avih", 4);
+    putU32(h + 28, 56);
+    putU32(h + 32, usPerFrame);
+    putU32(h + 36, (uint32_t)((uint64_t)w.maxFrameBytes * 1000000 / usPerFrame));
+    putU32(h + 44, 0x10); // AVIF_HASINDEX
+    putU32(h + 48, w.frames);
+    putU32(h + 56, 1);    // Streams
+    putU32(h + 60, w.maxFrameBytes);
+    putU32(h + 64, w.width);
+    putU32(h + 68, w.height);
+
+    // strl: strh + strf - ek MJPEG video stream
+    memcpy(h + 88, "LIST", 4);
+    putU32(h + 92, 116);
+    memcpy(h + 96, "strl", 4);
+    memcpy(h + 100, "strh", 4);
+    putU32(h + 104, 56);
+    memcpy(h + 108, "vids", 4);
+    memcpy(h + 112, "MJPG", 4);
+    putU32(h + 128, usPerFrame); // Scale / rate = seconds per frame
+    putU32(h + 132, 1000000);
+    putU32(h + 140, w.frames);
+    putU32(h + 144, w.maxFrameBytes);
+    putU32(h + 148, 0xFFFFFFFF); // Default quality
+    putU16(h + 160, w.width);
+    putU16(h + 162, w.height);
+    memcpy(h + 164, "strf", 4);
+    putU32(h + 168, 40);
+    putU32(h + 172, 40); // BITMAPINFOHEADER
+    putU32(h + 176, w.width);
+    putU32(h + 180, w.height);
+    putU16(h + 184, 1);
+    putU16(h + 186, 24);
+    memcpy(h + 188, "MJPG", 4);
+    putU32(h + 192, w.width * w.height * 3);
+
+    memcpy(h + 212, "LIST", 4);
+    putU32(h + 216, 4 + w.moviBytes);
+    memcpy(h + 220, "movi", 4);
+}
+
+// Nayi recording file - pehle frame ke size se header
+bool aviOpen(AviWriter *w, const StorageJob *job)
+{
+    if (storageFreeBytes() < STORAGE_MIN_FREE)
+        return false;
+    if (!w->index)
+    {
+        w->index = (uint32_t *)heap_caps_malloc(RECORD_MAX_FRAMES * 2 * sizeof(uint32_t), MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!w->index)
+            return false;
+    }
+
+    char path[32];
+    snprintf(path, sizeof(path), "/cap%04u/rec%03u.avi", storageBoot % 10000, ++w->number);
+    w->file = storageFs->open(path, FILE_WRITE);
+    if (!w->file)
+        return false;
+
+    w->timelapse = recordMode == RECORD_TIMELAPSE;
+    w->frames = 0;
+    w->moviBytes = 0;
+    w->maxFrameBytes = 0;
+    w->width = job->width;
+    w->height = job->height;
+    w->firstUs = job->timestampUs;
+    w->lastUs = job->timestampUs;
+
+    uint8_t header[AVI_HEADER_SIZE];
+    buildAviHeader(header, *w);
+    if (w->file.write(header, sizeof(header)) != sizeof(header))
+    {
+        w->file.close();
+        return false;
+    }
+    w->open = true;
+    Serial.printf("Recording shuru: %s (%s)\n", path, w->timelapse ? "timelapse" : "burst");
+    return true;
+}
+
+// idx1 likh ke header me asli counts - iske baad hi file playable hai
+void aviClose(AviWriter *w, uint8_t *chunk)
+{
+    if (!w->open)
+        return;
+
+    // idx1 chunk ke buffer me bana ke likhte hain - 16 bytes per frame
+    uint8_t entry[16];
+    memcpy(entry, "idx1", 4);
+    putU32(entry + 4, w->frames * 16);
+    bool ok = w->file.write(entry, 8) == 8;
+    uint8_t *buf = chunk ? chunk : entry;
+    size_t perChunk = chunk ? STORAGE_CHUNK_SIZE / 16 : 1;
+    for (uint32_t i = 0; ok && i < w->frames; i += perChunk)
+    {
+        uint32_t n = min((uint32_t)perChunk, w->frames - i);
+        for (uint32_t k = 0; k < n; k++)
+        {
+            uint8_t *e = buf + k * 16;
+            memcpy(e, "00dc", 4);
+            putU32(e + 4, 0x10); // AVIIF_KEYFRAME - MJPEG me har frame
+            putU32(e + 8, w->index[(i + k) * 2]);
+            putU32(e + 12, w->index[(i + k) * 2 + 1]);
+        }
+        ok = w->file.write(buf, n * 16) == n * 16;
+    }
+
+    uint8_t header[AVI_HEADER_SIZE];
+    buildAviHeader(header, *w);
+    ok = ok && w->file.seek(0) && w->file.write(header, sizeof(header)) == sizeof(header);
+    w->file.close();
+    w->open = false;
+    recordingsClosed++;
+    if (ok)
+        Serial.printf("Recording band: %u frames, %u bytes\n", w->frames, w->moviBytes);
+    else
+    {
+        storageErrors++;
+        Serial.println("Recording close fail - index/header nahi likh paye");
+    }
+}
+
+// Ek frame recording me - '00dc' chunk, odd length ho to ek pad byte
+void aviAppend(AviWriter *w, const StorageJob *job, uint8_t *chunk)
+{
+    if (!w->open && !aviOpen(w, job))
+    {
+        storageDropped++;
+        return;
+    }
+
+    unsigned long start = millis();
+    uint8_t head[8];
+    memcpy(head, "00dc", 4);
+    putU32(head + 4, job->len);
+    static const uint8_t pad = 0;
+    bool odd = job->len & 1;
+    bool ok = w->file.write(head, 8) == 8 && writeChunked(w->file, job->buf, job->len, chunk) &&
+              (!odd || w->file.write(&pad, 1) == 1);
+    if (!ok)
+    {
+        // File ab bharosemand nahi - jitna likha usi ka index leke band
+        storageErrors++;
+        aviClose(w, chunk);
+        return;
+    }
+
+    w->index[w->frames * 2] = 4 + w->moviBytes; // 'movi' fourcc se offset
+    w->index[w->frames * 2 + 1] = job->len;
+    w->frames++;
+    w->moviBytes += 8 + job->len + (odd ? 1 : 0);
+    w->maxFrameBytes = max(w->maxFrameBytes, (uint32_t)job->len);
+    w->lastUs = job->timestampUs;
+    storageWritten++;
+    storageLastWriteMs = millis() - start;
+
+    if (w->frames % RECORD_FLUSH_FRAMES == 0)
+        w->file.flush(); // File size directory me update - crash me data bacha rahe
+    if (w->frames >= RECORD_MAX_FRAMES)
+        aviClose(w, chunk); // Index bhar gaya - agla frame nayi file kholega
+}
+
+// Writer task - queue se job leke sequential file (ya recording me append) likhta hai,
+// phir job wapas free list me. SD_MMC ka DMA PSRAM se nahi padh sakta, isliye frame
+// internal RAM ke chunk me copy karke likhte hain.
+void storageTask(void *parameter)
+{
+    uint8_t *chunk = (uint8_t *)heap_caps_aligned_alloc(32, STORAGE_CHUNK_SIZE, MALLOC_CAP_DMA | MALLOC_CAP_INTERNAL);
+    bool full = false;
+    int index;
+
+    while (true)
+    {
+        if (xQueueReceive(storageQueue, &index, portMAX_DELAY) != pdTRUE)
+            continue;
+        if (index == STORAGE_CLOSE_AVI)
+        {
+            aviClose(&avi, chunk);
+            continue;
+        }
+        StorageJob *job = &storageJobs[index];
+
+        if (job->tag == 'a')
+        {
+            aviAppend(&avi, job, chunk);
+            xQueueSend(storageFree, &index, 0);
+            continue;
+        }
+
+        if (storageFileIndex % STORAGE_FREE_CHECK_EVERY == 0)
+            full = storageFreeBytes() < STORAGE_MIN_FREE;
+        if (full)
+        {
+            storageDropped++;
+            storageFileIndex++; // Agla free space check aage badhta rahe
+            xQueueSend(storageFree, &index, 0);
+            continue;
+        }
+
+        unsigned long start = millis();
+        char path[32];
+        snprintf(path, sizeof(path), "/cap%04u/%06u%c.jpg", storageBoot % 10000, storageFileIndex++, job->tag);
+        File file = storageFs->open(path, FILE_WRITE);
+        bool ok = file && writeChunked(file, job->buf, job->len, chunk);
+        if (file)
+            file.close();
+
+        if (ok)
+        {
+            storageWritten++;
+            storageLastWriteMs = millis() - start;
+        }
+        else
+        {
+            storageErrors++;
+            Serial.printf("Storage: %s likh nahi paye\n", path);
+        }
+        xQueueSend(storageFree, &index, 0);
+    }
+}
+
+// JPEG ki copy storage queue me - caller apna frame buffer turant wapas de sakta hai.
+// Koi job khali nahi (queue bhari) to ye frame drop - capture write ka wait nahi karta.
+bool queueFrameForStorage(const uint8_t *jpeg, size_t len, uint16_t width, uint16_t height, int64_t timestampUs, char tag)
+{
+    if (!storageQueue)
+        return false; // Storage band hai
+
+    int index;
+    if (xQueueReceive(storageFree, &index, 0) != pdTRUE)
+    {
+        storageDropped++;
+        return false;
+    }
+
+    StorageJob *job = &storageJobs[index];
+    if (job->cap < len)
+    {
+        uint8_t *grown = (uint8_t *)heap_caps_realloc(job->buf, len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!grown)
+        {
+            xQueueSend(storageFree, &index, 0);
+            storageDropped++;
+            return false;
+        }
+        job->buf = grown;
+        job->cap = len;
+    }
+    memcpy(job->buf, jpeg, len);
+    job->len = len;
+    job->timestampUs = timestampUs;
+    job->width = width;
+    job->height = height;
+    job->tag = tag;
+    xQueueSend(storageQueue, &index, 0);
+    return true;
+}
+
+// Storage start - mount, job queues aur writer task
+bool startStorage()
+{
+    if (!mountStorage())
+        return false;
+
+    storageFree = xQueueCreate(STORAGE_QUEUE_DEPTH, sizeof(int));
+    QueueHandle_t ready = xQueueCreate(STORAGE_QUEUE_DEPTH + 1, sizeof(int)); // +1: recording close
+    if (!storageFree || !ready)
+        return false;
+    for (int i = 0; i < STORAGE_QUEUE_DEPTH; i++)
+        xQueueSend(storageFree, &i, 0);
+    storageQueue = ready;
+
+    if (xTaskCreatePinnedToCore(storageTask, "StorageWriter", 4096, NULL,
+                                STORAGE_TASK_PRIORITY, NULL, STORAGE_TASK_CORE) != pdPASS)
+    {
+        storageQueue = NULL;
+        return false;
+    }
+    Serial.printf("Storage: %s, folder /cap%04u\n", storageName, storageBoot % 10000);
+    return true;
+}
+
+// Recording band - pehle ke queued frames ke baad writer file close karta hai
+void recordStop()
+{
+    if (recordMode == RECORD_OFF)
+        return;
+    recordMode = RECORD_OFF;
+    int close = STORAGE_CLOSE_AVI;
+    xQueueSend(storageQueue, &close, pdMS_TO_TICKS(100));
+    Serial.printf("Recording stop - %u frames queue kiye\n", recordQueued);
+}
+
+// Recording shuru - burst: intervalMs 0 (har frame), timelapse: har intervalMs ek frame.
+// durationMs 0 = "stop" tak.
+void recordStart(RecordMode mode, uint32_t intervalMs, uint32_t durationMs)
+{
+    if (!storageQueue)
+    {
+        Serial.println("Storage nahi hai - recording nahi ho sakti");
+        return;
+    }
+    recordStop(); // Pichli recording ki file alag
+    recordIntervalMs = intervalMs;
+    recordUntilMs = durationMs ? millis() + durationMs : 0;
+    recordLastFrameMs = 0;
+    recordQueued = 0;
+    recordMode = mode;
+}
+
+// Capture task se - is frame ko recording me chahiye to copy queue me
+bool recordOffer(const camera_fb_t *fb)
+{
+    unsigned long now = millis();
+    if (recordUntilMs && (long)(now - recordUntilMs) >= 0)
+    {
+        recordStop();
+        return false;
+    }
+    if (recordMode == RECORD_TIMELAPSE && recordLastFrameMs && now - recordLastFrameMs < recordIntervalMs)
+        return false;
+    recordLastFrameMs = now;
+
+    // Burst me queue bhari ho to frame drop - sensor ki fps se writer peeche ho to bhi capture chalta hai
+    int64_t frameUs = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    if (!queueFrameForStorage(fb->buf, fb->len, fb->width, fb->height, frameUs, 'a'))
+        return false;
+    recordQueued++;
+    return true;
+}
+
+// Serial commands: "burst <sec>", "timelapse <sec> [minutes]", "stop", "brightness <-2..2>", "contrast <-2..2>"
+void handleSerialCommand()
+{
+    if (!Serial.available())
+        return;
+    String line = Serial.readStringUntil('\n');
+    char cmd[16] = {0};
+    int arg1 = 0;
+    int arg2 = 0;
+    sscanf(line.c_str(), "%15s %d %d", cmd, &arg1, &arg2);
+
+    if (!strcmp(cmd, "burst"))
+        recordStart(RECORD_BURST, 0, (arg1 > 0 ? arg1 : 10) * 1000);
+    else if (!strcmp(cmd, "timelapse"))
+        recordStart(RECORD_TIMELAPSE, (arg1 > 0 ? arg1 : 5) * 1000, arg2 * 60000);
+    else if (!strcmp(cmd, "stop"))
+        recordStop();
+    else if ((!strcmp(cmd, "brightness") || !strcmp(cmd, "contrast")) && arg1 >= -2 && arg1 <= 2)
+    {
+        sensor_t *s = esp_camera_sensor_get();
+        if (s)
+        {
+            if (cmd[0] == 'b')
+                s->set_brightness(s, arg1);
+            else
+                s->set_contrast(s, arg1);
+            sensorStateDirty = true; // Agle converged check par NVS me, agle boot par wapas
+            Serial.printf("%s %d\n", cmd, arg1);
+        }
+    }
+    else if (cmd[0])
+        Serial.println("Commands: burst <sec> | timelapse <sec> [minutes] | stop | brightness <-2..2> | contrast <-2..2>");
+}
+
 // Photo capture karne ka function
-void capturePhoto()
+void capturePhoto(bool useFlash)
 {
-    // Flash LED on karte hain
-    digitalWrite(FLASH_LED, HIGH);
-    delay(100); // Flash ke liye thoda wait karte hain
+    // Flash chahiye to on karke us frame ka wait karte hain jo flash on hone ke baad shuru hua.
+    // Bina flash ke jo frame ready hai wahi turant mil jata hai.
+    int64_t notBefore = 0;
+    useFlash = useFlash && flashAvailable();
+    if (useFlash)
+    {
+        digitalWrite(FLASH_LED, HIGH);
+        notBefore = esp_timer_get_time();
+    }
 
     // Photo capture karte hain
-    camera_fb_t *fb = esp_camera_fb_get();
+    camera_fb_t *fb = takeLatestFrame(notBefore, 1000);
     if (!fb)
     {
         Serial.println("Photo capture nahi ho paya!");
-        digitalWrite(FLASH_LED, LOW);
+        if (useFlash)
+            digitalWrite(FLASH_LED, LOW);
         return;
     }
 
@@ -117,25 +1133,595 @@ void capturePhoto()
     Serial.printf("Photo size: %d bytes\n", fb->len);
     Serial.printf("Resolution: %dx%d\n", fb->width, fb->height);
 
-    // Memory free karte hain
+    // Storage queue me copy - write writer task karega
+    queueFrameForStorage(fb->buf, fb->len, fb->width, fb->height,
+                         (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec, 'p');
+
+    // Frame buffer driver ko wapas dete hain
     esp_camera_fb_return(fb);
 
     // Flash LED off karte hain
-    digitalWrite(FLASH_LED, LOW);
+    if (useFlash)
+        digitalWrite(FLASH_LED, LOW);
+}
+
+// PSRAM ho to wahan, warna internal RAM me
+void *motionAlloc(size_t bytes)
+{
+    void *p = heap_caps_malloc(bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    return p ? p : heap_caps_malloc(bytes, MALLOC_CAP_8BIT);
+}
+
+// Frame ki JPEG copy ring slot me - buffer sirf tab badhta hai jab frame bada ho
+bool storeRingFrame(RingFrame *slot, const camera_fb_t *fb)
+{
+    if (slot->cap < fb->len)
+    {
+        uint8_t *grown = (uint8_t *)heap_caps_realloc(slot->buf, fb->len, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!grown)
+            return false;
+        slot->buf = grown;
+        slot->cap = fb->len;
+    }
+    memcpy(slot->buf, fb->buf, fb->len);
+    slot->len = fb->len;
+    slot->width = fb->width;
+    slot->height = fb->height;
+    slot->timestampUs = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    slot->saved = false;
+    return true;
+}
+
+// RGB565 (high byte pehle, jaise jpg2rgb565 likhta hai) se 0-255 brightness
+static inline uint32_t rgb565Luma(uint8_t hi, uint8_t lo)
+{
+    uint32_t r = hi >> 3;
+    uint32_t g = ((hi & 0x07) << 3) | (lo >> 5);
+    uint32_t b = lo & 0x1F;
+    return (r * 616 + g * 600 + b * 232) >> 8; // 0.30 R + 0.59 G + 0.11 B
+}
+
+// Frame ko 1/8 scale par decode karke har 8x8 block ka SAD background se nikalte hain.
+// Usi pass me background bhi update hota hai. Return: changed blocks, decode fail par -1.
+int detectMotion(const camera_fb_t *fb)
+{
+    int w = fb->width / 8;
+    int h = fb->height / 8;
+    if (w > MOTION_MAX_W || h > MOTION_MAX_H || !jpg2rgb565(fb->buf, fb->len, motionRgb, JPG_SCALE_8X))
+        return -1;
+    if (w != motionW || h != motionH)
+    {
+        motionW = w;
+        motionH = h;
+        motionReseed = true;
+    }
+
+    bool seed = motionReseed;
+    int blocksX = w / MOTION_BLOCK;
+    int blocksY = h / MOTION_BLOCK;
+    int changed = 0;
+    for (int by = 0; by < blocksY; by++)
+    {
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            uint32_t sad = 0;
+            for (int y = 0; y < MOTION_BLOCK; y++)
+            {
+                int offset = (by * MOTION_BLOCK + y) * w + bx * MOTION_BLOCK;
+                const uint8_t *px = motionRgb + offset * 2;
+                uint16_t *bg = motionBg + offset;
+                for (int x = 0; x < MOTION_BLOCK; x++, px += 2)
+                {
+                    int32_t luma = rgb565Luma(px[0], px[1]) << 8;
+                    if (seed)
+                        bg[x] = luma;
+                    int32_t diff = luma - bg[x];
+                    sad += abs(diff) >> 8;
+                    bg[x] += diff >> MOTION_BG_SHIFT;
+                }
+            }
+            if (sad > MOTION_BLOCK_DIFF * MOTION_BLOCK * MOTION_BLOCK)
+                changed++;
+        }
+    }
+    motionReseed = false;
+    motionSamples++;
+
+    // Lagbhag pura frame badla - light ya auto exposure, background dobara se seed karte hain
+    if (changed * 100 > blocksX * blocksY * MOTION_LIGHTING_PCT)
+    {
+        motionReseed = true;
+        return 0;
+    }
+    return changed;
+}
+
+// Ek motion photo - storage queue me, upload ka hook bhi yahi hai
+void saveMotionFrame(RingFrame *frame, bool preTrigger)
+{
+    queueFrameForStorage(frame->buf, frame->len, frame->width, frame->height, frame->timestampUs,
+                         preTrigger ? 'r' : 'm');
+
+    int64_t ageMs = (esp_timer_get_time() - frame->timestampUs) / 1000;
+    Serial.printf("Motion photo%s: %u bytes, %ux%u, %lld ms purana\n", preTrigger ? " (pre-trigger)" : "",
+                  (unsigned)frame->len, frame->width, frame->height, (long long)ageMs);
+    frame->saved = true;
+    motionFramesSaved++;
+}
+
+// Ring ke jo frames abhi save nahi hue, purane se naye tak
+void flushMotionRing()
+{
+    int newest = (ringHead + MOTION_RING_SIZE - 1) % MOTION_RING_SIZE;
+    for (int i = ringCount; i > 0; i--)
+    {
+        int index = (ringHead + MOTION_RING_SIZE - i) % MOTION_RING_SIZE;
+        if (!motionRing[index].saved)
+            saveMotionFrame(&motionRing[index], index != newest);
+    }
+}
+
+// Motion task - har MOTION_SAMPLE_MS par naya frame ring me copy karke check karta hai
+void motionTask(void *parameter)
+{
+    TickType_t lastWake = xTaskGetTickCount();
+    bool active = false; // Motion event chal raha hai
+    unsigned long lastMotionMs = 0;
+
+    while (true)
+    {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(MOTION_SAMPLE_MS));
+
+        camera_fb_t *fb = takeLatestFrame(0, MOTION_SAMPLE_MS);
+        if (!fb)
+            continue;
+
+        // Copy fail ho (memory kam) to bhi detection chalta hai, bas woh frame ring me nahi hoga
+        if (storeRingFrame(&motionRing[ringHead], fb))
+        {
+            ringHead = (ringHead + 1) % MOTION_RING_SIZE;
+            if (ringCount < MOTION_RING_SIZE)
+                ringCount++;
+        }
+        int changed = detectMotion(fb);
+        esp_camera_fb_return(fb); // Buffer turant sensor ko wapas
+        if (changed < 0)
+            continue;
+        lastChangedBlocks = changed;
+
+        unsigned long now = millis();
+        int warmup = sensorStateRestored ? MOTION_WARMUP_RESTORED : MOTION_WARMUP_SAMPLES;
+        if (changed >= MOTION_MIN_BLOCKS && motionSamples > (uint32_t)warmup)
+        {
+            lastMotionMs = now;
+            if (!active)
+            {
+                active = true;
+                motionEvents++;
+                Serial.printf("\nMotion mila! %d blocks badle (event #%u)\n", changed, motionEvents);
+            }
+        }
+        else if (active && now - lastMotionMs >= MOTION_HOLD_MS)
+        {
+            active = false;
+            Serial.println("Motion khatam");
+        }
+
+        // Event ke dauran har naya frame, aur shuru me pre-trigger frames bhi
+        if (active)
+            flushMotionRing();
+    }
+}
+
+// Motion detection start karte hain - decode aur background buffers ek hi baar allocate
+bool startMotionDetector()
+{
+    motionRgb = (uint8_t *)motionAlloc(MOTION_MAX_W * MOTION_MAX_H * 2);
+    motionBg = (uint16_t *)motionAlloc(MOTION_MAX_W * MOTION_MAX_H * sizeof(uint16_t));
+    if (!motionRgb || !motionBg)
+        return false;
+    return xTaskCreatePinnedToCore(motionTask, "MotionDetect", 4096, NULL,
+                                   MOTION_TASK_PRIORITY, NULL, MOTION_TASK_CORE) == pdPASS;
 }
 
 // WiFi ke different status codes ko human readable format me convert karne ka function
 void printWiFiStatus(wl_status_t status)
 {
-    // ... (same as Level 1) ...
+    switch (status)
+    {
+    case WL_IDLE_STATUS: // WiFi idle hai
+        Serial.println("WiFi IDLE status - WiFi module kaam kar raha hai par connected nahi hai");
+        break;
+    case WL_NO_SSID_AVAIL: // Koi WiFi network nahi mila
+        Serial.println("WiFi network nahi mil raha hai - Check karo ki network range me hai");
+        break;
+    case WL_SCAN_COMPLETED: // WiFi scan complete ho gaya
+        Serial.println("WiFi scan complete ho gaya - Networks mil gaye hain");
+        break;
+    case WL_CONNECTED: // WiFi connected ho gaya
+        Serial.println("WiFi connected! Network se successfully jud gaye hain");
+        break;
+    case WL_CONNECT_FAILED: // Connection fail ho gaya
+        Serial.println("WiFi connection fail ho gaya - Password galat ho sakta hai");
+        break;
+    case WL_CONNECTION_LOST: // Connection lost ho gaya
+        Serial.println("WiFi connection lost ho gaya - Signal weak ho sakta hai");
+        break;
+    case WL_DISCONNECTED: // Disconnected ho gaya
+        Serial.println("WiFi disconnected hai - Connection toot gaya hai");
+        break;
+    default: // Koi aur status code
+        Serial.printf("Unknown WiFi status: %d - Ye status code samajh me nahi aaya\n", status);
+        break;
+    }
+}
+
+// WiFi se connect karne ka function (Level 1 jaisa) - scan me mila AP (BSSID + channel)
+// pinned hai, to driver dobara scan nahi karta
+bool tryConnectWiFi(const char *ssid, const char *password, int32_t channel, const uint8_t *bssid)
+{
+    Serial.printf("\nNetwork '%s' ke saath password try kar rahe hain\n", ssid);
+    WiFi.begin(ssid, password, channel, bssid);
+
+    // 10 seconds tak wait - par galat password ya AP gayab ho to driver turant bata deta hai
+    unsigned long start = millis();
+    while (WiFi.status() != WL_CONNECTED && millis() - start < 10000)
+    {
+        wl_status_t status = WiFi.status();
+        if (millis() - start > 500 && (status == WL_CONNECT_FAILED || status == WL_NO_SSID_AVAIL))
+            break; // Shuru ke 500ms purane attempt ka status ho sakta hai, uske baad bharosa karte hain
+
+        digitalWrite(LED_BUILTIN, !digitalRead(LED_BUILTIN)); // LED ko blink karte hain
+        delay(100);
+    }
+
+    if (WiFi.status() == WL_CONNECTED)
+    {
+        digitalWrite(LED_BUILTIN, LOW); // LED on - connected
+        Serial.printf("Connected! IP Address: %s, Signal: %d dBm\n", WiFi.localIP().toString().c_str(), WiFi.RSSI());
+        return true;
+    }
+
+    printWiFiStatus(WiFi.status());
+    WiFi.disconnect(); // Fail - agla password / network
+    return false;
+}
+
+// Fast reconnect cache (Level 1 jaisa) - last successful AP, channel aur IP lease
+#define WIFI_CACHE_MAGIC 0x57464331  // Cache valid hai ya nahi pehchanne ke liye
+#define FAST_CONNECT_TIMEOUT_MS 3000 // Cached AP par itne time me IP nahi mila to scan karenge
+struct WiFiCache
+{
+    uint32_t magic;
+    char ssid[33];      // Network ka naam
+    int passwordIndex;  // passwords[] me kaunsa password chala tha
+    uint8_t bssid[6];   // AP ka MAC address
+    int32_t channel;    // AP ka channel
+    uint32_t ip;        // IP lease - sirf RTC copy me, 0 matlab DHCP karo
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+};
+RTC_DATA_ATTR WiFiCache rtcCache; // Sirf deep sleep wake tak bachta hai - reset/power on par NVS copy
+
+// Successful connection ki details cache me save karte hain
+void saveWiFiCache(const char *ssid, int passwordIndex)
+{
+    WiFiCache entry = {};
+    entry.magic = WIFI_CACHE_MAGIC;
+    strncpy(entry.ssid, ssid, sizeof(entry.ssid) - 1);
+    entry.passwordIndex = passwordIndex;
+    memcpy(entry.bssid, WiFi.BSSID(), sizeof(entry.bssid));
+    entry.channel = WiFi.channel();
+    entry.ip = WiFi.localIP();
+    entry.gateway = WiFi.gatewayIP();
+    entry.subnet = WiFi.subnetMask();
+    entry.dns = WiFi.dnsIP(0);
+    rtcCache = entry; // RTC copy me lease ke saath
+
+    // NVS me lease nahi - lambe power off ke baad wo IP kisi aur ko mil chuka ho sakta hai.
+    // Flash wear bachane ke liye sirf tab likhte hain jab AP badla ho (har wake par nahi).
+    entry.ip = entry.gateway = entry.subnet = entry.dns = 0;
+    WiFiCache saved;
+    Preferences prefs;
+    prefs.begin("wifi", false);
+    if (prefs.getBytes("cache", &saved, sizeof(saved)) != sizeof(saved) || memcmp(&saved, &entry, sizeof(entry)) != 0)
+        prefs.putBytes("cache", &entry, sizeof(entry));
+    prefs.end();
+}
+
+// Cache bekaar nikla - dono jagah se hata dete hain
+void clearWiFiCache()
+{
+    rtcCache.magic = 0;
+    Preferences prefs;
+    prefs.begin("wifi", false);
+    prefs.remove("cache");
+    prefs.end();
+}
+
+// Cache load karte hain - RTC me na ho (power on ya reset) to NVS se AP, lease nahi.
+// false matlab koi kaam ka cache nahi.
+bool loadWiFiCache(WiFiCache *cache)
+{
+    *cache = rtcCache;
+    if (cache->magic != WIFI_CACHE_MAGIC)
+    {
+        Preferences prefs;
+        prefs.begin("wifi", true);
+        size_t size = prefs.getBytes("cache", cache, sizeof(*cache));
+        prefs.end();
+        if (size != sizeof(*cache) || cache->magic != WIFI_CACHE_MAGIC)
+            return false; // Koi cache nahi
+        cache->ip = 0;
+    }
+    return cache->passwordIndex >= 0 && cache->passwordIndex < NUM_PASSWORDS;
+}
+
+// Cached AP par seedha connect - scan nahi, channel aur BSSID pinned.
+// keepOnFailure: fail hone par bhi cache rakhte hain (battery mode agli wakes par phir try karta hai)
+bool tryCachedConnect(bool keepOnFailure = false)
+{
+    WiFiCache cache;
+    if (!loadWiFiCache(&cache))
+        return false;
+
+    Serial.printf("Cached network '%s' (channel %d) par fast connect\n", cache.ssid, (int)cache.channel);
+    unsigned long start = millis();
+
+    // Lease bacha hai to static IP - DHCP ka wait nahi
+    if (cache.ip != 0)
+        WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+    WiFi.begin(cache.ssid, passwords[cache.passwordIndex], cache.channel, cache.bssid);
+
+    while (WiFi.status() != WL_CONNECTED && millis() - start < FAST_CONNECT_TIMEOUT_MS)
+        delay(20); // Chhota wait - battery mode me har millisecond count hota hai
+
+    if (WiFi.status() == WL_CONNECTED)
+    {
+        digitalWrite(LED_BUILTIN, LOW); // LED on - connected
+        Serial.printf("Fast connect %lu ms me, IP: %s\n", millis() - start, WiFi.localIP().toString().c_str());
+        saveWiFiCache(cache.ssid, cache.passwordIndex); // Naya lease RTC me
+        return true;
+    }
+
+    // Fail - DHCP wapas on, aur (keepOnFailure na ho to) cache hata dete hain - aage scan chalega
+    Serial.println("Fast connect fail ho gaya");
+    WiFi.disconnect();
+    WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0));
+    if (!keepOnFailure)
+        clearWiFiCache();
+    return false;
+}
+
+// Scan karke har network par saare passwords - jo chala wo cache me
+bool scanAndConnectWiFi()
+{
+    int count = WiFi.scanNetworks();
+    for (int i = 0; i < count; i++)
+    {
+        for (int j = 0; j < NUM_PASSWORDS; j++)
+        {
+            if (tryConnectWiFi(WiFi.SSID(i).c_str(), passwords[j], WiFi.channel(i), WiFi.BSSID(i)))
+            {
+                saveWiFiCache(WiFi.SSID(i).c_str(), j); // Agli baar fast connect
+                WiFi.scanDelete();
+                return true;
+            }
+        }
+    }
+    WiFi.scanDelete();
+    return false;
 }
 
-// WiFi se connect karne ka function
-bool tryConnectWiFi(const char *ssid, const char *password)
+#if DUTY_CYCLE
+// Battery mode ki RTC state - deep sleep me bachi rehti hai, power jaane par reset
+struct DutyState
 {
-    // ... (same as Level 1) ...
+    uint32_t magic;
+    uint32_t seq;           // Har upload kiya frame, relay par gap = chhoota frame
+    uint32_t wakes;
+    uint32_t pirWakes;
+    uint32_t wifiFailures;  // Kul, relay ko X-Failures me jata hai
+    uint32_t uploadFailures;
+    uint8_t failStreak;     // Lagatar fail wakes - sleep isi se lamba hota hai
+    uint8_t cacheFailStreak; // Lagatar wakes jinme cached AP nahi mila - DUTY_SCAN_AFTER_FAILURES par scan
+    uint32_t lastAwakeMs;   // Pichhli baar kitni der jaage, power budget ke liye
+};
+RTC_DATA_ATTR DutyState dutyState;
+
+// Meta data headers me, ek hi POST me frame - alag request nahi. last = Connection: close.
+static bool uploadFrame(WiFiClient &client, const camera_fb_t *fb, const char *deviceId, bool pirWake, bool last)
+{
+    char header[384];
+    int n = snprintf(header, sizeof(header),
+                     "POST " UPLOAD_PATH " HTTP/1.1\r\nHost: %s:%d\r\nContent-Type: image/jpeg\r\nContent-Length: %u\r\n"
+                     "X-Device: %s\r\nX-Seq: %u\r\nX-Wake: %s\r\nX-Wakes: %u\r\nX-Failures: %u\r\nX-Awake-Ms: %u\r\n"
+                     "Connection: %s\r\n\r\n",
+                     UPLOAD_HOST, UPLOAD_PORT, (unsigned)fb->len, deviceId, dutyState.seq, pirWake ? "pir" : "timer",
+                     dutyState.wakes, dutyState.wifiFailures + dutyState.uploadFailures, dutyState.lastAwakeMs,
+                     last ? "close" : "keep-alive");
+    if (client.write((const uint8_t *)header, n) != (size_t)n || client.write(fb->buf, fb->len) != fb->len)
+        return false;
+
+    // Status line, phir headers - body (chhota JSON) padh ke chhod dete hain taaki agla POST isi connection par
+    String status = client.readStringUntil('\n');
+    int contentLength = 0;
+    while (client.connected() || client.available())
+    {
+        String line = client.readStringUntil('\n');
+        if (line.length() <= 1)
+            break;
+        if (line.startsWith("Content-Length:") || line.startsWith("content-length:"))
+            contentLength = line.substring(15).toInt();
+    }
+    while (contentLength-- > 0 && client.read() >= 0)
+        ;
+    return status.startsWith("HTTP/1.1 200");
 }
 
+// Cache wala AP pehle, aur cache fail hone par bhi rakhte hain - AP thodi der ke liye gayab ho sakta
+// hai. Lagatar DUTY_SCAN_AFTER_FAILURES wakes fail ho tab cache hata ke full scan (seconds lagta hai).
+// Cache hai hi nahi (pehli boot, ya hat gaya) to isi wake par scan - warna photos bina wajah drop.
+static bool dutyConnectWiFi()
+{
+    WiFi.mode(WIFI_STA);
+    WiFiCache cache;
+    if (loadWiFiCache(&cache))
+    {
+        if (tryCachedConnect(true))
+        {
+            dutyState.cacheFailStreak = 0;
+            return true;
+        }
+        if (++dutyState.cacheFailStreak < DUTY_SCAN_AFTER_FAILURES)
+            return false; // Agli wake phir usi AP par
+        clearWiFiCache();
+    }
+
+    dutyState.cacheFailStreak = 0;
+    return scanAndConnectWiFi(); // Mil gaya to naya cache save hota hai
+}
+
+// Restore ki values par hold frames, phir AE/AWB do frames ke beech stable hone tak (ya max frames).
+// Restore na hua ho to DUTY_COLD_FRAMES - pehli wake, ya naya sensor.
+static camera_fb_t *dutySettleAndCapture(bool restored)
+{
+    sensor_t *s = esp_camera_sensor_get();
+    SensorState previous = {};
+    bool havePrevious = false;
+    int frames = restored ? DUTY_SETTLE_MAX_FRAMES : DUTY_COLD_FRAMES;
+    for (int i = 0; i < frames; i++)
+    {
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (!fb)
+            continue;
+        esp_camera_fb_return(fb);
+        if (sensorHoldFrames > 0 && --sensorHoldFrames == 0)
+            releaseSensorHold();
+        if (sensorHoldFrames > 0)
+            continue;
+
+        SensorState current = {};
+        if (!readSensorState(s, &current))
+            continue;
+        if (havePrevious && sensorStatesClose(current, previous, SENSOR_STATE_STABLE_PCT))
+            break; // Settle ho gaya - agla frame photo
+        previous = current;
+        havePrevious = true;
+    }
+    return esp_camera_fb_get();
+}
+
+// Sab band karke deep sleep - timer, aur PIR HIGH par. Fail streak par timer lamba (backoff).
+static void dutySleep(uint32_t wakeStartMs)
+{
+    dutyState.lastAwakeMs = millis() - wakeStartMs;
+    WiFi.disconnect(true);
+    WiFi.mode(WIFI_OFF);
+    esp_camera_deinit();
+
+    // Sensor power down aur flash LED off - sleep me pins isi state me hold
+    pinMode(PWDN_GPIO_NUM, OUTPUT);
+    digitalWrite(PWDN_GPIO_NUM, HIGH);
+    digitalWrite(FLASH_LED, LOW);
+    gpio_hold_en((gpio_num_t)PWDN_GPIO_NUM);
+    gpio_hold_en((gpio_num_t)FLASH_LED);
+    gpio_deep_sleep_hold_en();
+
+    uint64_t sleepS = (uint64_t)DUTY_SLEEP_S << min((int)dutyState.failStreak, DUTY_BACKOFF_MAX);
+    esp_sleep_enable_timer_wakeup(sleepS * 1000000ULL);
+#if DUTY_PIR_GPIO >= 0
+    esp_sleep_enable_ext0_wakeup((gpio_num_t)DUTY_PIR_GPIO, 1);
+#endif
+    Serial.printf("Deep sleep %llu s (jaage %u ms, fail streak %u)\n", (unsigned long long)sleepS,
+                  dutyState.lastAwakeMs, dutyState.failStreak);
+    Serial.flush();
+    esp_deep_sleep_start();
+}
+
+// Battery mode ki ek wake: sensor restore, settle, photo(s), WiFi (fast reconnect), ek connection
+// par upload, deep sleep. Wapas nahi aata.
+void runDutyCycle()
+{
+    uint32_t wakeStartMs = millis();
+    if (dutyState.magic != DUTY_STATE_MAGIC)
+    {
+        memset(&dutyState, 0, sizeof(dutyState)); // Power on - RTC memory me kachra
+        dutyState.magic = DUTY_STATE_MAGIC;
+    }
+    bool pirWake = esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_EXT0;
+    dutyState.wakes++;
+    if (pirWake)
+        dutyState.pirWakes++;
+
+    // Pichhli sleep ke holds chhodte hain, warna sensor power down hi rehta
+    gpio_hold_dis((gpio_num_t)PWDN_GPIO_NUM);
+    gpio_hold_dis((gpio_num_t)FLASH_LED);
+    gpio_deep_sleep_hold_dis();
+
+    if (!initCamera())
+    {
+        dutyState.failStreak++;
+        dutySleep(wakeStartMs);
+    }
+    bool restored = restoreSensorState();
+
+    // Frames pehle, WiFi baad me - radio tabhi on jab bhejne ko kuch ho
+    camera_fb_t *frames[DUTY_PIR_FRAMES] = {};
+    int frameCount = 0;
+    frames[frameCount] = dutySettleAndCapture(restored);
+    if (frames[frameCount])
+        frameCount++;
+    while (pirWake && frameCount > 0 && frameCount < DUTY_PIR_FRAMES && frameCount < CAMERA_FB_COUNT - 1)
+    {
+        // PIR: kuch aur frames - sensor ke fb_count tak, buffers upload tak pakde rehte hain
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (!fb)
+            break;
+        frames[frameCount++] = fb;
+    }
+
+    // Is wake ki converged state - agli wake ka restore (sirf kaafi badla ho tab NVS write)
+    SensorState current = {};
+    if (readSensorState(esp_camera_sensor_get(), &current) &&
+        (!sensorStateValid || !sensorStatesClose(current, savedSensorState, SENSOR_STATE_MIN_CHANGE_PCT)))
+        saveSensorState(current);
+
+    bool ok = frameCount > 0;
+    if (ok && !dutyConnectWiFi())
+    {
+        dutyState.wifiFailures++;
+        ok = false;
+        Serial.println("WiFi nahi mila - frames chhod ke sleep");
+    }
+    else if (ok)
+    {
+        uint64_t mac = ESP.getEfuseMac();
+        char deviceId[8];
+        snprintf(deviceId, sizeof(deviceId), "%06llx", (unsigned long long)((mac >> 24) & 0xFFFFFF));
+
+        WiFiClient client;
+        client.setTimeout(UPLOAD_TIMEOUT_S);
+        ok = client.connect(UPLOAD_HOST, UPLOAD_PORT);
+        for (int i = 0; ok && i < frameCount; i++)
+        {
+            ok = uploadFrame(client, frames[i], deviceId, pirWake, i == frameCount - 1);
+            dutyState.seq++;
+        }
+        client.stop();
+        if (!ok)
+            dutyState.uploadFailures++;
+        Serial.printf("Upload %s: %d frames, seq %u\n", ok ? "ho gaya" : "fail", frameCount, dutyState.seq);
+    }
+
+    for (int i = 0; i < frameCount; i++)
+        esp_camera_fb_return(frames[i]);
+    dutyState.failStreak = ok ? 0 : dutyState.failStreak + 1;
+    dutySleep(wakeStartMs);
+}
+#endif
+
 void setup()
 {
     // Brownout detector ko disable karte hain
@@ -149,12 +1735,16 @@ void setup()
 
     // Serial communication start karte hain
     Serial.begin(115200);
-    delay(2000);
+    delay(SERIAL_BOOT_WAIT_MS);
 
     Serial.println("\n\n=================================");
     Serial.println("ESP32 WiFi + Camera Test Level 2");
     Serial.println("=================================");
 
+#if DUTY_CYCLE
+    runDutyCycle(); // Deep sleep me jata hai, wapas nahi aata
+#endif
+
     // Camera initialize karte hain
     if (!initCamera())
     {
@@ -166,40 +1756,98 @@ void setup()
         }
     }
 
-    // WiFi connection ka code (same as Level 1)
+#if SENSOR_STATE_RESTORE
+    // Pichhli baar ki converged exposure/gain/AWB - capture engine ke pehle frames se hi
+    if (!restoreSensorState())
+        Serial.println("Sensor state nahi mila - auto exposure shuru se settle karega");
+#endif
+
+#if STORAGE_ENABLED
+    // Storage - SD card ya LittleFS, writer task ke saath
+    if (!startStorage())
+    {
+        Serial.println("Storage mount nahi ho paya - photos save nahi honge");
+    }
+#endif
+
+    // Capture task start - ab sensor lagatar frames deta rahega
+    if (!startCaptureEngine())
+    {
+        Serial.println("Capture task start nahi ho paya!");
+    }
+
+#if MOTION_DETECT
+    // Motion mode - ab photos sirf motion par
+    if (!startMotionDetector())
+    {
+        Serial.println("Motion detector start nahi ho paya!");
+    }
+#endif
+
+    // WiFi connection - pehle cached AP, phir scan + saare passwords (Level 1 jaisa)
     WiFi.mode(WIFI_STA);
-    WiFi.disconnect(true);
-    delay(1000);
+    WiFi.persistent(false); // Credentials hum khud cache karte hain, driver ka flash write nahi chahiye
 
-    bool connected = false;
+    bool connected = tryCachedConnect();
     while (!connected)
     {
-        // ... (same WiFi connection code as Level 1) ...
+        connected = scanAndConnectWiFi();
+        if (!connected)
+        {
+            Serial.println("Koi network connect nahi hua - 5 second baad phir scan karenge");
+            delay(5000);
+        }
     }
 }
 
 void loop()
 {
+#if !MOTION_DETECT
     static unsigned long lastCaptureTime = 0;     // Last photo capture ka time track karne ke liye
     const unsigned long CAPTURE_INTERVAL = 10000; // Har 10 seconds me photo lenge
+#endif
+    static unsigned long lastStatusTime = 0;      // Last status print ka time
+
+    handleSerialCommand(); // Recording start/stop
 
     // Connected hai to photo capture karenge
     if (WiFi.status() == WL_CONNECTED)
     {
         digitalWrite(LED_BUILTIN, LOW); // LED on rakhenge jab connected ho
 
-        // Check if it's time to capture a photo
         unsigned long currentTime = millis();
+#if !MOTION_DETECT
+        // Check if it's time to capture a photo
         if (currentTime - lastCaptureTime >= CAPTURE_INTERVAL)
         {
             Serial.println("\nPhoto capture kar rahe hain...");
-            capturePhoto();
+            capturePhoto(true);
             lastCaptureTime = currentTime;
         }
+#endif
 
-        Serial.printf("Connected chal raha hai | Signal: %d dBm | IP: %s\n",
-                      WiFi.RSSI(),
-                      WiFi.localIP().toString().c_str());
+        // Status har second - delay() nahi, taaki loop block na ho
+        if (currentTime - lastStatusTime >= 1000)
+        {
+            lastStatusTime = currentTime;
+#if SENSOR_STATE_RESTORE
+            sensorStateLoop(); // Converged registers NVS me
+#endif
+            Serial.printf("Connected chal raha hai | Signal: %d dBm | IP: %s | Frames: %u",
+                          WiFi.RSSI(),
+                          WiFi.localIP().toString().c_str(),
+                          framesCaptured);
+#if MOTION_DETECT
+            Serial.printf(" | Motion: %d blocks, %u events, %u photos", lastChangedBlocks, motionEvents, motionFramesSaved);
+#endif
+#if STORAGE_ENABLED
+            Serial.printf(" | %s: %u saved, %u dropped, %u errors, %u ms", storageName, storageWritten,
+                          storageDropped, storageErrors, storageLastWriteMs);
+            if (recordMode != RECORD_OFF)
+                Serial.printf(" | REC %s: %u frames", recordMode == RECORD_BURST ? "burst" : "timelapse", recordQueued);
+#endif
+            Serial.println();
+        }
     }
     else
     {
@@ -208,5 +1856,5 @@ void loop()
         ESP.restart();
     }
 
-    delay(1000); // 1 second wait
+    delay(10); // Chhota wait - frames capture task me aa rahe hain
 }
\ No newline at end of file
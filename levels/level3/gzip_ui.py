@@ -0,0 +1,50 @@
+# Build se pehle index.html ko gzip karke index_html_gz.h banata hai (PlatformIO extra_scripts).
+# Firmware page ko waise hi bhejta hai (gzip header ke saath) - har request par
+# compression ya strlen() nahi. ETag gzip bytes ka CRC32 hai, page badle tabhi badalta hai.
+# Bina PlatformIO ke: python gzip_ui.py
+import gzip
+import os
+import zlib
+
+try:
+    Import("env")  # noqa: F821 - PlatformIO SCons deta hai
+    PROJECT_DIR = env.subst("$PROJECT_DIR")  # noqa: F821
+except NameError:
+    PROJECT_DIR = os.path.dirname(os.path.abspath(__file__))
+
+SOURCE = os.path.join(PROJECT_DIR, "index.html")
+HEADER = os.path.join(PROJECT_DIR, "index_html_gz.h")
+
+
+def generate():
+    with open(SOURCE, "rb") as f:
+        html = f.read()
+    # mtime=0: same page = same bytes = same ETag, har build par
+    data = gzip.compress(html, compresslevel=9, mtime=0)
+    etag = "%08x" % (zlib.crc32(data) & 0xFFFFFFFF)
+
+    lines = [
+        "// Generated by gzip_ui.py from index.html - yahan edit mat karo, index.html badlo",
+        "#pragma once",
+        "",
+        "#define INDEX_HTML_GZ_LEN %d // index.html: %d bytes" % (len(data), len(html)),
+        '#define INDEX_HTML_GZ_ETAG "\\"%s\\""' % etag,
+        "",
+        "const uint8_t index_html_gz[INDEX_HTML_GZ_LEN] PROGMEM = {",
+    ]
+    for i in range(0, len(data), 16):
+        lines.append("    " + ", ".join("0x%02x" % b for b in data[i : i + 16]) + ",")
+    lines.append("};")
+    text = "\n".join(lines) + "\n"
+
+    # Page badla ho tabhi likhte hain - warna header ka mtime same, main.cpp dobara compile nahi
+    if os.path.exists(HEADER):
+        with open(HEADER, "r", newline="\n") as f:
+            if f.read() == text:
+                return
+    with open(HEADER, "w", newline="\n") as f:
+        f.write(text)
+    print("gzip_ui: index.html %d -> %d bytes, ETag %s" % (len(html), len(data), etag))
+
+
+generate()
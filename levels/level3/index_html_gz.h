@@ -0,0 +1,69 @@
+// Generated by gzip_ui.py from index.html - yahan edit mat karo, index.html badlo
+#pragma once
+
+#define INDEX_HTML_GZ_LEN 967 // index.html: 2744 bytes
+#define INDEX_HTML_GZ_ETAG "\"5d4e2910\""
+
+const uint8_t index_html_gz[INDEX_HTML_GZ_LEN] PROGMEM = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xad, 0x56, 0x6d, 0x6f, 0xdb, 0x36,
+    0x10, 0xfe, 0xde, 0x5f, 0x71, 0xe3, 0xb0, 0xd9, 0xc6, 0x6a, 0xc9, 0x4e, 0x9a, 0x61, 0xb0, 0x25,
+    0x17, 0xa9, 0x9b, 0xa2, 0x05, 0x5a, 0x34, 0x98, 0x53, 0x0c, 0xfb, 0x48, 0x53, 0xb4, 0xc5, 0x55,
+    0x22, 0x05, 0xf2, 0xe4, 0xc4, 0x2b, 0xfa, 0xdf, 0x77, 0x94, 0x64, 0x25, 0xb2, 0xdd, 0xd4, 0x29,
+    0xa6, 0x0f, 0xb6, 0xc8, 0xbb, 0x7b, 0x78, 0xf7, 0xdc, 0x8b, 0x18, 0xfd, 0xf4, 0xfa, 0xe3, 0xfc,
+    0xe6, 0xef, 0xeb, 0x2b, 0x48, 0x31, 0xcf, 0x66, 0xcf, 0xa2, 0xdd, 0x9f, 0xe4, 0xc9, 0xec, 0x19,
+    0xd0, 0x13, 0xa1, 0xc2, 0x4c, 0xce, 0xae, 0x16, 0xd7, 0xe7, 0x67, 0xc3, 0xf9, 0xe5, 0x07, 0xf8,
+    0x4b, 0x2e, 0x61, 0x21, 0xed, 0x46, 0xda, 0x28, 0xac, 0x65, 0xb5, 0x5e, 0x2e, 0x91, 0x83, 0xe6,
+    0xb9, 0x8c, 0xd9, 0x46, 0xc9, 0xdb, 0xc2, 0x58, 0x64, 0x20, 0x8c, 0x46, 0xa9, 0x31, 0x66, 0xb7,
+    0x2a, 0xc1, 0x34, 0x4e, 0xe4, 0x46, 0x09, 0x39, 0xac, 0x16, 0xcf, 0x41, 0x69, 0x85, 0x8a, 0x67,
+    0x43, 0x27, 0x78, 0x26, 0xe3, 0x31, 0x6b, 0x80, 0x1c, 0x6e, 0x77, 0xa0, 0xfe, 0x59, 0x9a, 0x64,
+    0x0b, 0x5f, 0x60, 0x45, 0x48, 0xc3, 0x15, 0xcf, 0x55, 0xb6, 0x9d, 0xc0, 0xa5, 0x25, 0xbb, 0x29,
+    0xa0, 0xbc, 0xc3, 0x21, 0xcf, 0xd4, 0x5a, 0x4f, 0x40, 0xd0, 0x31, 0xd2, 0x4e, 0x21, 0xe7, 0x76,
+    0xad, 0x68, 0x3d, 0x2a, 0xee, 0x80, 0x97, 0x68, 0xa6, 0xf0, 0xb5, 0x85, 0x0a, 0x96, 0x25, 0xa2,
+    0xd1, 0xf0, 0xa5, 0xdd, 0xa9, 0x0e, 0xe0, 0xe2, 0xf3, 0xda, 0x9a, 0x52, 0x27, 0x43, 0x61, 0x32,
+    0x63, 0x27, 0xf0, 0xf3, 0x8b, 0xf9, 0xe5, 0x9b, 0x8b, 0xd1, 0xb4, 0xab, 0x66, 0x6c, 0x22, 0x49,
+    0xa8, 0x8d, 0x96, 0x5d, 0x49, 0x63, 0x75, 0x9b, 0x2a, 0xdc, 0x93, 0x14, 0x3c, 0x49, 0x94, 0x5e,
+    0x4f, 0x60, 0xec, 0xdd, 0x39, 0xa3, 0x9f, 0xae, 0xfc, 0x48, 0x00, 0x1d, 0x79, 0x15, 0xb4, 0x53,
+    0xff, 0x4a, 0x42, 0xf8, 0x7d, 0xdf, 0x78, 0x17, 0xe9, 0x0b, 0x0f, 0xbd, 0x2f, 0x14, 0xa5, 0x75,
+    0xde, 0xa9, 0xc2, 0xa8, 0x2e, 0xec, 0x03, 0x36, 0x5c, 0xa6, 0x28, 0x22, 0xe2, 0xb6, 0xca, 0xc7,
+    0x84, 0xfc, 0xf3, 0x0e, 0x3e, 0xd0, 0x50, 0xf9, 0xfa, 0x5e, 0x5a, 0x93, 0x99, 0xf3, 0xbb, 0x61,
+    0xb3, 0x31, 0x1e, 0x8d, 0x7e, 0x99, 0x42, 0x2a, 0xd5, 0x3a, 0xc5, 0x49, 0x87, 0xeb, 0x28, 0x6c,
+    0x72, 0x18, 0x85, 0x75, 0x21, 0x45, 0x3e, 0x89, 0x4d, 0x7a, 0xd3, 0xf1, 0x5e, 0x31, 0xcd, 0x29,
+    0x48, 0x6b, 0x32, 0xd2, 0x1d, 0x37, 0x2a, 0xfe, 0x5c, 0x67, 0x45, 0xcc, 0x18, 0xa8, 0x24, 0x66,
+    0x45, 0x6a, 0xd0, 0x30, 0x68, 0x84, 0x89, 0xda, 0xdc, 0x17, 0x47, 0xd4, 0x64, 0x54, 0x64, 0xdc,
+    0xb9, 0x98, 0xd5, 0x2b, 0x06, 0x46, 0x8b, 0x4c, 0x89, 0xcf, 0x31, 0x43, 0xb3, 0x5e, 0x67, 0x72,
+    0x81, 0x56, 0xf2, 0xbc, 0x3f, 0x60, 0xb3, 0x05, 0x72, 0x8b, 0xe1, 0x02, 0x4d, 0x01, 0xf5, 0x66,
+    0x14, 0xd6, 0x36, 0xa7, 0x43, 0x0a, 0x5e, 0x60, 0x69, 0xe5, 0xb5, 0x77, 0xca, 0x43, 0xce, 0xeb,
+    0x35, 0x54, 0x1b, 0x4f, 0x87, 0xab, 0x3d, 0x7c, 0x43, 0xd2, 0xd4, 0xa3, 0xdd, 0x54, 0x4b, 0xa8,
+    0xd6, 0x5d, 0xb0, 0x28, 0x6c, 0x23, 0xdf, 0xe3, 0x20, 0x3d, 0x27, 0x27, 0x72, 0x69, 0x39, 0xf5,
+    0x25, 0x22, 0xd5, 0x9b, 0x23, 0x2e, 0xcf, 0x1f, 0x28, 0x14, 0xb3, 0x57, 0xd6, 0x67, 0x49, 0x4b,
+    0xe7, 0x26, 0x44, 0xaf, 0x2e, 0x4a, 0x04, 0xdc, 0x16, 0xd4, 0xaa, 0x96, 0xeb, 0xb5, 0x64, 0x3b,
+    0xef, 0xea, 0x8a, 0xa8, 0x59, 0x5f, 0xb6, 0x26, 0x0c, 0x72, 0xa5, 0x63, 0x36, 0x3c, 0x63, 0x3e,
+    0xfd, 0x31, 0xa3, 0xff, 0x0d, 0xcf, 0x4a, 0xb2, 0x1e, 0x55, 0x81, 0xa4, 0x1e, 0x23, 0x66, 0x65,
+    0x91, 0x70, 0x94, 0xb5, 0x27, 0x7d, 0x4c, 0x95, 0xa3, 0x70, 0xa2, 0xb0, 0xe8, 0xf8, 0x51, 0xe5,
+    0x9a, 0x3b, 0x3c, 0xd9, 0x0b, 0xd1, 0x18, 0xfc, 0x1f, 0x3e, 0x3c, 0xca, 0xe0, 0x62, 0xeb, 0x50,
+    0xe6, 0x54, 0x15, 0x1c, 0xcb, 0x03, 0xfe, 0x2a, 0x57, 0x5c, 0x25, 0x62, 0x3e, 0x06, 0x2d, 0x85,
+    0xe7, 0x39, 0x08, 0x82, 0xa3, 0xe0, 0x4e, 0x58, 0x55, 0xe0, 0x3d, 0xc0, 0x86, 0x5b, 0x70, 0x55,
+    0xb9, 0x91, 0x11, 0xc4, 0xb0, 0xe2, 0x99, 0x7b, 0x30, 0x29, 0xbc, 0x78, 0xc9, 0x9d, 0x7c, 0x6b,
+    0x1c, 0x92, 0x34, 0x31, 0xa2, 0xcc, 0x69, 0x18, 0x04, 0x99, 0x11, 0x1c, 0x95, 0xd1, 0x81, 0xa1,
+    0x54, 0x28, 0x3d, 0x3d, 0x82, 0xf7, 0xc9, 0x66, 0x47, 0x2d, 0x0a, 0x4b, 0xc5, 0x48, 0x73, 0x09,
+    0x7e, 0x83, 0x5e, 0x18, 0xf6, 0xe8, 0xef, 0x50, 0x27, 0xa5, 0xe3, 0xfc, 0xbc, 0xf6, 0x3a, 0x93,
+    0x3f, 0xc6, 0x61, 0x8d, 0xd8, 0xbb, 0x3f, 0xa6, 0x7d, 0x59, 0x95, 0x5a, 0x78, 0x13, 0xe8, 0xb6,
+    0xd3, 0xde, 0x1c, 0x55, 0x2b, 0xe8, 0xb7, 0x51, 0xee, 0x0b, 0xfd, 0xd3, 0xba, 0xb0, 0x96, 0x78,
+    0x95, 0x49, 0xff, 0xfa, 0x6a, 0xfb, 0x2e, 0xe9, 0xf7, 0xaa, 0x06, 0xef, 0x0d, 0x02, 0xea, 0x79,
+    0x8a, 0x86, 0xb1, 0xe9, 0x81, 0xe9, 0x23, 0xec, 0x55, 0x43, 0x0d, 0x24, 0xed, 0xfd, 0xf8, 0x91,
+    0x2d, 0x99, 0x8f, 0x9f, 0x8c, 0xb6, 0xdc, 0x3f, 0xf8, 0xc8, 0x5c, 0x3d, 0xa4, 0xad, 0x3b, 0x32,
+    0xf6, 0xdc, 0x5c, 0x49, 0x14, 0x69, 0xbf, 0xcd, 0xbf, 0x4f, 0x58, 0xa3, 0xff, 0x92, 0x2a, 0xfd,
+    0x92, 0xaa, 0x7a, 0xd4, 0x1b, 0x1c, 0xb8, 0x15, 0x60, 0x2a, 0x75, 0xdf, 0x4a, 0x57, 0x18, 0x4d,
+    0x91, 0xc7, 0x33, 0xd8, 0xbd, 0x07, 0xcb, 0xcc, 0x2c, 0xfb, 0x83, 0x6f, 0x99, 0x78, 0xa9, 0x57,
+    0x3f, 0xe4, 0xea, 0x09, 0x7c, 0x7d, 0xfa, 0xf3, 0x7d, 0x20, 0x88, 0x17, 0x94, 0x1f, 0x97, 0xff,
+    0x50, 0x2f, 0xd0, 0xba, 0x02, 0x1e, 0x1c, 0xf2, 0xf7, 0x75, 0x30, 0x3d, 0x89, 0xa3, 0xce, 0x1c,
+    0xfc, 0x3e, 0x45, 0x2b, 0xaf, 0xd8, 0x3b, 0x11, 0xbb, 0x33, 0x15, 0x64, 0x1d, 0xd6, 0x29, 0x69,
+    0xa8, 0x3f, 0x4c, 0x2f, 0xa9, 0xdd, 0x62, 0xdf, 0x42, 0x8d, 0x65, 0xa0, 0x12, 0x2f, 0xfe, 0x95,
+    0xe6, 0x4f, 0x67, 0xbb, 0x9a, 0x47, 0x8f, 0x7b, 0x14, 0x86, 0xcd, 0x80, 0x69, 0x5c, 0x02, 0x49,
+    0xd7, 0xa8, 0x2d, 0x5c, 0x80, 0x93, 0x74, 0x58, 0xe2, 0x5a, 0x45, 0x27, 0xf1, 0x9d, 0xff, 0x6e,
+    0x13, 0x66, 0x7f, 0x17, 0xc6, 0x29, 0xb4, 0xd4, 0x33, 0xea, 0x69, 0xf5, 0xe2, 0x2f, 0x21, 0xdf,
+    0xae, 0x17, 0x2f, 0xfd, 0x81, 0x7a, 0xd9, 0x39, 0x12, 0x28, 0x1a, 0x96, 0xf6, 0xed, 0xcd, 0x87,
+    0xf7, 0xbe, 0x7f, 0x08, 0xeb, 0x3b, 0x15, 0xf2, 0x1c, 0x2e, 0x46, 0xa3, 0x51, 0xb3, 0x43, 0xf7,
+    0x88, 0x66, 0x92, 0xd2, 0xa7, 0xb0, 0xba, 0x41, 0xd0, 0x60, 0xae, 0x2e, 0xa8, 0xff, 0x01, 0x1e,
+    0x56, 0x47, 0xbf, 0xb8, 0x0a, 0x00, 0x00,
+};
@@ -10,13 +10,34 @@ Description:
    - Connection monitoring
 
 2. Camera Features (Level 2):
-   - YUV422 format with 640x480 resolution
-   - Auto image quality optimization
+   - Hardware JPEG output with 640x480 (VGA) resolution - stream me software encoding nahi
+   - YUV422/RGB565 sirf tab jab koi consumer maange (/control?var=pixformat), tab stream
+     ek reused JPEG buffer me software encode karta hai
+   - Auto image quality optimization: stream controller har viewer ka send time aur
+     bytes/sec naapta hai aur target fps (ya bitrate) ke liye JPEG quality, framesize aur
+     frame interval khud adjust karta hai - hysteresis ke saath, taaki baar baar na badle
    - Flash LED control
    - Automatic photo capture
 
 3. Web Server Features (New in Level 3):
-   - Live camera stream in browser
+   - Live camera stream in browser - kai viewers ek saath (MAX_STREAM_CLIENTS):
+     ek broadcaster task frame ek hi baar capture karta hai, har viewer ka apna send task
+     same bytes bhejta hai. Slow viewer frames chhod deta hai, camera ko nahi rokta.
+   - Do alag web servers: port 80 par page + /control, /capture, /flash, /status,
+     port 81 par sirf /stream (apna task, core 1) - control kabhi stream ke peeche nahi rukta
+   - Web page index.html me hai; build ke waqt gzip_ui.py use gzip byte array (index_html_gz.h)
+     banata hai. / use Content-Encoding: gzip, Cache-Control aur ETag ke saath bhejta hai,
+     dobara load par 304 - kam airtime, httpd worker stream se kam der hatta hai
+   - Region of interest: port 81 par /roi?x=&y=&w=&h=&scale= frame ka sirf ek hissa stream
+     karta hai (chhota aur scaled). OV2640 par sensor ki windowing khud crop/scale karti hai,
+     baaki cases me crop + scale + software JPEG - pura UXGA frame bhejne ki zarurat nahi
+   - Relay uplink (RELAY_UPLINK): har frame ek hi baar typed binary packet (PACKET_TYPE_VIDEO,
+     seq + timestamp) ban ke server/server.js ko jata hai. Relay use har subscribed browser ko
+     bhejta hai - audio wala backpressure, slow browser ko sirf sabse naya frame. Device ka
+     egress ek stream, remote viewers kitne bhi hon; LAN /stream saath me chalta rehta hai
+   - Snapshot cache: /capture aakhri JPEG timestamp aur ETag ke saath rakhta hai.
+     /capture?maxAge=ms utna taaza frame cache se turant deta hai, If-None-Match par 304 -
+     kai dashboards ek hi unit ko poll karein to bhi har interval me sirf ek sensor read
    - Camera control panel:
      * Capture photo button
      * Flash LED toggle
@@ -47,9 +68,14 @@ Date: Current Date
 #include <Arduino.h>
 #include <WiFi.h>
 #include "esp_camera.h"
+#include "img_converters.h" // Software JPEG encoding (sirf non-JPEG frames ke liye)
 #include "esp_http_server.h"
+#include "esp_rom_crc.h"
+#include <WebSocketsClient.h>
+#include <ArduinoJson.h>
 #include "soc/soc.h"
 #include "soc/rtc_cntl_reg.h"
+#include "index_html_gz.h" // Web page, gzip_ui.py build se pehle index.html se banata hai
 
 // Pin Definitions
 const int FLASH_LED = 4;    // GPIO 4 is connected to Flash LED
@@ -57,171 +83,1042 @@ const int LED_BUILTIN = 33; // GPIO 33 is built-in LED
 
 // ... Previous level's constants and pin definitions ...
 
-// Web server instance
-httpd_handle_t camera_httpd = NULL;
+// Web server instances - control aur stream alag, taaki /control kabhi /stream ke peeche na ruke
+httpd_handle_t camera_httpd = NULL; // Port 80: page, /control, /capture, /flash, /status
+httpd_handle_t stream_httpd = NULL; // Port 81: sirf /stream, apne task aur core par
+#define STREAM_PORT 81
+#define STREAM_SERVER_CORE 1  // Control server default core par, stream alag core par
+#define STREAM_SERVER_PRIORITY 4
 
-// JPEG streaming ke liye variables
-uint8_t *_jpg_buf = NULL;
-size_t _jpg_buf_len = 0;
+// Software JPEG encoding ka output buffer - ek baar allocate, har frame me reuse.
+// Sirf tab use hota hai jab sensor JPEG ke alawa kuch de raha ho.
+struct JpegPool
+{
+    uint8_t *buf;   // PSRAM buffer
+    size_t size;    // Allocated bytes
+    size_t len;     // Current frame ki JPEG length
+    bool overflow;  // Buffer badhana fail ho gaya
+};
+#define JPEG_POOL_INITIAL (64 * 1024) // VGA JPEG aksar isme aa jata hai
+#define SOFT_JPEG_QUALITY 80
 
 // Stream boundary markers
 static const char *_STREAM_BOUNDARY = "\r\n--123456789000000000000987654321\r\n";
 static const char *_STREAM_PART = "Content-Type: image/jpeg\r\nContent-Length: %u\r\n\r\n";
+static const char *_STREAM_HEADER = "HTTP/1.1 200 OK\r\n"
+                                    "Content-Type: multipart/x-mixed-replace;boundary=123456789000000000000987654321\r\n"
+                                    "Access-Control-Allow-Origin: *\r\n"
+                                    "Cache-Control: no-cache\r\n\r\n";
 
-// HTML page ka template
-const char index_html[] PROGMEM = R"rawliteral(
-<!DOCTYPE html>
-<html>
-<head>
-    <title>ESP32-CAM Web Server</title>
-    <meta name="viewport" content="width=device-width, initial-scale=1">
-    <style>
-        body { font-family: Arial; text-align: center; margin: 0px auto; }
-        .button {
-            background-color: #4CAF50;
-            border: none;
-            color: white;
-            padding: 10px 20px;
-            text-align: center;
-            font-size: 16px;
-            margin: 4px 2px;
-            cursor: pointer;
-        }
-        .slider { width: 200px; }
-        img { width: auto; max-width: 100%; height: auto; }
-    </style>
-</head>
-<body>
-    <h1>ESP32-CAM Web Control</h1>
-    <img src="" id="photo" >
-    <div>
-        <button class="button" onclick="toggleStream()">Start/Stop Stream</button>
-        <button class="button" onclick="capturePhoto()">Capture Photo</button>
-        <button class="button" onclick="toggleFlash()">Toggle Flash</button>
-    </div>
-    <div>
-        <h3>Camera Settings</h3>
-        <p>Brightness: <input type="range" class="slider" id="brightness" min="-2" max="2" value="0" onchange="updateCamera(this)"></p>
-        <p>Contrast: <input type="range" class="slider" id="contrast" min="-2" max="2" value="0" onchange="updateCamera(this)"></p>
-    </div>
-    <div>
-        <h3>System Status</h3>
-        <p id="status">Connecting...</p>
-    </div>
-    <script>
-        var streaming = false;
-        var baseHost = document.location.origin;
-        var streamUrl = baseHost + '/stream';
-        
-        function toggleStream() {
-            if (streaming) {
-                document.getElementById('photo').src = "";
-                streaming = false;
-            } else {
-                document.getElementById('photo').src = streamUrl;
-                streaming = true;
-            }
-        }
-        
-        function capturePhoto() {
-            fetch(baseHost + '/capture')
-                .then(response => response.blob())
-                .then(blob => {
-                    document.getElementById('photo').src = URL.createObjectURL(blob);
-                });
-        }
-        
-        function toggleFlash() {
-            fetch(baseHost + '/flash');
-        }
-        
-        function updateCamera(element) {
-            fetch(baseHost + '/control?' + element.id + '=' + element.value);
+// MJPEG fan-out - broadcaster ek frame capture karke refcounted slot me rakhta hai,
+// har viewer ka send task wahi slot apne socket par bhejta hai
+#define MAX_STREAM_CLIENTS 5    // Ek saath itne /stream viewers
+#define FRAME_SLOTS 3           // Naya frame + slow viewers ko abhi bhi ja rahe frames
+#define BROADCAST_TASK_CORE 1
+#define BROADCAST_TASK_PRIORITY 2
+#define CLIENT_TASK_PRIORITY 1
+#define CLIENT_TASK_STACK 3072
+
+struct FrameSlot
+{
+    JpegPool jpeg;       // Frame ki JPEG bytes (sensor se copy ya software encode)
+    uint32_t seq;        // Frame number, 0 matlab khali
+    int refs;            // Kitne viewers abhi ise bhej rahe hain
+    int64_t timestampUs; // Sensor ne frame kab liya (esp_timer)
+    uint16_t width, height;
+    uint8_t quality;     // Sensor ki JPEG quality, software encode me 0
+};
+
+struct StreamClient
+{
+    bool inUse;
+    int fd;                  // httpd session ka socket
+    uint32_t generation;     // Slot reuse hone par purane session ka close ignore karne ke liye
+    volatile bool closed;    // httpd ne session band kar diya
+    TaskHandle_t task;
+    uint32_t framesSent;
+    uint32_t framesDropped;  // Slow tha, beech ke frames chhod diye
+    float sendMs;            // Ek frame bhejne ka average time (EWMA)
+    float bytesPerSec;       // Average throughput (EWMA)
+};
+
+// Relay uplink - frames server/server.js ko, wahan se remote browsers ko (server/public/index.html)
+#define RELAY_UPLINK 1              // 0 = sirf LAN par /stream
+#define RELAY_HOST "192.168.1.100"  // server/server.js chalane wali machine
+#define RELAY_PORT 3012             // server/server.js ka default PORT
+#define RELAY_PATH "/"
+#define RELAY_USE_TLS 0             // 1 = wss:// (tab RELAY_PORT aksar 443)
+#define RELAY_RECONNECT_MS 2000
+#define UPLINK_TASK_CORE 0          // Broadcaster aur stream server core 1 par
+#define UPLINK_TASK_PRIORITY 1
+#define UPLINK_TASK_STACK 8192      // TLS handshake ko jagah chahiye
+
+// Packet format src/audio_packet.h wala hi hai - relay aur page use waise hi parse karte hain.
+// Header: [magic, type, seq(2), samples(2), checksum(2), version, headerSize, flags, rate,
+// timestamp(4), crc32(4)], payload: [width(2), height(2), quality, reserved(3)] + JPEG
+#define PACKET_HEADER_MAGIC_V2 0xA6
+#define PACKET_HEADER_VERSION 3
+#define PACKET_HEADER_SIZE 20
+#define PACKET_FLAG_CRC32 0x01
+#define PACKET_TYPE_VIDEO 0x08
+#define PACKET_RATE_16000 0x00
+#define VIDEO_HEADER_SIZE 8
+#define VIDEO_CLOCK_HZ 16000 // Timestamp 16 kHz ticks me - audio packets wali clock, rate code 0
+#define UPLINK_JPEG_OFFSET (WEBSOCKETS_MAX_HEADER_SIZE + PACKET_HEADER_SIZE + VIDEO_HEADER_SIZE)
+
+struct RelayUplink
+{
+    volatile bool enabled;   // /control?var=uplink&val=0 ya relay ka video command
+    volatile bool connected; // Relay se juda hai - broadcaster tab bhi chalta hai jab LAN viewer na ho
+    TaskHandle_t task;
+    JpegPool packet;         // [WebSocket header ki jagah][packet header][video header][JPEG], reuse
+    uint32_t framesSent;
+    uint32_t framesDropped;  // Pichhla frame abhi ja raha tha - beech wale chhode
+    float sendMs;            // Stream viewers jaisa, controller ke liye
+    float bytesPerSec;
+};
+RelayUplink relayUplink = {RELAY_UPLINK, false, NULL, {NULL, 0, 0, false}, 0, 0, 0, 0};
+WebSocketsClient relaySocket; // Sirf uplink task chhuta hai
+
+// Adaptive stream controller - sabse slow viewer ke hisaab se camera settings.
+// Pehle quality girti hai, phir framesize; sudhaar dheere dheere ulte order me.
+#define STREAM_TARGET_FPS 15         // /control?var=target_fps se badal sakte hain
+#define STREAM_TARGET_KBPS 0         // 0 = sirf fps target; warna is bitrate se upar nahi
+#define STREAM_CONTROL_PERIOD_MS 1000
+#define STREAM_QUALITY_STEP 4        // Ek step me JPEG quality kitni badle
+#define STREAM_QUALITY_WORST 40      // Isse kharab quality nahi (0-63, zyada = kharab)
+#define STREAM_SLOW_PERIODS 2        // Itne periods target se neeche -> ek step kharab
+#define STREAM_FAST_PERIODS 5        // Itne periods target se kaafi upar -> ek step behtar
+#define STREAM_SLOW_RATIO 0.8f       // Achievable fps < target * 0.8 = slow
+#define STREAM_FAST_RATIO 1.5f       // Achievable fps > target * 1.5 = headroom
+#define STREAM_SEND_EWMA 0.2f
+
+// Framesize ki seedhi - controller inhi ke beech upar neeche jata hai
+static const framesize_t framesizeLadder[] = {FRAMESIZE_QVGA, FRAMESIZE_CIF, FRAMESIZE_VGA, FRAMESIZE_SVGA,
+                                              FRAMESIZE_XGA, FRAMESIZE_SXGA, FRAMESIZE_UXGA};
+#define FRAMESIZE_LADDER_COUNT (sizeof(framesizeLadder) / sizeof(framesizeLadder[0]))
+
+struct StreamController
+{
+    bool enabled;         // /control?var=adaptive&val=0 se band
+    int targetFps;
+    int targetKbps;
+    int bestQuality;      // User ki quality - isse behtar nahi jayenge
+    int bestLadder;       // User ka framesize - isse bada nahi
+    int quality;          // Abhi ki quality
+    int ladder;           // Abhi ka framesize (framesizeLadder index)
+    int slowPeriods;
+    int fastPeriods;
+    uint32_t intervalMs;  // Do frames ke beech kam se kam itna time
+    int64_t lastRun;
+};
+StreamController streamController = {true, STREAM_TARGET_FPS, STREAM_TARGET_KBPS, 12, 2, 12, 2, 0, 0,
+                                     1000 / STREAM_TARGET_FPS, 0};
+
+// Region of interest - sab viewers ka ek hi window (camera ek hai).
+// x/y/w/h hamesha sensor ke poore UXGA frame (1600x1200) ke pixels me.
+#define ROI_SENSOR_W 1600
+#define ROI_SENSOR_H 1200
+#define ROI_MAX_OUT_W 640   // Camera ke JPEG buffers VGA ke hisaab se bane hain
+#define ROI_MAX_OUT_H 480
+#define ROI_ALIGN 16        // Output JPEG MCU ke multiple me
+
+struct StreamRoi
+{
+    bool active;
+    bool sensorWindow; // true: OV2640 khud crop/scale karta hai, false: software
+    int x, y, w, h;    // Sensor pixels
+    int scale;         // 1, 2, 4 ya 8
+    int outW, outH;    // Sensor window ka output size
+};
+StreamRoi streamRoi = {};
+
+// Software ROI ke reused buffers - sirf broadcaster use karta hai
+struct RoiBuffer
+{
+    uint8_t *buf;
+    size_t size;
+};
+RoiBuffer roiDecode = {NULL, 0}; // JPEG frame ka scaled RGB565 decode
+RoiBuffer roiCrop = {NULL, 0};   // Crop kiya hua RGB565/YUV422, encoder ka input
+
+// /capture ka snapshot cache - sirf control server ka ek worker task ise chhuta hai, lock nahi chahiye
+#define CAPTURE_DEFAULT_MAX_AGE_MS 1000 // maxAge na diya ho to itna purana frame bhi chalega
+#define CAPTURE_MAX_AGE_LIMIT_MS 60000
+
+struct CaptureCache
+{
+    JpegPool jpeg;
+    int64_t timestampUs; // Frame kab capture hua (esp_timer), 0 = khali
+    uint32_t seq;        // Har naye frame par badhta hai - ETag isi se
+    char etag[24];
+};
+CaptureCache captureCache = {{NULL, 0, 0, false}, 0, 0, ""};
+uint32_t captureHits = 0;   // Cache se diye
+uint32_t captureMisses = 0; // Sensor se naya frame liya
+
+// httpd session context - session band hone par client ko batata hai
+struct StreamSession
+{
+    StreamClient *client;
+    uint32_t generation;
+};
+
+FrameSlot frameSlots[FRAME_SLOTS];
+FrameSlot *latestSlot = NULL; // Sabse naya frame
+StreamClient streamClients[MAX_STREAM_CLIENTS];
+volatile int streamClientCount = 0;
+SemaphoreHandle_t streamLock = NULL; // frameSlots, latestSlot aur streamClients ko protect karta hai
+TaskHandle_t broadcasterTask = NULL;
+uint32_t broadcastFrames = 0;
+uint32_t broadcastDrops = 0; // Saare slots busy the - camera frame chhoda
+
+// Camera ko hardware JPEG mode me start karte hain - pins Level 2 wale hi hain
+bool initCamera()
+{
+    camera_config_t config;
+    config.ledc_channel = LEDC_CHANNEL_0;
+    config.ledc_timer = LEDC_TIMER_0;
+    config.pin_d0 = Y2_GPIO_NUM;
+    config.pin_d1 = Y3_GPIO_NUM;
+    config.pin_d2 = Y4_GPIO_NUM;
+    config.pin_d3 = Y5_GPIO_NUM;
+    config.pin_d4 = Y6_GPIO_NUM;
+    config.pin_d5 = Y7_GPIO_NUM;
+    config.pin_d6 = Y8_GPIO_NUM;
+    config.pin_d7 = Y9_GPIO_NUM;
+    config.pin_xclk = XCLK_GPIO_NUM;
+    config.pin_pclk = PCLK_GPIO_NUM;
+    config.pin_vsync = VSYNC_GPIO_NUM;
+    config.pin_href = HREF_GPIO_NUM;
+    config.pin_sscb_sda = SIOD_GPIO_NUM;
+    config.pin_sscb_scl = SIOC_GPIO_NUM;
+    config.pin_pwdn = PWDN_GPIO_NUM;
+    config.pin_reset = RESET_GPIO_NUM;
+    config.xclk_freq_hz = 20000000;
+
+    // Sensor khud JPEG banata hai - CPU par encoding ka koi kharcha nahi
+    config.pixel_format = PIXFORMAT_JPEG;
+    config.frame_size = FRAMESIZE_VGA; // 640x480
+    config.jpeg_quality = 12;
+    config.fb_count = psramFound() ? 2 : 1;
+    config.fb_location = psramFound() ? CAMERA_FB_IN_PSRAM : CAMERA_FB_IN_DRAM;
+    config.grab_mode = psramFound() ? CAMERA_GRAB_LATEST : CAMERA_GRAB_WHEN_EMPTY;
+
+    esp_err_t err = esp_camera_init(&config);
+    if (err != ESP_OK)
+    {
+        Serial.printf("Camera initialize nahi ho paya! Error: 0x%x\n", err);
+        return false;
+    }
+    return true;
+}
+
+// frame2jpg_cb ka output callback - pool buffer me likhta hai, zarurat ho to double karta hai
+static size_t jpegPoolWrite(void *arg, size_t index, const void *data, size_t len)
+{
+    JpegPool *pool = (JpegPool *)arg;
+    if (index == 0)
+        pool->len = 0; // Naya frame
+    if (index + len > pool->size)
+    {
+        size_t size = max(pool->size * 2, index + len);
+        uint8_t *grown = (uint8_t *)heap_caps_realloc(pool->buf, size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (!grown)
+        {
+            pool->overflow = true;
+            return 0; // Encoder ruk jayega
         }
-        
-        // Status update every 5 seconds
-        setInterval(function() {
-            fetch(baseHost + '/status')
-                .then(response => response.text())
-                .then(text => {
-                    document.getElementById('status').innerHTML = text;
-                });
-        }, 5000);
-    </script>
-</body>
-</html>
-)rawliteral";
+        pool->buf = grown;
+        pool->size = size;
+    }
+    memcpy(pool->buf + index, data, len);
+    pool->len = index + len;
+    return len;
+}
 
 // Web server ke endpoints handle karne ke functions
+
+// If-None-Match me hamara ETag hai? Header list ho sakta hai ("a", "b"), weak (W/"a") ya "*".
+// If-None-Match weak comparison karta hai, to W/ hata ke tag compare karte hain.
+#define IF_NONE_MATCH_MAX 256 // Isse lamba header kat jata hai - bache hue tags phir bhi dekhte hain
+static bool etagMatches(httpd_req_t *req, const char *etag)
+{
+    char header[IF_NONE_MATCH_MAX];
+    esp_err_t result = httpd_req_get_hdr_value_str(req, "If-None-Match", header, sizeof(header));
+    if (result != ESP_OK && result != ESP_ERR_HTTPD_RESULT_TRUNC)
+        return false;
+
+    size_t etagLen = strlen(etag);
+    const char *p = header;
+    while (*p)
+    {
+        while (*p == ' ' || *p == '\t' || *p == ',')
+            p++;
+        const char *end = strchr(p, ',');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        while (len > 0 && (p[len - 1] == ' ' || p[len - 1] == '\t'))
+            len--; // Token ke baad ka space
+        if (len == 1 && *p == '*')
+            return true;
+        if (len > 2 && p[0] == 'W' && p[1] == '/')
+        {
+            p += 2;
+            len -= 2;
+        }
+        if (len == etagLen && !memcmp(p, etag, len))
+            return true;
+        if (!end)
+            break;
+        p = end + 1;
+    }
+    return false;
+}
+
+// / - page build ke waqt gzip hua (index.html -> gzip_ui.py -> index_html_gz.h), waise hi bhejte hain.
+// Browser ETag ke saath puchhe aur page wahi ho to 304, body nahi.
 esp_err_t index_handler(httpd_req_t *req)
 {
+    httpd_resp_set_hdr(req, "ETag", INDEX_HTML_GZ_ETAG);
+    httpd_resp_set_hdr(req, "Cache-Control", "max-age=60"); // Ek minute tak request hi nahi, phir ETag se check
+
+    if (etagMatches(req, INDEX_HTML_GZ_ETAG))
+    {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    // Har browser gzip samajhta hai - Accept-Encoding nahi dekhte
     httpd_resp_set_type(req, "text/html");
-    return httpd_resp_send(req, (const char *)index_html, strlen(index_html));
+    httpd_resp_set_hdr(req, "Content-Encoding", "gzip");
+    return httpd_resp_send(req, (const char *)index_html_gz, INDEX_HTML_GZ_LEN);
 }
 
-esp_err_t stream_handler(httpd_req_t *req)
+// Buffer kam se kam itna bada - PSRAM me, sirf badhta hai
+static bool roiReserve(RoiBuffer *buffer, size_t bytes)
+{
+    if (buffer->size >= bytes)
+        return true;
+    uint8_t *grown = (uint8_t *)heap_caps_realloc(buffer->buf, bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!grown)
+        return false;
+    buffer->buf = grown;
+    buffer->size = bytes;
+    return true;
+}
+
+static jpg_scale_t roiJpegScale(int scale)
+{
+    switch (scale)
+    {
+    case 2:
+        return JPG_SCALE_2X;
+    case 4:
+        return JPG_SCALE_4X;
+    case 8:
+        return JPG_SCALE_8X;
+    default:
+        return JPG_SCALE_NONE;
+    }
+}
+
+// Software ROI - window crop + scale karke RGB565/YUV422 buffer, phir software JPEG.
+// JPEG frame ho to decoder khud 1/2/4/8 scale karta hai; raw frames me nearest-pixel skip.
+static bool encodeRoiFrame(FrameSlot *slot, camera_fb_t *fb, const StreamRoi &roi)
+{
+    // Window is frame ke pixels me - ROI sensor coordinates me hai
+    int scale = roi.scale;
+    int fx = roi.x * fb->width / ROI_SENSOR_W;
+    int fy = roi.y * fb->height / ROI_SENSOR_H;
+    int fw = min((int)(roi.w * fb->width / ROI_SENSOR_W), (int)fb->width - fx);
+    int fh = min((int)(roi.h * fb->height / ROI_SENSOR_H), (int)fb->height - fy);
+    int outW = (fw / scale) & ~1; // YUV me do pixels ek U/V share karte hain
+    int outH = fh / scale;
+    if (outW < 2 || outH < 1)
+        return false;
+
+    size_t outBytes = outW * outH * 2;
+    if (!roiReserve(&roiCrop, outBytes))
+        return false;
+    uint8_t *out = roiCrop.buf;
+    pixformat_t outFormat = PIXFORMAT_RGB565;
+
+    if (fb->format == PIXFORMAT_JPEG)
+    {
+        // Poora frame scaled decode, phir sirf window ki rows copy
+        int dw = fb->width / scale;
+        int dh = fb->height / scale;
+        int dx = fx / scale;
+        int dy = fy / scale;
+        if (dx + outW > dw || dy + outH > dh)
+            return false;
+        if (!roiReserve(&roiDecode, dw * dh * 2) || !jpg2rgb565(fb->buf, fb->len, roiDecode.buf, roiJpegScale(scale)))
+            return false;
+        for (int y = 0; y < outH; y++)
+            memcpy(out + y * outW * 2, roiDecode.buf + ((dy + y) * dw + dx) * 2, outW * 2);
+    }
+    else if (fb->format == PIXFORMAT_RGB565)
+    {
+        for (int y = 0; y < outH; y++)
+        {
+            const uint16_t *src = (const uint16_t *)fb->buf + (fy + y * scale) * fb->width + fx;
+            uint16_t *dst = (uint16_t *)out + y * outW;
+            for (int x = 0; x < outW; x++)
+                dst[x] = src[x * scale];
+        }
+    }
+    else if (fb->format == PIXFORMAT_YUV422)
+    {
+        // YUYV: pixel k ka Y byte 2k par, uske jode ka U/V (k & ~1) * 2 + 1 / + 3 par
+        outFormat = PIXFORMAT_YUV422;
+        for (int y = 0; y < outH; y++)
+        {
+            const uint8_t *src = fb->buf + ((fy + y * scale) * fb->width + (fx & ~1)) * 2;
+            uint8_t *dst = out + y * outW * 2;
+            for (int x = 0; x < outW; x += 2, dst += 4)
+            {
+                int k0 = x * scale;
+                int k1 = (x + 1) * scale;
+                const uint8_t *pair = src + (k0 & ~1) * 2;
+                dst[0] = src[k0 * 2];
+                dst[1] = pair[1];
+                dst[2] = src[k1 * 2];
+                dst[3] = pair[3];
+            }
+        }
+    }
+    else
+    {
+        return false;
+    }
+
+    slot->jpeg.overflow = false;
+    slot->width = outW;
+    slot->height = outH;
+    return fmt2jpg_cb(out, outBytes, outW, outH, outFormat, SOFT_JPEG_QUALITY, jpegPoolWrite, &slot->jpeg) &&
+           !slot->jpeg.overflow;
+}
+
+// Frame ko slot ke buffer me daalte hain - JPEG ho to copy, warna software encode.
+// Software ROI ho to pehle crop + scale.
+static bool fillFrameSlot(FrameSlot *slot, camera_fb_t *fb, const StreamRoi &roi)
 {
-    camera_fb_t *fb = NULL;
-    esp_err_t res = ESP_OK;
-    char *part_buf[64];
-    static int64_t last_frame = 0;
+    slot->timestampUs = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    slot->width = fb->width;
+    slot->height = fb->height;
+    slot->quality = 0;
+    if (roi.active && !roi.sensorWindow)
+        return encodeRoiFrame(slot, fb, roi);
 
-    res = httpd_resp_set_type(req, "multipart/x-mixed-replace;boundary=123456789000000000000987654321");
-    if (res != ESP_OK)
-        return res;
+    JpegPool *pool = &slot->jpeg;
+    pool->overflow = false;
+    if (fb->format != PIXFORMAT_JPEG)
+        return frame2jpg_cb(fb, SOFT_JPEG_QUALITY, jpegPoolWrite, pool) && !pool->overflow;
+    slot->quality = streamController.quality;
+    return jpegPoolWrite(pool, 0, fb->buf, fb->len) == fb->len;
+}
 
+// Camera par controller ki abhi ki quality aur framesize lagate hain
+static void applyStreamSettings(StreamController *ctl)
+{
+    sensor_t *sensor = esp_camera_sensor_get();
+    if (!sensor || sensor->pixformat != PIXFORMAT_JPEG)
+        return; // Quality/framesize sirf JPEG mode me
+    sensor->set_quality(sensor, ctl->quality);
+    if (!streamRoi.sensorWindow)
+        sensor->set_framesize(sensor, framesizeLadder[ctl->ladder]); // Framesize sensor window ko mita deta
+}
+
+// Har STREAM_CONTROL_PERIOD_MS - sabse slow viewer ka achievable fps dekh ke ek step upar/neeche.
+// Alag thresholds aur lagatar periods ki ginti = hysteresis, settings oscillate nahi karti.
+static void runStreamController(StreamController *ctl)
+{
+    int64_t now = esp_timer_get_time();
+    if (!ctl->enabled || now - ctl->lastRun < STREAM_CONTROL_PERIOD_MS * 1000LL)
+        return;
+    ctl->lastRun = now;
+
+    // Sabse slow viewer - sab ko same frames jaate hain, camera ek hi hai
+    float worstSendMs = 0;
+    float worstBytesPerSec = 0;
+    xSemaphoreTake(streamLock, portMAX_DELAY);
+    for (int i = 0; i < MAX_STREAM_CLIENTS; i++)
+    {
+        if (streamClients[i].inUse && streamClients[i].sendMs > worstSendMs)
+        {
+            worstSendMs = streamClients[i].sendMs;
+            worstBytesPerSec = streamClients[i].bytesPerSec;
+        }
+    }
+    xSemaphoreGive(streamLock);
+    if (relayUplink.connected && relayUplink.enabled && relayUplink.sendMs > worstSendMs)
+    {
+        // Relay bhi ek viewer hai - uska link slow ho to sab remote viewers ke frames late
+        worstSendMs = relayUplink.sendMs;
+        worstBytesPerSec = relayUplink.bytesPerSec;
+    }
+    if (worstSendMs == 0)
+        return; // Abhi naap nahi hai
+
+    float achievableFps = 1000.0f / worstSendMs;
+    float bytesPerFrame = worstBytesPerSec * worstSendMs / 1000.0f;
+    bool overBitrate = ctl->targetKbps > 0 && bytesPerFrame * 8 * ctl->targetFps / 1000 > ctl->targetKbps;
+    bool slow = achievableFps < ctl->targetFps * STREAM_SLOW_RATIO || overBitrate;
+    bool fast = achievableFps > ctl->targetFps * STREAM_FAST_RATIO && !overBitrate;
+    ctl->slowPeriods = slow ? ctl->slowPeriods + 1 : 0;
+    ctl->fastPeriods = fast ? ctl->fastPeriods + 1 : 0;
+
+    bool changed = false;
+    if (ctl->slowPeriods >= STREAM_SLOW_PERIODS)
+    {
+        // Kharab karo: pehle quality, phir chhota framesize (aur quality wapas user wali)
+        if (ctl->quality + STREAM_QUALITY_STEP <= STREAM_QUALITY_WORST)
+        {
+            ctl->quality += STREAM_QUALITY_STEP;
+            changed = true;
+        }
+        else if (ctl->ladder > 0 && !streamRoi.active)
+        {
+            ctl->ladder--;
+            ctl->quality = ctl->bestQuality;
+            changed = true;
+        }
+        ctl->slowPeriods = 0;
+    }
+    else if (ctl->fastPeriods >= STREAM_FAST_PERIODS)
+    {
+        // Behtar karo - ulta order: pehle framesize (user wale tak), phir quality
+        if (ctl->ladder < ctl->bestLadder && ctl->quality == ctl->bestQuality && !streamRoi.active)
+        {
+            ctl->ladder++;
+            ctl->quality = min(ctl->bestQuality + 2 * STREAM_QUALITY_STEP, STREAM_QUALITY_WORST); // Bada frame, thodi kam quality se shuru
+            changed = true;
+        }
+        else if (ctl->quality > ctl->bestQuality)
+        {
+            ctl->quality = max(ctl->quality - STREAM_QUALITY_STEP, ctl->bestQuality);
+            changed = true;
+        }
+        ctl->fastPeriods = 0;
+    }
+
+    // Frame interval - target fps, par slowest viewer se tez capture karne ka fayda nahi
+    ctl->intervalMs = max((uint32_t)(1000 / ctl->targetFps), slow ? (uint32_t)worstSendMs : 0u);
+
+    if (changed)
+    {
+        applyStreamSettings(ctl);
+        Serial.printf("Stream controller: %.1f fps possible, %.0f kB/s -> quality %d, framesize %d, interval %u ms\n",
+                      achievableFps, worstBytesPerSec / 1024, ctl->quality, framesizeLadder[ctl->ladder], ctl->intervalMs);
+    }
+}
+
+// Koi LAN viewer ya relay uplink frames le raha hai
+static bool streamWanted()
+{
+    return streamClientCount > 0 || (relayUplink.connected && relayUplink.enabled);
+}
+
+// Broadcaster - koi viewer ho tabhi camera se frames leta hai, ek frame sab ke liye
+void broadcasterLoop(void *parameter)
+{
+    uint32_t frameSeq = 0;
+    TickType_t lastFrame = xTaskGetTickCount();
     while (true)
     {
-        fb = esp_camera_fb_get();
+        if (!streamWanted())
+        {
+            ulTaskNotifyTake(pdTRUE, portMAX_DELAY); // Pehle viewer ka wait
+            lastFrame = xTaskGetTickCount();
+            continue;
+        }
+
+        // Controller ka frame interval - zarurat se tez capture nahi
+        runStreamController(&streamController);
+        vTaskDelayUntil(&lastFrame, pdMS_TO_TICKS(streamController.intervalMs));
+
+        camera_fb_t *fb = esp_camera_fb_get();
         if (!fb)
         {
             Serial.println("Camera frame capture failed");
-            res = ESP_FAIL;
+            vTaskDelay(pdMS_TO_TICKS(10));
+            continue;
         }
+
+        // Khali slot dhundte hain - latest wala nahi, aur jise koi bhej na raha ho
+        xSemaphoreTake(streamLock, portMAX_DELAY);
+        FrameSlot *slot = NULL;
+        for (int i = 0; i < FRAME_SLOTS && !slot; i++)
+        {
+            if (frameSlots[i].refs == 0 && &frameSlots[i] != latestSlot)
+                slot = &frameSlots[i];
+        }
+
+        if (!slot)
+        {
+            // Saare viewers slow hain - ye frame chhod dete hain, camera chalta rehta hai
+            xSemaphoreGive(streamLock);
+            esp_camera_fb_return(fb);
+            broadcastDrops++;
+            continue;
+        }
+
+        StreamRoi roi = streamRoi; // Is frame ke liye window ki copy
+        xSemaphoreGive(streamLock);
+
+        // Slot free hai aur latest nahi, to koi viewer ise nahi le sakta - lock ke bina bharte hain
+
+        bool filled = fillFrameSlot(slot, fb, roi);
+        esp_camera_fb_return(fb); // Sensor buffer turant wapas
+        if (!filled)
+        {
+            Serial.println("JPEG compression failed");
+            continue;
+        }
+
+        xSemaphoreTake(streamLock, portMAX_DELAY);
+        slot->seq = ++frameSeq;
+        latestSlot = slot;
+        for (int i = 0; i < MAX_STREAM_CLIENTS; i++)
+        {
+            if (streamClients[i].inUse)
+                xTaskNotifyGive(streamClients[i].task);
+        }
+        if (relayUplink.task)
+            xTaskNotifyGive(relayUplink.task);
+        xSemaphoreGive(streamLock);
+        broadcastFrames++;
+    }
+}
+
+// Poora buffer bhejte hain - httpd_socket_send ek baar me kam bhi bhej sakta hai
+static bool sendAll(int fd, const char *data, size_t len)
+{
+    while (len > 0)
+    {
+        int sent = httpd_socket_send(stream_httpd, fd, data, len, 0);
+        if (sent <= 0)
+            return false;
+        data += sent;
+        len -= sent;
+    }
+    return true;
+}
+
+// Ek frame bhejne ka time aur throughput (EWMA) - controller inhi se decide karta hai
+static void recordSendTime(float *sendMs, float *bytesPerSec, size_t bytes, int64_t sendStart)
+{
+    float ms = max((esp_timer_get_time() - sendStart) / 1000.0f, 0.1f);
+    float bps = bytes * 1000.0f / ms;
+    *sendMs = *sendMs == 0 ? ms : *sendMs + STREAM_SEND_EWMA * (ms - *sendMs);
+    *bytesPerSec = *bytesPerSec == 0 ? bps : *bytesPerSec + STREAM_SEND_EWMA * (bps - *bytesPerSec);
+}
+
+// Har viewer ka send task - naya frame aane par bhejta hai, slow ho to beech ke frames skip
+void streamClientLoop(void *parameter)
+{
+    StreamClient *client = (StreamClient *)parameter;
+    uint32_t lastSeq = 0;
+    char part_buf[64];
+    bool ok = sendAll(client->fd, _STREAM_HEADER, strlen(_STREAM_HEADER));
+
+    while (ok && !client->closed)
+    {
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(1000));
+
+        // Sabse naya frame refcount ke saath le lete hain
+        xSemaphoreTake(streamLock, portMAX_DELAY);
+        FrameSlot *slot = latestSlot;
+        if (slot && slot->seq != lastSeq)
+            slot->refs++;
         else
+            slot = NULL;
+        xSemaphoreGive(streamLock);
+        if (!slot)
+            continue;
+
+        if (lastSeq != 0 && slot->seq > lastSeq + 1)
+            client->framesDropped += slot->seq - lastSeq - 1;
+        lastSeq = slot->seq;
+
+        size_t hlen = snprintf(part_buf, sizeof(part_buf), _STREAM_PART, slot->jpeg.len);
+        int64_t sendStart = esp_timer_get_time();
+        ok = sendAll(client->fd, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY)) &&
+             sendAll(client->fd, part_buf, hlen) &&
+             sendAll(client->fd, (const char *)slot->jpeg.buf, slot->jpeg.len);
+        if (ok)
         {
-            if (fb->format != PIXFORMAT_JPEG)
-            {
-                bool jpeg_converted = frame2jpg(fb, 80, &_jpg_buf, &_jpg_buf_len);
-                if (!jpeg_converted)
-                {
-                    Serial.println("JPEG compression failed");
-                    res = ESP_FAIL;
-                }
-            }
-            else
-            {
-                _jpg_buf_len = fb->len;
-                _jpg_buf = fb->buf;
-            }
+            recordSendTime(&client->sendMs, &client->bytesPerSec, slot->jpeg.len, sendStart);
+            client->framesSent++;
         }
 
-        if (res == ESP_OK)
+        xSemaphoreTake(streamLock, portMAX_DELAY);
+        slot->refs--;
+        xSemaphoreGive(streamLock);
+    }
+
+    Serial.printf("Stream viewer gaya (fd %d): %u frames bheje, %u chhode\n", client->fd,
+                  client->framesSent, client->framesDropped);
+    if (!client->closed)
+        httpd_sess_trigger_close(stream_httpd, client->fd);
+
+    xSemaphoreTake(streamLock, portMAX_DELAY);
+    client->inUse = false;
+    client->generation++; // Ab aane wala purana close is slot ko nahi chhuega
+    streamClientCount--;
+    xSemaphoreGive(streamLock);
+    vTaskDelete(NULL);
+}
+
+// httpd session band hone par - viewer ke task ko rukne ko bolte hain
+static void streamSessionClosed(void *ctx)
+{
+    StreamSession *session = (StreamSession *)ctx;
+    xSemaphoreTake(streamLock, portMAX_DELAY);
+    StreamClient *client = session->client;
+    if (client->inUse && client->generation == session->generation)
+    {
+        client->closed = true;
+        xTaskNotifyGive(client->task);
+    }
+    xSemaphoreGive(streamLock);
+    free(session);
+}
+
+// /stream - viewer ko register karke turant return, taaki httpd worker free rahe
+esp_err_t stream_handler(httpd_req_t *req)
+{
+    StreamSession *session = (StreamSession *)malloc(sizeof(StreamSession));
+    if (!session)
+    {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    xSemaphoreTake(streamLock, portMAX_DELAY);
+    StreamClient *client = NULL;
+    for (int i = 0; i < MAX_STREAM_CLIENTS && !client; i++)
+    {
+        if (!streamClients[i].inUse)
+            client = &streamClients[i];
+    }
+    if (client)
+    {
+        client->inUse = true;
+        client->fd = httpd_req_to_sockfd(req);
+        client->closed = false;
+        client->framesSent = 0;
+        client->framesDropped = 0;
+        client->sendMs = 0;
+        client->bytesPerSec = 0;
+        if (xTaskCreatePinnedToCore(streamClientLoop, "StreamClient", CLIENT_TASK_STACK, client,
+                                    CLIENT_TASK_PRIORITY, &client->task, tskNO_AFFINITY) != pdPASS)
         {
-            res = httpd_resp_send_chunk(req, _STREAM_BOUNDARY, strlen(_STREAM_BOUNDARY));
+            client->inUse = false;
+            client = NULL;
         }
-        if (res == ESP_OK)
+        else
         {
-            size_t hlen = snprintf((char *)part_buf, 64, _STREAM_PART, _jpg_buf_len);
-            res = httpd_resp_send_chunk(req, (const char *)part_buf, hlen);
+            streamClientCount++;
         }
-        if (res == ESP_OK)
+    }
+    xSemaphoreGive(streamLock);
+
+    if (!client)
+    {
+        free(session);
+        httpd_resp_set_status(req, "503 Service Unavailable");
+        return httpd_resp_send(req, "Bahut saare viewers - baad me try karo", HTTPD_RESP_USE_STRLEN);
+    }
+
+    // Session band hone ki khabar ke liye context, response client ka task khud bhejta hai
+    session->client = client;
+    session->generation = client->generation;
+    req->sess_ctx = session;
+    req->free_ctx = streamSessionClosed;
+    xTaskNotifyGive(broadcasterTask);
+    return ESP_OK;
+}
+
+// Query se ek number, na ho to fallback
+static int queryInt(const char *query, const char *key, int fallback)
+{
+    char value[16];
+    if (httpd_query_key_value(query, key, value, sizeof(value)) != ESP_OK)
+        return fallback;
+    return atoi(value);
+}
+
+// ROI ko sensor ki limits me laate hain aur tay karte hain ki sensor window chalega ya software.
+// Output bahut bada ho to scale double karte hain. False = galat window.
+static bool prepareStreamRoi(StreamRoi *roi)
+{
+    if (roi->scale != 1 && roi->scale != 2 && roi->scale != 4 && roi->scale != 8)
+        return false;
+    if (roi->x < 0 || roi->y < 0 || roi->x >= ROI_SENSOR_W || roi->y >= ROI_SENSOR_H)
+        return false;
+    roi->x &= ~3; // OV2640 window offsets 4 ke multiple
+    roi->y &= ~3;
+    roi->w = min(roi->w, ROI_SENSOR_W - roi->x);
+    roi->h = min(roi->h, ROI_SENSOR_H - roi->y);
+    while ((roi->w / roi->scale > ROI_MAX_OUT_W || roi->h / roi->scale > ROI_MAX_OUT_H) && roi->scale < 8)
+        roi->scale *= 2;
+
+    roi->outW = min(roi->w / roi->scale, ROI_MAX_OUT_W) & ~(ROI_ALIGN - 1);
+    roi->outH = min(roi->h / roi->scale, ROI_MAX_OUT_H) & ~(ROI_ALIGN - 1);
+    if (roi->outW < ROI_ALIGN || roi->outH < ROI_ALIGN)
+        return false;
+    roi->w = roi->outW * roi->scale;
+    roi->h = roi->outH * roi->scale;
+
+    // Sensor windowing sirf OV2640 ke JPEG mode me - baaki sab software path
+    sensor_t *s = esp_camera_sensor_get();
+    roi->sensorWindow = s && s->id.PID == OV2640_PID && s->pixformat == PIXFORMAT_JPEG && s->set_res_raw;
+    roi->active = true;
+    return true;
+}
+
+// ROI lagate hain (ya active = false se hatate hain) - sensor window ho to seedha camera par
+static void applyStreamRoi(const StreamRoi &roi)
+{
+    sensor_t *s = esp_camera_sensor_get();
+    xSemaphoreTake(streamLock, portMAX_DELAY);
+    bool hadWindow = streamRoi.sensorWindow;
+    bool wasActive = streamRoi.active;
+    streamRoi = roi;
+    xSemaphoreGive(streamLock);
+
+    if (roi.sensorWindow)
+    {
+        // Mode 0 = OV2640 UXGA, offsets aur window usi ke pixels me, output DSP scale karta hai
+        s->set_res_raw(s, 0, 0, 0, 0, roi.x, roi.y, roi.w, roi.h, roi.outW, roi.outH, false, false);
+    }
+    else if (hadWindow && s)
+    {
+        s->set_framesize(s, framesizeLadder[streamController.ladder]); // Pura frame wapas
+    }
+
+    if (roi.active)
+        Serial.printf("ROI: %d,%d %dx%d scale %d (%s)\n", roi.x, roi.y, roi.w, roi.h, roi.scale,
+                      roi.sensorWindow ? "sensor window" : "software");
+    else if (wasActive)
+        Serial.println("ROI hata diya - pura frame");
+}
+
+static void clearStreamRoi()
+{
+    StreamRoi none = {};
+    applyStreamRoi(none);
+}
+
+// /roi?x=&y=&w=&h=&scale= - window set karke wahi stream bhejta hai (x/y/w/h sensor ke UXGA
+// pixels me, scale 1/2/4/8). Bina w/h ke pura frame wapas. Sab viewers ko yahi window dikhta hai.
+esp_err_t roi_handler(httpd_req_t *req)
+{
+    char query[96] = {0};
+    StreamRoi roi = {};
+    roi.scale = 1;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK)
+    {
+        roi.x = queryInt(query, "x", 0);
+        roi.y = queryInt(query, "y", 0);
+        roi.w = queryInt(query, "w", 0);
+        roi.h = queryInt(query, "h", 0);
+        roi.scale = queryInt(query, "scale", 1);
+    }
+
+    if (roi.w > 0 && roi.h > 0)
+    {
+        if (!prepareStreamRoi(&roi))
         {
-            res = httpd_resp_send_chunk(req, (const char *)_jpg_buf, _jpg_buf_len);
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Galat ROI - x/y/w/h 1600x1200 ke andar, scale 1/2/4/8");
+            return ESP_FAIL;
         }
+        applyStreamRoi(roi);
+    }
+    else
+    {
+        clearStreamRoi();
+    }
+    return stream_handler(req);
+}
+
+// Big-endian - packet header src/audio_packet.h jaisa
+static void putBigEndian(uint8_t *out, uint32_t value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; i--, value >>= 8)
+        out[i] = value & 0xFF;
+}
+
+// Slot ka frame relay packet me copy - slot turant wapas, bhejna slot ke bina hota hai.
+// seq broadcaster ka frame number hai, to beech me chhode frames relay ko gap dikhte hain.
+static bool buildUplinkPacket(const FrameSlot *slot)
+{
+    JpegPool *pool = &relayUplink.packet;
+    if (jpegPoolWrite(pool, UPLINK_JPEG_OFFSET, slot->jpeg.buf, slot->jpeg.len) != slot->jpeg.len)
+        return false;
+
+    uint8_t *packet = pool->buf + WEBSOCKETS_MAX_HEADER_SIZE;
+    uint8_t *payload = packet + PACKET_HEADER_SIZE;
+    putBigEndian(payload, slot->width, 2);
+    putBigEndian(payload + 2, slot->height, 2);
+    payload[4] = slot->quality;
+    payload[5] = payload[6] = payload[7] = 0;
+    size_t payloadBytes = VIDEO_HEADER_SIZE + slot->jpeg.len;
+
+    packet[0] = PACKET_HEADER_MAGIC_V2;
+    packet[1] = PACKET_TYPE_VIDEO;
+    putBigEndian(packet + 2, slot->seq & 0xFFFF, 2);
+    putBigEndian(packet + 4, 0, 4); // samples aur purana checksum - video me 0
+    packet[8] = PACKET_HEADER_VERSION;
+    packet[9] = PACKET_HEADER_SIZE;
+    packet[10] = PACKET_FLAG_CRC32;
+    packet[11] = PACKET_RATE_16000;
+    putBigEndian(packet + 12, (uint32_t)(slot->timestampUs * VIDEO_CLOCK_HZ / 1000000), 4);
+    putBigEndian(packet + 16, esp_rom_crc32_le(0, payload, payloadBytes), 4);
+    return true;
+}
+
+// Relay ka "video" command - {"command":"video","enabled":true,"fps":15,"quality":12}, sab optional
+static void handleRelayCommand(const uint8_t *payload, size_t length)
+{
+    StaticJsonDocument<256> doc;
+    if (deserializeJson(doc, (const char *)payload, length) || strcmp(doc["command"] | "", "video") != 0)
+        return;
+
+    bool ok = true;
+    if (doc.containsKey("enabled"))
+    {
+        relayUplink.enabled = doc["enabled"] | false;
+        xTaskNotifyGive(broadcasterTask);
+    }
+    int fps = doc["fps"] | 0;
+    if (fps >= 1 && fps <= 30)
+        streamController.targetFps = fps;
+    else if (fps != 0)
+        ok = false;
+    int quality = doc["quality"] | 0;
+    sensor_t *s = esp_camera_sensor_get();
+    if (quality >= 4 && quality <= 63 && s)
+    {
+        s->set_quality(s, quality);
+        streamController.bestQuality = quality; // /control?var=quality jaisa
+        streamController.quality = quality;
+    }
+    else if (quality != 0)
+        ok = false;
+
+    char reply[192];
+    snprintf(reply, sizeof(reply),
+             "{\"type\":\"video\",\"ok\":%s,\"enabled\":%s,\"fps\":%d,\"quality\":%d,\"frames\":%u,\"drops\":%u}",
+             ok ? "true" : "false", relayUplink.enabled ? "true" : "false", streamController.targetFps,
+             streamController.quality, relayUplink.framesSent, relayUplink.framesDropped);
+    relaySocket.sendTXT(reply);
+}
 
-        if (fb)
+static void relayEvent(WStype_t type, uint8_t *payload, size_t length)
+{
+    switch (type)
+    {
+    case WStype_CONNECTED:
+    {
+        // Relay ko batate hain ki ye device hai - browsers isi ID ko subscribe karte hain
+        uint64_t mac = ESP.getEfuseMac();
+        char hello[96];
+        snprintf(hello, sizeof(hello), "{\"type\":\"hello\",\"client\":\"esp32\",\"device\":\"ESP32-CAM\",\"id\":\"%06llx\"}",
+                 (unsigned long long)((mac >> 24) & 0xFFFFFF));
+        relaySocket.sendTXT(hello);
+        relayUplink.connected = true;
+        relayUplink.sendMs = 0;
+        relayUplink.bytesPerSec = 0;
+        xTaskNotifyGive(broadcasterTask);
+        Serial.printf("Relay uplink %s:%d se juda\n", RELAY_HOST, RELAY_PORT);
+        break;
+    }
+    case WStype_DISCONNECTED:
+        if (relayUplink.connected)
+            Serial.printf("Relay uplink toota: %u frames bheje, %u chhode\n", relayUplink.framesSent,
+                          relayUplink.framesDropped);
+        relayUplink.connected = false;
+        break;
+    case WStype_TEXT:
+        handleRelayCommand(payload, length);
+        break;
+    default:
+        break;
+    }
+}
+
+// Uplink task - WebSocket ko chalata hai aur har naya frame ek baar relay ko bhejta hai.
+// Bhejte waqt naye frames aa jayein to sirf sabse naya jata hai, LAN viewers jaisa.
+void relayUplinkLoop(void *parameter)
+{
+    uint32_t lastSeq = 0;
+    while (true)
+    {
+        relaySocket.loop();
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(10)); // Naya frame, ya socket ka agla poll
+        if (!relayUplink.connected || !relayUplink.enabled)
+            continue;
+
+        xSemaphoreTake(streamLock, portMAX_DELAY);
+        FrameSlot *slot = latestSlot;
+        if (slot && slot->seq != lastSeq)
+            slot->refs++;
+        else
+            slot = NULL;
+        xSemaphoreGive(streamLock);
+        if (!slot)
+            continue;
+
+        if (lastSeq != 0 && slot->seq > lastSeq + 1)
+            relayUplink.framesDropped += slot->seq - lastSeq - 1;
+        lastSeq = slot->seq;
+        bool built = buildUplinkPacket(slot);
+
+        xSemaphoreTake(streamLock, portMAX_DELAY);
+        slot->refs--;
+        xSemaphoreGive(streamLock);
+        if (!built)
         {
-            esp_camera_fb_return(fb);
-            fb = NULL;
-            _jpg_buf = NULL;
+            Serial.println("Uplink packet ke liye PSRAM nahi");
+            continue;
         }
 
-        if (res != ESP_OK)
-            break;
+        // sendBIN packet ke aage wali jagah me WebSocket header likhta hai - copy nahi
+        size_t packetBytes = relayUplink.packet.len - WEBSOCKETS_MAX_HEADER_SIZE;
+        int64_t sendStart = esp_timer_get_time();
+        if (relaySocket.sendBIN(relayUplink.packet.buf, packetBytes, true))
+        {
+            recordSendTime(&relayUplink.sendMs, &relayUplink.bytesPerSec, packetBytes, sendStart);
+            relayUplink.framesSent++;
+        }
     }
+}
 
-    return res;
+// Relay uplink shuru - broadcaster ke baad, WiFi judne par khud connect/reconnect karta hai
+bool startRelayUplink()
+{
+#if RELAY_USE_TLS
+    relaySocket.beginSSL(RELAY_HOST, RELAY_PORT, RELAY_PATH);
+#else
+    relaySocket.begin(RELAY_HOST, RELAY_PORT, RELAY_PATH);
+#endif
+    relaySocket.onEvent(relayEvent);
+    relaySocket.setReconnectInterval(RELAY_RECONNECT_MS);
+    relaySocket.enableHeartbeat(15000, 3000, 2); // Mara hua link jaldi pakad mein aaye
+    return xTaskCreatePinnedToCore(relayUplinkLoop, "RelayUplink", UPLINK_TASK_STACK, NULL,
+                                   UPLINK_TASK_PRIORITY, &relayUplink.task, UPLINK_TASK_CORE) == pdPASS;
+}
+
+// Fan-out shuru karte hain - startWebServer se pehle
+bool startStreamBroadcaster()
+{
+    streamLock = xSemaphoreCreateMutex();
+    if (!streamLock)
+        return false;
+    return xTaskCreatePinnedToCore(broadcasterLoop, "StreamBroadcast", 4096, NULL,
+                                   BROADCAST_TASK_PRIORITY, &broadcasterTask, BROADCAST_TASK_CORE) == pdPASS;
 }
 
 esp_err_t cmd_handler(httpd_req_t *req)
@@ -276,17 +1173,65 @@ esp_err_t cmd_handler(httpd_req_t *req)
 
     if (!strcmp(variable, "framesize"))
     {
+        clearStreamRoi(); // Naya framesize sensor window ko waise bhi mita deta hai
         if (s->pixformat == PIXFORMAT_JPEG)
             s->set_framesize(s, (framesize_t)val);
+
+        // Controller ki upper limit bhi yahi - seedhi me sabse kareeb wala step
+        int ladder = 0;
+        for (int i = 0; i < (int)FRAMESIZE_LADDER_COUNT; i++)
+        {
+            if (framesizeLadder[i] <= (framesize_t)val)
+                ladder = i;
+        }
+        streamController.bestLadder = ladder;
+        streamController.ladder = ladder;
     }
     else if (!strcmp(variable, "quality"))
+    {
         s->set_quality(s, val);
+        streamController.bestQuality = val; // Controller isse behtar nahi karega
+        streamController.quality = val;
+    }
+    else if (!strcmp(variable, "roi"))
+    {
+        if (val == 0)
+            clearStreamRoi();
+    }
+    else if (!strcmp(variable, "uplink"))
+    {
+        relayUplink.enabled = val != 0;
+        xTaskNotifyGive(broadcasterTask);
+    }
+    else if (!strcmp(variable, "adaptive"))
+        streamController.enabled = val != 0;
+    else if (!strcmp(variable, "target_fps"))
+    {
+        if (val >= 1 && val <= 30)
+            streamController.targetFps = val;
+    }
+    else if (!strcmp(variable, "target_kbps"))
+    {
+        if (val >= 0)
+            streamController.targetKbps = val;
+    }
     else if (!strcmp(variable, "contrast"))
         s->set_contrast(s, val);
     else if (!strcmp(variable, "brightness"))
         s->set_brightness(s, val);
     else if (!strcmp(variable, "saturation"))
         s->set_saturation(s, val);
+    else if (!strcmp(variable, "pixformat"))
+    {
+        // YUV/RGB chahiye to sensor switch karte hain - stream tab software encoding par chala jata hai.
+        // 0 = JPEG (default), 1 = YUV422, 2 = RGB565
+        static const pixformat_t formats[] = {PIXFORMAT_JPEG, PIXFORMAT_YUV422, PIXFORMAT_RGB565};
+        if (val >= 0 && val < 3)
+        {
+            clearStreamRoi(); // Window JPEG mode ke hisaab se tha
+            s->set_pixformat(s, formats[val]);
+        }
+    }
     else if (!strcmp(variable, "flash"))
     {
         digitalWrite(FLASH_LED, !digitalRead(FLASH_LED));
@@ -296,9 +1241,123 @@ esp_err_t cmd_handler(httpd_req_t *req)
     return httpd_resp_send(req, NULL, 0);
 }
 
-// Web server start karne ka function
+// Cache me naya frame - JPEG ho to copy, warna ek baar software encode
+static bool refreshCaptureCache()
+{
+    camera_fb_t *fb = esp_camera_fb_get();
+    if (!fb)
+        return false;
+
+    JpegPool *pool = &captureCache.jpeg;
+    pool->overflow = false;
+    bool ok;
+    if (fb->format == PIXFORMAT_JPEG)
+        ok = jpegPoolWrite(pool, 0, fb->buf, fb->len) == fb->len;
+    else
+        ok = frame2jpg_cb(fb, SOFT_JPEG_QUALITY, jpegPoolWrite, pool) && !pool->overflow;
+    int64_t frameUs = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    esp_camera_fb_return(fb);
+    if (!ok)
+    {
+        captureCache.timestampUs = 0;
+        return false;
+    }
+
+    // Boot id ETag me - reboot ke baad purana ETag galti se match na ho
+    static uint32_t bootId = esp_random();
+    captureCache.timestampUs = frameUs ? frameUs : esp_timer_get_time();
+    captureCache.seq++;
+    snprintf(captureCache.etag, sizeof(captureCache.etag), "\"%08x-%u\"", bootId, captureCache.seq);
+    return true;
+}
+
+// /capture?maxAge=ms - cache ka frame agar itna taaza ho, warna sensor se naya.
+// If-None-Match cache ke ETag se mile to 304, body nahi.
+esp_err_t capture_handler(httpd_req_t *req)
+{
+    char query[32] = {0};
+    int maxAgeMs = CAPTURE_DEFAULT_MAX_AGE_MS;
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK)
+    {
+        maxAgeMs = queryInt(query, "maxAge", maxAgeMs);
+        maxAgeMs = constrain(maxAgeMs, 0, CAPTURE_MAX_AGE_LIMIT_MS);
+    }
+
+    int64_t ageUs = esp_timer_get_time() - captureCache.timestampUs;
+    if (captureCache.timestampUs == 0 || ageUs > maxAgeMs * 1000LL)
+    {
+        if (!refreshCaptureCache())
+        {
+            Serial.println("Camera capture failed");
+            httpd_resp_send_500(req);
+            return ESP_FAIL;
+        }
+        captureMisses++;
+        ageUs = esp_timer_get_time() - captureCache.timestampUs;
+    }
+    else
+    {
+        captureHits++;
+    }
+
+    char age[16];
+    snprintf(age, sizeof(age), "%lld", (long long)(ageUs / 1000));
+    httpd_resp_set_hdr(req, "ETag", captureCache.etag);
+    httpd_resp_set_hdr(req, "Cache-Control", "no-cache"); // Browser har baar ETag ke saath puchhe
+    httpd_resp_set_hdr(req, "X-Frame-Age", age);
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+
+    if (etagMatches(req, captureCache.etag))
+    {
+        httpd_resp_set_status(req, "304 Not Modified");
+        return httpd_resp_send(req, NULL, 0);
+    }
+
+    httpd_resp_set_type(req, "image/jpeg");
+    httpd_resp_set_hdr(req, "Content-Disposition", "inline; filename=capture.jpg");
+    return httpd_resp_send(req, (const char *)captureCache.jpeg.buf, captureCache.jpeg.len);
+}
+
+// /flash - flash LED toggle, nayi state wapas
+esp_err_t flash_handler(httpd_req_t *req)
+{
+    digitalWrite(FLASH_LED, !digitalRead(FLASH_LED));
+    httpd_resp_set_type(req, "text/plain");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    return httpd_resp_send(req, digitalRead(FLASH_LED) ? "on" : "off", HTTPD_RESP_USE_STRLEN);
+}
+
+// /status - page har 5 second me isse dikhata hai
+esp_err_t status_handler(httpd_req_t *req)
+{
+    char status[400];
+    snprintf(status, sizeof(status),
+             "Uptime: %lu s | WiFi: %d dBm | Free heap: %u | Free PSRAM: %u<br>"
+             "Viewers: %d | Frames: %u | Dropped: %u | ROI: %s | Capture cache: %u hit / %u miss | Flash: %s<br>"
+             "Relay: %s | Sent: %u | Skipped: %u",
+             millis() / 1000, WiFi.RSSI(), ESP.getFreeHeap(), ESP.getFreePsram(),
+             streamClientCount, broadcastFrames, broadcastDrops,
+             !streamRoi.active ? "off" : streamRoi.sensorWindow ? "sensor" : "software", captureHits, captureMisses,
+             digitalRead(FLASH_LED) ? "on" : "off",
+             !relayUplink.enabled ? "off" : relayUplink.connected ? "connected" : "connecting",
+             relayUplink.framesSent, relayUplink.framesDropped);
+    httpd_resp_set_type(req, "text/html");
+    httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*");
+    return httpd_resp_send(req, status, HTTPD_RESP_USE_STRLEN);
+}
+
+// Web server start karne ka function - control aur stream do alag httpd instances
 void startWebServer()
 {
+    if (!broadcasterTask && !startStreamBroadcaster())
+    {
+        Serial.println("Stream broadcaster start nahi ho paya");
+        return;
+    }
+    if (RELAY_UPLINK && !relayUplink.task && !startRelayUplink())
+        Serial.println("Relay uplink start nahi ho paya");
+
+    // Control server - port 80, chhote requests, default worker
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.server_port = 80;
 
@@ -308,25 +1367,66 @@ void startWebServer()
         .handler = index_handler,
         .user_ctx = NULL};
 
-    httpd_uri_t stream_uri = {
-        .uri = "/stream",
-        .method = HTTP_GET,
-        .handler = stream_handler,
-        .user_ctx = NULL};
-
     httpd_uri_t cmd_uri = {
         .uri = "/control",
         .method = HTTP_GET,
         .handler = cmd_handler,
         .user_ctx = NULL};
 
+    httpd_uri_t capture_uri = {
+        .uri = "/capture",
+        .method = HTTP_GET,
+        .handler = capture_handler,
+        .user_ctx = NULL};
+
+    httpd_uri_t flash_uri = {
+        .uri = "/flash",
+        .method = HTTP_GET,
+        .handler = flash_handler,
+        .user_ctx = NULL};
+
+    httpd_uri_t status_uri = {
+        .uri = "/status",
+        .method = HTTP_GET,
+        .handler = status_handler,
+        .user_ctx = NULL};
+
     if (httpd_start(&camera_httpd, &config) == ESP_OK)
     {
         httpd_register_uri_handler(camera_httpd, &index_uri);
-        httpd_register_uri_handler(camera_httpd, &stream_uri);
         httpd_register_uri_handler(camera_httpd, &cmd_uri);
+        httpd_register_uri_handler(camera_httpd, &capture_uri);
+        httpd_register_uri_handler(camera_httpd, &flash_uri);
+        httpd_register_uri_handler(camera_httpd, &status_uri);
         Serial.println("Web server successfully started");
     }
+
+    // Stream server - port 81, apna task, alag core. Dono instances ke ctrl_port alag hone chahiye.
+    httpd_config_t stream_config = HTTPD_DEFAULT_CONFIG();
+    stream_config.server_port = STREAM_PORT;
+    stream_config.ctrl_port = config.ctrl_port + 1;
+    stream_config.core_id = STREAM_SERVER_CORE;
+    stream_config.task_priority = STREAM_SERVER_PRIORITY;
+    stream_config.max_open_sockets = MAX_STREAM_CLIENTS + 1; // Viewers ke sockets khule rehte hain
+
+    httpd_uri_t stream_uri = {
+        .uri = "/stream",
+        .method = HTTP_GET,
+        .handler = stream_handler,
+        .user_ctx = NULL};
+
+    httpd_uri_t roi_uri = {
+        .uri = "/roi",
+        .method = HTTP_GET,
+        .handler = roi_handler,
+        .user_ctx = NULL};
+
+    if (httpd_start(&stream_httpd, &stream_config) == ESP_OK)
+    {
+        httpd_register_uri_handler(stream_httpd, &stream_uri);
+        httpd_register_uri_handler(stream_httpd, &roi_uri);
+        Serial.printf("Stream server port %d par start ho gaya\n", STREAM_PORT);
+    }
 }
 
 // ... rest of the previous level's code ...
\ No newline at end of file
@@ -0,0 +1,255 @@
+/**
+ * Relay backplane - moves packets, commands and status between relay processes
+ *
+ * One relay process only knows its own sockets. With RELAY_WORKERS > 1 the
+ * cluster primary forks workers that share the HTTP and UDP ports, and with
+ * REDIS_URL several nodes share a Redis server. Either way a device and the
+ * browsers subscribed to it can end up in different processes, so each process
+ * publishes what it receives and the backplane delivers it to the others:
+ *
+ *   "packet"  (deviceId, data)    - validated audio/silence packets, only to
+ *                                   processes with a subscriber for the device
+ *   "command" (device, command)   - browser commands for ESP32s elsewhere
+ *   "status"  (origin, status)    - per-process counters for the aggregate status
+ *
+ * Interest is the set of device IDs (or "*") this process has subscribers for;
+ * packets for other devices are not sent to it at all.
+ */
+
+const cluster = require("cluster");
+const crypto = require("crypto");
+const { EventEmitter } = require("events");
+
+const SUBSCRIBE_ALL = "*";
+const REDIS_PREFIX = process.env.REDIS_PREFIX || "relay";
+const ORIGIN_SIZE = 8; // Random per-process ID in front of Redis payloads
+
+// Single process: nothing to share
+class LocalBackplane extends EventEmitter {
+  constructor() {
+    super();
+    this.origin = crypto.randomBytes(ORIGIN_SIZE).toString("hex");
+    this.kind = "local";
+  }
+
+  setInterest(deviceIds) {}
+  publishPacket(deviceId, data) {}
+  publishCommand(device, command) {}
+  publishStatus(status) {}
+  close() {}
+}
+
+// Cluster worker: the primary routes everything over IPC, see runClusterPrimary()
+class ClusterBackplane extends LocalBackplane {
+  constructor() {
+    super();
+    this.kind = `cluster worker ${cluster.worker.id}`;
+    this.onMessage = (message) => {
+      if (!message || !message.bp) {
+        return;
+      }
+      if (message.bp === "packet") {
+        const { data } = message; // A Uint8Array after the structured clone
+        this.emit(
+          "packet",
+          message.deviceId,
+          Buffer.isBuffer(data)
+            ? data
+            : Buffer.from(data.buffer, data.byteOffset, data.byteLength)
+        );
+      } else if (message.bp === "command") {
+        this.emit("command", message.device, message.command);
+      } else if (message.bp === "status") {
+        this.emit("status", message.origin, message.status);
+      }
+    };
+    process.on("message", this.onMessage);
+  }
+
+  setInterest(deviceIds) {
+    process.send({ bp: "interest", deviceIds });
+  }
+
+  publishPacket(deviceId, data) {
+    process.send({ bp: "packet", deviceId, data });
+  }
+
+  publishCommand(device, command) {
+    process.send({ bp: "command", device, command });
+  }
+
+  publishStatus(status) {
+    process.send({ bp: "status", origin: this.origin, status });
+  }
+
+  close() {
+    process.off("message", this.onMessage);
+  }
+}
+
+// Several nodes: one channel per device, subscribed only while we have interest
+class RedisBackplane extends LocalBackplane {
+  constructor(redis, url) {
+    super();
+    this.kind = "redis";
+    this.originBytes = Buffer.from(this.origin, "hex");
+    this.interest = new Set();
+    this.pub = redis.createClient({ url });
+    this.sub = this.pub.duplicate();
+    this.onPacket = (message, channel) => {
+      if (message.subarray(0, ORIGIN_SIZE).equals(this.originBytes)) {
+        return; // Our own publication
+      }
+      const deviceId = channel.toString().slice(`${REDIS_PREFIX}:audio:`.length);
+      if (this.interest.has(SUBSCRIBE_ALL) || this.interest.has(deviceId)) {
+        this.emit("packet", deviceId, message.subarray(ORIGIN_SIZE));
+      }
+    };
+    this.pub.on("error", (error) => this.emit("error", error));
+    this.sub.on("error", (error) => this.emit("error", error));
+    this.ready = Promise.all([this.pub.connect(), this.sub.connect()]).then(() =>
+      Promise.all([
+        this.sub.subscribe(`${REDIS_PREFIX}:command`, (message) => {
+          const { origin, device, command } = JSON.parse(message);
+          if (origin !== this.origin) {
+            this.emit("command", device, command);
+          }
+        }),
+        this.sub.subscribe(`${REDIS_PREFIX}:status`, (message) => {
+          const { origin, status } = JSON.parse(message);
+          if (origin !== this.origin) {
+            this.emit("status", origin, status);
+          }
+        }),
+      ])
+    );
+    this.ready.catch((error) => this.emit("error", error));
+  }
+
+  // "*" is one pattern subscription; specific devices are one channel each
+  setInterest(deviceIds) {
+    const next = new Set(deviceIds);
+    this.ready.then(() => {
+      for (const id of this.interest) {
+        if (!next.has(id)) {
+          if (id === SUBSCRIBE_ALL) {
+            this.sub.pUnsubscribe(`${REDIS_PREFIX}:audio:*`);
+          } else {
+            this.sub.unsubscribe(`${REDIS_PREFIX}:audio:${id}`);
+          }
+        }
+      }
+      for (const id of next) {
+        if (!this.interest.has(id)) {
+          if (id === SUBSCRIBE_ALL) {
+            this.sub.pSubscribe(`${REDIS_PREFIX}:audio:*`, this.onPacket, true);
+          } else {
+            this.sub.subscribe(`${REDIS_PREFIX}:audio:${id}`, this.onPacket, true);
+          }
+        }
+      }
+      this.interest = next;
+    });
+  }
+
+  publishPacket(deviceId, data) {
+    if (this.pub.isReady) {
+      this.pub.publish(
+        `${REDIS_PREFIX}:audio:${deviceId}`,
+        Buffer.concat([this.originBytes, data])
+      );
+    }
+  }
+
+  publishCommand(device, command) {
+    if (this.pub.isReady) {
+      this.pub.publish(
+        `${REDIS_PREFIX}:command`,
+        JSON.stringify({ origin: this.origin, device, command })
+      );
+    }
+  }
+
+  publishStatus(status) {
+    if (this.pub.isReady) {
+      this.pub.publish(
+        `${REDIS_PREFIX}:status`,
+        JSON.stringify({ origin: this.origin, status })
+      );
+    }
+  }
+
+  close() {
+    this.sub.quit().catch(() => {});
+    this.pub.quit().catch(() => {});
+  }
+}
+
+// Redis when REDIS_URL is set (needs `npm install redis`), the cluster primary
+// in a worker, otherwise nothing
+function createBackplane() {
+  const url = process.env.REDIS_URL;
+  if (url) {
+    let redis;
+    try {
+      redis = require("redis");
+    } catch (error) {
+      throw new Error("REDIS_URL is set but the redis package is not installed");
+    }
+    return new RedisBackplane(redis, url);
+  }
+  if (cluster.isWorker) {
+    return new ClusterBackplane();
+  }
+  return new LocalBackplane();
+}
+
+// Cluster primary: fork the workers (they share the listening ports) and route
+// backplane messages between them. Packets only go to workers whose interest
+// covers the device; a worker that dies is replaced.
+function runClusterPrimary(workers, log) {
+  const interest = new Map(); // worker id -> Set of device IDs
+
+  // Structured clone carries Buffers over IPC without a JSON round trip
+  cluster.setupPrimary({ serialization: "advanced" });
+
+  const fork = () => {
+    const worker = cluster.fork();
+    interest.set(worker.id, new Set());
+    worker.on("message", (message) => {
+      if (!message || !message.bp) {
+        return;
+      }
+      if (message.bp === "interest") {
+        interest.set(worker.id, new Set(message.deviceIds));
+        return;
+      }
+      for (const id in cluster.workers) {
+        const other = cluster.workers[id];
+        if (!other || other === worker || !other.isConnected()) {
+          continue;
+        }
+        if (message.bp === "packet") {
+          const wants = interest.get(other.id);
+          if (!wants || (!wants.has(SUBSCRIBE_ALL) && !wants.has(message.deviceId))) {
+            continue;
+          }
+        }
+        other.send(message);
+      }
+    });
+  };
+
+  cluster.on("exit", (worker, code, signal) => {
+    interest.delete(worker.id);
+    log(`Relay worker ${worker.id} exited (${signal || code}), restarting`);
+    fork();
+  });
+
+  log(`Relay cluster: starting ${workers} workers`);
+  for (let i = 0; i < workers; i++) {
+    fork();
+  }
+}
+
+module.exports = { createBackplane, runClusterPrimary, SUBSCRIBE_ALL };
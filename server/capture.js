@@ -0,0 +1,209 @@
+/**
+ * Traffic capture - the relay's inbound frames on disk, for replay.js
+ *
+ * Enabled with CAPTURE_FILE. Every frame a client or UDP source sends is
+ * logged with its arrival time before the relay looks at it, plus the opening
+ * and closing of each connection. The capture is raw traffic, so changes to
+ * packet handling, fan-out or the reorder buffer can be measured against what
+ * a real fleet sent. A clustered relay writes one file per worker,
+ * CAPTURE_FILE.<worker id>. Capture stops at CAPTURE_MAX_MB.
+ *
+ * File, little-endian (unlike the packets) so it maps straight onto a C struct:
+ *   File header (16 bytes):
+ *     0  char[4] "RCAP"
+ *     4  u16     CAPTURE_VERSION
+ *     6  u16     record header size (24)
+ *     8  f64     wall clock at the start, ms since the epoch
+ *   Record (24-byte header, data padded to a multiple of 8 so every header
+ *   stays 8-byte aligned):
+ *     0  f64     arrival, ms since the start (performance.now())
+ *     8  u32     connection, numbered from 1 in order of arrival
+ *    12  u32     data length, before padding
+ *    16  u8      kind
+ *    17  u8[7]   reserved
+ *    24  data
+ *
+ * Kinds:
+ *   KIND_OPEN    data: JSON {transport: "ws" | "udp", address, userAgent}
+ *   KIND_CLOSE   no data
+ *   KIND_BINARY  WebSocket binary frame
+ *   KIND_TEXT    WebSocket text frame (UTF-8)
+ *   KIND_UDP     UDP datagram
+ * A UDP source gets a KIND_OPEN with its first datagram and no KIND_CLOSE.
+ *
+ * Writes go through the recorder's SegmentWriter, flushed every
+ * CAPTURE_FLUSH_MS so a crash loses at most that much, and SIGINT or SIGTERM
+ * closes the file before the relay exits.
+ */
+
+const fs = require("fs");
+const cluster = require("cluster");
+const { SegmentWriter } = require("./recorder");
+
+const CAPTURE_MAGIC = "RCAP";
+const CAPTURE_VERSION = 1;
+const FILE_HEADER_SIZE = 16;
+const RECORD_HEADER_SIZE = 24;
+const KIND_OPEN = 1;
+const KIND_CLOSE = 2;
+const KIND_BINARY = 3;
+const KIND_TEXT = 4;
+const KIND_UDP = 5;
+const CAPTURE_FLUSH_MS = 1000;
+const READ_CHUNK_BYTES = 4 * 1024 * 1024;
+
+const CAPTURE_FILE = process.env.CAPTURE_FILE || "";
+const CAPTURE_MAX_BYTES = parseInt(process.env.CAPTURE_MAX_MB || "1024", 10) * 1024 * 1024;
+
+let writer = null;
+let startedAt = 0;
+let nextConnection = 1;
+let flushTimer = null;
+const stats = { records: 0, bytes: 0 };
+
+const padded = (length) => (length + 7) & ~7;
+
+// Start capturing if CAPTURE_FILE is set; the relay calls this in each worker
+function start() {
+  if (CAPTURE_FILE === "" || writer) {
+    return;
+  }
+  const file = cluster.isWorker ? `${CAPTURE_FILE}.${cluster.worker.id}` : CAPTURE_FILE;
+  writer = new SegmentWriter(file);
+  startedAt = performance.now();
+  const header = Buffer.alloc(FILE_HEADER_SIZE);
+  header.write(CAPTURE_MAGIC, 0, "latin1");
+  header.writeUInt16LE(CAPTURE_VERSION, 4);
+  header.writeUInt16LE(RECORD_HEADER_SIZE, 6);
+  header.writeDoubleLE(performance.timeOrigin + startedAt, 8);
+  writer.append(header);
+  flushTimer = setInterval(() => writer && writer.flush(), CAPTURE_FLUSH_MS);
+  flushTimer.unref();
+  // Ctrl-C is the usual way to end a capture
+  process.once("SIGINT", () => close().then(() => process.exit(130)));
+  process.once("SIGTERM", () => close().then(() => process.exit(143)));
+  console.log(`Capturing inbound traffic to ${file}`);
+}
+
+function append(connection, kind, data) {
+  if (!writer) {
+    return;
+  }
+  const length = data ? data.length : 0;
+  if (writer.offset + RECORD_HEADER_SIZE + length > CAPTURE_MAX_BYTES) {
+    console.log(`Capture reached CAPTURE_MAX_MB after ${stats.records} records - stopped`);
+    close();
+    return;
+  }
+  const header = Buffer.alloc(RECORD_HEADER_SIZE + padded(length) - length);
+  header.writeDoubleLE(performance.now() - startedAt, 0);
+  header.writeUInt32LE(connection, 8);
+  header.writeUInt32LE(length, 12);
+  header[16] = kind;
+  writer.append(header.subarray(0, RECORD_HEADER_SIZE));
+  if (length > 0) {
+    writer.append(data);
+    writer.append(header.subarray(RECORD_HEADER_SIZE)); // Zero padding
+  }
+  stats.records++;
+  stats.bytes += length;
+}
+
+// New connection or UDP source; returns its capture ID, 0 while not capturing
+function open(transport, address, userAgent = "") {
+  if (!writer) {
+    return 0;
+  }
+  const connection = nextConnection++;
+  append(connection, KIND_OPEN, Buffer.from(JSON.stringify({ transport, address, userAgent })));
+  return connection;
+}
+
+function frame(connection, kind, data) {
+  if (connection) {
+    append(connection, kind, typeof data === "string" ? Buffer.from(data) : data);
+  }
+}
+
+function closeConnection(connection) {
+  if (connection) {
+    append(connection, KIND_CLOSE, null);
+  }
+}
+
+function close() {
+  if (!writer) {
+    return Promise.resolve();
+  }
+  clearInterval(flushTimer);
+  const closing = writer.close();
+  writer = null;
+  console.log(`Capture closed: ${stats.records} records, ${stats.bytes} bytes of frames`);
+  return closing;
+}
+
+// Records of a capture file in order, read in chunks so a capture larger
+// than memory still replays: { time, connection, kind, data }
+function* readCapture(file) {
+  const fd = fs.openSync(file, "r");
+  try {
+    const header = Buffer.alloc(FILE_HEADER_SIZE);
+    if (
+      fs.readSync(fd, header, 0, FILE_HEADER_SIZE, 0) !== FILE_HEADER_SIZE ||
+      header.toString("latin1", 0, 4) !== CAPTURE_MAGIC ||
+      header.readUInt16LE(4) !== CAPTURE_VERSION
+    ) {
+      throw new Error(`${file} is not a version ${CAPTURE_VERSION} capture`);
+    }
+    const recordHeaderSize = header.readUInt16LE(6);
+    let position = FILE_HEADER_SIZE;
+    let buffer = Buffer.alloc(0);
+    let offset = 0;
+    // Make sure `needed` bytes are buffered from offset; false at end of file
+    const fill = (needed) => {
+      while (buffer.length - offset < needed) {
+        const chunk = Buffer.allocUnsafe(Math.max(READ_CHUNK_BYTES, needed));
+        const read = fs.readSync(fd, chunk, 0, chunk.length, position);
+        if (read === 0) {
+          return false;
+        }
+        position += read;
+        buffer = Buffer.concat([buffer.subarray(offset), chunk.subarray(0, read)]);
+        offset = 0;
+      }
+      return true;
+    };
+    while (fill(recordHeaderSize)) {
+      const time = buffer.readDoubleLE(offset);
+      const connection = buffer.readUInt32LE(offset + 8);
+      const length = buffer.readUInt32LE(offset + 12);
+      const kind = buffer[offset + 16];
+      if (!fill(recordHeaderSize + padded(length))) {
+        return; // Cut short by a crash or CAPTURE_MAX_MB
+      }
+      const start = offset + recordHeaderSize;
+      const data = buffer.subarray(start, start + length);
+      offset = start + padded(length);
+      yield { time, connection, kind, data };
+    }
+  } finally {
+    fs.closeSync(fd);
+  }
+}
+
+module.exports = {
+  get enabled() {
+    return writer !== null;
+  },
+  start,
+  open,
+  frame,
+  closeConnection,
+  close,
+  readCapture,
+  KIND_OPEN,
+  KIND_CLOSE,
+  KIND_BINARY,
+  KIND_TEXT,
+  KIND_UDP,
+};
@@ -0,0 +1,131 @@
+/**
+ * Latency measurement mode - clock sync and per-device latency, see
+ * src/clock_sync.h for the device's half
+ *
+ * While a browser has the mode on, the relay probes each of its devices every
+ * CLOCK_SYNC_INTERVAL_MS with an NTP-style exchange:
+ *   t0 relay send, t1 device receive, t2 device send, t3 relay receive
+ *   offset = ((t1 - t0) + (t2 - t3)) / 2, round trip = (t3 - t0) - (t2 - t1)
+ * The estimate comes from the exchange with the lowest round trip of the
+ * last SYNC_SAMPLES, because queueing on the path only ever adds delay. Browsers
+ * sync to the relay the same way, with the relay answering.
+ *
+ * The device's reply also carries a capture anchor: a sample clock value and
+ * its device time. Together with the offset, this puts any packet's header
+ * timestamp (its capture stamp) on the relay clock, which is the wall clock in
+ * milliseconds (relayNow()).
+ */
+
+const SYNC_SAMPLES = 8;
+
+// Relay clock: epoch milliseconds with sub-millisecond resolution, monotonic
+// within a process
+function relayNow() {
+  return performance.timeOrigin + performance.now();
+}
+
+class ClockSync {
+  constructor() {
+    this.samples = []; // { offset, rtt } of the last SYNC_SAMPLES exchanges
+    this.offsetMs = null; // Remote clock minus ours
+    this.rttMs = null;
+  }
+
+  // One completed exchange; false if the times are unusable
+  add(t0, t1, t2, t3) {
+    const rtt = t3 - t0 - (t2 - t1);
+    if (![t0, t1, t2, t3].every(Number.isFinite) || rtt < 0) {
+      return false;
+    }
+    this.samples.push({ offset: (t1 - t0 + (t2 - t3)) / 2, rtt });
+    if (this.samples.length > SYNC_SAMPLES) {
+      this.samples.shift();
+    }
+    const best = this.samples.reduce((a, b) => (b.rtt < a.rtt ? b : a));
+    this.offsetMs = best.offset;
+    this.rttMs = best.rtt;
+    return true;
+  }
+
+  // A time on the remote clock, on ours
+  toLocal(remoteMs) {
+    return remoteMs - this.offsetMs;
+  }
+}
+
+// One device: its clock, capture anchor and the latency of its packets at the
+// relay since the last report
+class DeviceLatency {
+  constructor() {
+    this.clock = new ClockSync();
+    this.anchor = null; // { sampleClock, time (relay ms), rate }
+    this.captureToSendMs = 0; // Device side, smoothed
+    this.resetWindow();
+  }
+
+  resetWindow() {
+    this.packets = 0;
+    this.uplinkSum = 0;
+    this.uplinkMax = 0;
+    this.relaySum = 0;
+  }
+
+  // The device's clock_sync reply, received at relay time t3
+  onReply(reply, t3) {
+    if (!this.clock.add(reply.t0, reply.t1, reply.t2, t3)) {
+      return false;
+    }
+    if (Number.isFinite(reply.sampleClock) && reply.rate > 0) {
+      this.anchor = {
+        sampleClock: reply.sampleClock >>> 0,
+        time: this.clock.toLocal(reply.sampleTime),
+        rate: reply.rate,
+      };
+    }
+    this.captureToSendMs = Number.isFinite(reply.sendMs) ? reply.sendMs : 0;
+    return true;
+  }
+
+  // Capture time of a packet's first sample on the relay clock, or null
+  captureTime(timestamp, sampleRate) {
+    const anchor = this.anchor;
+    if (!anchor || timestamp === null || sampleRate !== anchor.rate) {
+      return null;
+    }
+    // Signed 32-bit distance, so packets from before the anchor work too
+    return anchor.time + (((timestamp - anchor.sampleClock) | 0) * 1000) / anchor.rate;
+  }
+
+  // One forwarded packet: arrival and egress on the relay clock
+  observe(timestamp, sampleRate, arrivedAt, sentAt) {
+    const captured = this.captureTime(timestamp, sampleRate);
+    if (captured === null) {
+      return;
+    }
+    const uplink = Math.max(0, arrivedAt - captured - this.captureToSendMs);
+    this.packets++;
+    this.uplinkSum += uplink;
+    this.uplinkMax = Math.max(this.uplinkMax, uplink);
+    this.relaySum += sentAt - arrivedAt;
+  }
+
+  // The "latency" message for browsers; starts a new window
+  report(deviceId) {
+    const round = (value) => Math.round(value * 100) / 100;
+    const report = {
+      type: "latency",
+      device: deviceId,
+      anchor: this.anchor,
+      rttMs: round(this.clock.rttMs || 0),
+      captureToSendMs: round(this.captureToSendMs),
+      uplinkMs: this.packets ? round(this.uplinkSum / this.packets) : null,
+      uplinkMaxMs: this.packets ? round(this.uplinkMax) : null,
+      relayMs: this.packets ? round(this.relaySum / this.packets) : null,
+      packets: this.packets,
+    };
+    this.resetWindow();
+    return report;
+  }
+}
+
+module.exports = { ClockSync, DeviceLatency, relayNow };
@@ -0,0 +1,160 @@
+/**
+ * Per-device reorder buffer on the 16-bit packet sequence number
+ *
+ * Packets are released in sequence order. An in-order packet goes straight
+ * through, so a clean WebSocket stream gets no added latency. After a gap,
+ * later packets wait, at most `depth` of them and for at most `waitMs`, for
+ * the missing one to show up. Sequence numbers still missing after that are
+ * reported to onLost() (the relay conceals them) and the stream moves on.
+ *
+ * Counters (stats):
+ *   received   - packets pushed, duplicates included
+ *   lost       - sequence numbers given up on
+ *   reordered  - packets that arrived after a later one, but in time
+ *   late       - packets for a sequence number already given up on
+ *   duplicates - packets for a sequence number already released or buffered
+ *   resyncs    - jumps too large to be loss (device restart), buffer reset
+ */
+
+const SEQ_MODULO = 0x10000;
+const SEQ_HALF = 0x8000;
+const RESYNC_DISTANCE = 1000; // Further ahead than this is a new stream
+const LOST_HISTORY = 64; // Given-up sequence numbers kept to tell late from duplicate
+
+class ReorderBuffer {
+  constructor({ depth, waitMs, onRelease, onLost }) {
+    this.depth = depth;
+    this.waitMs = waitMs;
+    this.onRelease = onRelease;
+    this.onLost = onLost;
+    this.expected = null; // Next sequence number to release
+    this.pending = new Map(); // seq -> packet, all ahead of expected
+    this.lostSeqs = [];
+    this.timer = null;
+    this.stats = {
+      received: 0,
+      lost: 0,
+      reordered: 0,
+      late: 0,
+      duplicates: 0,
+      resyncs: 0,
+    };
+  }
+
+  push(seq, packet) {
+    this.stats.received++;
+    if (this.expected === null) {
+      this.expected = seq;
+    }
+
+    const ahead = (seq - this.expected + SEQ_MODULO) % SEQ_MODULO;
+    if (ahead >= SEQ_HALF) {
+      // Behind the release point: given up on, or already sent
+      if (this.lostSeqs.includes(seq)) {
+        this.stats.late++;
+      } else {
+        this.stats.duplicates++;
+      }
+      return;
+    }
+    if (ahead > RESYNC_DISTANCE) {
+      this.stats.resyncs++;
+      this.flush();
+      this.expected = seq;
+    } else if (this.pending.has(seq)) {
+      this.stats.duplicates++;
+      return;
+    }
+
+    if (seq === this.expected) {
+      if (this.pending.size > 0) {
+        this.stats.reordered++; // Later packets were already waiting for this one
+      }
+      this.release(packet);
+      this.drain();
+    } else if (this.depth === 0) {
+      this.giveUpUntil(seq); // No reordering: everything before seq is lost now
+      this.release(packet);
+    } else {
+      this.pending.set(seq, packet);
+      if (this.pending.size > this.depth) {
+        this.skipGap();
+      }
+    }
+    this.updateTimer();
+  }
+
+  // Release pending packets that are now in order
+  drain() {
+    while (this.pending.has(this.expected)) {
+      const packet = this.pending.get(this.expected);
+      this.pending.delete(this.expected);
+      this.release(packet);
+    }
+  }
+
+  release(packet) {
+    this.expected = (this.expected + 1) % SEQ_MODULO;
+    this.onRelease(packet);
+  }
+
+  // Declare every sequence number from expected up to (not including) seq lost
+  giveUpUntil(seq) {
+    while (this.expected !== seq) {
+      this.stats.lost++;
+      this.lostSeqs.push(this.expected);
+      if (this.lostSeqs.length > LOST_HISTORY) {
+        this.lostSeqs.shift();
+      }
+      this.onLost(this.expected);
+      this.expected = (this.expected + 1) % SEQ_MODULO;
+    }
+  }
+
+  // Stop waiting for the current gap: jump to the oldest pending packet
+  skipGap() {
+    let oldest = null;
+    let oldestAhead = SEQ_MODULO;
+    for (const seq of this.pending.keys()) {
+      const ahead = (seq - this.expected + SEQ_MODULO) % SEQ_MODULO;
+      if (ahead < oldestAhead) {
+        oldest = seq;
+        oldestAhead = ahead;
+      }
+    }
+    if (oldest !== null) {
+      this.giveUpUntil(oldest);
+      this.drain();
+    }
+  }
+
+  // Release everything still pending, concealing the gaps in between
+  flush() {
+    while (this.pending.size > 0) {
+      this.skipGap();
+    }
+    this.updateTimer();
+  }
+
+  updateTimer() {
+    if (this.pending.size > 0 && !this.timer) {
+      this.timer = setTimeout(() => {
+        this.timer = null;
+        this.flush();
+      }, this.waitMs);
+    } else if (this.pending.size === 0 && this.timer) {
+      clearTimeout(this.timer);
+      this.timer = null;
+    }
+  }
+
+  close() {
+    if (this.timer) {
+      clearTimeout(this.timer);
+      this.timer = null;
+    }
+    this.pending.clear();
+  }
+}
+
+module.exports = { ReorderBuffer };
@@ -0,0 +1,282 @@
+/**
+ * Level feed - RMS, peak and a coarse spectrum per device for wall displays
+ *
+ * A wall display showing twenty microphones does not need twenty audio
+ * streams, only how loud each one is and roughly where its energy sits. The
+ * relay meters each device's released audio once (LevelMeter), however many
+ * displays watch. Every LEVELS_INTERVAL_MS (server.js) the readings go out as
+ * one small binary frame to the browsers that asked for levels. These browsers
+ * need no audio subscription.
+ *
+ * Per device:
+ * - RMS and peak of the samples in the interval, stereo folded to mono.
+ * - Spectrum: Hann-windowed FFT_SIZE-point frames with 50 % overlap. Their
+ *   power is added up over the interval (Welch), then summed into LEVEL_BANDS
+ *   log-spaced bands from BAND_LOW_HZ to BAND_HIGH_HZ. Scaled so a full-scale
+ *   sine reads about 0 dB in its band. The FFT is the native spectrum addon
+ *   (server/native) when built, the same FFT in JavaScript otherwise.
+ * - The relay has no Opus decoder, so an Opus device has no levels, only
+ *   LEVEL_FLAG_OPUS. A device in VAD silence reads silent with LEVEL_FLAG_SILENT.
+ *
+ * Frame (big-endian like the audio packets):
+ *   0  u8   LEVELS_FRAME_MAGIC
+ *   1  u8   band count
+ *   2  u16  entry count
+ *   4  u16  interval, ms
+ * Entry:
+ *   u8 id length, id (UTF-8), u8 flags, u8 RMS, u8 peak, u8 per band.
+ * Levels are in half dB below full scale: 0 is 0 dBFS, 254 is -127 dB.
+ * LEVEL_NONE (255) is silence, or a band above the device's Nyquist frequency.
+ */
+
+let spectrumAddon = null;
+try {
+  spectrumAddon = require("./native/build/Release/spectrum.node");
+} catch (error) {
+  spectrumAddon = null;
+}
+
+const LEVELS_FRAME_MAGIC = 0xa8; // Next to the status frame's 0xA7
+const FRAME_HEADER_SIZE = 6;
+const LEVEL_BANDS = 32;
+const BAND_LOW_HZ = 50;
+const BAND_HIGH_HZ = 8000;
+const FFT_SIZE = 256; // 16 ms at 16 kHz
+const FFT_HOP = FFT_SIZE / 2;
+const LEVEL_NONE = 255;
+const LEVEL_FLAG_CLIPPED = 0x01; // A sample at full scale in the interval
+const LEVEL_FLAG_SILENT = 0x02;
+const LEVEL_FLAG_OPUS = 0x04;
+const FULL_SCALE = 32768;
+const MAX_STRING = 255;
+
+// A full-scale sine through the Hann window peaks at |X| = N / 4 per unit amplitude
+const SPECTRUM_SCALE_DB = -20 * Math.log10((FULL_SCALE * FFT_SIZE) / 4);
+
+// JavaScript stand-in for spectrum.cc's accumulate()
+const jsSpectrum = (() => {
+  const window = new Float32Array(FFT_SIZE);
+  const cos = new Float32Array(FFT_SIZE / 2);
+  const sin = new Float32Array(FFT_SIZE / 2);
+  const reversed = new Uint16Array(FFT_SIZE);
+  const re = new Float32Array(FFT_SIZE);
+  const im = new Float32Array(FFT_SIZE);
+  const bits = Math.log2(FFT_SIZE);
+  for (let i = 0; i < FFT_SIZE; i++) {
+    window[i] = 0.5 - 0.5 * Math.cos((2 * Math.PI * i) / FFT_SIZE);
+    let r = 0;
+    for (let b = 0; b < bits; b++) {
+      r |= ((i >> b) & 1) << (bits - 1 - b);
+    }
+    reversed[i] = r;
+  }
+  for (let i = 0; i < FFT_SIZE / 2; i++) {
+    cos[i] = Math.cos((2 * Math.PI * i) / FFT_SIZE);
+    sin[i] = -Math.sin((2 * Math.PI * i) / FFT_SIZE);
+  }
+  return {
+    accumulate(frame, power) {
+      for (let i = 0; i < FFT_SIZE; i++) {
+        re[reversed[i]] = frame[i] * window[i];
+        im[reversed[i]] = 0;
+      }
+      for (let half = 1; half < FFT_SIZE; half <<= 1) {
+        const step = FFT_SIZE / (half * 2);
+        for (let start = 0; start < FFT_SIZE; start += half * 2) {
+          for (let k = 0; k < half; k++) {
+            const wr = cos[k * step];
+            const wi = sin[k * step];
+            const a = start + k;
+            const b = a + half;
+            const tr = re[b] * wr - im[b] * wi;
+            const ti = re[b] * wi + im[b] * wr;
+            re[b] = re[a] - tr;
+            im[b] = im[a] - ti;
+            re[a] += tr;
+            im[a] += ti;
+          }
+        }
+      }
+      for (let k = 0; k <= FFT_SIZE / 2; k++) {
+        power[k] += re[k] * re[k] + im[k] * im[k];
+      }
+    },
+  };
+})();
+
+const spectrum = spectrumAddon || jsSpectrum;
+
+// FFT bins [first, last) of each band at a sample rate, cached per rate.
+// A band narrower than a bin takes the bin its centre falls in; a band above
+// Nyquist has none.
+const bandMaps = new Map();
+function bandMap(sampleRate) {
+  let map = bandMaps.get(sampleRate);
+  if (map) {
+    return map;
+  }
+  map = [];
+  const binHz = sampleRate / FFT_SIZE;
+  const nyquist = sampleRate / 2;
+  const ratio = BAND_HIGH_HZ / BAND_LOW_HZ;
+  for (let band = 0; band < LEVEL_BANDS; band++) {
+    const low = BAND_LOW_HZ * Math.pow(ratio, band / LEVEL_BANDS);
+    const high = BAND_LOW_HZ * Math.pow(ratio, (band + 1) / LEVEL_BANDS);
+    if (low >= nyquist) {
+      map.push(null);
+      continue;
+    }
+    let first = Math.ceil(low / binHz - 0.5);
+    let last = Math.ceil(Math.min(high, nyquist) / binHz - 0.5);
+    if (last <= first) {
+      first = Math.round(Math.sqrt(low * high) / binHz);
+      last = first + 1;
+    }
+    map.push([first, Math.min(last, FFT_SIZE / 2 + 1)]);
+  }
+  bandMaps.set(sampleRate, map);
+  return map;
+}
+
+// Half-dB steps below full scale, LEVEL_NONE for nothing
+function levelByte(db) {
+  if (!Number.isFinite(db)) {
+    return LEVEL_NONE;
+  }
+  return Math.max(0, Math.min(LEVEL_NONE - 1, Math.round(-db * 2)));
+}
+
+class LevelMeter {
+  constructor(deviceId) {
+    this.deviceId = deviceId;
+    this.sampleRate = 0;
+    this.fifo = new Float32Array(FFT_SIZE);
+    this.filled = 0;
+    this.power = new Float64Array(FFT_SIZE / 2 + 1);
+    this.frames = 0; // FFT frames in power
+    this.sumSquares = 0;
+    this.count = 0;
+    this.peak = 0;
+    this.silent = false;
+    this.opus = false;
+    this.lastSeen = 0; // performance.now() of the last packet
+  }
+
+  // Decoded PCM/ADPCM samples of a released packet
+  push(samples, channels, sampleRate, now) {
+    this.lastSeen = now;
+    this.silent = false;
+    this.opus = false;
+    if (sampleRate !== this.sampleRate) {
+      this.sampleRate = sampleRate;
+      this.filled = 0;
+      this.power.fill(0);
+      this.frames = 0;
+    }
+    for (let i = 0; i + channels <= samples.length; i += channels) {
+      let sample = samples[i];
+      let magnitude = Math.abs(sample);
+      if (channels === 2) {
+        sample = (sample + samples[i + 1]) / 2;
+        magnitude = Math.max(magnitude, Math.abs(samples[i + 1]));
+      }
+      if (magnitude > this.peak) {
+        this.peak = magnitude;
+      }
+      this.sumSquares += sample * sample;
+      this.count++;
+      this.fifo[this.filled++] = sample;
+      if (this.filled === FFT_SIZE) {
+        spectrum.accumulate(this.fifo, this.power);
+        this.frames++;
+        this.fifo.copyWithin(0, FFT_HOP);
+        this.filled = FFT_SIZE - FFT_HOP;
+      }
+    }
+  }
+
+  // Start or end of the device's VAD silence
+  setSilent(silent, now) {
+    this.lastSeen = now;
+    this.silent = silent;
+    if (silent) {
+      this.filled = 0; // The next talk spurt starts a new frame
+    }
+  }
+
+  // An Opus packet: the device is alive but not metered
+  markOpus(now) {
+    this.lastSeen = now;
+    this.opus = true;
+  }
+
+  // Readings since the last read, then start over
+  read() {
+    let flags = 0;
+    if (this.peak >= FULL_SCALE - 1) {
+      flags |= LEVEL_FLAG_CLIPPED;
+    }
+    if (this.silent) {
+      flags |= LEVEL_FLAG_SILENT;
+    }
+    if (this.opus) {
+      flags |= LEVEL_FLAG_OPUS;
+    }
+    const rms = this.count > 0 ? 10 * Math.log10(this.sumSquares / this.count / (FULL_SCALE * FULL_SCALE)) : -Infinity;
+    const peak = this.count > 0 ? 20 * Math.log10(this.peak / FULL_SCALE) : -Infinity;
+    const bands = new Uint8Array(LEVEL_BANDS).fill(LEVEL_NONE);
+    if (this.frames > 0) {
+      bandMap(this.sampleRate).forEach((bins, band) => {
+        if (!bins) {
+          return;
+        }
+        let sum = 0;
+        for (let k = bins[0]; k < bins[1]; k++) {
+          sum += this.power[k];
+        }
+        bands[band] = levelByte(10 * Math.log10(sum / this.frames) + SPECTRUM_SCALE_DB);
+      });
+    }
+    this.sumSquares = 0;
+    this.count = 0;
+    this.peak = 0;
+    this.power.fill(0);
+    this.frames = 0;
+    return { deviceId: this.deviceId, flags, rms: levelByte(rms), peak: levelByte(peak), bands };
+  }
+}
+
+// One frame for a list of read() results
+function encodeLevels(entries, intervalMs) {
+  const ids = entries.map((entry) => {
+    const id = Buffer.from(String(entry.deviceId), "utf8");
+    return id.length > MAX_STRING ? id.subarray(0, MAX_STRING) : id;
+  });
+  const entryBytes = ids.reduce((total, id) => total + 4 + id.length + LEVEL_BANDS, 0);
+  const frame = Buffer.alloc(FRAME_HEADER_SIZE + entryBytes);
+  frame[0] = LEVELS_FRAME_MAGIC;
+  frame[1] = LEVEL_BANDS;
+  frame.writeUInt16BE(Math.min(entries.length, 0xffff), 2);
+  frame.writeUInt16BE(Math.min(intervalMs, 0xffff), 4);
+  let offset = FRAME_HEADER_SIZE;
+  entries.forEach((entry, i) => {
+    frame[offset++] = ids[i].length;
+    offset += ids[i].copy(frame, offset);
+    frame[offset++] = entry.flags;
+    frame[offset++] = entry.rms;
+    frame[offset++] = entry.peak;
+    frame.set(entry.bands, offset);
+    offset += LEVEL_BANDS;
+  });
+  return frame;
+}
+
+module.exports = {
+  LevelMeter,
+  encodeLevels,
+  LEVELS_FRAME_MAGIC,
+  LEVEL_BANDS,
+  BAND_LOW_HZ,
+  BAND_HIGH_HZ,
+  nativeSpectrum: spectrumAddon !== null,
+};
@@ -0,0 +1,534 @@
+/**
+ * Synthetic fleet load generator for the relay
+ *
+ * Opens N device connections that speak the firmware's protocol (the hello
+ * from src/main.cpp, then version 3 audio packets with a CRC32, see
+ * src/audio_packet.h) and M browser connections subscribed to them, then
+ * reports what came through:
+ *
+ *   node loadgen.js --devices=200 --browsers=400 --duration=60
+ *
+ * Options (defaults in brackets):
+ *   --url             relay WebSocket URL [ws://localhost:3012]
+ *   --devices         simulated ESP32s [10]
+ *   --browsers        subscribers, spread round-robin over the devices [10]
+ *   --codec           pcm | adpcm | opus (needs the opus_encoder addon) [pcm]
+ *   --rate            capture rate, 16000 | 8000 | 44100 [16000]
+ *   --samples         samples per packet (PCM/ADPCM) [512]
+ *   --opus-frame-ms   Opus frame duration [20]
+ *   --loss            fraction of packets never sent, 0-1 [0]
+ *   --jitter-ms       random extra send delay, order kept as on TCP [0]
+ *   --duration        seconds, then a summary and exit [30]
+ *   --interval        seconds between report lines [5]
+ *   --ramp-ms         spread of the connection start-up [2000]
+ *
+ * Latency is measured end to end: every device stamps each sequence number
+ * with its send time, and a browser receiving that packet looks it up, so the
+ * numbers include the relay, the sockets and this process's event loop. Run
+ * the load generator on a different machine than the relay for sizing.
+ * Relay CPU, memory, event loop delay and its own ingress-to-egress histogram
+ * come from the relay's /metrics (see metrics.js).
+ */
+
+const WebSocket = require("ws");
+const http = require("http");
+const https = require("https");
+const zlib = require("zlib");
+
+const PACKET_HEADER_MAGIC_V2 = 0xa6;
+const PACKET_HEADER_SIZE = 20;
+const PACKET_HEADER_VERSION = 3;
+const PACKET_FLAG_CRC32 = 0x01;
+const PACKET_TYPE_AUDIO = 0x01;
+const PACKET_TYPE_AUDIO_ADPCM = 0x02;
+const PACKET_TYPE_AUDIO_OPUS = 0x03;
+const PACKET_RATE_CODES = { 16000: 0, 8000: 1, 44100: 2 };
+const ADPCM_HEADER_SIZE = 4;
+const DEVICE_USER_AGENT = "arduino-WebSocket-Client"; // links2004/WebSockets
+const BROWSER_USER_AGENT = "Mozilla/5.0 (relay loadgen)";
+const PAYLOAD_CYCLE = 16; // Distinct payloads per stream, reused in turn
+const LATENCY_RESERVOIR = 100000;
+const STALE_SEND_MS = 10000; // An older send time for a sequence number is a previous lap
+
+// IMA-ADPCM tables - must match src/adpcm.cpp
+const ADPCM_STEP_TABLE = [
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+  12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+];
+const ADPCM_INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8];
+
+function parseArgs(argv) {
+  const options = {
+    url: "ws://localhost:3012",
+    devices: 10,
+    browsers: 10,
+    codec: "pcm",
+    rate: 16000,
+    samples: 512,
+    "opus-frame-ms": 20,
+    loss: 0,
+    "jitter-ms": 0,
+    duration: 30,
+    interval: 5,
+    "ramp-ms": 2000,
+  };
+  argv.forEach((arg) => {
+    const match = /^--([a-z-]+)=(.*)$/.exec(arg);
+    if (!match || !(match[1] in options)) {
+      console.error(`Unknown option: ${arg}`);
+      process.exit(2);
+    }
+    const [, name, value] = match;
+    options[name] = typeof options[name] === "number" ? Number(value) : value;
+  });
+  if (!(options.rate in PACKET_RATE_CODES)) {
+    console.error(`--rate must be one of ${Object.keys(PACKET_RATE_CODES).join(", ")}`);
+    process.exit(2);
+  }
+  return options;
+}
+
+const crc32 =
+  zlib.crc32 ||
+  (() => {
+    const table = new Int32Array(256).map((_, n) => {
+      let c = n;
+      for (let k = 0; k < 8; k++) {
+        c = c & 1 ? 0xedb88320 ^ (c >>> 1) : c >>> 1;
+      }
+      return c;
+    });
+    return (buffer) => {
+      let crc = -1;
+      for (let i = 0; i < buffer.length; i++) {
+        crc = table[(crc ^ buffer[i]) & 0xff] ^ (crc >>> 8);
+      }
+      return (crc ^ -1) >>> 0;
+    };
+  })();
+
+// Voice-band test signal, continuous across packets
+function testSignal(count, rate, offset) {
+  const samples = new Int16Array(count);
+  for (let i = 0; i < count; i++) {
+    const t = (offset + i) / rate;
+    samples[i] = Math.round(
+      6000 * Math.sin(2 * Math.PI * 220 * t) + 2000 * Math.sin(2 * Math.PI * 1400 * t)
+    );
+  }
+  return samples;
+}
+
+function adpcmEncode(state, samples) {
+  const codes = Buffer.alloc(Math.ceil(samples.length / 2));
+  const encode = (sample) => {
+    let step = ADPCM_STEP_TABLE[state.index];
+    let diff = sample - state.predictor;
+    let code = 0;
+    if (diff < 0) {
+      code = 8;
+      diff = -diff;
+    }
+    let vpdiff = step >> 3;
+    for (let bit = 4; bit >= 1; bit >>= 1) {
+      if (diff >= step) {
+        code |= bit;
+        diff -= step;
+        vpdiff += step;
+      }
+      step >>= 1;
+    }
+    state.predictor += code & 8 ? -vpdiff : vpdiff;
+    state.predictor = Math.max(-32768, Math.min(32767, state.predictor));
+    state.index = Math.max(0, Math.min(88, state.index + ADPCM_INDEX_TABLE[code]));
+    return code;
+  };
+  for (let i = 0; i < samples.length; i += 2) {
+    const lo = encode(samples[i]);
+    const hi = i + 1 < samples.length ? encode(samples[i + 1]) : 0;
+    codes[i >> 1] = lo | (hi << 4);
+  }
+  return codes;
+}
+
+// PAYLOAD_CYCLE consecutive payloads with their CRCs, shared by every device.
+// Each ADPCM payload carries the state it starts from, so any can follow any.
+function buildPayloads(options) {
+  const { codec, rate } = options;
+  const payloads = [];
+  if (codec === "opus") {
+    let addon;
+    try {
+      addon = require("./native/build/Release/opus_encoder.node");
+    } catch (error) {
+      console.error("--codec=opus needs the opus_encoder addon (npm run build:native with libopus)");
+      process.exit(2);
+    }
+    const encoder = new addon.OpusEncoder(rate, 16000, options["opus-frame-ms"]);
+    let offset = 0;
+    while (payloads.length < PAYLOAD_CYCLE) {
+      const pcm = testSignal(encoder.frameSamples, rate, offset);
+      offset += pcm.length;
+      encoder.encode(pcm).forEach((frame) =>
+        payloads.push({ data: frame, crc: crc32(frame), samples: encoder.frameSamples })
+      );
+    }
+    return payloads;
+  }
+
+  const state = { predictor: 0, index: 0 };
+  for (let i = 0; i < PAYLOAD_CYCLE; i++) {
+    const pcm = testSignal(options.samples, rate, i * options.samples);
+    let data;
+    if (codec === "adpcm") {
+      const header = Buffer.alloc(ADPCM_HEADER_SIZE);
+      header.writeInt16BE(state.predictor, 0);
+      header[2] = state.index;
+      data = Buffer.concat([header, adpcmEncode(state, pcm)]);
+    } else {
+      data = Buffer.alloc(pcm.length * 2);
+      pcm.forEach((sample, j) => data.writeInt16BE(sample, j * 2));
+    }
+    payloads.push({ data, crc: crc32(data), samples: pcm.length });
+  }
+  return payloads;
+}
+
+// Fixed-size uniform sample of latencies (Vitter's algorithm R), per report window
+class Reservoir {
+  constructor(size) {
+    this.values = new Float64Array(size);
+    this.reset();
+  }
+
+  reset() {
+    this.count = 0;
+  }
+
+  add(value) {
+    if (this.count < this.values.length) {
+      this.values[this.count] = value;
+    } else {
+      const j = Math.floor(Math.random() * (this.count + 1));
+      if (j < this.values.length) {
+        this.values[j] = value;
+      }
+    }
+    this.count++;
+  }
+
+  percentiles(...ps) {
+    const n = Math.min(this.count, this.values.length);
+    if (n === 0) {
+      return ps.map(() => NaN);
+    }
+    const sorted = this.values.slice(0, n).sort();
+    return ps.map((p) => sorted[Math.min(n - 1, Math.floor(p * n))]);
+  }
+}
+
+const stats = {
+  devicesOpen: 0,
+  browsersOpen: 0,
+  sent: 0,
+  skipped: 0, // Simulated loss
+  expected: 0, // Subscriber deliveries the relay should make
+  received: 0,
+  unmatched: 0, // Relay-made packets (concealment) or laps we cannot time
+  errors: 0,
+};
+const latency = new Reservoir(LATENCY_RESERVOIR);
+const runLatency = new Reservoir(LATENCY_RESERVOIR);
+
+function startDevice(options, index, payloads) {
+  const id = (0xf00000 + index).toString(16); // Like the firmware's 6-hex eFuse MAC ID
+  const type =
+    options.codec === "adpcm"
+      ? PACKET_TYPE_AUDIO_ADPCM
+      : options.codec === "opus"
+      ? PACKET_TYPE_AUDIO_OPUS
+      : PACKET_TYPE_AUDIO;
+  const device = { id, sentAt: new Float64Array(0x10000), subscribers: 0, ws: null };
+  const ws = new WebSocket(options.url, {
+    headers: { "User-Agent": DEVICE_USER_AGENT },
+    perMessageDeflate: false,
+  });
+  device.ws = ws;
+
+  let seq = 0;
+  let timestamp = Math.floor(Math.random() * 0xffffffff);
+  let lastSendAt = 0;
+  let timer = null;
+  const packetMs = (payloads[0].samples * 1000) / options.rate;
+
+  ws.on("open", () => {
+    stats.devicesOpen++;
+    ws.send(
+      JSON.stringify({ type: "hello", client: "esp32", device: "ESP32-AUDIO", id })
+    );
+    const start = performance.now();
+    let n = 0;
+    const tick = () => {
+      const payload = payloads[n % payloads.length];
+      const packet = Buffer.allocUnsafe(PACKET_HEADER_SIZE + payload.data.length);
+      packet[0] = PACKET_HEADER_MAGIC_V2;
+      packet[1] = type;
+      packet.writeUInt16BE(seq, 2);
+      packet.writeUInt16BE(payload.samples, 4);
+      packet.writeUInt16BE(0, 6);
+      packet[8] = PACKET_HEADER_VERSION;
+      packet[9] = PACKET_HEADER_SIZE;
+      packet[10] = PACKET_FLAG_CRC32;
+      packet[11] = PACKET_RATE_CODES[options.rate];
+      packet.writeUInt32BE(timestamp >>> 0, 12);
+      packet.writeUInt32BE(payload.crc, 16);
+      payload.data.copy(packet, PACKET_HEADER_SIZE);
+      const packetSeq = seq;
+      seq = (seq + 1) & 0xffff;
+      timestamp = (timestamp + payload.samples) >>> 0;
+      n++;
+
+      if (Math.random() < options.loss) {
+        stats.skipped++;
+      } else {
+        // Jitter delays the send but keeps the order, as TCP would
+        const delay = Math.random() * options["jitter-ms"];
+        const sendAt = Math.max(performance.now() + delay, lastSendAt);
+        lastSendAt = sendAt;
+        const send = () => {
+          if (ws.readyState === WebSocket.OPEN) {
+            device.sentAt[packetSeq] = performance.now();
+            ws.send(packet);
+            stats.sent++;
+            stats.expected += device.subscribers;
+          }
+        };
+        if (sendAt - performance.now() > 1) {
+          setTimeout(send, sendAt - performance.now());
+        } else {
+          send();
+        }
+      }
+      // Scheduled from the start time, so timer lateness does not drift the rate
+      timer = setTimeout(tick, Math.max(0, start + n * packetMs - performance.now()));
+    };
+    tick();
+  });
+  ws.on("message", () => {}); // Status and commands - not simulated
+  ws.on("close", () => {
+    clearTimeout(timer);
+    stats.devicesOpen--;
+  });
+  ws.on("error", () => stats.errors++);
+  return device;
+}
+
+function startBrowser(options, device) {
+  const ws = new WebSocket(options.url, {
+    headers: { "User-Agent": BROWSER_USER_AGENT },
+    perMessageDeflate: false,
+  });
+  ws.on("open", () => {
+    stats.browsersOpen++;
+    device.subscribers++;
+    ws.send(
+      JSON.stringify({
+        type: "hello",
+        client: "browser",
+        codecs: ["pcm", "adpcm", "opus"],
+        devices: [device.id],
+        statusDetail: "devices",
+      })
+    );
+  });
+  ws.on("message", (data, isBinary) => {
+    if (!isBinary || data.length < 4 || data[0] !== PACKET_HEADER_MAGIC_V2) {
+      return; // Status frames and JSON
+    }
+    const type = data[1];
+    if (
+      type !== PACKET_TYPE_AUDIO &&
+      type !== PACKET_TYPE_AUDIO_ADPCM &&
+      type !== PACKET_TYPE_AUDIO_OPUS
+    ) {
+      return;
+    }
+    stats.received++;
+    const sentAt = device.sentAt[data.readUInt16BE(2)];
+    const ms = performance.now() - sentAt;
+    if (sentAt === 0 || ms < 0 || ms > STALE_SEND_MS) {
+      stats.unmatched++;
+      return;
+    }
+    latency.add(ms);
+    runLatency.add(ms);
+  });
+  ws.on("close", () => {
+    stats.browsersOpen--;
+    device.subscribers--;
+  });
+  ws.on("error", () => stats.errors++);
+}
+
+// Relay metrics we report on, from its Prometheus text
+function fetchRelayMetrics(url) {
+  const metricsUrl = new URL(url);
+  metricsUrl.protocol = metricsUrl.protocol === "wss:" ? "https:" : "http:";
+  metricsUrl.pathname = "/metrics";
+  const client = metricsUrl.protocol === "https:" ? https : http;
+  return new Promise((resolve) => {
+    const req = client.get(metricsUrl, (res) => {
+      let body = "";
+      res.setEncoding("utf8");
+      res.on("data", (chunk) => (body += chunk));
+      res.on("end", () => resolve(parseMetrics(body)));
+    });
+    req.on("error", () => resolve(null));
+    req.setTimeout(2000, () => req.destroy());
+  });
+}
+
+function parseMetrics(text) {
+  const values = new Map();
+  text.split("\n").forEach((line) => {
+    const match = /^([a-z_]+(?:\{[^}]*\})?) (\S+)$/.exec(line);
+    if (match) {
+      values.set(match[1], Number(match[2]));
+    }
+  });
+  return values;
+}
+
+// Percentile from cumulative Prometheus buckets, as the upper bucket bound
+function histogramPercentile(current, previous, name, p) {
+  const buckets = [];
+  current.forEach((value, key) => {
+    const match = new RegExp(`^${name}_bucket\\{le="([^"]+)"\\}$`).exec(key);
+    if (match) {
+      const before = previous ? previous.get(key) || 0 : 0;
+      buckets.push([Number(match[1]), value - before]);
+    }
+  });
+  buckets.sort((a, b) => a[0] - b[0]);
+  const total = buckets.length ? buckets[buckets.length - 1][1] : 0;
+  if (total === 0) {
+    return NaN;
+  }
+  const bucket = buckets.find(([, count]) => count >= p * total);
+  return bucket ? bucket[0] : Infinity;
+}
+
+function sumMatching(metrics, prefix) {
+  let sum = 0;
+  metrics.forEach((value, key) => {
+    if (key.startsWith(prefix)) {
+      sum += value;
+    }
+  });
+  return sum;
+}
+
+function formatMs(ms) {
+  return Number.isFinite(ms) ? ms.toFixed(1) : "-";
+}
+
+function relaySummary(current, previous, seconds) {
+  if (!current) {
+    return "relay /metrics unavailable";
+  }
+  const delta = (name) => (current.get(name) || 0) - ((previous && previous.get(name)) || 0);
+  const cpu = (delta("process_cpu_seconds_total") / seconds) * 100;
+  const rss = (current.get("process_resident_memory_bytes") || 0) / 1048576;
+  const lag = (current.get("nodejs_eventloop_delay_p99_seconds") || 0) * 1000;
+  const p50 = histogramPercentile(current, previous, "relay_ingress_to_egress_seconds", 0.5);
+  const p99 = histogramPercentile(current, previous, "relay_ingress_to_egress_seconds", 0.99);
+  const drops =
+    sumMatching(current, "relay_packets_dropped_total") -
+    (previous ? sumMatching(previous, "relay_packets_dropped_total") : 0);
+  const sendDrops = delta("relay_send_drops_total");
+  return (
+    `relay cpu ${cpu.toFixed(0)}%, rss ${rss.toFixed(0)} MB, loop p99 ${lag.toFixed(1)} ms, ` +
+    `internal p50/p99 <=${formatMs(p50 * 1000)}/<=${formatMs(p99 * 1000)} ms, ` +
+    `dropped ${drops} invalid + ${sendDrops} backpressure`
+  );
+}
+
+function clientSummary(counts, reservoir, seconds) {
+  const [p50, p99, max] = reservoir.percentiles(0.5, 0.99, 1);
+  const delivered = counts.expected > 0 ? (counts.received - counts.unmatched) / counts.expected : 1;
+  return (
+    `${stats.devicesOpen} devices, ${stats.browsersOpen} browsers | ` +
+    `sent ${(counts.sent / seconds).toFixed(0)} pkt/s, received ${(counts.received / seconds).toFixed(0)} pkt/s, ` +
+    `not delivered ${(Math.max(0, 1 - delivered) * 100).toFixed(2)}% | ` +
+    `latency p50 ${formatMs(p50)} p99 ${formatMs(p99)} max ${formatMs(max)} ms`
+  );
+}
+
+async function main() {
+  const options = parseArgs(process.argv.slice(2));
+  const payloads = buildPayloads(options);
+  console.log(
+    `Load: ${options.devices} devices (${options.codec}, ${options.rate} Hz, ` +
+      `${payloads[0].samples} samples/packet, loss ${options.loss}, jitter ${options["jitter-ms"]} ms), ` +
+      `${options.browsers} browsers -> ${options.url}`
+  );
+
+  const devices = [];
+  for (let i = 0; i < options.devices; i++) {
+    setTimeout(() => {
+      devices[i] = startDevice(options, i, payloads);
+    }, (i * options["ramp-ms"]) / Math.max(1, options.devices));
+  }
+  // Browsers after their device exists, spread over the same ramp
+  for (let j = 0; j < options.browsers; j++) {
+    setTimeout(() => {
+      const device = devices[j % options.devices];
+      if (device) {
+        startBrowser(options, device);
+      }
+    }, options["ramp-ms"] + (j * options["ramp-ms"]) / Math.max(1, options.browsers));
+  }
+
+  const startMetrics = await fetchRelayMetrics(options.url);
+  let previousMetrics = startMetrics;
+  let windowStart = performance.now();
+  const runStart = windowStart;
+  const snapshot = () => ({ ...stats });
+  let windowBase = snapshot();
+  const runBase = snapshot();
+
+  const report = async () => {
+    const now = performance.now();
+    const seconds = (now - windowStart) / 1000;
+    const counts = {};
+    Object.keys(stats).forEach((key) => (counts[key] = stats[key] - windowBase[key]));
+    const metrics = await fetchRelayMetrics(options.url);
+    console.log(`${clientSummary(counts, latency, seconds)} | ${relaySummary(metrics, previousMetrics, seconds)}`);
+    latency.reset();
+    previousMetrics = metrics || previousMetrics;
+    windowBase = snapshot();
+    windowStart = now;
+  };
+  const reportTimer = setInterval(report, options.interval * 1000);
+
+  setTimeout(async () => {
+    clearInterval(reportTimer);
+    await report();
+    const seconds = (performance.now() - runStart) / 1000;
+    const counts = {};
+    Object.keys(stats).forEach((key) => (counts[key] = stats[key] - runBase[key]));
+    const metrics = await fetchRelayMetrics(options.url);
+    console.log(
+      `\nSummary over ${seconds.toFixed(0)} s: ${clientSummary(counts, runLatency, seconds)}\n` +
+        `  ${relaySummary(metrics, startMetrics, seconds)}\n` +
+        `  simulated loss ${counts.skipped}, untimed ${counts.unmatched}, socket errors ${counts.errors}`
+    );
+    process.exit(0);
+  }, options.duration * 1000);
+}
+
+main();
@@ -0,0 +1,171 @@
+/**
+ * Relay metrics in the Prometheus text format, served on /metrics
+ *
+ * Counters and histograms are plain numbers updated in the packet path, so
+ * recording costs an increment or a short bucket scan. Gauges are read from
+ * callbacks when the endpoint is scraped. Label sets are created on first use
+ * and kept for the life of the process; keep their values bounded (packet
+ * types, drop reasons, device IDs).
+ *
+ * Process CPU, memory and event loop delay are always included; the loop delay
+ * percentiles cover the time since the previous scrape.
+ *
+ * Also here: sampledLog(), for messages that could otherwise be written once
+ * per packet.
+ */
+
+const { monitorEventLoopDelay } = require("perf_hooks");
+
+const metrics = [];
+
+function labelKey(names, values) {
+  return names
+    .map((name, i) => `${name}="${String(values[i]).replace(/["\\\n]/g, "\\$&")}"`)
+    .join(",");
+}
+
+class Counter {
+  constructor(name, help, labelNames = []) {
+    this.name = name;
+    this.help = help;
+    this.labelNames = labelNames;
+    this.values = new Map(); // label key -> value
+    metrics.push(this);
+  }
+
+  inc(...labels) {
+    this.add(1, ...labels);
+  }
+
+  add(amount, ...labels) {
+    const key = labelKey(this.labelNames, labels);
+    this.values.set(key, (this.values.get(key) || 0) + amount);
+  }
+
+  render() {
+    const lines = [`# HELP ${this.name} ${this.help}`, `# TYPE ${this.name} counter`];
+    if (this.values.size === 0 && this.labelNames.length === 0) {
+      lines.push(`${this.name} 0`);
+    }
+    this.values.forEach((value, key) => {
+      lines.push(`${this.name}${key ? `{${key}}` : ""} ${value}`);
+    });
+    return lines;
+  }
+}
+
+class Histogram {
+  constructor(name, help, buckets) {
+    this.name = name;
+    this.help = help;
+    this.buckets = buckets; // Upper bounds, ascending
+    this.counts = new Array(buckets.length).fill(0);
+    this.sum = 0;
+    this.count = 0;
+    metrics.push(this);
+  }
+
+  observe(value) {
+    let i = 0;
+    while (i < this.buckets.length && value > this.buckets[i]) {
+      i++;
+    }
+    if (i < this.buckets.length) {
+      this.counts[i]++;
+    }
+    this.sum += value;
+    this.count++;
+  }
+
+  render() {
+    const lines = [`# HELP ${this.name} ${this.help}`, `# TYPE ${this.name} histogram`];
+    let cumulative = 0;
+    this.buckets.forEach((bound, i) => {
+      cumulative += this.counts[i];
+      lines.push(`${this.name}_bucket{le="${bound}"} ${cumulative}`);
+    });
+    lines.push(`${this.name}_bucket{le="+Inf"} ${this.count}`);
+    lines.push(`${this.name}_sum ${this.sum}`);
+    lines.push(`${this.name}_count ${this.count}`);
+    return lines;
+  }
+}
+
+// Value(s) read at scrape time: collect() returns a number, or an array of
+// [labelValues, value] pairs
+class Gauge {
+  constructor(name, help, labelNames, collect, type = "gauge") {
+    this.name = name;
+    this.help = help;
+    this.labelNames = labelNames;
+    this.collect = collect;
+    this.type = type;
+    metrics.push(this);
+  }
+
+  render() {
+    const lines = [`# HELP ${this.name} ${this.help}`, `# TYPE ${this.name} ${this.type}`];
+    const value = this.collect();
+    if (typeof value === "number") {
+      lines.push(`${this.name} ${value}`);
+    } else {
+      value.forEach(([labels, v]) => {
+        lines.push(`${this.name}{${labelKey(this.labelNames, labels)}} ${v}`);
+      });
+    }
+    return lines;
+  }
+}
+
+// Process metrics, under the names Prometheus client libraries use
+const loopDelay = monitorEventLoopDelay({ resolution: 10 });
+loopDelay.enable();
+new Gauge(
+  "process_cpu_seconds_total",
+  "User and system CPU time",
+  [],
+  () => {
+    const { user, system } = process.cpuUsage();
+    return (user + system) / 1e6;
+  },
+  "counter"
+);
+new Gauge("process_resident_memory_bytes", "Resident set size", [], () => process.memoryUsage().rss);
+new Gauge("nodejs_heap_used_bytes", "V8 heap in use", [], () => process.memoryUsage().heapUsed);
+new Gauge("nodejs_eventloop_delay_p50_seconds", "Event loop delay median since the last scrape", [], () =>
+  loopDelay.count > 0 ? loopDelay.percentile(50) / 1e9 : 0
+);
+new Gauge("nodejs_eventloop_delay_p99_seconds", "Event loop delay p99 since the last scrape", [], () => {
+  const value = loopDelay.count > 0 ? loopDelay.percentile(99) / 1e9 : 0;
+  loopDelay.reset();
+  return value;
+});
+
+function render() {
+  return metrics.map((metric) => metric.render().join("\n")).join("\n") + "\n";
+}
+
+// Log a message at most once per intervalMs for its key; the next one that gets
+// through says how many were suppressed in between
+const sampled = new Map(); // key -> { at, suppressed }
+
+function sampledLog(key, message, intervalMs, write = console.warn) {
+  const now = Date.now();
+  const entry = sampled.get(key);
+  if (entry && now - entry.at < intervalMs) {
+    entry.suppressed++;
+    return;
+  }
+  const suppressed = entry ? entry.suppressed : 0;
+  sampled.set(key, { at: now, suppressed: 0 });
+  write(suppressed > 0 ? `${message} (${suppressed} more since last logged)` : message);
+}
+
+module.exports = {
+  Counter,
+  Histogram,
+  Gauge,
+  render,
+  sampledLog,
+  CONTENT_TYPE: "text/plain; version=0.0.4; charset=utf-8",
+};
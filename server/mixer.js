@@ -0,0 +1,340 @@
+/**
+ * Room mixer - the microphones of one room mixed into a single stream
+ *
+ * A room (MIX_ROOMS in server.js) lists device IDs. Browsers subscribe to the
+ * room like to a device and get one 16 kHz mono PCM stream, not one per
+ * microphone to mix themselves. A mixer only runs while its room has a
+ * subscriber.
+ *
+ * The mix has its own sample clock at MIX_RATE, tied to the relay clock:
+ * mix sample n belongs to performance.now() = start + n / MIX_RATE seconds.
+ * A frame of MIX_FRAME samples is mixed once it is delayMs old. The delay is
+ * the room's jitter budget: a packet later than that misses its frame.
+ *
+ * Per device (MixInput):
+ * - Drift: the packets' capture stamps (device frames) against their arrival
+ *   time, as a least-squares line with exponential forgetting over about
+ *   DRIFT_WINDOW packets. Its slope is the device's sample rate on the relay
+ *   clock. Crystals are off by tens of ppm, which is a sample every few
+ *   seconds and, over an hour, audible echo between two microphones. The
+ *   nominal rate is used until DRIFT_MIN_SPAN_MS of arrivals are in, or if the
+ *   slope is more than MAX_DRIFT_PPM off (a stalled link, not a crystal).
+ * - Placement: each packet lands on the mix timeline by its capture stamp,
+ *   so samples captured together are mixed together. The offset of each
+ *   device's timeline is set by its fastest packets. The floor is the lowest
+ *   arrival-minus-placement seen, and it leaks upward by FLOOR_LEAK in case
+ *   the path gets slower. Placement is steered to keep the floor at 0, through
+ *   a ratio correction of at most STEER_MAX. Microphones on one network are
+ *   then aligned to within the difference of their fastest paths. A floor
+ *   further off than RESEAT_MS (a restart, a long stall) jumps instead.
+ * - Resampling: a cubic (Catmull-Rom) fractional resampler takes the device
+ *   rate, drift included, to MIX_RATE into the input's ring on the mix
+ *   timeline. Stereo is folded to mono. A stamp gap (VAD silence, a lost
+ *   packet) leaves silence, and the resampler picks up after it.
+ *
+ * Mixing sums the inputs times the room gain and clips to 16 bits. A frame no
+ * input wrote to is not sent. The stream goes quiet with onSilence(true) the
+ * way a device's VAD does, and onSilence(false) comes before its next frame.
+ *
+ * Counters (stats) per room: frames, silent, clipped (samples), skipped (frames
+ * lost to an event loop stall). Per input: packets, late and overflow
+ * (samples too late for their frame, or too far ahead for the ring), reseats,
+ * restarts (stamp jumps: device reboot or rate change).
+ */
+
+const MIX_RATE = 16000;
+const MIX_FRAME = 320; // 20 ms - one Opus frame when the relay transcodes
+const MIX_FRAME_MS = (MIX_FRAME * 1000) / MIX_RATE;
+const RING_SIZE = 1 << 15; // Samples per input, about 2 s ahead of the mix
+const RING_MASK = RING_SIZE - 1;
+const DRIFT_WINDOW = 2000; // Packets, about a minute at 32 ms blocks
+const DRIFT_MIN_SPAN_MS = 5000;
+const MAX_DRIFT_PPM = 1000;
+const FLOOR_LEAK = 0.001; // Floor rises 1 ms per second of audio
+const STEER_SAMPLES = 10 * MIX_RATE; // A floor error is steered out over about 10 s
+const STEER_MAX = 0.002; // 2000 ppm, about 3 cents of pitch
+const RESEAT_MS = 100;
+const GAP_MAX_MS = 5000; // A stamp jump longer than this starts over
+const MAX_CATCHUP_FRAMES = 10; // Further behind than this, the mix skips ahead
+
+// Exponentially weighted least squares of device frames (y) on arrival ms (x)
+class DriftEstimator {
+  constructor(sampleRate) {
+    this.nominal = sampleRate / 1000; // Frames per ms
+    this.lambda = 1 - 1 / DRIFT_WINDOW;
+    this.x0 = null;
+    this.y0 = 0;
+    this.span = 0;
+    this.weight = 0;
+    this.meanX = 0;
+    this.meanY = 0;
+    this.cxx = 0;
+    this.cxy = 0;
+  }
+
+  add(x, y) {
+    if (this.x0 === null) {
+      this.x0 = x;
+      this.y0 = y;
+    }
+    x -= this.x0; // Relative, so the sums keep their precision
+    y -= this.y0;
+    this.span = x;
+    this.weight = this.weight * this.lambda + 1;
+    const dx = x - this.meanX;
+    this.meanX += dx / this.weight;
+    this.meanY += (y - this.meanY) / this.weight;
+    this.cxx = this.lambda * this.cxx + dx * (x - this.meanX);
+    this.cxy = this.lambda * this.cxy + dx * (y - this.meanY);
+  }
+
+  // Device frames per relay millisecond
+  rate() {
+    if (this.span < DRIFT_MIN_SPAN_MS || this.cxx <= 0) {
+      return this.nominal;
+    }
+    const slope = this.cxy / this.cxx;
+    return Math.abs(slope / this.nominal - 1) * 1e6 <= MAX_DRIFT_PPM ? slope : this.nominal;
+  }
+
+  ppm() {
+    return (this.rate() / this.nominal - 1) * 1e6;
+  }
+}
+
+function cubic(y0, y1, y2, y3, t) {
+  return (
+    y1 +
+    0.5 * t * (y2 - y0 + t * (2 * y0 - 5 * y1 + 4 * y2 - y3 + t * (3 * (y1 - y2) + y3 - y0)))
+  );
+}
+
+// One device's stream on the mix timeline
+class MixInput {
+  constructor() {
+    this.ring = new Float32Array(RING_SIZE);
+    this.sampleRate = 0;
+    this.drift = null;
+    this.stats = { packets: 0, late: 0, overflow: 0, reseats: 0, restarts: 0 };
+    this.restart();
+  }
+
+  restart() {
+    this.nextStamp = null; // Capture stamp expected next
+    this.frames = 0; // Unwrapped capture stamp of the next frame
+    this.pos = null; // Mix position of the next frame, fractional
+    this.nextOut = 0; // Next mix sample the resampler writes
+    this.floor = 0; // Samples
+    this.buffer = new Float32Array(3); // Resampler history, then the packet
+  }
+
+  // Place and resample one packet. mono: the packet folded to one channel.
+  push(mono, timestamp, sampleRate, arrivalIdx, arrivedAt, readPos) {
+    this.stats.packets++;
+    if (sampleRate !== this.sampleRate) {
+      this.sampleRate = sampleRate;
+      this.drift = new DriftEstimator(sampleRate);
+      this.restart();
+    }
+    const count = mono.length;
+    let gap = 0;
+    if (this.nextStamp !== null) {
+      gap = (timestamp - this.nextStamp) | 0;
+      if (gap < 0 || gap > (GAP_MAX_MS * sampleRate) / 1000) {
+        this.stats.restarts++;
+        this.drift = new DriftEstimator(sampleRate);
+        this.restart();
+        gap = 0;
+      }
+    }
+    this.frames += gap;
+    this.nextStamp = (timestamp + count) >>> 0;
+    this.drift.add(arrivedAt, this.frames + count);
+    this.frames += count;
+
+    const steer = Math.max(-STEER_MAX, Math.min(STEER_MAX, this.floor / STEER_SAMPLES));
+    const ratio = (MIX_RATE / 1000 / this.drift.rate()) * (1 + steer); // Mix samples per device frame
+    if (gap > 0) {
+      this.pos += gap * ratio;
+      this.buffer.fill(0, 0, 3); // Silence before the packet, not the last one's tail
+      this.nextOut = Math.max(this.nextOut, Math.ceil(this.pos - 2 * ratio));
+    }
+    if (this.pos === null || Math.abs(this.floor) > (RESEAT_MS * MIX_RATE) / 1000) {
+      if (this.pos !== null) {
+        this.stats.reseats++;
+      }
+      this.pos = arrivalIdx - count * ratio;
+      this.floor = 0;
+      this.buffer.fill(0, 0, 3);
+      this.nextOut = Math.ceil(this.pos - 2 * ratio);
+    }
+
+    // [3 samples of history | packet]; mix sample n reads the input at (n - pos) / ratio
+    const buffer = new Float32Array(count + 3);
+    buffer.set(this.buffer.subarray(0, 3));
+    buffer.set(mono, 3);
+    const limit = readPos + RING_SIZE;
+    for (;;) {
+      const u = (this.nextOut - this.pos) / ratio + 3;
+      const i = Math.max(1, Math.floor(u)); // A new ratio can put u a hair before the history
+      if (i + 2 >= buffer.length) {
+        break;
+      }
+      if (this.nextOut < readPos) {
+        this.stats.late++;
+      } else if (this.nextOut >= limit) {
+        this.stats.overflow++;
+      } else {
+        this.ring[this.nextOut & RING_MASK] = cubic(
+          buffer[i - 1],
+          buffer[i],
+          buffer[i + 1],
+          buffer[i + 2],
+          u - i
+        );
+      }
+      this.nextOut++;
+    }
+    this.buffer = buffer.subarray(count);
+    this.pos += count * ratio;
+
+    const lead = arrivalIdx - this.pos;
+    this.floor = Math.min(this.floor + count * ratio * FLOOR_LEAK, lead);
+  }
+}
+
+class RoomMixer {
+  constructor({ name, devices, delayMs, gain, onFrame, onSilence }) {
+    this.name = name;
+    this.devices = new Set(devices);
+    this.delaySamples = (delayMs * MIX_RATE) / 1000;
+    this.gain = gain;
+    this.onFrame = onFrame; // (Int16Array frame, timestamp)
+    this.onSilence = onSilence; // (silent, timestamp)
+    this.inputs = new Map(); // deviceId -> MixInput
+    this.timer = null;
+    this.mix = new Float32Array(MIX_FRAME);
+    this.stats = { frames: 0, silent: 0, clipped: 0, skipped: 0 };
+  }
+
+  get running() {
+    return this.timer !== null;
+  }
+
+  start() {
+    if (this.timer) {
+      return;
+    }
+    this.startedAt = performance.now();
+    this.readPos = 0;
+    this.silent = true;
+    this.inputs.clear();
+    this.timer = setInterval(() => this.tick(), MIX_FRAME_MS / 2);
+  }
+
+  stop() {
+    clearInterval(this.timer);
+    this.timer = null;
+    this.inputs.clear();
+  }
+
+  // A PCM/ADPCM packet's decoded samples from one of the room's devices.
+  // arrivedAt is performance.now() at arrival.
+  push(deviceId, samples, channels, timestamp, sampleRate, arrivedAt) {
+    if (!this.timer || !this.devices.has(deviceId) || sampleRate > MIX_RATE) {
+      return false; // No anti-alias filter - only rates up to the mix rate
+    }
+    let input = this.inputs.get(deviceId);
+    if (!input) {
+      input = new MixInput();
+      this.inputs.set(deviceId, input);
+    }
+    const count = samples.length / channels;
+    const mono = new Float32Array(count);
+    for (let i = 0; i < count; i++) {
+      mono[i] = channels === 2 ? (samples[2 * i] + samples[2 * i + 1]) / 2 : samples[i];
+    }
+    const arrivalIdx = ((arrivedAt - this.startedAt) * MIX_RATE) / 1000;
+    input.push(mono, timestamp, sampleRate, arrivalIdx, arrivedAt, this.readPos);
+    return true;
+  }
+
+  tick() {
+    const due = ((performance.now() - this.startedAt) * MIX_RATE) / 1000 - this.delaySamples;
+    const behind = Math.floor((due - this.readPos) / MIX_FRAME);
+    if (behind > MAX_CATCHUP_FRAMES) {
+      // The event loop stalled: what is buffered is too old to be worth playing
+      const skip = behind - 1;
+      this.readPos += skip * MIX_FRAME;
+      this.stats.skipped += skip;
+      this.inputs.forEach((input) => input.ring.fill(0));
+    }
+    while (this.readPos + MIX_FRAME <= due) {
+      this.mixFrame();
+    }
+  }
+
+  mixFrame() {
+    const mix = this.mix.fill(0);
+    const start = this.readPos;
+    let active = 0;
+    this.inputs.forEach((input) => {
+      const ring = input.ring;
+      let wrote = false;
+      for (let i = 0; i < MIX_FRAME; i++) {
+        const k = (start + i) & RING_MASK;
+        if (ring[k] !== 0) {
+          mix[i] += ring[k];
+          ring[k] = 0;
+          wrote = true;
+        }
+      }
+      if (wrote) {
+        active++;
+      }
+    });
+    this.readPos += MIX_FRAME;
+    const timestamp = start >>> 0;
+
+    if (active === 0) {
+      this.stats.silent++;
+      if (!this.silent) {
+        this.silent = true;
+        this.onSilence(true, timestamp);
+      }
+      return;
+    }
+    if (this.silent) {
+      this.silent = false;
+      if (this.stats.frames > 0) {
+        this.onSilence(false, timestamp);
+      }
+    }
+    const frame = new Int16Array(MIX_FRAME);
+    for (let i = 0; i < MIX_FRAME; i++) {
+      const value = Math.round(mix[i] * this.gain);
+      if (value > 32767 || value < -32768) {
+        this.stats.clipped++;
+      }
+      frame[i] = Math.max(-32768, Math.min(32767, value));
+    }
+    this.stats.frames++;
+    this.onFrame(frame, timestamp);
+  }
+
+  // Per input: drift in ppm, offset floor in ms and counters, for metrics
+  inputStats() {
+    const result = [];
+    this.inputs.forEach((input, deviceId) => {
+      result.push({
+        deviceId,
+        driftPpm: input.drift ? input.drift.ppm() : 0,
+        floorMs: (input.floor * 1000) / MIX_RATE,
+        ...input.stats,
+      });
+    });
+    return result;
+  }
+}
+
+module.exports = { RoomMixer, MIX_RATE, MIX_FRAME };
@@ -0,0 +1,56 @@
+{
+  "variables": {
+    "has_opus": "<!(pkg-config --exists opus && echo 1 || echo 0)"
+  },
+  "targets": [
+    {
+      "target_name": "relay_core",
+      "sources": ["relay_core.cc"],
+      "include_dirs": ["<!(node -p \"require('node-addon-api').include_dir\")"],
+      "defines": ["NAPI_VERSION=8", "NAPI_DISABLE_CPP_EXCEPTIONS"],
+      "cflags_cc": ["-O3"],
+      "xcode_settings": {
+        "OTHER_CPLUSPLUSFLAGS": ["-O3"]
+      },
+      "msvs_settings": {
+        "VCCLCompilerTool": { "Optimization": 2 }
+      }
+    },
+    {
+      "target_name": "spectrum",
+      "sources": ["spectrum.cc"],
+      "include_dirs": ["<!(node -p \"require('node-addon-api').include_dir\")"],
+      "defines": ["NAPI_VERSION=8", "NAPI_DISABLE_CPP_EXCEPTIONS", "_USE_MATH_DEFINES"],
+      "cflags_cc": ["-O3"],
+      "xcode_settings": {
+        "OTHER_CPLUSPLUSFLAGS": ["-O3"]
+      },
+      "msvs_settings": {
+        "VCCLCompilerTool": { "Optimization": 2 }
+      }
+    }
+  ],
+  "conditions": [
+    [
+      "has_opus==1",
+      {
+        "targets": [
+          {
+            "target_name": "opus_encoder",
+            "sources": ["opus_encoder.cc"],
+            "include_dirs": [
+              "<!(node -p \"require('node-addon-api').include_dir\")",
+              "<!@(pkg-config --cflags-only-I opus | sed s/-I//g)"
+            ],
+            "libraries": ["<!@(pkg-config --libs opus)"],
+            "defines": ["NAPI_VERSION=8", "NAPI_DISABLE_CPP_EXCEPTIONS"],
+            "cflags_cc": ["-O3"],
+            "xcode_settings": {
+              "OTHER_CPLUSPLUSFLAGS": ["-O3"]
+            }
+          }
+        ]
+      }
+    ]
+  ]
+}
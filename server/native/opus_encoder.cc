@@ -0,0 +1,145 @@
+/*
+Opus Encoder
+============
+
+libopus behind N-API, for the relay's transcoding stage (server.js,
+TRANSCODE=opus). One encoder per device stream: its PCM goes in once, and the
+Opus packets that come out are shared by every subscriber that decodes Opus.
+
+  const encoder = new OpusEncoder(sampleRate, bitrate, frameMs)
+  encoder.encode(samples: Int16Array) -> [Buffer, ...]   zero or more packets
+  encoder.frameSamples                                   samples per packet
+  encoder.reset()                                        drop buffered input
+
+Device blocks (e.g. 256 samples, 16 ms at 16 kHz) are not valid Opus frame
+sizes, so input collects in a FIFO and every full frameMs frame is encoded.
+The encoder runs as OPUS_APPLICATION_VOIP with in-band FEC off: the relay
+already conceals losses and the browser link is TCP.
+
+Built by `npm run build:native` when pkg-config finds libopus (see
+binding.gyp); server.js leaves transcoding off without it.
+*/
+
+#include <napi.h>
+#include <opus.h>
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+#define OPUS_MAX_PACKET 1276 // Largest packet for one frame, RFC 6716
+#define OPUS_DEFAULT_BITRATE 16000
+#define OPUS_DEFAULT_FRAME_MS 20
+
+class Encoder : public Napi::ObjectWrap<Encoder>
+{
+public:
+    static Napi::Object Init(Napi::Env env, Napi::Object exports)
+    {
+        Napi::Function ctor = DefineClass(env, "OpusEncoder",
+                                          {InstanceMethod("encode", &Encoder::Encode),
+                                           InstanceMethod("reset", &Encoder::Reset),
+                                           InstanceAccessor("frameSamples", &Encoder::FrameSamples, nullptr)});
+        exports.Set("OpusEncoder", ctor);
+        exports.Set("version", Napi::String::New(env, opus_get_version_string()));
+        return exports;
+    }
+
+    Encoder(const Napi::CallbackInfo &info) : Napi::ObjectWrap<Encoder>(info)
+    {
+        Napi::Env env = info.Env();
+        int32_t sampleRate = info.Length() > 0 && info[0].IsNumber() ? info[0].As<Napi::Number>().Int32Value() : 16000;
+        int32_t bitrate = info.Length() > 1 && info[1].IsNumber() ? info[1].As<Napi::Number>().Int32Value() : OPUS_DEFAULT_BITRATE;
+        int32_t frameMs = info.Length() > 2 && info[2].IsNumber() ? info[2].As<Napi::Number>().Int32Value() : OPUS_DEFAULT_FRAME_MS;
+        if (frameMs != 10 && frameMs != 20 && frameMs != 40 && frameMs != 60)
+        {
+            Napi::RangeError::New(env, "frameMs must be 10, 20, 40 or 60").ThrowAsJavaScriptException();
+            return;
+        }
+
+        int err = OPUS_OK;
+        encoder = opus_encoder_create(sampleRate, 1, OPUS_APPLICATION_VOIP, &err);
+        if (err != OPUS_OK)
+        {
+            encoder = NULL;
+            Napi::Error::New(env, opus_strerror(err)).ThrowAsJavaScriptException();
+            return;
+        }
+        opus_encoder_ctl(encoder, OPUS_SET_BITRATE(bitrate));
+        opus_encoder_ctl(encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+        opus_encoder_ctl(encoder, OPUS_SET_INBAND_FEC(0));
+        frameSamples = sampleRate / 1000 * frameMs;
+        fifo.resize(frameSamples);
+    }
+
+    ~Encoder()
+    {
+        if (encoder)
+            opus_encoder_destroy(encoder);
+    }
+
+private:
+    OpusEncoder *encoder = NULL;
+    std::vector<opus_int16> fifo; // One frame of pending input
+    size_t fifoUsed = 0;
+    int frameSamples = 0;
+
+    Napi::Value Encode(const Napi::CallbackInfo &info)
+    {
+        Napi::Env env = info.Env();
+        if (info.Length() < 1 || !info[0].IsTypedArray() ||
+            info[0].As<Napi::TypedArray>().TypedArrayType() != napi_int16_array)
+        {
+            Napi::TypeError::New(env, "encode(samples: Int16Array)").ThrowAsJavaScriptException();
+            return env.Null();
+        }
+        Napi::Int16Array input = info[0].As<Napi::Int16Array>();
+        const int16_t *samples = input.Data();
+        size_t count = input.ElementLength();
+
+        Napi::Array packets = Napi::Array::New(env);
+        uint32_t produced = 0;
+        uint8_t out[OPUS_MAX_PACKET];
+        while (count > 0 && encoder)
+        {
+            size_t n = frameSamples - fifoUsed;
+            if (n > count)
+                n = count;
+            memcpy(&fifo[fifoUsed], samples, n * sizeof(opus_int16));
+            fifoUsed += n;
+            samples += n;
+            count -= n;
+            if (fifoUsed < (size_t)frameSamples)
+                break;
+
+            fifoUsed = 0;
+            opus_int32 len = opus_encode(encoder, fifo.data(), frameSamples, out, sizeof(out));
+            if (len < 0)
+            {
+                Napi::Error::New(env, opus_strerror(len)).ThrowAsJavaScriptException();
+                return env.Null();
+            }
+            packets.Set(produced++, Napi::Buffer<uint8_t>::Copy(env, out, len));
+        }
+        return packets;
+    }
+
+    Napi::Value Reset(const Napi::CallbackInfo &info)
+    {
+        fifoUsed = 0;
+        if (encoder)
+            opus_encoder_ctl(encoder, OPUS_RESET_STATE);
+        return info.Env().Undefined();
+    }
+
+    Napi::Value FrameSamples(const Napi::CallbackInfo &info)
+    {
+        return Napi::Number::New(info.Env(), frameSamples);
+    }
+};
+
+static Napi::Object Init(Napi::Env env, Napi::Object exports)
+{
+    return Encoder::Init(env, exports);
+}
+
+NODE_API_MODULE(opus_encoder, Init)
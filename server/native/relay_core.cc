@@ -0,0 +1,374 @@
+/*
+Relay Core
+==========
+
+Native packet inspection for server.js. One call per packet parses the header
+(the same layout as src/audio_packet.h) and checks the payload: the CRC32 of
+version 3 packets, the additive checksum of legacy and version 2 packets.
+Before, the relay walked every sample in JavaScript to do this.
+
+inspect(buffer, verifyCrc, fields) writes the header into a caller-owned
+Uint32Array, so nothing is allocated per packet, and returns a status:
+  STATUS_OK                 header valid; for audio packets the payload checked out
+  STATUS_NOT_PACKET         not one of our packets (bad magic or header size)
+  STATUS_TOO_SMALL          audio payload shorter than the header says
+  STATUS_CRC_MISMATCH       version 3 CRC32 does not match - drop the packet
+  STATUS_CHECKSUM_MISMATCH  legacy checksum off by more than the tolerance -
+                            the relay only logs it, as before
+Only audio payloads are checked here. Silence, batch and stats packets are rare
+and are validated by server.js.
+
+The sample checksum (sum of |sample| over big-endian 16-bit PCM) and the ADPCM/
+Opus byte checksum use SSE2 or NEON when the build target has them. The CRC32
+is slicing-by-8, the IEEE polynomial as zlib and the ESP32 ROM crc32_le.
+
+Build with `npm run build:native` in server/. server.js falls back to its
+JavaScript implementations when the addon is not built.
+*/
+
+#include <napi.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define RELAY_SIMD "sse2"
+#define RELAY_HAS_SSE2 1
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define RELAY_SIMD "neon"
+#define RELAY_HAS_NEON 1
+#else
+#define RELAY_SIMD "scalar"
+#endif
+
+// Packet constants - see src/audio_packet.h
+#define PACKET_HEADER_MAGIC 0xA5
+#define PACKET_HEADER_MAGIC_V2 0xA6
+#define PACKET_FLAG_CRC32 0x01
+#define PACKET_TYPE_AUDIO 0x01
+#define PACKET_TYPE_AUDIO_ADPCM 0x02
+#define PACKET_TYPE_AUDIO_OPUS 0x03
+#define LEGACY_HEADER_SIZE 8
+#define V2_HEADER_SIZE 16
+#define V3_HEADER_SIZE 20
+#define ADPCM_HEADER_SIZE 4
+#define CHECKSUM_TOLERANCE 100 // Same slack the JavaScript check allows
+
+enum InspectStatus
+{
+    STATUS_OK,
+    STATUS_NOT_PACKET,
+    STATUS_TOO_SMALL,
+    STATUS_CRC_MISMATCH,
+    STATUS_CHECKSUM_MISMATCH
+};
+
+// Layout of the fields array filled by inspect()
+enum InspectField
+{
+    FIELD_TYPE,
+    FIELD_SEQ,
+    FIELD_SAMPLES,
+    FIELD_CHECKSUM,
+    FIELD_HEADER_SIZE,
+    FIELD_VERSION,     // 0 for the legacy header
+    FIELD_RATE_CODE,
+    FIELD_TIMESTAMP,
+    FIELD_CRC,
+    FIELD_FLAGS,       // FIELD_FLAG_* below
+    FIELD_PAYLOAD,     // Audio payload length in bytes
+    FIELD_CALCULATED,  // Legacy checksum as computed here
+    FIELD_COUNT
+};
+#define FIELD_FLAG_TIMESTAMP 0x01
+#define FIELD_FLAG_CRC 0x02
+
+static inline uint16_t readBe16(const uint8_t *p)
+{
+    return (uint16_t)((p[0] << 8) | p[1]);
+}
+
+static inline uint32_t readBe32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+// CRC32 slicing-by-8 tables, built once at load
+static uint32_t crcTable[8][256];
+
+static void initCrcTable()
+{
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        uint32_t c = n;
+        for (int k = 0; k < 8; k++)
+            c = c & 1 ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        crcTable[0][n] = c;
+    }
+    for (uint32_t n = 0; n < 256; n++)
+    {
+        for (int t = 1; t < 8; t++)
+            crcTable[t][n] = (crcTable[t - 1][n] >> 8) ^ crcTable[0][crcTable[t - 1][n] & 0xFF];
+    }
+}
+
+static uint32_t crc32(const uint8_t *p, size_t len)
+{
+    uint32_t crc = 0xFFFFFFFFu;
+    while (len >= 8)
+    {
+        uint32_t lo = crc ^ ((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+        uint32_t hi = (uint32_t)p[4] | ((uint32_t)p[5] << 8) | ((uint32_t)p[6] << 16) | ((uint32_t)p[7] << 24);
+        crc = crcTable[7][lo & 0xFF] ^ crcTable[6][(lo >> 8) & 0xFF] ^ crcTable[5][(lo >> 16) & 0xFF] ^
+              crcTable[4][lo >> 24] ^ crcTable[3][hi & 0xFF] ^ crcTable[2][(hi >> 8) & 0xFF] ^
+              crcTable[1][(hi >> 16) & 0xFF] ^ crcTable[0][hi >> 24];
+        p += 8;
+        len -= 8;
+    }
+    while (len--)
+        crc = crcTable[0][(crc ^ *p++) & 0xFF] ^ (crc >> 8);
+    return crc ^ 0xFFFFFFFFu;
+}
+
+// Sum of |sample| over big-endian 16-bit samples, mod 65536 like the ESP32.
+// 32-bit lanes: |-32768| does not fit in 16 bits. numSamples comes from a 16-bit
+// header field, so a lane sums at most ~16k samples and cannot overflow.
+static uint32_t sampleChecksum(const uint8_t *p, size_t numSamples)
+{
+    uint64_t sum = 0;
+    size_t i = 0;
+#if defined(RELAY_HAS_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    __m128i acc = zero;
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        __m128i v = _mm_loadu_si128((const __m128i *)(p + i * 2));
+        v = _mm_or_si128(_mm_slli_epi16(v, 8), _mm_srli_epi16(v, 8)); // Big-endian -> host
+        __m128i lo = _mm_srai_epi32(_mm_unpacklo_epi16(zero, v), 16); // Sign-extend to 32 bits
+        __m128i hi = _mm_srai_epi32(_mm_unpackhi_epi16(zero, v), 16);
+        __m128i slo = _mm_srai_epi32(lo, 31);
+        __m128i shi = _mm_srai_epi32(hi, 31);
+        acc = _mm_add_epi32(acc, _mm_sub_epi32(_mm_xor_si128(lo, slo), slo));
+        acc = _mm_add_epi32(acc, _mm_sub_epi32(_mm_xor_si128(hi, shi), shi));
+    }
+    uint32_t lanes[4];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    sum += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+#elif defined(RELAY_HAS_NEON)
+    uint32x4_t acc = vdupq_n_u32(0);
+    for (; i + 8 <= numSamples; i += 8)
+    {
+        int16x8_t v = vreinterpretq_s16_u8(vrev16q_u8(vld1q_u8(p + i * 2)));
+        acc = vaddq_u32(acc, vreinterpretq_u32_s32(vabsq_s32(vmovl_s16(vget_low_s16(v)))));
+        acc = vaddq_u32(acc, vreinterpretq_u32_s32(vabsq_s32(vmovl_s16(vget_high_s16(v)))));
+    }
+    sum += vgetq_lane_u32(acc, 0) + (uint64_t)vgetq_lane_u32(acc, 1) + vgetq_lane_u32(acc, 2) + vgetq_lane_u32(acc, 3);
+#endif
+    for (; i < numSamples; i++)
+        sum += (uint32_t)abs((int16_t)readBe16(p + i * 2));
+    return (uint32_t)(sum % 65536);
+}
+
+// Byte sum mod 65536 - the ADPCM and Opus checksum
+static uint32_t byteChecksum(const uint8_t *p, size_t len)
+{
+    uint64_t sum = 0;
+    size_t i = 0;
+#if defined(RELAY_HAS_SSE2)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= len; i += 16)
+        acc = _mm_add_epi64(acc, _mm_sad_epu8(_mm_loadu_si128((const __m128i *)(p + i)), _mm_setzero_si128()));
+    uint64_t lanes[2];
+    _mm_storeu_si128((__m128i *)lanes, acc);
+    sum = lanes[0] + lanes[1];
+#elif defined(RELAY_HAS_NEON)
+    uint64x2_t acc = vdupq_n_u64(0);
+    for (; i + 16 <= len; i += 16)
+        acc = vpadalq_u32(acc, vpaddlq_u16(vpaddlq_u8(vld1q_u8(p + i))));
+    sum = vgetq_lane_u64(acc, 0) + vgetq_lane_u64(acc, 1);
+#endif
+    for (; i < len; i++)
+        sum += p[i];
+    return (uint32_t)(sum % 65536);
+}
+
+// Parse and check one packet, see the top of the file
+static InspectStatus inspectPacket(const uint8_t *d, size_t len, bool verifyCrc, uint32_t *f)
+{
+    if (len < LEGACY_HEADER_SIZE)
+        return STATUS_NOT_PACKET;
+
+    for (int i = 0; i < FIELD_COUNT; i++)
+        f[i] = 0;
+    f[FIELD_TYPE] = d[1];
+    f[FIELD_SEQ] = readBe16(d + 2);
+    f[FIELD_SAMPLES] = readBe16(d + 4);
+    f[FIELD_CHECKSUM] = readBe16(d + 6);
+    f[FIELD_HEADER_SIZE] = LEGACY_HEADER_SIZE;
+
+    if (d[0] != PACKET_HEADER_MAGIC)
+    {
+        if (d[0] != PACKET_HEADER_MAGIC_V2 || len < V2_HEADER_SIZE || d[9] < V2_HEADER_SIZE)
+            return STATUS_NOT_PACKET;
+        f[FIELD_VERSION] = d[8];
+        f[FIELD_HEADER_SIZE] = d[9];
+        f[FIELD_RATE_CODE] = d[11];
+        f[FIELD_TIMESTAMP] = readBe32(d + 12);
+        f[FIELD_FLAGS] = FIELD_FLAG_TIMESTAMP;
+        if (d[8] >= 3 && (d[10] & PACKET_FLAG_CRC32))
+        {
+            if (d[9] < V3_HEADER_SIZE)
+                return STATUS_NOT_PACKET;
+            f[FIELD_CRC] = readBe32(d + 16);
+            f[FIELD_FLAGS] |= FIELD_FLAG_CRC;
+        }
+        if (len < f[FIELD_HEADER_SIZE])
+            return STATUS_NOT_PACKET;
+    }
+
+    uint32_t type = f[FIELD_TYPE];
+    if (type != PACKET_TYPE_AUDIO && type != PACKET_TYPE_AUDIO_ADPCM && type != PACKET_TYPE_AUDIO_OPUS)
+        return STATUS_OK;
+
+    size_t headerSize = f[FIELD_HEADER_SIZE];
+    size_t numSamples = f[FIELD_SAMPLES];
+    size_t payload = type == PACKET_TYPE_AUDIO_OPUS    ? len - headerSize
+                     : type == PACKET_TYPE_AUDIO_ADPCM ? ADPCM_HEADER_SIZE + (numSamples + 1) / 2
+                                                       : numSamples * 2;
+    f[FIELD_PAYLOAD] = (uint32_t)payload;
+    if (len < headerSize + payload)
+        return STATUS_TOO_SMALL;
+
+    const uint8_t *data = d + headerSize;
+    if (f[FIELD_FLAGS] & FIELD_FLAG_CRC)
+    {
+        if (!verifyCrc)
+            return STATUS_OK;
+        // Not secret, but compare without an early exit like the JavaScript check
+        return (crc32(data, payload) ^ f[FIELD_CRC]) == 0 ? STATUS_OK : STATUS_CRC_MISMATCH;
+    }
+
+    uint32_t calculated = type == PACKET_TYPE_AUDIO_OPUS    ? byteChecksum(data, payload)
+                          : type == PACKET_TYPE_AUDIO_ADPCM ? byteChecksum(data + ADPCM_HEADER_SIZE, payload - ADPCM_HEADER_SIZE)
+                                                            : sampleChecksum(data, numSamples);
+    f[FIELD_CALCULATED] = calculated;
+    int32_t diff = (int32_t)calculated - (int32_t)f[FIELD_CHECKSUM];
+    return abs(diff) > CHECKSUM_TOLERANCE ? STATUS_CHECKSUM_MISMATCH : STATUS_OK;
+}
+
+static bool throwUsage(const Napi::Env &env, const char *usage)
+{
+    Napi::TypeError::New(env, usage).ThrowAsJavaScriptException();
+    return false;
+}
+
+// Buffer argument plus an optional [offset, length) window inside it
+static bool bufferRange(const Napi::CallbackInfo &info, size_t lengthArg, const uint8_t **data, size_t *len)
+{
+    if (info.Length() < 1 || !info[0].IsBuffer())
+        return false;
+    Napi::Buffer<uint8_t> buffer = info[0].As<Napi::Buffer<uint8_t>>();
+    size_t offset = info.Length() > 1 ? info[1].As<Napi::Number>().Uint32Value() : 0;
+    size_t length = info.Length() > lengthArg ? info[lengthArg].As<Napi::Number>().Uint32Value() : buffer.Length() - offset;
+    if (offset > buffer.Length() || length > buffer.Length() - offset)
+        return false;
+    *data = buffer.Data() + offset;
+    *len = length;
+    return true;
+}
+
+// inspect(buffer, verifyCrc, fields: Uint32Array(FIELD_COUNT)) -> status
+static Napi::Value Inspect(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (info.Length() < 3 || !info[0].IsBuffer() || !info[2].IsTypedArray() ||
+        info[2].As<Napi::TypedArray>().TypedArrayType() != napi_uint32_array ||
+        info[2].As<Napi::TypedArray>().ElementLength() < FIELD_COUNT)
+    {
+        throwUsage(env, "inspect(buffer, verifyCrc, fields: Uint32Array(FIELD_COUNT))");
+        return env.Null();
+    }
+    Napi::Buffer<uint8_t> buffer = info[0].As<Napi::Buffer<uint8_t>>();
+    Napi::Uint32Array fields = info[2].As<Napi::Uint32Array>();
+    InspectStatus status = inspectPacket(buffer.Data(), buffer.Length(), info[1].ToBoolean().Value(), fields.Data());
+    return Napi::Number::New(env, status);
+}
+
+// crc32(buffer[, offset, length]) -> unsigned CRC32, same as zlib.crc32
+static Napi::Value Crc32(const Napi::CallbackInfo &info)
+{
+    const uint8_t *data;
+    size_t len;
+    if (!bufferRange(info, 2, &data, &len))
+    {
+        throwUsage(info.Env(), "crc32(buffer[, offset, length])");
+        return info.Env().Null();
+    }
+    return Napi::Number::New(info.Env(), crc32(data, len));
+}
+
+// sampleChecksum(buffer, offset, numSamples) -> checksum of 16-bit big-endian PCM
+static Napi::Value SampleChecksum(const Napi::CallbackInfo &info)
+{
+    const uint8_t *data;
+    size_t samples = info.Length() > 2 ? info[2].As<Napi::Number>().Uint32Value() : 0;
+    size_t len;
+    if (info.Length() < 3 || !bufferRange(info, 3, &data, &len) || len < samples * 2)
+    {
+        throwUsage(info.Env(), "sampleChecksum(buffer, offset, numSamples)");
+        return info.Env().Null();
+    }
+    return Napi::Number::New(info.Env(), sampleChecksum(data, samples));
+}
+
+// byteChecksum(buffer, offset, length) -> byte sum mod 65536
+static Napi::Value ByteChecksum(const Napi::CallbackInfo &info)
+{
+    const uint8_t *data;
+    size_t len;
+    if (!bufferRange(info, 2, &data, &len))
+    {
+        throwUsage(info.Env(), "byteChecksum(buffer, offset, length)");
+        return info.Env().Null();
+    }
+    return Napi::Number::New(info.Env(), byteChecksum(data, len));
+}
+
+static Napi::Object Init(Napi::Env env, Napi::Object exports)
+{
+    initCrcTable();
+    exports.Set("inspect", Napi::Function::New(env, Inspect));
+    exports.Set("crc32", Napi::Function::New(env, Crc32));
+    exports.Set("sampleChecksum", Napi::Function::New(env, SampleChecksum));
+    exports.Set("byteChecksum", Napi::Function::New(env, ByteChecksum));
+    exports.Set("simd", Napi::String::New(env, RELAY_SIMD));
+
+    // Index of each header field in the inspect() array
+    Napi::Object fields = Napi::Object::New(env);
+    fields.Set("type", Napi::Number::New(env, FIELD_TYPE));
+    fields.Set("seqNum", Napi::Number::New(env, FIELD_SEQ));
+    fields.Set("numSamples", Napi::Number::New(env, FIELD_SAMPLES));
+    fields.Set("checksum", Napi::Number::New(env, FIELD_CHECKSUM));
+    fields.Set("headerSize", Napi::Number::New(env, FIELD_HEADER_SIZE));
+    fields.Set("version", Napi::Number::New(env, FIELD_VERSION));
+    fields.Set("rateCode", Napi::Number::New(env, FIELD_RATE_CODE));
+    fields.Set("timestamp", Napi::Number::New(env, FIELD_TIMESTAMP));
+    fields.Set("crc", Napi::Number::New(env, FIELD_CRC));
+    fields.Set("flags", Napi::Number::New(env, FIELD_FLAGS));
+    fields.Set("payload", Napi::Number::New(env, FIELD_PAYLOAD));
+    fields.Set("calculated", Napi::Number::New(env, FIELD_CALCULATED));
+    exports.Set("fields", fields);
+    exports.Set("FIELD_COUNT", Napi::Number::New(env, FIELD_COUNT));
+    exports.Set("FIELD_FLAG_TIMESTAMP", Napi::Number::New(env, FIELD_FLAG_TIMESTAMP));
+    exports.Set("FIELD_FLAG_CRC", Napi::Number::New(env, FIELD_FLAG_CRC));
+    exports.Set("STATUS_OK", Napi::Number::New(env, STATUS_OK));
+    exports.Set("STATUS_NOT_PACKET", Napi::Number::New(env, STATUS_NOT_PACKET));
+    exports.Set("STATUS_TOO_SMALL", Napi::Number::New(env, STATUS_TOO_SMALL));
+    exports.Set("STATUS_CRC_MISMATCH", Napi::Number::New(env, STATUS_CRC_MISMATCH));
+    exports.Set("STATUS_CHECKSUM_MISMATCH", Napi::Number::New(env, STATUS_CHECKSUM_MISMATCH));
+    return exports;
+}
+
+NODE_API_MODULE(relay_core, Init)
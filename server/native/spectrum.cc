@@ -0,0 +1,141 @@
+/*
+Spectrum
+========
+
+Windowed power spectrum behind N-API, for the relay's level feed (levels.js).
+The relay runs one small FFT per device every few milliseconds of audio,
+however many wall displays watch, so this is the one place the feed spends
+CPU.
+
+  accumulate(frame: Float32Array, power: Float64Array)
+
+Applies a Hann window to the frame (N samples, a power of two from 16 to
+4096), runs an iterative radix-2 FFT and adds |X[k]|^2 for k = 0..N/2 into
+power (N/2 + 1 values). Adding up several frames between reads gives the
+Welch average; levels.js does the scaling. The window and twiddles are
+computed once per size.
+
+Built by `npm run build:native` with the relay core; levels.js has the same
+FFT in JavaScript for when it is not built.
+*/
+
+#include <napi.h>
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#define SPECTRUM_MIN_SIZE 16
+#define SPECTRUM_MAX_SIZE 4096
+
+struct FftPlan
+{
+    size_t size = 0;
+    std::vector<float> window;
+    std::vector<float> cosTable, sinTable; // N/2 twiddles
+    std::vector<uint32_t> reversed;        // Bit-reversed index of each input
+    std::vector<float> re, im;             // Work buffers
+};
+
+static FftPlan plan;
+
+static void preparePlan(size_t n)
+{
+    if (plan.size == n)
+        return;
+    plan.size = n;
+    plan.window.resize(n);
+    plan.cosTable.resize(n / 2);
+    plan.sinTable.resize(n / 2);
+    plan.reversed.resize(n);
+    plan.re.resize(n);
+    plan.im.resize(n);
+
+    for (size_t i = 0; i < n; i++)
+        plan.window[i] = (float)(0.5 - 0.5 * cos(2.0 * M_PI * i / n));
+    for (size_t i = 0; i < n / 2; i++)
+    {
+        plan.cosTable[i] = (float)cos(2.0 * M_PI * i / n);
+        plan.sinTable[i] = (float)-sin(2.0 * M_PI * i / n);
+    }
+    int bits = 0;
+    while (((size_t)1 << bits) < n)
+        bits++;
+    for (size_t i = 0; i < n; i++)
+    {
+        uint32_t r = 0;
+        for (int b = 0; b < bits; b++)
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        plan.reversed[i] = r;
+    }
+}
+
+static void transform(const float *frame)
+{
+    size_t n = plan.size;
+    float *re = plan.re.data();
+    float *im = plan.im.data();
+    for (size_t i = 0; i < n; i++)
+    {
+        re[plan.reversed[i]] = frame[i] * plan.window[i];
+        im[plan.reversed[i]] = 0.0f;
+    }
+    for (size_t half = 1; half < n; half <<= 1)
+    {
+        size_t step = n / (half * 2);
+        for (size_t start = 0; start < n; start += half * 2)
+        {
+            for (size_t k = 0; k < half; k++)
+            {
+                float wr = plan.cosTable[k * step];
+                float wi = plan.sinTable[k * step];
+                size_t a = start + k;
+                size_t b = a + half;
+                float tr = re[b] * wr - im[b] * wi;
+                float ti = re[b] * wi + im[b] * wr;
+                re[b] = re[a] - tr;
+                im[b] = im[a] - ti;
+                re[a] += tr;
+                im[a] += ti;
+            }
+        }
+    }
+}
+
+static Napi::Value Accumulate(const Napi::CallbackInfo &info)
+{
+    Napi::Env env = info.Env();
+    if (info.Length() < 2 || !info[0].IsTypedArray() || !info[1].IsTypedArray() ||
+        info[0].As<Napi::TypedArray>().TypedArrayType() != napi_float32_array ||
+        info[1].As<Napi::TypedArray>().TypedArrayType() != napi_float64_array)
+    {
+        Napi::TypeError::New(env, "accumulate(frame: Float32Array, power: Float64Array)")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+    }
+    Napi::Float32Array frame = info[0].As<Napi::Float32Array>();
+    Napi::Float64Array power = info[1].As<Napi::Float64Array>();
+    size_t n = frame.ElementLength();
+    if (n < SPECTRUM_MIN_SIZE || n > SPECTRUM_MAX_SIZE || (n & (n - 1)) != 0 ||
+        power.ElementLength() != n / 2 + 1)
+    {
+        Napi::RangeError::New(env, "frame must be a power of two from 16 to 4096, power N/2 + 1 long")
+            .ThrowAsJavaScriptException();
+        return env.Null();
+    }
+
+    preparePlan(n);
+    transform(frame.Data());
+    double *out = power.Data();
+    for (size_t k = 0; k <= n / 2; k++)
+        out[k] += (double)plan.re[k] * plan.re[k] + (double)plan.im[k] * plan.im[k];
+    return env.Undefined();
+}
+
+static Napi::Object Init(Napi::Env env, Napi::Object exports)
+{
+    exports.Set("accumulate", Napi::Function::New(env, Accumulate));
+    return exports;
+}
+
+NODE_API_MODULE(spectrum, Init)
@@ -0,0 +1,313 @@
+/**
+ * Playout worklet - see index.html
+ *
+ * Runs on the audio rendering thread. The page posts decoded or raw packets
+ * over the node's MessagePort (the sample buffer is transferred, not copied);
+ * this processor converts them to float, resamples to the context rate and
+ * appends them to one stereo ring buffer that process() reads 128 frames at a
+ * time. Mono packets go to both channels.
+ * There is one continuous stream, so no per-packet nodes and no clicks at
+ * packet boundaries.
+ *
+ * Messages in:
+ *   { type: "packet", format, data, sampleRate, timestamp, channels }
+ *       format "be16": big-endian 16-bit PCM straight from the packet,
+ *                      interleaved L/R when channels is 2
+ *              "i16":  Int16Array buffer (decoded ADPCM)
+ *              "f32":  Float32Array buffer (decoded Opus)
+ *       timestamp: capture sample clock in frames, or null for legacy packets
+ *   { type: "config", targetMs }   - playout delay the ring refills to
+ *   { type: "reset" }
+ * Messages out, once a second:
+ *   { type: "stats", fillMs, targetMs, queueMs, underruns, drops, concealed, late }
+ *   queueMs: average audio already buffered ahead of a packet when it was
+ *   added, i.e. its wait in the ring, over the last interval
+ *
+ * Playout: the ring fills to targetMs before output starts. An underrun
+ * outputs silence and waits for the ring to refill; more than targetMs +
+ * MAX_EXCESS_MS buffered drops the oldest audio, so latency stays bounded.
+ * A short hole on the capture clock (up to CONCEAL_MAX_BLOCKS) is filled with
+ * the previous block, faded out.
+ */
+
+const RING_SECONDS = 1;
+const MAX_EXCESS_MS = 40;
+const CONCEAL_MAX_BLOCKS = 2;
+const FADE_SAMPLES = 32; // Ramp after an underrun so the restart does not click
+const STATS_INTERVAL = 1; // Seconds
+const MAX_PACKET_SAMPLES = 8192; // Frames; same limit as the page's header check
+const MAX_RATE_RATIO = 6; // 8 kHz stream into a 48 kHz context
+
+// The player's soft compression: reduce dynamic range for voice above +-0.1
+function compress(samples, count) {
+  for (let i = 0; i < count; i++) {
+    const s = samples[i];
+    if (s > 0.1) {
+      samples[i] = 0.1 + (s - 0.1) * 0.8;
+    } else if (s < -0.1) {
+      samples[i] = -0.1 + (s + 0.1) * 0.8;
+    }
+  }
+}
+
+class PlayoutProcessor extends AudioWorkletProcessor {
+  constructor() {
+    super();
+    this.ring = new Float32Array(Math.ceil(sampleRate * RING_SECONDS));
+    this.ringRight = new Float32Array(this.ring.length);
+    this.readIndex = 0;
+    this.fill = 0;
+    this.targetSamples = Math.round(sampleRate * 0.04);
+    this.playing = false;
+    this.fadeIn = 0;
+
+    this.nextTimestamp = null; // Expected capture clock of the next packet
+    this.streamRate = 0;
+    this.phase = 0; // Resampler position between input samples
+    this.lastInput = 0; // Last input sample, for interpolation across packets
+    this.lastInputRight = 0;
+
+    // Scratch buffers, allocated once - nothing is allocated per packet here.
+    // The right channel mirrors the left for mono packets.
+    this.input = new Float32Array(MAX_PACKET_SAMPLES);
+    this.inputRight = new Float32Array(MAX_PACKET_SAMPLES);
+    this.block = new Float32Array(Math.ceil(MAX_PACKET_SAMPLES * MAX_RATE_RATIO));
+    this.blockRight = new Float32Array(this.block.length);
+    this.lastBlock = new Float32Array(this.block.length); // For concealment
+    this.lastBlockRight = new Float32Array(this.block.length);
+    this.lastLength = 0;
+
+    this.stats = { underruns: 0, drops: 0, concealed: 0, late: 0 };
+    this.statsFrames = 0;
+    this.queuedSum = 0; // Samples ahead of each packet added this interval
+    this.queuedPackets = 0;
+    this.port.onmessage = (event) => this.onMessage(event.data);
+  }
+
+  onMessage(message) {
+    if (message.type === "packet") {
+      this.addPacket(message);
+    } else if (message.type === "config") {
+      this.targetSamples = Math.min(
+        Math.round((sampleRate * message.targetMs) / 1000),
+        this.ring.length / 2
+      );
+    } else if (message.type === "reset") {
+      this.fill = 0;
+      this.playing = false;
+      this.nextTimestamp = null;
+      this.lastLength = 0;
+    }
+  }
+
+  // Input frames of a packet as floats in this.input / this.inputRight, with
+  // the player's soft compression; returns the frame count
+  toFloat(format, data, channels) {
+    let count;
+    const input = this.input;
+    const inputRight = this.inputRight;
+    if (format === "f32") {
+      const samples = new Float32Array(data);
+      count = Math.min(samples.length, input.length);
+      input.set(samples.subarray(0, count));
+    } else if (format === "i16") {
+      const samples = new Int16Array(data);
+      count = Math.min(samples.length, input.length);
+      for (let i = 0; i < count; i++) {
+        input[i] = samples[i] / 32768;
+      }
+    } else if (channels === 2) {
+      const view = new DataView(data);
+      count = Math.min(data.byteLength >> 2, input.length);
+      for (let i = 0; i < count; i++) {
+        input[i] = view.getInt16(i * 4, false) / 32768;
+        inputRight[i] = view.getInt16(i * 4 + 2, false) / 32768;
+      }
+    } else {
+      const view = new DataView(data);
+      count = Math.min(data.byteLength >> 1, input.length);
+      for (let i = 0; i < count; i++) {
+        input[i] = view.getInt16(i * 2, false) / 32768;
+      }
+    }
+
+    compress(input, count);
+    if (channels === 2) {
+      compress(inputRight, count);
+    } else {
+      inputRight.set(input.subarray(0, count));
+    }
+    return count;
+  }
+
+  // this.input at the stream rate into this.block at the context rate (linear
+  // interpolation, continuous across packets), and the same for the right
+  // channel; returns the block length
+  resample(count, rate) {
+    const input = this.input;
+    const inputRight = this.inputRight;
+    const block = this.block;
+    const blockRight = this.blockRight;
+    if (rate === sampleRate) {
+      block.set(input.subarray(0, count));
+      blockRight.set(inputRight.subarray(0, count));
+      return count;
+    }
+    const step = rate / sampleRate;
+    let n = 0;
+    let position = this.phase;
+    while (position < count && n < block.length) {
+      const index = Math.floor(position);
+      const frac = position - index;
+      const a = index === 0 ? this.lastInput : input[index - 1];
+      const b = input[index];
+      const aRight = index === 0 ? this.lastInputRight : inputRight[index - 1];
+      const bRight = inputRight[index];
+      block[n] = a + (b - a) * frac;
+      blockRight[n++] = aRight + (bRight - aRight) * frac;
+      position += step;
+    }
+    this.phase = position - count;
+    this.lastInput = input[count - 1];
+    this.lastInputRight = inputRight[count - 1];
+    return n;
+  }
+
+  addPacket({ format, data, sampleRate: rate, timestamp, channels = 1 }) {
+    const count = this.toFloat(format, data, channels);
+    if (count === 0) {
+      return;
+    }
+    if (rate !== this.streamRate) {
+      this.streamRate = rate; // New capture rate: new clock, new resampler state
+      this.nextTimestamp = null;
+      this.phase = 0;
+      this.lastInput = this.input[0];
+      this.lastInputRight = this.inputRight[0];
+      this.lastLength = 0;
+    }
+
+    if (timestamp !== null && this.nextTimestamp !== null) {
+      const gap = (timestamp - this.nextTimestamp) >>> 0;
+      if (gap >= 0x80000000) {
+        this.stats.late++; // Behind what was already played
+        return;
+      }
+      if (gap > 0 && gap <= count * CONCEAL_MAX_BLOCKS && this.lastLength > 0) {
+        this.conceal(Math.round((gap * sampleRate) / rate));
+      }
+    }
+    if (timestamp !== null) {
+      this.nextTimestamp = (timestamp + count) >>> 0;
+    }
+
+    const length = this.resample(count, rate);
+    const block = this.block;
+    const blockRight = this.blockRight;
+    this.queuedSum += this.fill;
+    this.queuedPackets++;
+    for (let i = 0; i < length; i++) {
+      this.push(block[i], blockRight[i]);
+    }
+    this.lastBlock.set(block.subarray(0, length));
+    this.lastBlockRight.set(blockRight.subarray(0, length));
+    this.lastLength = length;
+    this.trim();
+  }
+
+  // Previous block repeated over the hole, fading to silence
+  conceal(length) {
+    const previous = this.lastBlock;
+    const previousRight = this.lastBlockRight;
+    const previousLength = this.lastLength;
+    for (let i = 0; i < length; i++) {
+      const fade = 1 - i / length;
+      this.push(previous[i % previousLength] * fade, previousRight[i % previousLength] * fade);
+    }
+    this.stats.concealed += Math.ceil(length / previousLength);
+  }
+
+  push(left, right) {
+    const ring = this.ring;
+    if (this.fill === ring.length) {
+      this.readIndex = this.readIndex + 1 === ring.length ? 0 : this.readIndex + 1;
+      this.fill--; // Full: overwrite the oldest
+    }
+    const index = (this.readIndex + this.fill) % ring.length;
+    ring[index] = left;
+    this.ringRight[index] = right;
+    this.fill++;
+  }
+
+  // Too far behind live: drop the oldest audio down to the target
+  trim() {
+    const limit = this.targetSamples + Math.round((sampleRate * MAX_EXCESS_MS) / 1000);
+    if (this.fill > limit) {
+      const drop = this.fill - this.targetSamples;
+      this.readIndex = (this.readIndex + drop) % this.ring.length;
+      this.fill -= drop;
+      this.stats.drops++;
+      this.fadeIn = FADE_SAMPLES;
+    }
+  }
+
+  process(inputs, outputs) {
+    const output = outputs[0][0];
+    const outputRight = outputs[0][1] || null; // Absent on a mono node
+    const frames = output.length;
+
+    if (!this.playing && this.fill >= this.targetSamples) {
+      this.playing = true;
+      this.fadeIn = FADE_SAMPLES;
+    }
+    if (this.playing) {
+      const ring = this.ring;
+      const ringRight = this.ringRight;
+      const available = Math.min(frames, this.fill);
+      for (let i = 0; i < available; i++) {
+        let gain = 1;
+        if (this.fadeIn > 0) {
+          gain = 1 - this.fadeIn / FADE_SAMPLES;
+          this.fadeIn--;
+        }
+        output[i] = ring[this.readIndex] * gain;
+        if (outputRight) {
+          outputRight[i] = ringRight[this.readIndex] * gain;
+        }
+        this.readIndex = this.readIndex + 1 === ring.length ? 0 : this.readIndex + 1;
+      }
+      this.fill -= available;
+      if (available < frames) {
+        output.fill(0, available);
+        if (outputRight) {
+          outputRight.fill(0, available);
+        }
+        this.playing = false; // Underrun: refill to the target before resuming
+        this.stats.underruns++;
+      }
+    } else {
+      output.fill(0);
+      if (outputRight) {
+        outputRight.fill(0);
+      }
+    }
+
+    this.statsFrames += frames;
+    if (this.statsFrames >= sampleRate * STATS_INTERVAL) {
+      this.statsFrames = 0;
+      const queued = this.queuedPackets > 0 ? this.queuedSum / this.queuedPackets : this.fill;
+      this.queuedSum = 0;
+      this.queuedPackets = 0;
+      this.port.postMessage({
+        type: "stats",
+        fillMs: (this.fill * 1000) / sampleRate,
+        targetMs: (this.targetSamples * 1000) / sampleRate,
+        queueMs: (queued * 1000) / sampleRate,
+        ...this.stats,
+      });
+    }
+    return true;
+  }
+}
+
+registerProcessor("playout", PlayoutProcessor);
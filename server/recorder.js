@@ -0,0 +1,539 @@
+/**
+ * Server-side recorder - per-device audio on disk in time-limited segments
+ *
+ * Enabled with RECORD_DIR. Every device gets a directory, and each segment is
+ * a file named after its start time:
+ *
+ *   <RECORD_DIR>/<deviceId>/<YYYYMMDD-HHMMSS>.wav    PCM and ADPCM (decoded), stereo
+ *                                                    PCM as a two-channel WAV
+ *   <RECORD_DIR>/<deviceId>/<YYYYMMDD-HHMMSS>.opus   Opus, in Ogg pages
+ *   <same name>.idx                                  seek index, see below
+ *   <YYYYMMDD-HHMMSS>-backlog.wav / .opus            audio the device stored
+ *                                                    through an outage
+ *
+ * Backlog segments are named after the time the audio was captured. That is
+ * worked out from the live stream's capture clock, so they sort into the gap
+ * the outage left among the live segments. Their index has the original
+ * sequence numbers and timestamps, and their length limit counts audio time,
+ * not upload time.
+ *
+ * A segment ends after RECORD_SEGMENT_MINUTES, when the codec, sample rate or
+ * channel count changes, after a capture gap longer than RECORD_MAX_GAP_S, or when the
+ * device goes away. Shorter gaps in a WAV segment are filled with silence,
+ * so the byte offset keeps following the capture clock.
+ *
+ * Index: one 16-byte little-endian record per packet,
+ *   uint32 seq          - packet sequence number, unwrapped past 65535
+ *   uint32 timestamp    - capture sample clock from the header (0 if legacy)
+ *   uint32 offset       - byte offset of the packet's samples (WAV) or of the
+ *                         Ogg page holding it (Opus)
+ *   uint32 elapsedMs    - audio time since the segment started
+ * so a player can binary-search a time or sequence number without reading
+ * the audio file.
+ *
+ * Writes go through SegmentWriter: data is copied into RECORD_BUFFER_BYTES
+ * chunks, and each full chunk is one fs.write(), issued in order.
+ */
+
+const fs = require("fs");
+const path = require("path");
+const crypto = require("crypto");
+
+const RECORD_DIR = process.env.RECORD_DIR || "";
+const RECORD_SEGMENT_MS =
+  parseFloat(process.env.RECORD_SEGMENT_MINUTES || "10") * 60000;
+const RECORD_MAX_GAP_S = parseFloat(process.env.RECORD_MAX_GAP_S || "10");
+const RECORD_BUFFER_BYTES = 256 * 1024;
+const RECORD_FLUSH_MS = 2000; // Partial chunks reach the disk at least this often
+const RECORD_DEVICES = (process.env.RECORD_DEVICES || "*").split(",");
+
+const WAV_HEADER_SIZE = 44;
+const INDEX_ENTRY_SIZE = 16;
+const OPUS_RATE = 48000; // Ogg Opus granule positions always count 48 kHz samples
+const OPUS_PRE_SKIP = 312;
+const OGG_PAGE_MAX_PACKETS = 50; // ~1 s of 20 ms frames per page
+const OGG_PAGE_MAX_BYTES = 4096;
+
+// Ogg page CRC: polynomial 0x04c11db7, not reflected, no final xor
+const OGG_CRC_TABLE = new Uint32Array(256);
+for (let i = 0; i < 256; i++) {
+  let r = i << 24;
+  for (let j = 0; j < 8; j++) {
+    r = r & 0x80000000 ? (r << 1) ^ 0x04c11db7 : r << 1;
+  }
+  OGG_CRC_TABLE[i] = r >>> 0;
+}
+
+function oggCrc(buffer) {
+  let crc = 0;
+  for (let i = 0; i < buffer.length; i++) {
+    crc = ((crc << 8) ^ OGG_CRC_TABLE[((crc >>> 24) ^ buffer[i]) & 0xff]) >>> 0;
+  }
+  return crc;
+}
+
+// Samples at 48 kHz in an Opus packet, from its TOC byte (RFC 6716, 3.1)
+function opusPacketSamples(packet) {
+  if (packet.length < 1) {
+    return 0;
+  }
+  const toc = packet[0];
+  const config = toc >> 3;
+  let frameSamples;
+  if (config < 12) {
+    frameSamples = [480, 960, 1920, 2880][config & 3]; // SILK 10/20/40/60 ms
+  } else if (config < 16) {
+    frameSamples = [480, 960][config & 1]; // Hybrid 10/20 ms
+  } else {
+    frameSamples = [120, 240, 480, 960][config & 3]; // CELT 2.5/5/10/20 ms
+  }
+  const code = toc & 3;
+  const frames = code === 0 ? 1 : code < 3 ? 2 : packet.length > 1 ? packet[1] & 0x3f : 0;
+  return frameSamples * frames;
+}
+
+function timeName(date) {
+  const pad = (n) => String(n).padStart(2, "0");
+  return (
+    `${date.getFullYear()}${pad(date.getMonth() + 1)}${pad(date.getDate())}-` +
+    `${pad(date.getHours())}${pad(date.getMinutes())}${pad(date.getSeconds())}`
+  );
+}
+
+// Append-only file with large, ordered writes. patch() rewrites bytes that
+// were already written (the WAV sizes) once everything before it is on disk.
+class SegmentWriter {
+  constructor(file) {
+    this.fd = fs.openSync(file, "w");
+    this.chunk = Buffer.allocUnsafe(RECORD_BUFFER_BYTES);
+    this.used = 0;
+    this.position = 0; // File offset of chunk[0]
+    this.pending = Promise.resolve();
+  }
+
+  get offset() {
+    return this.position + this.used;
+  }
+
+  append(data) {
+    let done = 0;
+    while (done < data.length) {
+      const n = Math.min(data.length - done, this.chunk.length - this.used);
+      data.copy(this.chunk, this.used, done, done + n);
+      this.used += n;
+      done += n;
+      if (this.used === this.chunk.length) {
+        this.flush();
+      }
+    }
+  }
+
+  flush() {
+    if (this.used === 0) {
+      return;
+    }
+    const chunk = this.chunk;
+    const length = this.used;
+    const position = this.position;
+    this.position += length;
+    this.chunk = Buffer.allocUnsafe(RECORD_BUFFER_BYTES);
+    this.used = 0;
+    this.queue((fd, done) => fs.write(fd, chunk, 0, length, position, done));
+  }
+
+  patch(data, position) {
+    this.queue((fd, done) => fs.write(fd, data, 0, data.length, position, done));
+  }
+
+  close() {
+    this.flush();
+    this.queue((fd, done) => fs.close(fd, done));
+    return this.pending;
+  }
+
+  queue(operation) {
+    const fd = this.fd;
+    this.pending = this.pending.then(
+      () =>
+        new Promise((resolve) =>
+          operation(fd, (error) => {
+            if (error) {
+              console.error(`Recorder write error: ${error.message}`);
+            }
+            resolve();
+          })
+        )
+    );
+  }
+}
+
+// One segment: audio file, index, and the bookkeeping to fill or split gaps
+class Segment {
+  constructor(deviceDir, format, sampleRate, channels = 1, start = new Date(), suffix = "") {
+    const base = path.join(deviceDir, timeName(start) + suffix);
+    this.format = format;
+    this.sampleRate = sampleRate;
+    this.channels = channels;
+    this.inputRate = sampleRate; // Device rate, also for Opus
+    this.started = Date.now();
+    this.file = `${base}.${format === "opus" ? "opus" : "wav"}`;
+    this.audio = new SegmentWriter(this.file);
+    this.index = new SegmentWriter(`${base}.idx`);
+    this.entry = Buffer.alloc(INDEX_ENTRY_SIZE);
+    this.samples = 0; // Frames written so far, at sampleRate (48 kHz for Opus)
+    this.inputSamples = 0; // The same on the device clock, for backlog segment lengths
+    this.nextTimestamp = null;
+
+    if (format === "opus") {
+      this.serial = crypto.randomBytes(4).readUInt32LE(0);
+      this.pageSeq = 0;
+      this.pagePackets = [];
+      this.pageBytes = 0;
+      this.pageEntries = [];
+      this.writeOpusHeaders();
+    } else {
+      this.audio.append(Buffer.alloc(WAV_HEADER_SIZE)); // Sizes patched at close
+    }
+  }
+
+  addIndex(seq, timestamp, offset, samples = this.samples) {
+    this.entry.writeUInt32LE(seq >>> 0, 0);
+    this.entry.writeUInt32LE((timestamp || 0) >>> 0, 4);
+    this.entry.writeUInt32LE(offset >>> 0, 8);
+    this.entry.writeUInt32LE(Math.round((samples * 1000) / this.sampleRate) >>> 0, 12);
+    this.index.append(this.entry);
+  }
+
+  // Samples between the end of the last packet and this one on the capture
+  // clock; null when the header has no timestamp
+  gapBefore(timestamp) {
+    if (timestamp === null || this.nextTimestamp === null) {
+      return null;
+    }
+    const gap = (timestamp - this.nextTimestamp) >>> 0;
+    return gap < 0x80000000 ? gap : 0; // Older than expected: no gap
+  }
+
+  // samples: Int16Array, interleaved when the segment is stereo
+  writePcm(seq, timestamp, samples) {
+    const gap = this.gapBefore(timestamp);
+    if (gap) {
+      this.audio.append(Buffer.alloc(gap * 2 * this.channels)); // Silence keeps offsets on the clock
+      this.samples += gap;
+    }
+    this.addIndex(seq, timestamp, this.audio.offset);
+    const bytes = Buffer.from(samples.buffer, samples.byteOffset, samples.length * 2);
+    this.audio.append(bytes); // Int16Array is little-endian on every host we run on
+    const frames = samples.length / this.channels;
+    this.samples += frames;
+    this.inputSamples += frames;
+    if (timestamp !== null) {
+      this.nextTimestamp = (timestamp + frames) >>> 0;
+    }
+  }
+
+  writeOpus(seq, timestamp, packet, deviceSamples) {
+    if (
+      this.pagePackets.length >= OGG_PAGE_MAX_PACKETS ||
+      this.pageBytes + packet.length > OGG_PAGE_MAX_BYTES ||
+      this.laceCount() + Math.floor(packet.length / 255) + 1 > 255
+    ) {
+      this.flushPage(false);
+    }
+    this.pageEntries.push([seq, timestamp, this.samples]);
+    this.pagePackets.push(Buffer.from(packet));
+    this.pageBytes += packet.length;
+    this.samples += opusPacketSamples(packet);
+    this.inputSamples += deviceSamples;
+    if (timestamp !== null) {
+      this.nextTimestamp = (timestamp + deviceSamples) >>> 0;
+    }
+  }
+
+  laceCount() {
+    return this.pagePackets.reduce((n, p) => n + Math.floor(p.length / 255) + 1, 0);
+  }
+
+  writeOpusHeaders() {
+    const head = Buffer.alloc(19);
+    head.write("OpusHead", 0, "ascii");
+    head[8] = 1; // Version
+    head[9] = 1; // Mono
+    head.writeUInt16LE(OPUS_PRE_SKIP, 10);
+    head.writeUInt32LE(this.inputRate, 12);
+    head.writeInt16LE(0, 16); // Output gain
+    head[18] = 0; // Mapping family
+    this.writePage([head], 0, 0x02);
+
+    const vendor = Buffer.from("esp32-audio-relay");
+    const tags = Buffer.alloc(8 + 4 + vendor.length + 4);
+    tags.write("OpusTags", 0, "ascii");
+    tags.writeUInt32LE(vendor.length, 8);
+    vendor.copy(tags, 12);
+    tags.writeUInt32LE(0, 12 + vendor.length); // No user comments
+    this.writePage([tags], 0, 0);
+    this.sampleRate = OPUS_RATE;
+  }
+
+  // Packets collected so far go out as one page; every one is indexed at the
+  // page's offset, where a reader has to start decoding anyway
+  flushPage(last) {
+    if (this.pagePackets.length === 0 && !last) {
+      return;
+    }
+    const offset = this.audio.offset;
+    for (const [seq, timestamp, samples] of this.pageEntries) {
+      this.addIndex(seq, timestamp, offset, samples);
+    }
+    this.writePage(this.pagePackets, OPUS_PRE_SKIP + this.samples, last ? 0x04 : 0);
+    this.pagePackets = [];
+    this.pageEntries = [];
+    this.pageBytes = 0;
+  }
+
+  writePage(packets, granule, flags) {
+    const lacing = [];
+    for (const packet of packets) {
+      let length = packet.length;
+      while (length >= 255) {
+        lacing.push(255);
+        length -= 255;
+      }
+      lacing.push(length);
+    }
+    const header = Buffer.alloc(27 + lacing.length);
+    header.write("OggS", 0, "ascii");
+    header[4] = 0; // Version
+    header[5] = flags;
+    header.writeBigUInt64LE(BigInt(granule), 6);
+    header.writeUInt32LE(this.serial, 14);
+    header.writeUInt32LE(this.pageSeq++, 18);
+    header[26] = lacing.length;
+    Buffer.from(lacing).copy(header, 27);
+    const page = Buffer.concat([header, ...packets]);
+    page.writeUInt32LE(oggCrc(page), 22);
+    this.audio.append(page);
+  }
+
+  // Partial chunks to disk. A WAV header gets the sizes so far, so the file
+  // plays even if the relay dies before close().
+  flush() {
+    this.audio.flush();
+    this.index.flush();
+    if (this.format !== "opus") {
+      this.audio.patch(this.wavHeader(), 0);
+    }
+  }
+
+  wavHeader() {
+    const dataBytes = this.audio.offset - WAV_HEADER_SIZE;
+    const header = Buffer.alloc(WAV_HEADER_SIZE);
+    header.write("RIFF", 0, "ascii");
+    header.writeUInt32LE(36 + dataBytes, 4);
+    header.write("WAVEfmt ", 8, "ascii");
+    header.writeUInt32LE(16, 16);
+    header.writeUInt16LE(1, 20); // PCM
+    header.writeUInt16LE(this.channels, 22);
+    header.writeUInt32LE(this.sampleRate, 24);
+    header.writeUInt32LE(this.sampleRate * 2 * this.channels, 28);
+    header.writeUInt16LE(2 * this.channels, 32);
+    header.writeUInt16LE(16, 34);
+    header.write("data", 36, "ascii");
+    header.writeUInt32LE(dataBytes, 40);
+    return header;
+  }
+
+  close() {
+    if (this.format === "opus") {
+      this.flushPage(true);
+    }
+    this.flush();
+    return Promise.all([this.audio.close(), this.index.close()]);
+  }
+}
+
+// Per-device state: the open segment and the unwrapped sequence number. The
+// device's backlog gets a second one of these, which keeps its own segment
+// and reads capture times off the live one (`live`).
+class DeviceRecorder {
+  constructor(deviceId, live = null) {
+    this.dir = path.join(RECORD_DIR, deviceId.replace(/[^A-Za-z0-9._-]/g, "_"));
+    fs.mkdirSync(this.dir, { recursive: true });
+    this.deviceId = deviceId;
+    this.live = live;
+    this.segment = null;
+    this.lastSeq = null;
+    this.seqHigh = 0;
+    this.clock = null; // Live only: { timestamp, sampleRate, at } of the newest packet
+    this.backlogRecorder = null;
+  }
+
+  backlog() {
+    if (!this.backlogRecorder) {
+      this.backlogRecorder = new DeviceRecorder(this.deviceId, this);
+    }
+    return this.backlogRecorder;
+  }
+
+  noteClock(timestamp, sampleRate) {
+    if (timestamp !== null) {
+      this.clock = { timestamp, sampleRate, at: Date.now() };
+    }
+  }
+
+  // Wall-clock time of a capture timestamp, from the live stream's clock
+  captureTime(timestamp, sampleRate) {
+    const clock = this.live && this.live.clock;
+    if (!clock || timestamp === null || clock.sampleRate !== sampleRate) {
+      return new Date();
+    }
+    const behind = (clock.timestamp - timestamp) >>> 0;
+    return behind < 0x80000000
+      ? new Date(clock.at - (behind * 1000) / sampleRate)
+      : new Date();
+  }
+
+  unwrapSeq(seq) {
+    if (this.lastSeq !== null && seq < this.lastSeq && this.lastSeq - seq > 0x8000) {
+      this.seqHigh += 0x10000;
+    }
+    this.lastSeq = seq;
+    return this.seqHigh + seq;
+  }
+
+  // Current segment if it can take this packet, otherwise a new one
+  segmentFor(format, sampleRate, timestamp, channels = 1) {
+    const segment = this.segment;
+    if (segment) {
+      const gap = segment.gapBefore(timestamp);
+      const rate = format === "opus" ? segment.inputRate : segment.sampleRate;
+      if (
+        segment.format !== format ||
+        rate !== sampleRate ||
+        segment.channels !== channels ||
+        (this.live
+          ? (segment.inputSamples * 1000) / sampleRate
+          : Date.now() - segment.started) >= RECORD_SEGMENT_MS ||
+        (gap !== null && gap > RECORD_MAX_GAP_S * sampleRate)
+      ) {
+        this.close();
+      }
+    }
+    if (!this.segment) {
+      this.segment = this.live
+        ? new Segment(
+            this.dir,
+            format,
+            sampleRate,
+            channels,
+            this.captureTime(timestamp, sampleRate),
+            "-backlog"
+          )
+        : new Segment(this.dir, format, sampleRate, channels);
+      console.log(`Recording to ${this.segment.file}`);
+    }
+    return this.segment;
+  }
+
+  flush() {
+    if (this.segment) {
+      this.segment.flush();
+    }
+    if (this.backlogRecorder) {
+      this.backlogRecorder.flush();
+    }
+  }
+
+  close() {
+    if (this.segment) {
+      this.segment.close();
+      this.segment = null;
+    }
+    if (this.backlogRecorder) {
+      this.backlogRecorder.close();
+    }
+  }
+}
+
+const devices = new Map(); // deviceId -> DeviceRecorder
+
+function enabledFor(deviceId) {
+  return (
+    RECORD_DIR !== "" &&
+    (RECORD_DEVICES.includes("*") || RECORD_DEVICES.includes(deviceId))
+  );
+}
+
+function deviceRecorder(deviceId) {
+  let recorder = devices.get(deviceId);
+  if (!recorder) {
+    recorder = new DeviceRecorder(deviceId);
+    devices.set(deviceId, recorder);
+  }
+  return recorder;
+}
+
+// The live recorder, or its backlog one for packets stored through an outage
+function trackFor(deviceId, header, backlog) {
+  const recorder = deviceRecorder(deviceId);
+  if (backlog) {
+    return recorder.backlog();
+  }
+  recorder.noteClock(header.timestamp, header.sampleRate);
+  return recorder;
+}
+
+// Decoded PCM (Int16Array) from a validated PCM or ADPCM packet
+function recordPcm(deviceId, header, samples, backlog = false) {
+  if (!enabledFor(deviceId)) {
+    return;
+  }
+  const recorder = trackFor(deviceId, header, backlog);
+  const seq = recorder.unwrapSeq(header.seqNum);
+  recorder
+    .segmentFor("pcm", header.sampleRate, header.timestamp, header.channels || 1)
+    .writePcm(seq, header.timestamp, samples);
+}
+
+// Opus packet payload as the device sent it; deviceSamples is its length on
+// the capture clock (header numSamples)
+function recordOpus(deviceId, header, packet, backlog = false) {
+  if (!enabledFor(deviceId)) {
+    return;
+  }
+  const recorder = trackFor(deviceId, header, backlog);
+  const seq = recorder.unwrapSeq(header.seqNum);
+  recorder
+    .segmentFor("opus", header.sampleRate, header.timestamp)
+    .writeOpus(seq, header.timestamp, packet, header.numSamples);
+}
+
+// Device disconnected: finish its segment
+function closeDevice(deviceId) {
+  const recorder = devices.get(deviceId);
+  if (recorder) {
+    recorder.close();
+    devices.delete(deviceId);
+  }
+}
+
+function closeAll() {
+  devices.forEach((recorder) => recorder.close());
+  devices.clear();
+}
+
+// Push partial chunks to disk so a crash loses at most RECORD_FLUSH_MS of audio
+if (RECORD_DIR !== "") {
+  setInterval(() => {
+    devices.forEach((recorder) => recorder.flush());
+  }, RECORD_FLUSH_MS).unref();
+}
+
+module.exports = {
+  enabled: RECORD_DIR !== "",
+  recordPcm,
+  recordOpus,
+  closeDevice,
+  closeAll,
+  SegmentWriter, // Also writes traffic captures, see capture.js
+};
@@ -0,0 +1,246 @@
+/**
+ * Replay a traffic capture (capture.js) into a relay
+ *
+ * Every captured connection is opened again, with its User-Agent, and sends
+ * its frames in the captured order. UDP sources each get their own socket.
+ * Frames go out at the captured pace, faster, or as fast as the relay takes
+ * them:
+ *
+ *   CAPTURE_FILE=fleet.rcap node server.js     # record, stop with Ctrl-C
+ *   node replay.js fleet.rcap --speed=10      # replay 10x faster
+ *
+ * Options (defaults in brackets):
+ *   --url            relay WebSocket URL; UDP goes to the same host [ws://localhost:3012]
+ *   --udp-port       relay UDP port [3013]
+ *   --speed          time scale, or "max" for no pacing [1]
+ *   --loops          times through the file, each with new connections [1]
+ *   --devices-only   1 skips the captured browsers, so only device traffic
+ *                    goes in and the relay fans out to nobody [0]
+ *   --interval       seconds between report lines [5]
+ *
+ * A connection is open before the record after its opening is sent, so the
+ * relay sees the frames of all connections in the captured order, at any
+ * speed. At --speed=max the replay waits for a socket's send buffer to drain
+ * below MAX_BUFFERED_BYTES; the relay's ingest rate is then the result. Lag
+ * is how far the replay ran behind the scaled capture clock. For the relay's
+ * own side, compare its /metrics before and after (see metrics.js).
+ *
+ * Device IDs and sequence numbers are the captured ones. Replay against a
+ * relay the captured devices are not connected to, and after a previous run's
+ * connections have closed.
+ */
+
+const WebSocket = require("ws");
+const dgram = require("dgram");
+const capture = require("./capture");
+
+const MAX_BUFFERED_BYTES = 4 * 1024 * 1024;
+const YIELD_EVERY = 256; // Records between event loop turns at --speed=max
+const BROWSER_PATTERN = /Mozilla|Chrome|Safari/; // As the relay identifies them
+
+function parseArgs(argv) {
+  const options = {
+    url: "ws://localhost:3012",
+    "udp-port": 3013,
+    speed: 1,
+    loops: 1,
+    "devices-only": 0,
+    interval: 5,
+  };
+  let file = null;
+  argv.forEach((arg) => {
+    const match = /^--([a-z-]+)=(.*)$/.exec(arg);
+    if (!match) {
+      file = arg;
+      return;
+    }
+    if (!(match[1] in options)) {
+      console.error(`Unknown option: ${arg}`);
+      process.exit(2);
+    }
+    const [, name, value] = match;
+    options[name] = name === "url" || (name === "speed" && value === "max") ? value : Number(value);
+  });
+  if (!file) {
+    console.error("Usage: node replay.js <capture file> [--speed=1|<factor>|max] [options]");
+    process.exit(2);
+  }
+  if (options.speed !== "max" && !(options.speed > 0)) {
+    console.error("--speed must be a positive number or max");
+    process.exit(2);
+  }
+  return { file, options };
+}
+
+const stats = {
+  records: 0,
+  frames: 0,
+  bytes: 0,
+  skipped: 0, // Frames of connections not replayed
+  received: 0, // Frames the relay sent to replayed browsers
+  receivedBytes: 0,
+  errors: 0,
+  lagMs: 0, // Worst in the report window
+};
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+function openWebSocket(url, userAgent) {
+  return new Promise((resolve) => {
+    const ws = new WebSocket(url, { headers: { "User-Agent": userAgent } });
+    ws.binaryType = "nodebuffer";
+    ws.on("open", () => resolve(ws));
+    ws.on("message", (data) => {
+      stats.received++;
+      stats.receivedBytes += data.length;
+    });
+    ws.on("error", () => {
+      stats.errors++;
+      resolve(null);
+    });
+  });
+}
+
+async function waitForDrain(ws) {
+  while (ws.readyState === WebSocket.OPEN && ws.bufferedAmount > MAX_BUFFERED_BYTES) {
+    await sleep(1);
+  }
+}
+
+// One pass over the file; returns the captured time span in ms
+async function replayOnce(file, options, udpHost) {
+  const connections = new Map(); // Capture connection ID -> { ws } or { udp }
+  let first = null;
+  let last = 0;
+  let startedAt = 0;
+  let count = 0;
+  for (const record of capture.readCapture(file)) {
+    stats.records++;
+    if (first === null) {
+      first = record.time;
+      startedAt = performance.now();
+    }
+    last = record.time;
+    if (options.speed === "max") {
+      if (++count % YIELD_EVERY === 0) {
+        await new Promise((resolve) => setImmediate(resolve));
+      }
+    } else {
+      const due = startedAt + (record.time - first) / options.speed;
+      const wait = due - performance.now();
+      if (wait > 1) {
+        await sleep(wait);
+      }
+      stats.lagMs = Math.max(stats.lagMs, performance.now() - due);
+    }
+
+    const connection = connections.get(record.connection);
+    switch (record.kind) {
+      case capture.KIND_OPEN: {
+        const info = JSON.parse(record.data.toString());
+        if (info.transport === "udp") {
+          const udp = dgram.createSocket("udp4");
+          udp.on("error", () => stats.errors++);
+          connections.set(record.connection, { udp });
+        } else if (options["devices-only"] && BROWSER_PATTERN.test(info.userAgent)) {
+          connections.set(record.connection, {});
+        } else {
+          connections.set(record.connection, { ws: await openWebSocket(options.url, info.userAgent) });
+        }
+        break;
+      }
+      case capture.KIND_CLOSE:
+        if (connection && connection.ws) {
+          connection.ws.close();
+        }
+        connections.delete(record.connection);
+        break;
+      case capture.KIND_BINARY:
+      case capture.KIND_TEXT:
+        if (!connection || !connection.ws || connection.ws.readyState !== WebSocket.OPEN) {
+          stats.skipped++;
+          break;
+        }
+        if (options.speed === "max") {
+          await waitForDrain(connection.ws);
+        }
+        connection.ws.send(record.data, { binary: record.kind === capture.KIND_BINARY });
+        stats.frames++;
+        stats.bytes += record.data.length;
+        break;
+      case capture.KIND_UDP:
+        if (!connection || !connection.udp) {
+          stats.skipped++;
+          break;
+        }
+        connection.udp.send(record.data, options["udp-port"], udpHost);
+        stats.frames++;
+        stats.bytes += record.data.length;
+        break;
+    }
+  }
+
+  // Let the last frames go out before the connections close
+  for (const { ws } of connections.values()) {
+    if (ws) {
+      await waitForDrain(ws);
+    }
+  }
+  await sleep(500);
+  connections.forEach(({ ws, udp }) => {
+    if (ws) {
+      ws.close();
+    }
+    if (udp) {
+      udp.close();
+    }
+  });
+  return first === null ? 0 : last - first;
+}
+
+function report(base, seconds) {
+  const rate = (key) => ((stats[key] - base[key]) / seconds).toFixed(0);
+  const line =
+    `sent ${rate("frames")} frames/s (${((stats.bytes - base.bytes) / seconds / 1e6).toFixed(2)} MB/s), ` +
+    `browsers received ${rate("received")} frames/s | skipped ${stats.skipped}, errors ${stats.errors}` +
+    (typeof base.speed === "number" ? `, lag max ${stats.lagMs.toFixed(1)} ms` : "");
+  stats.lagMs = 0;
+  return line;
+}
+
+async function main() {
+  const { file, options } = parseArgs(process.argv.slice(2));
+  const udpHost = new URL(options.url).hostname;
+  console.log(`Replaying ${file} -> ${options.url} (UDP ${udpHost}:${options["udp-port"]}), speed ${options.speed}`);
+
+  let windowBase = { ...stats, speed: options.speed };
+  let windowStart = performance.now();
+  const reportTimer = setInterval(() => {
+    const now = performance.now();
+    console.log(report(windowBase, (now - windowStart) / 1000));
+    windowBase = { ...stats, speed: options.speed };
+    windowStart = now;
+  }, options.interval * 1000);
+
+  const runStart = performance.now();
+  let captured = 0;
+  for (let loop = 0; loop < options.loops; loop++) {
+    captured += await replayOnce(file, options, udpHost);
+  }
+  clearInterval(reportTimer);
+
+  const elapsed = performance.now() - runStart;
+  console.log(
+    `\nReplayed ${stats.records} records (${stats.frames} frames, ${(stats.bytes / 1e6).toFixed(1)} MB) ` +
+      `in ${(elapsed / 1000).toFixed(1)} s: ${(captured / 1000).toFixed(1)} s of capture, ` +
+      `${(captured / elapsed).toFixed(2)}x real time\n` +
+      `  browsers received ${stats.received} frames (${(stats.receivedBytes / 1e6).toFixed(1)} MB), ` +
+      `skipped ${stats.skipped}, socket errors ${stats.errors}`
+  );
+  process.exit(0);
+}
+
+main().catch((error) => {
+  console.error(error.message);
+  process.exit(1);
+});
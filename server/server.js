@@ -1,16 +1,46 @@
 /**
  * WebSocket Server for ESP32 Audio Streaming
- * Handles both raw PCM and ADPCM audio from ESP32 devices
+ * Handles both raw PCM and ADPCM audio from ESP32 devices, over the WebSocket
+ * or as UDP datagrams (same packet format) with the WebSocket as control plane
  */
 
 const express = require("express");
 const http = require("http");
 const WebSocket = require("ws");
 const path = require("path");
+const fs = require("fs");
+const crypto = require("crypto");
+const zlib = require("zlib");
+const dgram = require("dgram");
+const cluster = require("cluster");
+const {
+  createBackplane,
+  runClusterPrimary,
+  SUBSCRIBE_ALL,
+} = require("./backplane");
+const recorder = require("./recorder");
+const capture = require("./capture");
+const { ReorderBuffer } = require("./jitter");
+const { StatusEncoder } = require("./status_frame");
+const { DeviceLatency, relayNow } = require("./clock_sync");
+const { RoomMixer, MIX_RATE } = require("./mixer");
+const levels = require("./levels");
+const webrtc = require("./webrtc");
+const metrics = require("./metrics");
+
+// Clustered mode (RELAY_WORKERS > 1): the primary only forks workers and routes
+// backplane messages between them; each worker runs everything below
+const RELAY_WORKERS = parseInt(process.env.RELAY_WORKERS || "1", 10);
+if (cluster.isPrimary && RELAY_WORKERS > 1) {
+  runClusterPrimary(RELAY_WORKERS, log);
+  return;
+}
+capture.start(); // CAPTURE_FILE, see capture.js
 
 // Server configuration
 const app = express();
 const port = process.env.PORT || 3012;
+const udpPort = process.env.UDP_PORT || 3013; // UDP audio transport, see src/main.cpp
 const server = http.createServer(app);
 const wss = new WebSocket.Server({ server });
 
@@ -22,10 +52,437 @@ let audioPacketsReceived = 0;
 let totalAudioPackets = 0;
 let packetCount = 0;
 
-// ESP32 audio packet constants
-const PACKET_HEADER_MAGIC = 0xa5;
+// Per-device fan-out: device ID -> browsers subscribed to it. Browsers on
+// SUBSCRIBE_ALL get every device. Devices never receive each other's audio.
+const subscribers = new Map([[SUBSCRIBE_ALL, new Set()]]);
+
+// Per-client backpressure. Once a socket has SEND_BUFFER_LIMIT bytes waiting in
+// ws, packets go to a queue of at most SEND_QUEUE_LIMIT that drops the oldest,
+// so a slow browser stays at most that far behind live and memory stays bounded.
+// Status messages are latest-only: a newer one replaces a queued one.
+const SEND_BUFFER_LIMIT = parseInt(process.env.SEND_BUFFER_LIMIT || "65536", 10);
+const SEND_QUEUE_LIMIT = parseInt(process.env.SEND_QUEUE_LIMIT || "32", 10);
+let nextClientId = 1;
+let totalSendDrops = 0;
+
+// Other relay processes (cluster workers or Redis nodes), see backplane.js.
+// Their last status reports are summed into ours; silent ones expire.
+const backplane = createBackplane();
+const REMOTE_STATUS_TIMEOUT = 15000;
+const remoteStatus = new Map(); // origin -> { status, at }
+const remoteSources = new Map(); // deviceId -> source for packets from the backplane
+let publishedInterest = "";
+
+// Status is coalesced into one tick per STATUS_INTERVAL_MS and only sent when it
+// changed. Each client picks a detail level: "summary" (JSON, the default),
+// "devices" (binary per-device metrics with deltas, see status_frame.js) or
+// "none". ESP32s get none.
+const STATUS_INTERVAL_MS = parseInt(process.env.STATUS_INTERVAL_MS || "1000", 10);
+const STATUS_DETAILS = ["none", "summary", "devices"];
+const STATUS_PUBLISH_INTERVAL = 5000; // Backplane report even when unchanged
+const statusEncoder = new StatusEncoder();
+let lastStatusSummary = null;
+let lastStatusPublished = 0;
+let lastPublishedStatus = null;
+let deviceMetrics = {}; // deviceId -> rates over the last status tick
+let lastMetricsAt = Date.now();
+
+// ESP32 audio packet constants - see src/audio_packet.h
+const PACKET_HEADER_MAGIC = 0xa5; // Legacy 8-byte header
+const PACKET_HEADER_MAGIC_V2 = 0xa6; // Versioned header with capture timestamp
+const LEGACY_HEADER_SIZE = 8;
+const PACKET_HEADER_SIZE = 20; // Version 3 header, as the relay writes it
+const PACKET_HEADER_VERSION = 3;
+const PACKET_FLAG_CRC32 = 0x01; // Version 3+: CRC32 of the payload at offset 16
+const PACKET_FLAG_STEREO = 0x02; // Interleaved L/R PCM, numSamples counts both channels
+const SAMPLE_RATE = 16000; // Default capture rate, rate code 0
+const PACKET_RATES = [16000, 8000, 44100]; // Header rate code -> sample rate
 const PACKET_TYPE_AUDIO = 0x01;
-const PACKET_HEADER_SIZE = 8;
+const PACKET_TYPE_AUDIO_ADPCM = 0x02;
+const PACKET_TYPE_AUDIO_OPUS = 0x03;
+const PACKET_TYPE_SILENCE = 0x04; // VAD control packet, see src/audio_packet.h
+const SILENCE_PAYLOAD_SIZE = 4; // state(1) + reserved(1) + noiseRms(2)
+const SILENCE_START = 0x01;
+const SILENCE_STOP = 0x00;
+const PACKET_TYPE_BATCH = 0x05; // Several packets in one frame, [length(2)] + packet each
+const BATCH_ENTRY_HEADER_SIZE = 2;
+const PACKET_TYPE_STATS = 0x06; // Device telemetry, payload layout in src/telemetry.h
+const STATS_COUNTERS_SIZE = 36;
+const STATS_HEAP_SIZE = 16; // Heap and network arena trailer, absent from older firmware
+const STATS_TASK_SIZE = 14; // Per task after the heap trailer, see src/task_topology.h
+const STATS_TASKS = [
+  "microphone",
+  "network",
+  "opus",
+  "wakeWord",
+  "monitor",
+  "camera",
+  "person",
+  "statusLed",
+  "idle0",
+  "idle1",
+]; // TaskId order
+const STATS_STAGES = ["i2sWait", "convert", "encode", "enqueue", "send"];
+const PACKET_TYPE_BACKLOG = 0x07; // Outage audio uploaded later, laid out like a batch
+const PACKET_TYPE_VIDEO = 0x08; // JPEG camera frame, stamped on the audio sample clock
+const VIDEO_HEADER_SIZE = 8; // width(2) + height(2) + quality(1) + personScore(1) + reserved(2)
+const ADPCM_HEADER_SIZE = 4; // predictor(2) + stepIndex(1) + reserved(1)
+
+// Native relay core (server/native, `npm run build:native`): header parsing and
+// payload checks in C++ with SIMD. Without a build the JavaScript checks are used.
+let relayCore = null;
+try {
+  relayCore = require("./native/build/Release/relay_core.node");
+} catch (error) {
+  relayCore = null;
+}
+const nativeFields = relayCore ? new Uint32Array(relayCore.FIELD_COUNT) : null;
+
+// Transcoding stage (TRANSCODE=opus): 16 kHz PCM/ADPCM from a device is encoded
+// to Opus once, and the packets go to every subscriber that decodes Opus. Needs
+// the opus_encoder addon, built with the relay core when libopus is installed.
+const TRANSCODE = process.env.TRANSCODE || "off";
+const TRANSCODE_BITRATE = parseInt(process.env.TRANSCODE_BITRATE || "16000", 10);
+const TRANSCODE_FRAME_MS = 20;
+const TRANSCODE_RATE = 16000; // The browsers' Opus decoder runs at SAMPLE_RATE
+let opusAddon = null;
+if (TRANSCODE === "opus") {
+  try {
+    opusAddon = require("./native/build/Release/opus_encoder.node");
+  } catch (error) {
+    console.warn("TRANSCODE=opus but the opus_encoder addon is not built - transcoding off");
+  }
+}
+let totalTranscoded = 0;
+
+// Sequence handling per device, see jitter.js: after a gap, up to JITTER_DEPTH
+// later packets wait at most JITTER_WAIT_MS for the missing one. Lost PCM/ADPCM
+// packets are concealed by repeating the previous block, fading by PLC_FADE per
+// packet, for up to PLC_MAX_PACKETS in a row; longer gaps stay gaps.
+const JITTER_DEPTH = parseInt(process.env.JITTER_DEPTH || "4", 10);
+const JITTER_WAIT_MS = parseInt(process.env.JITTER_WAIT_MS || "60", 10);
+const PLC_MAX_PACKETS = parseInt(process.env.PLC_MAX_PACKETS || "3", 10);
+const PLC_FADE = 0.5;
+
+// Room mixer, see mixer.js: MIX_ROOMS="hall=dev1,dev2;lobby=dev3,dev4" names
+// the devices mixed into each room. Browsers subscribe to "room:hall" and get
+// one PCM stream (Opus with TRANSCODE=opus) instead of one per microphone.
+// MIX_DELAY_MS is the mix's jitter budget, on top of the reorder wait.
+const MIX_ROOM_PREFIX = "room:";
+const MIX_DELAY_MS = parseInt(process.env.MIX_DELAY_MS || "200", 10);
+const MIX_GAIN = parseFloat(process.env.MIX_GAIN || "1");
+const mixRooms = new Map(); // "room:<name>" -> { mixer, source }
+(process.env.MIX_ROOMS || "").split(";").forEach((entry) => {
+  const [name, list] = entry.split("=").map((part) => (part || "").trim());
+  const devices = (list || "").split(",").map((id) => id.trim()).filter(Boolean);
+  if (!name || devices.length === 0) {
+    return;
+  }
+  // The room's stream goes out as if from a device with the room's ID
+  const source = { deviceId: MIX_ROOM_PREFIX + name, isMix: true, seq: 0 };
+  const mixer = new RoomMixer({
+    name,
+    devices,
+    delayMs: MIX_DELAY_MS,
+    gain: MIX_GAIN,
+    onFrame: (frame, timestamp) => sendMixFrame(source, frame, timestamp),
+    onSilence: (silent, timestamp) => sendMixSilence(source, silent, timestamp),
+  });
+  mixRooms.set(source.deviceId, { mixer, source });
+});
+
+// Level feed, see levels.js: browsers that send {"type":"levels","devices":[...]}
+// get every LEVELS_INTERVAL_MS one binary frame with RMS, peak and a coarse
+// spectrum of those devices (SUBSCRIBE_ALL for all), without their audio.
+// Devices are only metered while a browser wants their levels.
+const LEVELS_INTERVAL_MS = parseInt(process.env.LEVELS_INTERVAL_MS || "100", 10);
+const LEVELS_IDLE_MS = 5000; // A meter with no packets this long is dropped
+const levelMeters = new Map(); // deviceId -> LevelMeter
+let levelDevices = new Set(); // Devices any browser wants levels of
+
+// Latency measurement mode, see clock_sync.js. While a browser has it on, each
+// local device is probed every CLOCK_SYNC_INTERVAL_MS and the browsers get a
+// per-device latency report on the same tick.
+const CLOCK_SYNC_INTERVAL_MS = parseInt(process.env.CLOCK_SYNC_INTERVAL_MS || "2000", 10);
+const deviceLatency = new Map(); // deviceId -> DeviceLatency
+
+// Payload CRC verification: "always", "never", or "auto" to skip it on TLS
+// connections, where the transport already guarantees integrity
+const CRC_VERIFY = process.env.CRC_VERIFY || "auto";
+
+// Packet path instrumentation, served on /metrics (see metrics.js). Nothing in
+// the packet path logs per packet: warnings are rate limited to one per kind
+// every LOG_SAMPLE_MS, and DEBUG_PACKETS=1 logs one sampled packet a second.
+const LOG_SAMPLE_MS = parseInt(process.env.LOG_SAMPLE_MS || "10000", 10);
+const DEBUG_PACKETS = process.env.DEBUG_PACKETS === "1";
+const PACKET_TYPE_NAMES = ["unknown", "pcm", "adpcm", "opus", "silence", "batch", "stats", "backlog", "video"];
+const packetsReceived = new metrics.Counter(
+  "relay_packets_received_total",
+  "Packets received from devices, batch entries counted one by one",
+  ["type"]
+);
+const backlogPackets = new metrics.Counter(
+  "relay_backlog_packets_total",
+  "Stored outage packets uploaded by devices, by what happened to them",
+  ["result"]
+);
+const videoFrames = new metrics.Counter(
+  "relay_video_frames_total",
+  "Camera frames received from devices, by what happened to them",
+  ["result"]
+);
+const videoReplaced = new metrics.Counter(
+  "relay_video_replaced_total",
+  "Frames held for a slow browser and replaced by a newer one before they went out"
+);
+const photoUploads = new metrics.Counter(
+  "relay_photo_uploads_total",
+  "Photos posted by battery camera units, by result",
+  ["result"]
+);
+const packetsDropped = new metrics.Counter(
+  "relay_packets_dropped_total",
+  "Device packets dropped before forwarding",
+  ["reason"]
+);
+const checksumMismatches = new metrics.Counter(
+  "relay_checksum_mismatches_total",
+  "Legacy checksum mismatches (these packets are still forwarded)"
+);
+const levelFrames = new metrics.Counter(
+  "relay_level_frames_total",
+  "Level feed frames to browsers: sent, or skipped for a browser behind on its queue",
+  ["result"]
+);
+const packetsForwarded = new metrics.Counter(
+  "relay_packets_forwarded_total",
+  "Audio packets handed to browser sockets"
+);
+const egressLatency = new metrics.Histogram(
+  "relay_ingress_to_egress_seconds",
+  "Time from receiving a device packet to queueing it for its subscribers, reorder wait included",
+  [0.0001, 0.00025, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25]
+);
+const fanoutSize = new metrics.Histogram(
+  "relay_fanout_clients",
+  "Browsers each audio packet was sent to",
+  [0, 1, 2, 5, 10, 20, 50, 100, 200, 500]
+);
+const queueDepth = new metrics.Histogram(
+  "relay_send_queue_depth",
+  "Send queue length after a packet had to be queued for a slow browser",
+  [1, 2, 4, 8, 16, 32, 64]
+);
+new metrics.Gauge("relay_worker", "Cluster worker ID of this process, 0 when not clustered", [], () =>
+  cluster.isWorker ? cluster.worker.id : 0
+);
+new metrics.Gauge("relay_clients", "Connected WebSocket clients", ["kind"], () => [
+  [["esp32"], esp32Devices],
+  [["browser"], browserClients],
+  [["other"], connectedClients - esp32Devices - browserClients],
+]);
+new metrics.Gauge("relay_udp_sources", "UDP senders heard from recently", [], () => udpSources.size);
+new metrics.Gauge("relay_send_queued_packets", "Packets waiting in browser send queues", [], () => {
+  let queued = 0;
+  wss.clients.forEach((client) => (queued += client.sendQueue.length));
+  return queued;
+});
+new metrics.Gauge(
+  "relay_send_drops_total",
+  "Packets dropped from browser send queues by backpressure",
+  [],
+  () => totalSendDrops,
+  "counter"
+);
+new metrics.Gauge(
+  "relay_transcoded_total",
+  "Opus packets produced by the transcoding stage",
+  [],
+  () => totalTranscoded,
+  "counter"
+);
+new metrics.Gauge("relay_device_jitter_ms", "Interarrival jitter per device", ["device"], () =>
+  Object.entries(deviceMetrics).map(([id, m]) => [[id], Math.round(m.jitterMs * 10) / 10])
+);
+new metrics.Gauge(
+  "relay_device_voice_gain",
+  "Voice gain each local device last reported (AGC or fixed), see src/agc.h",
+  ["device"],
+  () => {
+    const gains = [];
+    wss.clients.forEach((client) => {
+      if (client.isESP32 && client.deviceId && client.telemetry && client.telemetry.gain !== null) {
+        gains.push([[client.deviceId], client.telemetry.gain]);
+      }
+    });
+    return gains;
+  }
+);
+new metrics.Gauge(
+  "relay_device_heap_bytes",
+  "Internal heap each local device last reported: free, low water (min) and largest free block; " +
+    "largest shrinking while free holds is fragmentation, see src/net_arena.h",
+  ["device", "kind"],
+  () => {
+    const values = [];
+    wss.clients.forEach((client) => {
+      if (client.isESP32 && client.deviceId && client.telemetry) {
+        const { heapFree, heapMin, heapLargest } = client.telemetry;
+        values.push([[client.deviceId, "free"], heapFree], [[client.deviceId, "min"], heapMin]);
+        if (heapLargest !== null) {
+          values.push([[client.deviceId, "largest"], heapLargest]);
+        }
+      }
+    });
+    return values;
+  }
+);
+new metrics.Gauge(
+  "relay_device_task_cpu_ratio",
+  "Share of one core each local device task used over its last telemetry interval, see src/task_topology.h",
+  ["device", "task", "core"],
+  () => {
+    const values = [];
+    wss.clients.forEach((client) => {
+      if (client.isESP32 && client.deviceId && client.telemetry && client.telemetry.tasks) {
+        Object.entries(client.telemetry.tasks).forEach(([name, task]) => {
+          if (task.cpu !== null) {
+            values.push([[client.deviceId, name, task.core === null ? "any" : String(task.core)], task.cpu]);
+          }
+        });
+      }
+    });
+    return values;
+  }
+);
+new metrics.Gauge(
+  "relay_device_task_stack_free_bytes",
+  "Fewest stack bytes each local device task has left unused since boot (high-water mark)",
+  ["device", "task"],
+  () => {
+    const values = [];
+    wss.clients.forEach((client) => {
+      if (client.isESP32 && client.deviceId && client.telemetry && client.telemetry.tasks) {
+        Object.entries(client.telemetry.tasks).forEach(([name, task]) => {
+          values.push([[client.deviceId, name], task.stackFreeMin]);
+        });
+      }
+    });
+    return values;
+  }
+);
+new metrics.Gauge(
+  "relay_device_arena_fallbacks_total",
+  "TLS allocations each local device could not serve from its network arena, see src/net_arena.h",
+  ["device"],
+  () => {
+    const values = [];
+    wss.clients.forEach((client) => {
+      if (client.isESP32 && client.deviceId && client.telemetry && client.telemetry.arenaFallbacks !== null) {
+        values.push([[client.deviceId], client.telemetry.arenaFallbacks]);
+      }
+    });
+    return values;
+  },
+  "counter"
+);
+new metrics.Gauge(
+  "relay_mix_frames_total",
+  "Room mix frames: sent, silent (no device had audio) or skipped after an event loop stall",
+  ["room", "result"],
+  () => {
+    const values = [];
+    mixRooms.forEach(({ mixer }) => {
+      const { frames, silent, skipped } = mixer.stats;
+      values.push(
+        [[mixer.name, "sent"], frames],
+        [[mixer.name, "silent"], silent],
+        [[mixer.name, "skipped"], skipped]
+      );
+    });
+    return values;
+  },
+  "counter"
+);
+new metrics.Gauge(
+  "relay_webrtc_sessions",
+  "Browsers getting their audio over an open WebRTC data channel",
+  [],
+  () => {
+    let open = 0;
+    wss.clients.forEach((client) => {
+      if (client.webrtc && client.webrtc.open) {
+        open++;
+      }
+    });
+    return [[[], open]];
+  }
+);
+new metrics.Gauge(
+  "relay_webrtc_packets_total",
+  "Audio packets for WebRTC data channels: sent, or dropped on a full channel buffer",
+  ["result"],
+  () => [
+    [["sent"], webrtc.totals.sent],
+    [["dropped"], webrtc.totals.dropped],
+  ],
+  "counter"
+);
+new metrics.Gauge(
+  "relay_mix_drift_ppm",
+  "Sample clock drift of each device in a running room mix, against the relay clock",
+  ["room", "device"],
+  () => mixInputMetric((input) => Math.round(input.driftPpm * 10) / 10)
+);
+new metrics.Gauge(
+  "relay_mix_late_samples_total",
+  "Device samples that reached a room mix after their frame had gone out",
+  ["room", "device"],
+  () => mixInputMetric((input) => input.late),
+  "counter"
+);
+["received", "lost", "concealed", "reordered", "late", "duplicates", "resyncs"].forEach((name) => {
+  new metrics.Gauge(
+    `relay_stream_${name}_total`,
+    `Sequence counter "${name}" per device, see jitter.js`,
+    ["device"],
+    () => Object.entries(streamStats()).map(([id, stats]) => [[id], stats[name] || 0]),
+    "counter"
+  );
+});
+
+// Browser commands forwarded to the ESP32 ({"command": action, ...})
+const DEVICE_COMMANDS = [
+  "mic_on",
+  "mic_off",
+  "codec",
+  "opus_config",
+  "batch",
+  "capture",
+  "config",
+  "transport",
+  "power",
+  "filter",
+  "wake",
+  "backlog",
+  "monitor",
+  "video",
+  "person",
+];
+
+// Settings replies from the ESP32, logged as they come
+const DEVICE_REPORTS = ["config", "filter", "wake", "backlog", "monitor", "relay", "video", "person"];
+
+// IMA-ADPCM tables - must match src/adpcm.cpp
+const ADPCM_STEP_TABLE = [
+  7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+  50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+  253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+  1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+  3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+  12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767,
+];
+const ADPCM_INDEX_TABLE = [-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8];
 
 // Timestamp logging function
 function log(message) {
@@ -41,15 +498,94 @@ app.get("/", (req, res) => {
   res.sendFile(path.join(__dirname, "public", "index.html"));
 });
 
+// Prometheus scrape target. In clustered mode each request lands on one
+// worker, so these are that worker's numbers (relay_worker says which).
+app.get("/metrics", (req, res) => {
+  res.set("Content-Type", metrics.CONTENT_TYPE);
+  res.send(metrics.render());
+});
+
+// Battery camera units (levels/level2 DUTY_CYCLE) wake, POST their JPEGs here
+// on one connection and go back to sleep. Metadata comes in X- headers. The
+// newest photo of each device is kept for GET /upload/:device/latest, and with
+// RECORD_DIR set every photo is written to <RECORD_DIR>/<device>/photos/.
+const UPLOAD_LIMIT = process.env.UPLOAD_LIMIT || "2mb";
+const latestPhotos = new Map(); // Device ID -> { data, seq, wake, receivedAt }
+
+app.post("/upload", express.raw({ type: "image/jpeg", limit: UPLOAD_LIMIT }), (req, res) => {
+  const device = String(req.get("X-Device") || normalizeAddress(req.socket.remoteAddress));
+  if (!Buffer.isBuffer(req.body) || req.body.length === 0) {
+    photoUploads.inc("empty");
+    res.status(400).json({ ok: false });
+    return;
+  }
+  const seq = parseInt(req.get("X-Seq") || "0", 10);
+  const photo = { data: req.body, seq, wake: req.get("X-Wake") || "", receivedAt: Date.now() };
+  latestPhotos.set(device, photo);
+  photoUploads.inc("stored");
+  log(
+    `Photo from ${device}: ${req.body.length} bytes, seq ${seq}, ${photo.wake} wake #${req.get("X-Wakes")}, ` +
+      `${req.get("X-Failures")} failures, last wake ${req.get("X-Awake-Ms")} ms`
+  );
+
+  if (process.env.RECORD_DIR) {
+    const dir = path.join(process.env.RECORD_DIR, device.replace(/[^A-Za-z0-9._-]/g, "_"), "photos");
+    const stamp = new Date(photo.receivedAt).toISOString().replace(/[-:]/g, "").replace("T", "-").slice(0, 15);
+    fs.promises
+      .mkdir(dir, { recursive: true })
+      .then(() => fs.promises.writeFile(path.join(dir, `${stamp}-${seq}.jpg`), req.body))
+      .catch((error) => log(`Photo from ${device} not written: ${error.message}`));
+  }
+  res.json({ ok: true, seq });
+});
+
+app.get("/upload/:device/latest", (req, res) => {
+  const photo = latestPhotos.get(req.params.device);
+  if (!photo) {
+    res.status(404).end();
+    return;
+  }
+  res.set("Content-Type", "image/jpeg");
+  res.set("X-Seq", String(photo.seq));
+  res.set("Last-Modified", new Date(photo.receivedAt).toUTCString());
+  res.send(photo.data);
+});
+
 // WebSocket connection handler
 wss.on("connection", (ws, req) => {
   const clientIp = req.socket.remoteAddress;
   console.log(`New WebSocket connection from ${clientIp}`);
   connectedClients++;
+  ws.captureId = capture.open("ws", clientIp, req.headers["user-agent"] || "");
 
   // Start with unidentified client
   ws.isESP32 = false;
   ws.isBrowser = false;
+  ws.clientId = nextClientId++;
+  ws.sendQueue = []; // Packets held back by backpressure, oldest first
+  ws.pendingStatus = null;
+  ws.pendingVideo = null; // Newest frame held back by backpressure, see queueVideo
+  ws.sendDrops = 0;
+  ws.videoDrops = 0;
+  ws.drain = () => drainSendQueue(ws);
+  ws.address = normalizeAddress(clientIp);
+  ws.subscriptions = new Set(); // Device IDs, browsers only
+  ws.codecs = new Set(["pcm"]);
+  ws.jitter = 0; // Interarrival jitter in seconds, ESP32 only
+  ws.rx = { packets: 0, bytes: 0 }; // Received from this device
+  ws.metricsBase = { packets: 0, bytes: 0, lost: 0 }; // Counters at the last status tick
+  ws.rssi = null; // dBm, from the device's power report
+  ws.statusDetail = "summary";
+  ws.statusSynced = false; // Gets a full status (keyframe) on the next tick
+  ws.latencyMode = false; // Browser wants latency reports
+  ws.levelSubscriptions = new Set(); // Devices the browser wants levels of
+  ws.levelKey = "";
+  ws.webrtc = null; // WebRtcSession once the browser asks for one, see webrtc.js
+  ws.verifyCrc =
+    CRC_VERIFY === "always" ||
+    (CRC_VERIFY === "auto" &&
+      !req.socket.encrypted &&
+      req.headers["x-forwarded-proto"] !== "https");
 
   // Log the connection headers
   console.log(`Connection headers: ${JSON.stringify(req.headers)}`);
@@ -63,12 +599,11 @@ wss.on("connection", (ws, req) => {
   ) {
     ws.isBrowser = true;
     browserClients++;
+    setSubscriptions(ws, [SUBSCRIBE_ALL]); // Until the page picks a device
     console.log(`Browser client auto-identified by User-Agent: ${userAgent}`);
   }
 
-  broadcastStatus();
-
-  // Send initial status to the client
+  // Send initial status to the client; the full one follows on the next tick
   ws.send(
     JSON.stringify({
       type: "status",
@@ -86,10 +621,11 @@ wss.on("connection", (ws, req) => {
   });
 
   // Message handler
-  ws.on("message", (message) => {
+  ws.on("message", (message, isBinary) => {
+    capture.frame(ws.captureId, isBinary ? capture.KIND_BINARY : capture.KIND_TEXT, message);
     try {
-      // Binary message handling
-      if (message instanceof Buffer) {
+      // Binary message handling - ws 8 hands text frames over as Buffers too
+      if (isBinary) {
         // Process binary data from ESP32
         processAudioData(ws, message);
         return;
@@ -101,6 +637,16 @@ wss.on("connection", (ws, req) => {
 
         // Handle client identification
         if (data.type === "hello" && data.client === "browser") {
+          // Codecs the browser can decode itself - everything else gets PCM
+          ws.codecs = new Set(Array.isArray(data.codecs) ? data.codecs : ["pcm"]);
+          setStatusDetail(ws, data.statusDetail);
+          setSubscriptions(
+            ws,
+            Array.isArray(data.devices) ? data.devices : [SUBSCRIBE_ALL]
+          );
+          if (ws.isBrowser) {
+            return; // Already counted from the User-Agent
+          }
           ws.isBrowser = true;
           browserClients++;
           log(
@@ -110,28 +656,133 @@ wss.on("connection", (ws, req) => {
 
         // Handle ESP32 identification
         if (data.type === "hello" && data.client === "esp32") {
+          if (!ws.isESP32) {
+            esp32Devices++;
+          }
           ws.isESP32 = true;
-          esp32Devices++;
-          log(`ESP32 device identified - Total ESP32 devices: ${esp32Devices}`);
+          ws.statusDetail = "none";
+          ws.deviceName = data.device;
+          // Stable per-device ID; older firmware only sends the shared name
+          ws.deviceId = String(data.id || data.device || ws.address);
+          udpSources.forEach((source) => {
+            if (source.address === ws.address) {
+              source.deviceId = ws.deviceId;
+            }
+          });
+          log(
+            `ESP32 device ${ws.deviceId} identified - Total ESP32 devices: ${esp32Devices}`
+          );
+        }
+
+        // Status detail level, see STATUS_DETAILS
+        if (data.type === "status_detail") {
+          setStatusDetail(ws, data.detail);
+          return;
+        }
+
+        // Latency measurement mode: the browser's clock probe is answered at
+        // once, bypassing the send queue; the device's answer to ours updates its sync
+        if (data.type === "clock_sync") {
+          const t1 = relayNow();
+          if (ws.isESP32 && ws.deviceId) {
+            let latency = deviceLatency.get(ws.deviceId);
+            if (!latency) {
+              latency = new DeviceLatency();
+              deviceLatency.set(ws.deviceId, latency);
+            }
+            latency.onReply(data, t1);
+          } else if (!ws.isESP32) {
+            ws.send(JSON.stringify({ type: "clock_sync", t0: data.t0, t1, t2: relayNow() }));
+          }
+          return;
+        }
+        if (data.type === "latency_mode" && ws.isBrowser) {
+          ws.latencyMode = data.enabled === true;
+          log(`Browser client ${ws.clientId} latency mode ${ws.latencyMode ? "on" : "off"}`);
+          return;
+        }
+
+        // Audio over a WebRTC data channel, signalled here, see webrtc.js
+        if (data.type === "webrtc" && ws.isBrowser) {
+          setWebRtc(ws, data.action === "start");
+          return;
+        }
+        if ((data.type === "webrtc_answer" || data.type === "webrtc_candidate") && ws.webrtc) {
+          ws.webrtc.onSignal(data);
+          return;
+        }
+
+        // Level feed of these devices, SUBSCRIBE_ALL for every one, [] to stop
+        if (data.type === "levels" && ws.isBrowser) {
+          setLevelSubscriptions(ws, Array.isArray(data.devices) ? data.devices : []);
+          return;
+        }
+
+        // Browser picks the device streams it wants, SUBSCRIBE_ALL for every one
+        if (data.type === "subscribe" && ws.isBrowser) {
+          setSubscriptions(ws, Array.isArray(data.devices) ? data.devices : []);
+          log(`Browser subscribed to: ${[...ws.subscriptions].join(", ") || "none"}`);
+          return;
+        }
+
+        // Settings the ESP32 reports after a config, filter, wake, backlog, monitor or
+        // video command, and the relay endpoint it picked when it connects
+        if (DEVICE_REPORTS.includes(data.type) && ws.isESP32) {
+          log(`Device ${ws.deviceName || "?"} ${data.type}: ${JSON.stringify(data)}`);
+          return;
+        }
+
+        // Periodic power report - mode and estimated current draw
+        if (data.type === "power" && ws.isESP32) {
+          if (typeof data.rssi === "number") {
+            ws.rssi = data.rssi;
+          }
+          log(
+            `Device ${ws.deviceName || "?"} power: ${data.mode}, ~${data.estimatedMa} mA ` +
+              `(CPU active ${data.cpuActivePct}%, modem sleep ${data.modemSleepPct}%)`
+          );
+          return;
         }
 
         // Handle commands from browser to ESP32
         if (data.type === "command") {
-          // Forward mic control commands to ESP32 devices
-          if (data.action === "mic_on" || data.action === "mic_off") {
+          // Forward mic and codec control commands to ESP32 devices
+          if (DEVICE_COMMANDS.includes(data.action)) {
             log(`Forwarding command: ${data.action}`);
 
             // Format command in the way ESP32 expects
             const command = JSON.stringify({
               command: data.action,
+              codec: data.codec,
+              frameMs: data.frameMs,
+              bitrate: data.bitrate,
+              maxBlocks: data.maxBlocks,
+              sampleRate: data.sampleRate,
+              dmaBufLen: data.dmaBufLen,
+              dmaBufCount: data.dmaBufCount,
+              apll: data.apll,
+              channels: data.channels,
+              beamDelay: data.beamDelay,
+              gain: data.gain,
+              agc: data.agc,
+              enabled: data.enabled,
+              blockSize: data.blockSize,
+              transport: data.transport,
+              port: data.port,
+              mode: data.mode,
+              highpassHz: data.highpassHz,
+              presenceHz: data.presenceHz,
+              presenceDb: data.presenceDb,
+              presenceQ: data.presenceQ,
+              rateBytes: data.rateBytes,
+              fps: data.fps,
+              quality: data.quality,
             });
 
-            // Send to all ESP32 clients
-            wss.clients.forEach((client) => {
-              if (client.isESP32 && client.readyState === WebSocket.OPEN) {
-                client.send(command);
-              }
-            });
+            // Send to every ESP32, or only the one named in data.device,
+            // including those connected to other relay processes
+            sendCommandToDevices(data.device, command);
+            backplane.publishCommand(data.device || null, command);
           }
         }
       } catch (jsonError) {
@@ -146,11 +797,34 @@ wss.on("connection", (ws, req) => {
   // Close handler
   ws.on("close", () => {
     connectedClients--;
+    capture.closeConnection(ws.captureId);
 
     if (ws.isESP32) {
       esp32Devices--;
+      if (ws.deviceId) {
+        recorder.closeDevice(ws.deviceId);
+        deviceLatency.delete(ws.deviceId);
+      }
+      if (ws.reorder) {
+        const { received, lost, concealed, reordered, late, duplicates } =
+          ws.reorder.stats;
+        log(
+          `Device ${ws.deviceId || "?"} stream: ${received} packets, ${lost} lost ` +
+            `(${concealed} concealed), ${reordered} reordered, ${late} late, ${duplicates} duplicates`
+        );
+        ws.reorder.close();
+      }
       log(`ESP32 device disconnected - Total ESP32 devices: ${esp32Devices}`);
     } else if (ws.isBrowser) {
+      setSubscriptions(ws, []);
+      setLevelSubscriptions(ws, []);
+      setWebRtc(ws, false);
+      if (ws.sendDrops > 0 || ws.videoDrops > 0) {
+        log(
+          `Browser client ${ws.clientId} dropped ${ws.sendDrops} packets and ` +
+            `${ws.videoDrops} frames to backpressure`
+        );
+      }
       browserClients--;
       log(
         `Browser client disconnected - Total browser clients: ${browserClients}`
@@ -158,7 +832,6 @@ wss.on("connection", (ws, req) => {
     }
 
     log(`Client disconnected - Total clients: ${connectedClients}`);
-    broadcastStatus();
   });
 
   // Error handler
@@ -167,23 +840,662 @@ wss.on("connection", (ws, req) => {
   });
 });
 
-// Broadcast server status to all clients
-function broadcastStatus() {
-  const statusMessage = JSON.stringify({
-    type: "status",
+// Worst interarrival jitter across connected devices, for the browsers' playout buffers
+function maxDeviceJitterMs() {
+  let jitter = 0;
+  wss.clients.forEach((client) => {
+    if (client.isESP32) {
+      jitter = Math.max(jitter, client.jitter * 1000);
+    }
+  });
+  udpSources.forEach((source) => {
+    jitter = Math.max(jitter, source.jitter * 1000);
+  });
+  return Math.round(jitter * 10) / 10;
+}
+
+// Command JSON to our ESP32s: every one, or only the one with this ID or name
+function sendCommandToDevices(device, command) {
+  wss.clients.forEach((client) => {
+    if (
+      client.isESP32 &&
+      client.readyState === WebSocket.OPEN &&
+      (!device || client.deviceId === device || client.deviceName === device)
+    ) {
+      client.send(command);
+    }
+  });
+}
+
+// "::ffff:1.2.3.4" from the dual-stack WebSocket listener matches UDP's "1.2.3.4"
+function normalizeAddress(address) {
+  return (address || "").replace(/^::ffff:/, "");
+}
+
+// Replace a browser's subscriptions. SUBSCRIBE_ALL replaces any specific
+// devices, so a browser never gets the same packet twice.
+function setSubscriptions(ws, deviceIds) {
+  ws.subscriptions.forEach((id) => {
+    const set = subscribers.get(id);
+    if (set) {
+      set.delete(ws);
+      if (set.size === 0 && id !== SUBSCRIBE_ALL) {
+        subscribers.delete(id);
+      }
+    }
+  });
+  ws.subscriptions.clear();
+
+  const ids = deviceIds.map(String);
+  for (const id of ids.includes(SUBSCRIBE_ALL) ? [SUBSCRIBE_ALL] : ids) {
+    if (!subscribers.has(id)) {
+      subscribers.set(id, new Set());
+    }
+    subscribers.get(id).add(ws);
+    ws.subscriptions.add(id);
+  }
+  publishInterest();
+  updateMixers();
+}
+
+// Start or stop a browser's WebRTC audio channel
+function setWebRtc(ws, on) {
+  if (!on) {
+    if (ws.webrtc) {
+      const { sent, dropped } = ws.webrtc.stats;
+      ws.webrtc.close();
+      ws.webrtc = null;
+      log(`Browser client ${ws.clientId} WebRTC closed: ${sent} packets sent, ${dropped} dropped`);
+    }
+    return;
+  }
+  if (!webrtc.available) {
+    ws.send(JSON.stringify({ type: "webrtc_state", state: "unavailable" }));
+    return;
+  }
+  setWebRtc(ws, false); // A new start is a new peer connection
+  ws.webrtc = new webrtc.WebRtcSession((message) => {
+    if (ws.readyState === WebSocket.OPEN) {
+      ws.send(JSON.stringify(message));
+    }
+  });
+  log(`Browser client ${ws.clientId} asked for WebRTC audio`);
+}
+
+// Audio packet to a browser: on its WebRTC channel when that is open, else
+// through the WebSocket send queue
+function sendAudio(client, data) {
+  if (client.webrtc && client.webrtc.send(data)) {
+    return true;
+  }
+  return queueSend(client, data);
+}
+
+// Replace a browser's level feed devices, see LEVELS_INTERVAL_MS
+function setLevelSubscriptions(ws, deviceIds) {
+  const ids = deviceIds.map(String);
+  ws.levelSubscriptions = new Set(ids.includes(SUBSCRIBE_ALL) ? [SUBSCRIBE_ALL] : ids);
+  ws.levelKey = [...ws.levelSubscriptions].sort().join("\n");
+  levelDevices = new Set();
+  wss.clients.forEach((client) => {
+    if (client.levelSubscriptions) {
+      client.levelSubscriptions.forEach((id) => levelDevices.add(id));
+    }
+  });
+  levelMeters.forEach((meter, id) => {
+    if (!levelDevices.has(SUBSCRIBE_ALL) && !levelDevices.has(id)) {
+      levelMeters.delete(id);
+    }
+  });
+  publishInterest();
+}
+
+// Tell the backplane which devices we have subscribers for, when that changes.
+// A room with subscribers needs its devices' packets, wherever they connect,
+// and so does a device with a level feed here.
+function publishInterest() {
+  const ids = new Set(levelDevices);
+  subscribers.forEach((set, id) => {
+    if (set.size > 0) {
+      ids.add(id);
+      if (mixRooms.has(id)) {
+        mixRooms.get(id).mixer.devices.forEach((device) => ids.add(device));
+      }
+    }
+  });
+  const key = [...ids].sort().join("\n");
+  if (key !== publishedInterest) {
+    publishedInterest = key;
+    backplane.setInterest([...ids]);
+  }
+}
+
+// Run the mix of every room with a subscriber here, and no others
+function updateMixers() {
+  mixRooms.forEach(({ mixer, source }, id) => {
+    const wanted = subscribers.has(id) && subscribers.get(id).size > 0;
+    if (wanted && !mixer.running) {
+      mixer.start();
+      log(`Room mix ${mixer.name} started: ${[...mixer.devices].join(", ")}`);
+    } else if (!wanted && mixer.running) {
+      const { frames, clipped, skipped } = mixer.stats;
+      mixer.stop();
+      source.transcoder = null; // The next start is a new stream
+      log(`Room mix ${mixer.name} stopped: ${frames} frames, ${clipped} samples clipped, ${skipped} skipped`);
+    }
+  });
+}
+
+// Value per device of every running room mix, for the mix gauges
+function mixInputMetric(value) {
+  const values = [];
+  mixRooms.forEach(({ mixer }) => {
+    mixer.inputStats().forEach((input) => values.push([[mixer.name, input.deviceId], value(input)]));
+  });
+  return values;
+}
+
+// Call fn for every open browser subscribed to the source's device
+function forEachSubscriber(source, fn) {
+  const visit = (client) => {
+    if (client !== source && client.readyState === WebSocket.OPEN) {
+      fn(client);
+    }
+  };
+  const device = source.deviceId && subscribers.get(source.deviceId);
+  if (device) {
+    device.forEach(visit);
+  }
+  if (!source.isMix) {
+    subscribers.get(SUBSCRIBE_ALL).forEach(visit); // A room mix would double what they hear
+  }
+}
+
+// Connected devices, for the device picker. The address lets other relay
+// processes match UDP sources to a device.
+function deviceList() {
+  const devices = [];
+  wss.clients.forEach((client) => {
+    if (client.isESP32 && client.deviceId) {
+      devices.push({
+        id: client.deviceId,
+        name: client.deviceName || client.deviceId,
+        address: client.address,
+      });
+    }
+  });
+  mixRooms.forEach(({ mixer }, id) => {
+    devices.push({ id, name: `${mixer.name} (mix)`, address: "" });
+  });
+  return devices;
+}
+
+// Browsers per subscribed device ID here; a device's browsers can sit in
+// other relay processes than the device itself
+function subscriberCounts() {
+  const counts = {};
+  subscribers.forEach((set, id) => {
+    if (set.size > 0) {
+      counts[id] = set.size;
+    }
+  });
+  return counts;
+}
+
+// Sequence counters per device (see jitter.js), WebSocket and UDP streams added up
+function streamStats() {
+  const streams = {};
+  const add = (source) => {
+    if (!source.isESP32 || !source.reorder) {
+      return;
+    }
+    const id = source.deviceId || "unknown";
+    const total = streams[id] || (streams[id] = {});
+    Object.entries(source.reorder.stats).forEach(([name, value]) => {
+      total[name] = (total[name] || 0) + value;
+    });
+  };
+  wss.clients.forEach(add);
+  udpSources.forEach(add);
+  return streams;
+}
+
+// Packet rate, bitrate, loss, jitter and RSSI per device since the last status
+// tick, WebSocket and UDP streams added up
+function updateDeviceMetrics() {
+  const now = Date.now();
+  const seconds = Math.max((now - lastMetricsAt) / 1000, 0.001);
+  lastMetricsAt = now;
+  deviceMetrics = {};
+  const add = (source) => {
+    if (!source.isESP32 || !source.deviceId) {
+      return;
+    }
+    const metrics =
+      deviceMetrics[source.deviceId] ||
+      (deviceMetrics[source.deviceId] = {
+        packetRate: 0,
+        bitrate: 0,
+        packets: 0,
+        lost: 0,
+        jitterMs: 0,
+        rssi: null,
+      });
+    const base = source.metricsBase;
+    const lost = source.reorder ? source.reorder.stats.lost : 0;
+    metrics.packetRate += (source.rx.packets - base.packets) / seconds;
+    metrics.bitrate += ((source.rx.bytes - base.bytes) * 8) / seconds;
+    metrics.packets += source.rx.packets - base.packets;
+    metrics.lost += lost - base.lost;
+    metrics.jitterMs = Math.max(metrics.jitterMs, source.jitter * 1000);
+    if (source.rssi !== null && source.rssi !== undefined) {
+      metrics.rssi = source.rssi;
+    }
+    source.metricsBase = { packets: source.rx.packets, bytes: source.rx.bytes, lost };
+  };
+  wss.clients.forEach(add);
+  udpSources.forEach(add);
+}
+
+// A client's status detail level; unknown values keep the current one. Asking
+// again for the same level resyncs it (a browser that missed a delta).
+function setStatusDetail(ws, detail) {
+  if (STATUS_DETAILS.includes(detail)) {
+    ws.statusDetail = detail;
+    ws.statusSynced = false;
+  }
+}
+
+// This process's counters, as published on the backplane
+function localStatus() {
+  return {
     clients: connectedClients,
     esp32Devices: esp32Devices,
     browserClients: browserClients,
     audioPackets: totalAudioPackets,
+    jitterMs: maxDeviceJitterMs(),
+    devices: deviceList(),
+    subscriptions: subscriberCounts(),
+    streams: streamStats(),
+    metrics: deviceMetrics,
+    sendDrops: totalSendDrops,
+    transcoded: totalTranscoded,
+    slowClients: sendQueueStats(),
+  };
+}
+
+// Ours plus the live remote reports: counters add up, subscribers and rates add
+// up per device, jitter is the worst one
+function aggregateStatus(local) {
+  const { subscriptions, metrics, ...total } = local;
+  total.devices = [];
+  total.slowClients = [...local.slowClients];
+  const byId = new Map();
+  const addDevices = (devices) => {
+    devices.forEach(({ id, name }) => {
+      if (!byId.has(id)) {
+        const device = {
+          id,
+          name,
+          subscribers: 0,
+          packetRate: 0,
+          bitrate: 0,
+          lossPct: 0,
+          jitterMs: 0,
+          rssi: null,
+          packets: 0,
+          lost: 0,
+        };
+        byId.set(id, device);
+        total.devices.push(device);
+      }
+    });
+  };
+  const reports = [local];
+
+  const now = Date.now();
+  remoteStatus.forEach(({ status, at }, origin) => {
+    if (now - at > REMOTE_STATUS_TIMEOUT) {
+      remoteStatus.delete(origin);
+      return;
+    }
+    total.clients += status.clients;
+    total.esp32Devices += status.esp32Devices;
+    total.browserClients += status.browserClients;
+    total.audioPackets += status.audioPackets;
+    total.sendDrops += status.sendDrops;
+    total.transcoded += status.transcoded;
+    total.streams = { ...total.streams, ...status.streams };
+    total.jitterMs = Math.max(total.jitterMs, status.jitterMs);
+    total.slowClients.push(
+      ...status.slowClients.map((client) => ({ ...client, relay: origin }))
+    );
+    reports.push(status);
+  });
+
+  reports.forEach((status) => addDevices(status.devices));
+  reports.forEach((status) => {
+    Object.entries(status.subscriptions).forEach(([id, count]) => {
+      if (id === SUBSCRIBE_ALL) {
+        total.devices.forEach((device) => (device.subscribers += count));
+      } else if (byId.has(id)) {
+        byId.get(id).subscribers += count;
+      }
+    });
+    // A device's control connection and its UDP audio can be in different processes
+    Object.entries(status.metrics || {}).forEach(([id, metrics]) => {
+      const device = byId.get(id);
+      if (!device) {
+        return;
+      }
+      device.packetRate += metrics.packetRate;
+      device.bitrate += metrics.bitrate;
+      device.packets += metrics.packets;
+      device.lost += metrics.lost;
+      device.jitterMs = Math.max(device.jitterMs, metrics.jitterMs);
+      if (metrics.rssi !== null) {
+        device.rssi = metrics.rssi;
+      }
+    });
+  });
+  total.devices.forEach((device) => {
+    const { packets, lost } = device;
+    device.packetRate = Math.round(device.packetRate);
+    device.bitrate = Math.round(device.bitrate / 100) * 100;
+    device.lossPct = lost > 0 ? Math.round((lost / (lost + packets)) * 10000) / 100 : 0;
+    device.jitterMs = Math.round(device.jitterMs * 10) / 10;
+    delete device.packets;
+    delete device.lost;
   });
+  return total;
+}
+
+// Status tick: totals across every relay process, to each client at its detail
+// level and only when changed. A client that is new, switched level or still
+// has an unsent status queued gets the full status instead of a delta.
+function broadcastStatus() {
+  updateDeviceMetrics();
+  const local = localStatus();
+  if (backplane.kind !== "local") {
+    const published = JSON.stringify(local);
+    const now = Date.now();
+    if (published !== lastPublishedStatus || now - lastStatusPublished >= STATUS_PUBLISH_INTERVAL) {
+      backplane.publishStatus(local);
+      lastPublishedStatus = published;
+      lastStatusPublished = now;
+    }
+  }
+
+  const status = aggregateStatus(local);
+  const summary = JSON.stringify({ type: "status", ...status });
+  const summaryChanged = summary !== lastStatusSummary;
+  lastStatusSummary = summary;
+  const delta = statusEncoder.update(status);
 
   wss.clients.forEach((client) => {
-    if (client.readyState === WebSocket.OPEN) {
-      client.send(statusMessage);
+    if (client.readyState !== WebSocket.OPEN) {
+      return;
+    }
+    let data = null;
+    if (client.statusDetail === "summary") {
+      data = summaryChanged || !client.statusSynced ? summary : null;
+    } else if (client.statusDetail === "devices") {
+      data =
+        !client.statusSynced || client.pendingStatus !== null
+          ? statusEncoder.keyframe
+          : delta;
+    }
+    if (data !== null) {
+      queueSend(client, data, true);
+      client.statusSynced = true;
     }
   });
 }
 
+// Send now if the socket keeps up, otherwise queue. Returns false if a packet
+// was dropped to make room.
+function queueSend(client, data, isStatus = false) {
+  if (
+    client.bufferedAmount < SEND_BUFFER_LIMIT &&
+    client.sendQueue.length === 0 &&
+    client.pendingStatus === null &&
+    client.pendingVideo === null
+  ) {
+    client.send(data, client.drain);
+    return true;
+  }
+  if (isStatus) {
+    client.pendingStatus = data;
+    return true;
+  }
+  client.sendQueue.push(data);
+  queueDepth.observe(client.sendQueue.length);
+  if (client.sendQueue.length <= SEND_QUEUE_LIMIT) {
+    return true;
+  }
+  client.sendQueue.shift();
+  client.sendDrops++;
+  totalSendDrops++;
+  return false;
+}
+
+// Camera frames get the same backpressure, but only the newest is worth
+// showing: a slow browser holds one frame, a newer one replaces it, and it goes
+// out after the audio queued ahead of it. Returns false if a frame was replaced.
+function queueVideo(client, data) {
+  if (client.pendingVideo !== null) {
+    client.pendingVideo = data;
+    client.videoDrops++;
+    videoReplaced.inc();
+    return false;
+  }
+  if (
+    client.bufferedAmount < SEND_BUFFER_LIMIT &&
+    client.sendQueue.length === 0 &&
+    client.pendingStatus === null
+  ) {
+    client.send(data, client.drain);
+  } else {
+    client.pendingVideo = data;
+  }
+  return true;
+}
+
+// Send callback: the socket wrote something, so move queued packets into ws
+// while it is under the limit again
+function drainSendQueue(client) {
+  if (client.readyState !== WebSocket.OPEN) {
+    client.sendQueue.length = 0;
+    client.pendingStatus = null;
+    client.pendingVideo = null;
+    return;
+  }
+  while (client.bufferedAmount < SEND_BUFFER_LIMIT) {
+    if (client.pendingStatus !== null) {
+      client.send(client.pendingStatus, client.drain);
+      client.pendingStatus = null;
+    } else if (client.sendQueue.length > 0) {
+      client.send(client.sendQueue.shift(), client.drain);
+    } else if (client.pendingVideo !== null) {
+      client.send(client.pendingVideo, client.drain);
+      client.pendingVideo = null;
+    } else {
+      break;
+    }
+  }
+}
+
+// Browsers that are behind or have dropped packets, for the status message
+function sendQueueStats() {
+  const stats = [];
+  wss.clients.forEach((client) => {
+    if (
+      client.isBrowser &&
+      (client.sendDrops > 0 || client.sendQueue.length > 0 || client.videoDrops > 0)
+    ) {
+      stats.push({
+        client: client.clientId,
+        queued: client.sendQueue.length,
+        drops: client.sendDrops,
+        videoDrops: client.videoDrops,
+        bufferedBytes: client.bufferedAmount,
+      });
+    }
+  });
+  return stats;
+}
+
+// Parse the common packet header, or null if this is not one of our packets.
+// Fields after the checksum are only present in the versioned header.
+function parseHeader(data) {
+  if (!data || data.length < LEGACY_HEADER_SIZE) {
+    return null;
+  }
+  const header = {
+    type: data[1],
+    seqNum: data.readUInt16BE(2),
+    numSamples: data.readUInt16BE(4),
+    checksum: data.readUInt16BE(6),
+    headerSize: LEGACY_HEADER_SIZE,
+    timestamp: null,
+    crc: null,
+    sampleRate: SAMPLE_RATE,
+    channels: 1,
+  };
+  if (data[0] === PACKET_HEADER_MAGIC) {
+    return header;
+  }
+  if (data[0] !== PACKET_HEADER_MAGIC_V2 || data.length < 16 || data[9] < 16) {
+    return null;
+  }
+  header.version = data[8];
+  header.headerSize = data[9];
+  header.timestamp = data.readUInt32BE(12);
+  header.sampleRate = PACKET_RATES[data[11]] || SAMPLE_RATE;
+  header.channels = packetChannels(data);
+  if (header.version >= 3 && data[10] & PACKET_FLAG_CRC32) {
+    if (header.headerSize < 20) {
+      return null;
+    }
+    header.crc = data.readUInt32BE(16);
+  }
+  return data.length >= header.headerSize ? header : null;
+}
+
+// 2 for a stereo PCM packet (interleaved L/R), otherwise 1
+function packetChannels(data) {
+  return data[0] === PACKET_HEADER_MAGIC_V2 &&
+    data.length >= 16 &&
+    data[8] >= 3 &&
+    data[1] === PACKET_TYPE_AUDIO &&
+    data[10] & PACKET_FLAG_STEREO
+    ? 2
+    : 1;
+}
+
+// Header object as parseHeader() builds it, from the fields the native core
+// filled in (channels are added by the caller, see packetChannels())
+function nativeHeader(fields) {
+  const f = relayCore.fields;
+  const flags = fields[f.flags];
+  const versioned = (flags & relayCore.FIELD_FLAG_TIMESTAMP) !== 0;
+  const header = {
+    type: fields[f.type],
+    seqNum: fields[f.seqNum],
+    numSamples: fields[f.numSamples],
+    checksum: fields[f.checksum],
+    headerSize: fields[f.headerSize],
+    timestamp: versioned ? fields[f.timestamp] : null,
+    crc: flags & relayCore.FIELD_FLAG_CRC ? fields[f.crc] : null,
+    sampleRate: versioned
+      ? PACKET_RATES[fields[f.rateCode]] || SAMPLE_RATE
+      : SAMPLE_RATE,
+  };
+  if (versioned) {
+    header.version = fields[f.version];
+  }
+  return header;
+}
+
+// Act on the native core's verdict for an audio packet - false if it must be dropped.
+// Legacy checksum mismatches are only logged, as on the JavaScript path.
+function checkNativeStatus(status, data, header) {
+  const f = relayCore.fields;
+  switch (status) {
+    case relayCore.STATUS_TOO_SMALL:
+      dropPacket(
+        "too_small",
+        `Audio packet too small: ${data.length} bytes, expected ${
+          header.headerSize + nativeFields[f.payload]
+        }`
+      );
+      return false;
+    case relayCore.STATUS_CRC_MISMATCH:
+      dropPacket("crc", `CRC mismatch on audio packet #${header.seqNum}, dropped`);
+      return false;
+    case relayCore.STATUS_CHECKSUM_MISMATCH:
+      checksumMismatches.inc();
+      warnSampled(
+        "checksum",
+        `Checksum mismatch: received=${header.checksum}, calculated=${
+          nativeFields[f.calculated]
+        }`
+      );
+      return true;
+    default:
+      return true;
+  }
+}
+
+// Interarrival jitter per device (RFC 3550), from capture timestamps.
+// The estimate restarts when the capture rate changes.
+function updateJitter(ws, timestamp, sampleRate) {
+  if (ws.sampleRate !== sampleRate) {
+    ws.sampleRate = sampleRate;
+    ws.lastTransit = undefined;
+  }
+  const transit = performance.now() / 1000 - timestamp / sampleRate;
+  if (ws.lastTransit !== undefined) {
+    const d = Math.abs(transit - ws.lastTransit);
+    ws.jitter += (d - ws.jitter) / 16;
+  }
+  ws.lastTransit = transit;
+}
+
+// CRC32 (IEEE, same as the ESP32 ROM crc32_le) - zlib has it from Node 20.15
+const CRC32_TABLE = new Int32Array(256).map((_, n) => {
+  let c = n;
+  for (let k = 0; k < 8; k++) {
+    c = c & 1 ? 0xedb88320 ^ (c >>> 1) : c >>> 1;
+  }
+  return c;
+});
+const crc32 =
+  zlib.crc32 ||
+  (relayCore && relayCore.crc32) ||
+  function (buffer) {
+    let crc = -1;
+    for (let i = 0; i < buffer.length; i++) {
+      crc = CRC32_TABLE[(crc ^ buffer[i]) & 0xff] ^ (crc >>> 8);
+    }
+    return (crc ^ -1) >>> 0;
+  };
+
+// Check the payload CRC of a version 3 packet in constant time. Returns true for
+// packets without a CRC and when the connection skips verification.
+function verifyCrc(ws, data, header, payloadLength) {
+  if (header.crc === null || !ws.verifyCrc) {
+    return true;
+  }
+  const payload = data.subarray(
+    header.headerSize,
+    header.headerSize + payloadLength
+  );
+  const expected = Buffer.alloc(4);
+  expected.writeUInt32BE(crc32(payload));
+  return crypto.timingSafeEqual(expected, data.subarray(16, 20));
+}
+
 // Calculate audio checksum with same algorithm as ESP32
 function calculateAudioChecksum(buffer, offset, numSamples) {
   let sum = 0;
@@ -203,104 +1515,915 @@ function calculateAudioChecksum(buffer, offset, numSamples) {
   return sum % 65536;
 }
 
+// Checksum used by ADPCM packets: byte sum of the 4-bit codes
+function calculateByteChecksum(buffer, offset, length) {
+  let sum = 0;
+  for (let i = offset; i < offset + length && i < buffer.length; i++) {
+    sum += buffer[i];
+  }
+  return sum % 65536;
+}
+
+// Additive checksums of legacy and version 2 packets - mismatches are only logged
+function verifyLegacyChecksum(data, header, dataSizeBytes) {
+  const { type, headerSize, numSamples, checksum } = header;
+  const calculatedChecksum =
+    type === PACKET_TYPE_AUDIO_OPUS
+      ? calculateByteChecksum(data, headerSize, dataSizeBytes)
+      : type === PACKET_TYPE_AUDIO_ADPCM
+      ? calculateByteChecksum(
+          data,
+          headerSize + ADPCM_HEADER_SIZE,
+          dataSizeBytes - ADPCM_HEADER_SIZE
+        )
+      : calculateAudioChecksum(data, headerSize, numSamples);
+
+  // If checksums don't match, count it
+  if (Math.abs(calculatedChecksum - checksum) > 100) {
+    // Allow small differences
+    checksumMismatches.inc();
+    warnSampled(
+      "checksum",
+      `Checksum mismatch: received=${checksum}, calculated=${calculatedChecksum}`
+    );
+  }
+}
+
+// Decode IMA-ADPCM codes into 16-bit samples (low nibble first)
+function decodeAdpcm(buffer, offset, numSamples, predictor, stepIndex) {
+  const samples = new Int16Array(numSamples);
+  let index = Math.min(Math.max(stepIndex, 0), 88);
+
+  for (let i = 0; i < numSamples; i++) {
+    const byte = buffer[offset + (i >> 1)];
+    const code = i & 1 ? byte >> 4 : byte & 0x0f;
+    const step = ADPCM_STEP_TABLE[index];
+
+    let vpdiff = step >> 3;
+    if (code & 4) vpdiff += step;
+    if (code & 2) vpdiff += step >> 1;
+    if (code & 1) vpdiff += step >> 2;
+
+    predictor += code & 8 ? -vpdiff : vpdiff;
+    predictor = Math.min(Math.max(predictor, -32768), 32767);
+
+    index = Math.min(Math.max(index + ADPCM_INDEX_TABLE[code], 0), 88);
+    samples[i] = predictor;
+  }
+  return samples;
+}
+
+// Re-encode an ADPCM packet as a standard PCM packet for clients without ADPCM support
+// The header (including the timestamp) is kept, only type and CRC/checksum change
+function adpcmToPcmPacket(data, header) {
+  const { headerSize, numSamples } = header;
+  const predictor = data.readInt16BE(headerSize);
+  const stepIndex = data[headerSize + 2];
+  const samples = decodeAdpcm(
+    data,
+    headerSize + ADPCM_HEADER_SIZE,
+    numSamples,
+    predictor,
+    stepIndex
+  );
+
+  const packet = Buffer.alloc(headerSize + numSamples * 2);
+  data.copy(packet, 0, 0, headerSize);
+  let sum = 0;
+  for (let i = 0; i < numSamples; i++) {
+    packet.writeInt16BE(samples[i], headerSize + i * 2);
+    sum += Math.abs(samples[i]);
+  }
+  packet[1] = PACKET_TYPE_AUDIO;
+  if (header.crc !== null) {
+    packet.writeUInt32BE(crc32(packet.subarray(headerSize)), 16);
+  } else {
+    packet.writeUInt16BE(sum % 65536, 6);
+  }
+  return packet;
+}
+
+// Coalesced frame from the ESP32 - browsers still get one packet per message
+function processBatchPacket(ws, data, header) {
+  const count = header.numSamples;
+  let offset = header.headerSize;
+  for (let i = 0; i < count; i++) {
+    if (offset + BATCH_ENTRY_HEADER_SIZE > data.length) {
+      dropPacket("truncated_batch", `Truncated batch: ${i} of ${count} packets`);
+      return;
+    }
+    const length = data.readUInt16BE(offset);
+    offset += BATCH_ENTRY_HEADER_SIZE;
+    if (offset + length > data.length) {
+      dropPacket("truncated_batch", `Truncated batch: ${i} of ${count} packets`);
+      return;
+    }
+    const packet = data.subarray(offset, offset + length);
+    if (packet[1] !== PACKET_TYPE_BATCH) {
+      processAudioData(ws, packet);
+    }
+    offset += length;
+  }
+}
+
+// Audio an ESP32 stored through an outage (src/backlog_store.h). The entries
+// are complete packets with their original sequence numbers and timestamps.
+// They are too late for anyone listening, so they go only to the recording.
+function processBacklogPacket(ws, data, header) {
+  const count = header.numSamples;
+  let offset = header.headerSize;
+  for (let i = 0; i < count; i++) {
+    if (offset + BATCH_ENTRY_HEADER_SIZE > data.length) {
+      dropPacket("truncated_batch", `Truncated backlog: ${i} of ${count} packets`);
+      return;
+    }
+    const length = data.readUInt16BE(offset);
+    offset += BATCH_ENTRY_HEADER_SIZE;
+    if (offset + length > data.length) {
+      dropPacket("truncated_batch", `Truncated backlog: ${i} of ${count} packets`);
+      return;
+    }
+    const packet = data.subarray(offset, offset + length);
+    offset += length;
+
+    const entry = parseHeader(packet);
+    if (
+      !entry ||
+      (entry.type !== PACKET_TYPE_AUDIO &&
+        entry.type !== PACKET_TYPE_AUDIO_ADPCM &&
+        entry.type !== PACKET_TYPE_AUDIO_OPUS)
+    ) {
+      backlogPackets.inc("skipped"); // Silence markers: the recorder fills gaps itself
+      continue;
+    }
+    const payloadBytes = audioPayloadBytes(packet, entry);
+    if (
+      packet.length < entry.headerSize + payloadBytes ||
+      !verifyCrc(ws, packet, entry, payloadBytes)
+    ) {
+      backlogPackets.inc("corrupt");
+      continue;
+    }
+    if (ws.deviceId && recorder.enabled) {
+      recordPacket(ws.deviceId, packet, entry, true);
+      backlogPackets.inc("recorded");
+    } else {
+      backlogPackets.inc("discarded");
+    }
+  }
+}
+
+// Camera frame from an A/V device: checked once here, then sent on as-is. Frames
+// skip the audio reorder buffer - a late frame is simply shown late.
+function processVideoPacket(ws, data, header) {
+  if (
+    data.length < header.headerSize + VIDEO_HEADER_SIZE ||
+    !verifyCrc(ws, data, header, data.length - header.headerSize)
+  ) {
+    videoFrames.inc("corrupt");
+    return;
+  }
+  forwardVideo(ws, data);
+  if (ws.deviceId) {
+    backplane.publishPacket(ws.deviceId, data);
+  }
+}
+
+// One frame in from the device, fanned out to every subscriber. Device egress
+// stays one stream however many browsers watch.
+function forwardVideo(source, data) {
+  let sentCount = 0;
+  forEachSubscriber(source, (client) => {
+    queueVideo(client, data);
+    sentCount++;
+  });
+  videoFrames.inc(sentCount > 0 ? "forwarded" : "unwatched");
+}
+
+// Device telemetry: counters plus one latency histogram per pipeline stage.
+// Kept on the connection (ws.telemetry) and summarized in the log.
+function processStatsPacket(ws, data, header) {
+  const offset = header.headerSize;
+  if (data.length < offset + STATS_COUNTERS_SIZE) {
+    dropPacket("too_small", `Stats packet too small: ${data.length} bytes`);
+    return;
+  }
+  const stageCount = data[offset];
+  const bucketCount = data[offset + 1];
+  const stageSize = 12 + bucketCount * 2;
+  const stagesLength = STATS_COUNTERS_SIZE + stageCount * stageSize;
+  if (data.length < offset + stagesLength) {
+    dropPacket("too_small", `Stats packet too small: ${data.length} bytes`);
+    return;
+  }
+  const hasHeap = data.length >= offset + stagesLength + STATS_HEAP_SIZE;
+  const heapLength = stagesLength + (hasHeap ? STATS_HEAP_SIZE : 0);
+  const taskCount = hasHeap && data.length > offset + heapLength ? data[offset + heapLength] : 0;
+  const hasTasks = hasHeap && data.length >= offset + heapLength + 1 + taskCount * STATS_TASK_SIZE;
+  const payloadLength = heapLength + (hasTasks ? 1 + taskCount * STATS_TASK_SIZE : 0);
+  if (!verifyCrc(ws, data, header, payloadLength)) {
+    dropPacket("crc", `CRC mismatch on stats packet #${header.seqNum}, dropped`);
+    return;
+  }
+
+  const gainQ8 = data.readUInt16BE(offset + 2);
+  const telemetry = {
+    gain: gainQ8 ? gainQ8 / 256 : null, // 0 from firmware without the field
+    uptimeMs: data.readUInt32BE(offset + 4),
+    windowMs: data.readUInt32BE(offset + 8),
+    dmaOverruns: data.readUInt32BE(offset + 12),
+    ringDrops: data.readUInt32BE(offset + 16),
+    sendFailures: data.readUInt32BE(offset + 20),
+    readErrors: data.readUInt32BE(offset + 24),
+    heapFree: data.readUInt32BE(offset + 28),
+    heapMin: data.readUInt32BE(offset + 32),
+    heapLargest: hasHeap ? data.readUInt32BE(offset + stagesLength) : null,
+    arenaInUse: hasHeap ? data.readUInt32BE(offset + stagesLength + 4) : null,
+    arenaHighWater: hasHeap ? data.readUInt32BE(offset + stagesLength + 8) : null,
+    arenaFallbacks: hasHeap ? data.readUInt32BE(offset + stagesLength + 12) : null,
+    stages: {},
+    tasks: hasTasks ? {} : null,
+  };
+  for (let i = 0; i < stageCount; i++) {
+    const base = offset + STATS_COUNTERS_SIZE + i * stageSize;
+    const buckets = [];
+    for (let b = 0; b < bucketCount; b++) {
+      buckets.push(data.readUInt16BE(base + 12 + b * 2));
+    }
+    const count = data.readUInt32BE(base);
+    telemetry.stages[STATS_STAGES[i] || `stage${i}`] = {
+      count,
+      meanUs: count ? Math.round(data.readUInt32BE(base + 4) / count) : 0,
+      maxUs: data.readUInt32BE(base + 8),
+      buckets,
+    };
+  }
+  for (let i = 0; hasTasks && i < taskCount; i++) {
+    const base = offset + heapLength + 1 + i * STATS_TASK_SIZE;
+    const cpuPermille = data.readUInt16BE(base + 12);
+    telemetry.tasks[STATS_TASKS[data[base]] || `task${data[base]}`] = {
+      core: data[base + 1] === 0xff ? null : data[base + 1],
+      priority: data[base + 2],
+      stackBytes: data.readUInt32BE(base + 4),
+      stackFreeMin: data.readUInt32BE(base + 8),
+      cpu: cpuPermille === 0xffff ? null : cpuPermille / 1000, // Share of one core
+    };
+  }
+  ws.telemetry = telemetry;
+
+  const stages = Object.entries(telemetry.stages)
+    .map(([name, stage]) => `${name} ${stage.meanUs}/${stage.maxUs}us`)
+    .join(", ");
+  log(
+    `Device ${ws.deviceName || "?"} telemetry: ${stages} (mean/max) | ` +
+      `overruns ${telemetry.dmaOverruns}, drops ${telemetry.ringDrops}, ` +
+      `send fails ${telemetry.sendFailures}, heap min ${telemetry.heapMin}` +
+      (telemetry.heapLargest !== null
+        ? `, largest block ${telemetry.heapLargest}, arena fallbacks ${telemetry.arenaFallbacks}`
+        : "") +
+      (telemetry.gain !== null ? `, gain ${telemetry.gain.toFixed(2)}x` : "")
+  );
+  if (telemetry.tasks) {
+    const tasks = Object.entries(telemetry.tasks)
+      .map(
+        ([name, task]) =>
+          `${name}@${task.core === null ? "*" : task.core} ` +
+          `${task.cpu === null ? "?" : `${(task.cpu * 100).toFixed(1)}%`} ${task.stackFreeMin}B free`
+      )
+      .join(", ");
+    log(`Device ${ws.deviceName || "?"} tasks (core, CPU, stack low water): ${tasks}`);
+  }
+}
+
+// VAD silence start/stop from the ESP32 - forwarded to every browser so it can
+// play comfort noise at the reported background level until audio resumes
+function processSilencePacket(ws, data, header) {
+  const { headerSize, seqNum, checksum } = header;
+  if (data.length < headerSize + SILENCE_PAYLOAD_SIZE) {
+    dropPacket("too_small", `Silence packet too small: ${data.length} bytes`);
+    return;
+  }
+
+  const valid =
+    header.crc !== null
+      ? verifyCrc(ws, data, header, SILENCE_PAYLOAD_SIZE)
+      : calculateByteChecksum(data, headerSize, SILENCE_PAYLOAD_SIZE) ===
+        checksum;
+  if (!valid) {
+    dropPacket("checksum", `Silence packet #${seqNum} checksum mismatch`);
+    return;
+  }
+
+  const silent = data[headerSize] === SILENCE_START;
+  const noiseRms = data.readUInt16BE(headerSize + 2);
+  log(
+    `Silence ${silent ? "start" : "stop"} (packet #${seqNum}, noise RMS ${noiseRms})`
+  );
+
+  sequencePacket(ws, data, header);
+}
+
 // Process audio data (apply noise gate and forward to clients)
 function processAudioData(ws, data) {
   try {
-    // Safety check - minimum packet size for our new format
-    if (!data || data.length < PACKET_HEADER_SIZE) {
-      console.warn(
-        `Received invalid audio packet (too small): ${
-          data ? data.length : 0
-        } bytes`
+    // Check magic byte, header size and packet type. The native core also checks
+    // audio payloads in the same call; status stays null on the JavaScript path.
+    let status = null;
+    let header;
+    if (relayCore) {
+      status = relayCore.inspect(data, ws.verifyCrc, nativeFields);
+      header =
+        status === relayCore.STATUS_NOT_PACKET ? null : nativeHeader(nativeFields);
+      if (header) {
+        header.channels = packetChannels(data);
+      }
+    } else {
+      header = parseHeader(data);
+    }
+    if (!header) {
+      dropPacket(
+        "not_packet",
+        `Ignoring non-standard packet: ${data ? data.length : 0} bytes, Magic=${
+          data && data.length ? data[0] : "-"
+        }`
       );
       return;
     }
+    const { type: packetType, seqNum, numSamples, checksum, headerSize } =
+      header;
+    header.receivedAt = performance.now();
+    packetsReceived.inc(PACKET_TYPE_NAMES[packetType] || "unknown");
+    if (packetType !== PACKET_TYPE_BATCH) {
+      ws.rx.packets++; // Batch entries are counted one by one
+      ws.rx.bytes += data.length;
+    }
 
-    // Check magic byte and packet type
-    if (data[0] !== PACKET_HEADER_MAGIC || data[1] !== PACKET_TYPE_AUDIO) {
-      console.log(
-        `Ignoring non-standard packet: Magic=${data[0]}, Type=${data[1]}, expected Magic=${PACKET_HEADER_MAGIC}, Type=${PACKET_TYPE_AUDIO}`
+    if (packetType === PACKET_TYPE_BATCH) {
+      processBatchPacket(ws, data, header);
+      return;
+    }
+    if (packetType === PACKET_TYPE_SILENCE) {
+      processSilencePacket(ws, data, header);
+      return;
+    }
+    if (packetType === PACKET_TYPE_STATS) {
+      processStatsPacket(ws, data, header);
+      return;
+    }
+    if (packetType === PACKET_TYPE_BACKLOG) {
+      processBacklogPacket(ws, data, header);
+      return;
+    }
+    if (packetType === PACKET_TYPE_VIDEO) {
+      processVideoPacket(ws, data, header);
+      return;
+    }
+    if (
+      packetType !== PACKET_TYPE_AUDIO &&
+      packetType !== PACKET_TYPE_AUDIO_ADPCM &&
+      packetType !== PACKET_TYPE_AUDIO_OPUS
+    ) {
+      dropPacket(
+        "unknown_type",
+        `Ignoring packet type ${packetType}, expected ${PACKET_TYPE_AUDIO}/${PACKET_TYPE_AUDIO_ADPCM}/${PACKET_TYPE_AUDIO_OPUS}`
       );
       return;
     }
+    if (header.timestamp !== null) {
+      updateJitter(ws, header.timestamp, header.sampleRate);
+    }
 
-    // Parse the header using big-endian (network byte order)
-    const seqNum = (data[2] << 8) | data[3];
-    const numSamples = (data[4] << 8) | data[5];
-    const checksum = (data[6] << 8) | data[7];
+    if (DEBUG_PACKETS) {
+      metrics.sampledLog(
+        "packet",
+        `Received audio packet #${seqNum}: ${numSamples} samples, ${
+          header.crc !== null
+            ? `crc: ${header.crc.toString(16)}`
+            : `checksum: ${checksum}`
+        }`,
+        1000,
+        console.log
+      );
+    }
+
+    if (status !== null) {
+      // Size, CRC and legacy checksum already checked natively
+      if (!checkNativeStatus(status, data, header)) {
+        return;
+      }
+    } else {
+      const dataSizeBytes = audioPayloadBytes(data, header);
+
+      // Validate packet size
+      if (data.length < headerSize + dataSizeBytes) {
+        dropPacket(
+          "too_small",
+          `Audio packet too small: ${data.length} bytes, expected ${
+            headerSize + dataSizeBytes
+          }`
+        );
+        return;
+      }
+
+      // Version 3: CRC32 over the payload - corrupt packets are dropped
+      if (header.crc !== null) {
+        if (!verifyCrc(ws, data, header, dataSizeBytes)) {
+          dropPacket("crc", `CRC mismatch on audio packet #${seqNum}, dropped`);
+          return;
+        }
+      } else {
+        verifyLegacyChecksum(data, header, dataSizeBytes);
+      }
+    }
+
+    sequencePacket(ws, data, header);
 
-    // Log packet information
-    console.log(
-      `Received audio packet #${seqNum}: ${numSamples} samples, checksum: ${checksum}`
+    totalAudioPackets++;
+  } catch (error) {
+    packetsDropped.inc("error");
+    metrics.sampledLog(
+      "process_error",
+      `Error processing audio data: ${error.stack}`,
+      LOG_SAMPLE_MS,
+      console.error
     );
+  }
+}
 
-    // Calculate expected data size
-    const dataSizeBytes = numSamples * 2; // 16-bit samples = 2 bytes each
+// Per-packet warning, at most one per kind every LOG_SAMPLE_MS
+function warnSampled(kind, message) {
+  metrics.sampledLog(kind, message, LOG_SAMPLE_MS);
+}
 
-    // Validate packet size
-    if (data.length < PACKET_HEADER_SIZE + dataSizeBytes) {
-      console.warn(
-        `Audio packet too small: ${data.length} bytes, expected ${
-          PACKET_HEADER_SIZE + dataSizeBytes
-        }`
-      );
-      return;
+function dropPacket(reason, message) {
+  packetsDropped.inc(reason);
+  warnSampled(reason, message);
+}
+
+// Validated audio or silence packet into the device's reorder buffer, which
+// hands it to releasePacket() in sequence order
+function sequencePacket(ws, data, header) {
+  if (!ws.reorder) {
+    ws.reorder = new ReorderBuffer({
+      depth: JITTER_DEPTH,
+      waitMs: JITTER_WAIT_MS,
+      onRelease: ({ data, header }) => releasePacket(ws, data, header),
+      onLost: (seq) => concealPacket(ws, seq),
+    });
+    ws.reorder.stats.concealed = 0;
+    ws.lastAudio = null; // Last released PCM/ADPCM packet, the PLC source
+    ws.concealRun = 0;
+  }
+  ws.reorder.push(header.seqNum, { data, header });
+}
+
+// In-order packet: to local subscribers, the backplane and the recording
+function releasePacket(ws, data, header) {
+  meterAudio(ws.deviceId, data, header);
+  if (header.type === PACKET_TYPE_SILENCE) {
+    ws.lastAudio = null; // Nothing to conceal across a silence period
+    forEachSubscriber(ws, (client) => sendAudio(client, data));
+  } else {
+    if (header.type !== PACKET_TYPE_AUDIO_OPUS) {
+      ws.lastAudio = { data, header, samples: null };
+      ws.concealRun = 0;
+    }
+    forwardAudio(ws, data, header);
+    mixAudio(ws.deviceId, data, header);
+    if (ws.deviceId && recorder.enabled) {
+      recordPacket(ws.deviceId, data, header);
+    }
+  }
+  if (ws.deviceId) {
+    backplane.publishPacket(ws.deviceId, data);
+  }
+}
+
+// Lost packet: a PCM stand-in built from the previous block with a fade, sent
+// on like a real packet. Opus is left to the browsers' decoders.
+function concealPacket(ws, seq) {
+  const last = ws.lastAudio;
+  if (!last || ws.concealRun >= PLC_MAX_PACKETS) {
+    return;
+  }
+  ws.concealRun++;
+  ws.reorder.stats.concealed++;
+
+  const { header } = last;
+  const { headerSize, numSamples } = header;
+  last.samples = last.samples || packetSamples(last.data, header);
+  const packet = Buffer.alloc(headerSize + numSamples * 2);
+  last.data.copy(packet, 0, 0, headerSize);
+
+  const startGain = Math.pow(PLC_FADE, ws.concealRun - 1);
+  const endGain = startGain * PLC_FADE;
+  let sum = 0;
+  for (let i = 0; i < numSamples; i++) {
+    const gain = startGain + ((endGain - startGain) * i) / numSamples;
+    const sample = Math.round(last.samples[i] * gain);
+    packet.writeInt16BE(sample, headerSize + i * 2);
+    sum += Math.abs(sample);
+  }
+
+  packet[1] = PACKET_TYPE_AUDIO;
+  packet.writeUInt16BE(seq, 2);
+  const distance = (seq - header.seqNum + 0x10000) % 0x10000;
+  if (header.timestamp !== null) {
+    const frames = numSamples / header.channels; // The timestamp counts frames
+    packet.writeUInt32BE((header.timestamp + distance * frames) >>> 0, 12);
+  }
+  if (header.crc !== null) {
+    packet.writeUInt32BE(crc32(packet.subarray(headerSize)), 16);
+  } else {
+    packet.writeUInt16BE(sum % 65536, 6);
+  }
+
+  const concealed = parseHeader(packet);
+  forwardAudio(ws, packet, concealed);
+  mixAudio(ws.deviceId, packet, concealed);
+  meterAudio(ws.deviceId, packet, concealed);
+  if (ws.deviceId) {
+    backplane.publishPacket(ws.deviceId, packet);
+    if (recorder.enabled) {
+      recordPacket(ws.deviceId, packet, concealed);
     }
+  }
+}
+
+// Payload size an audio packet's header promises
+function audioPayloadBytes(data, header) {
+  const { type, headerSize, numSamples } = header;
+  return type === PACKET_TYPE_AUDIO_OPUS
+    ? data.length - headerSize // Variable-size Opus packet
+    : type === PACKET_TYPE_AUDIO_ADPCM
+    ? ADPCM_HEADER_SIZE + Math.ceil(numSamples / 2) // 4-bit codes after the state
+    : numSamples * 2; // 16-bit samples = 2 bytes each
+}
 
-    // Verify checksum
-    const calculatedChecksum = calculateAudioChecksum(
+// Decoded samples of a PCM or ADPCM packet
+function packetSamples(data, header) {
+  const { type, headerSize, numSamples } = header;
+  if (type === PACKET_TYPE_AUDIO_ADPCM) {
+    const predictor = data.readInt16BE(headerSize);
+    const stepIndex = data[headerSize + 2];
+    return decodeAdpcm(
       data,
-      PACKET_HEADER_SIZE,
-      numSamples
+      headerSize + ADPCM_HEADER_SIZE,
+      numSamples,
+      predictor,
+      stepIndex
     );
+  }
+  const samples = new Int16Array(numSamples);
+  for (let i = 0; i < numSamples; i++) {
+    samples[i] = data.readInt16BE(headerSize + i * 2);
+  }
+  return samples;
+}
 
-    // If checksums don't match, log the issue
-    if (Math.abs(calculatedChecksum - checksum) > 100) {
-      // Allow small differences
-      console.warn(
-        `Checksum mismatch: received=${checksum}, calculated=${calculatedChecksum}`
+// Validated audio packet to the device's recording, see recorder.js. PCM and
+// ADPCM are stored as decoded samples, Opus as it arrived. Backlog packets go
+// to the device's backlog segments.
+function recordPacket(deviceId, data, header, backlog = false) {
+  if (header.type === PACKET_TYPE_AUDIO_OPUS) {
+    recorder.recordOpus(deviceId, header, data.subarray(header.headerSize), backlog);
+  } else {
+    recorder.recordPcm(deviceId, header, packetSamples(data, header), backlog);
+  }
+}
+
+// Released PCM/ADPCM packet to the mix of every running room with its device.
+// The relay has no Opus decoder, so Opus devices are left out of room mixes.
+function mixAudio(deviceId, data, header) {
+  if (mixRooms.size === 0 || !deviceId || header.timestamp === null) {
+    return;
+  }
+  let samples = null;
+  mixRooms.forEach(({ mixer }) => {
+    if (!mixer.running || !mixer.devices.has(deviceId)) {
+      return;
+    }
+    if (header.type === PACKET_TYPE_AUDIO_OPUS || header.sampleRate > MIX_RATE) {
+      warnSampled(
+        "mix_format",
+        `Device ${deviceId} sends Opus or above ${MIX_RATE} Hz - not mixed into ${mixer.name}`
       );
+      return;
     }
+    samples = samples || packetSamples(data, header);
+    const arrivedAt = header.receivedAt !== undefined ? header.receivedAt : performance.now();
+    mixer.push(deviceId, samples, header.channels, header.timestamp, header.sampleRate, arrivedAt);
+  });
+}
 
-    // Forward to all clients
-    let sentCount = 0;
-    wss.clients.forEach((client) => {
-      if (client !== ws && client.readyState === WebSocket.OPEN) {
-        try {
-          // Send the packet as-is (header + data)
-          client.send(data);
-          sentCount++;
-        } catch (err) {
-          console.error(`Error sending audio to client: ${err.message}`);
-        }
+// Released packet to the device's level meter, while a browser wants its levels
+function meterAudio(deviceId, data, header) {
+  if (
+    levelDevices.size === 0 ||
+    !deviceId ||
+    (!levelDevices.has(SUBSCRIBE_ALL) && !levelDevices.has(deviceId))
+  ) {
+    return;
+  }
+  let meter = levelMeters.get(deviceId);
+  if (!meter) {
+    meter = new levels.LevelMeter(deviceId);
+    levelMeters.set(deviceId, meter);
+  }
+  const now = performance.now();
+  if (header.type === PACKET_TYPE_SILENCE) {
+    meter.setSilent(data[header.headerSize] === SILENCE_START, now);
+  } else if (header.type === PACKET_TYPE_AUDIO_OPUS) {
+    meter.markOpus(now);
+  } else {
+    meter.push(packetSamples(data, header), header.channels, header.sampleRate, now);
+  }
+}
+
+// Level feed tick: every meter read once, one frame for all devices and one
+// per distinct device list. A browser still behind on its queue skips the
+// frame; the next one is as good.
+function levelsTick() {
+  if (levelDevices.size === 0) {
+    return;
+  }
+  const now = performance.now();
+  const entries = [];
+  levelMeters.forEach((meter, id) => {
+    if (now - meter.lastSeen > LEVELS_IDLE_MS) {
+      levelMeters.delete(id);
+    } else {
+      entries.push(meter.read());
+    }
+  });
+  const frames = new Map(); // levelKey -> frame
+  wss.clients.forEach((client) => {
+    if (!client.isBrowser || client.levelSubscriptions.size === 0 || client.readyState !== WebSocket.OPEN) {
+      return;
+    }
+    let frame = frames.get(client.levelKey);
+    if (!frame) {
+      const wanted = client.levelSubscriptions.has(SUBSCRIBE_ALL)
+        ? entries
+        : entries.filter((entry) => client.levelSubscriptions.has(entry.deviceId));
+      frame = levels.encodeLevels(wanted, LEVELS_INTERVAL_MS);
+      frames.set(client.levelKey, frame);
+    }
+    if (client.sendQueue.length > 0 || client.bufferedAmount >= SEND_BUFFER_LIMIT) {
+      levelFrames.inc("skipped");
+      return;
+    }
+    queueSend(client, frame);
+    levelFrames.inc("sent");
+  });
+}
+
+// Version 3 header for a packet the relay builds for a room mix; CRC left to the caller
+function mixPacket(source, type, numSamples, payloadBytes, timestamp) {
+  const packet = Buffer.alloc(PACKET_HEADER_SIZE + payloadBytes);
+  packet[0] = PACKET_HEADER_MAGIC_V2;
+  packet[1] = type;
+  packet.writeUInt16BE(source.seq, 2);
+  packet.writeUInt16BE(numSamples, 4);
+  packet[8] = PACKET_HEADER_VERSION;
+  packet[9] = PACKET_HEADER_SIZE;
+  packet[10] = PACKET_FLAG_CRC32;
+  packet[11] = 0; // Rate code 0, the mix runs at 16 kHz
+  packet.writeUInt32BE(timestamp, 12);
+  source.seq = (source.seq + 1) & 0xffff;
+  return packet;
+}
+
+// Mixed frame to the room's subscribers, the way a device's PCM packet goes
+function sendMixFrame(source, frame, timestamp) {
+  const packet = mixPacket(source, PACKET_TYPE_AUDIO, frame.length, frame.length * 2, timestamp);
+  for (let i = 0; i < frame.length; i++) {
+    packet.writeInt16BE(frame[i], PACKET_HEADER_SIZE + i * 2);
+  }
+  packet.writeUInt32BE(crc32(packet.subarray(PACKET_HEADER_SIZE)), 16);
+  forwardAudio(source, packet, parseHeader(packet));
+}
+
+// The mix went quiet or is back, as a device's VAD would say it
+function sendMixSilence(source, silent, timestamp) {
+  const packet = mixPacket(source, PACKET_TYPE_SILENCE, 0, SILENCE_PAYLOAD_SIZE, timestamp);
+  packet[PACKET_HEADER_SIZE] = silent ? SILENCE_START : SILENCE_STOP; // Noise RMS 0: no comfort noise
+  packet.writeUInt32BE(crc32(packet.subarray(PACKET_HEADER_SIZE)), 16);
+  forEachSubscriber(source, (client) => sendAudio(client, packet));
+}
+
+// Forward a validated audio packet to the browsers subscribed to its device
+function forwardAudio(ws, data, header) {
+  const isAdpcm = header.type === PACKET_TYPE_AUDIO_ADPCM;
+  const isOpus = header.type === PACKET_TYPE_AUDIO_OPUS;
+  const transcode =
+    opusAddon !== null &&
+    !isOpus &&
+    header.sampleRate === TRANSCODE_RATE &&
+    header.channels === 1; // The shared encoder is mono; stereo goes out as PCM
+  const opusClients = [];
+  let sentCount = 0;
+  let pcmPacket = null; // Decoded lazily, once per packet
+  forEachSubscriber(ws, (client) => {
+    try {
+      // Send the packet as-is (header + data) unless the client can't decode it.
+      // Opus is not transcoded here - clients without a decoder skip it.
+      if (isOpus && !client.codecs.has("opus")) {
+        return;
       }
-    });
+      if (transcode && client.codecs.has("opus")) {
+        opusClients.push(client); // Gets the shared Opus stream below
+        return;
+      }
+      if (isAdpcm && !client.codecs.has("adpcm")) {
+        pcmPacket = pcmPacket || adpcmToPcmPacket(data, header);
+        sendAudio(client, pcmPacket);
+      } else {
+        sendAudio(client, data);
+      }
+      sentCount++;
+    } catch (err) {
+      metrics.sampledLog(
+        "send_error",
+        `Error sending audio to client: ${err.message}`,
+        LOG_SAMPLE_MS,
+        console.error
+      );
+    }
+  });
 
-    console.log(`Forwarded audio packet #${seqNum} to ${sentCount} clients`);
+  if (opusClients.length > 0) {
+    for (const packet of transcodeToOpus(ws, data, header)) {
+      opusClients.forEach((client) => sendAudio(client, packet));
+    }
+    sentCount += opusClients.length;
+  } else if (ws.transcoder && ws.transcoder.buffered > 0) {
+    ws.transcoder.encoder.reset(); // Nobody listening - don't resume mid-frame later
+    ws.transcoder.buffered = 0;
+  }
 
-    // Log statistics occasionally
-    totalAudioPackets++;
-    if (totalAudioPackets % 100 === 0) {
-      console.log(`Total audio packets processed: ${totalAudioPackets}`);
+  packetsForwarded.add(sentCount);
+  fanoutSize.observe(sentCount);
+  if (header.receivedAt !== undefined) {
+    const sentAt = performance.now();
+    egressLatency.observe((sentAt - header.receivedAt) / 1000);
+    const latency = deviceLatency.get(ws.deviceId);
+    if (latency) {
+      latency.observe(
+        header.timestamp,
+        header.sampleRate,
+        performance.timeOrigin + header.receivedAt,
+        performance.timeOrigin + sentAt
+      );
     }
-  } catch (error) {
-    console.error(`Error processing audio data: ${error.message}`);
-    console.error(error.stack);
+  }
+  if (DEBUG_PACKETS) {
+    metrics.sampledLog(
+      "forward",
+      `Forwarded audio packet #${header.seqNum} to ${sentCount} clients`,
+      1000,
+      console.log
+    );
   }
 }
 
-// Helper function to send binary data to all clients
-function sendToAllClients(data, excludeClient = null) {
-  let count = 0;
-  wss.clients.forEach((client) => {
-    if (client !== excludeClient && client.readyState === WebSocket.OPEN) {
-      client.send(data);
-      count++;
-    }
+// Feed one PCM/ADPCM packet to the device's encoder; returns the complete
+// Opus packets (often none: 20 ms frames span several device blocks). The
+// Opus stream has its own sequence numbers and frame-aligned timestamps.
+function transcodeToOpus(ws, data, header) {
+  let transcoder = ws.transcoder;
+  if (!transcoder) {
+    transcoder = ws.transcoder = {
+      encoder: new opusAddon.OpusEncoder(
+        TRANSCODE_RATE,
+        TRANSCODE_BITRATE,
+        TRANSCODE_FRAME_MS
+      ),
+      seq: 0,
+      buffered: 0, // Samples in the encoder's FIFO
+      frameStart: 0, // Capture timestamp of the FIFO's first sample
+    };
+  }
+  const samples = packetSamples(data, header);
+  if (transcoder.buffered === 0 && header.timestamp !== null) {
+    transcoder.frameStart = header.timestamp;
+  }
+  transcoder.buffered += samples.length;
+
+  const frameSamples = transcoder.encoder.frameSamples;
+  return transcoder.encoder.encode(samples).map((frame) => {
+    const packet = Buffer.alloc(PACKET_HEADER_SIZE + frame.length);
+    packet[0] = PACKET_HEADER_MAGIC_V2;
+    packet[1] = PACKET_TYPE_AUDIO_OPUS;
+    packet.writeUInt16BE(transcoder.seq, 2);
+    packet.writeUInt16BE(frameSamples, 4);
+    packet[8] = PACKET_HEADER_VERSION;
+    packet[9] = PACKET_HEADER_SIZE;
+    packet[10] = PACKET_FLAG_CRC32;
+    packet[11] = 0; // Rate code 0, 16 kHz
+    packet.writeUInt32BE(transcoder.frameStart >>> 0, 12);
+    frame.copy(packet, PACKET_HEADER_SIZE);
+    packet.writeUInt32BE(crc32(frame), 16);
+
+    transcoder.seq = (transcoder.seq + 1) & 0xffff;
+    transcoder.frameStart = (transcoder.frameStart + frameSamples) >>> 0;
+    transcoder.buffered -= frameSamples;
+    totalTranscoded++;
+    return packet;
   });
-  return count;
 }
 
+// Packet validated by another relay process for one of our subscribed devices
+backplane.on("packet", (deviceId, data) => {
+  const header = parseHeader(data);
+  if (!header) {
+    return;
+  }
+  // One source object per remote device, so per-stream state (the transcoder)
+  // carries over from packet to packet
+  let source = remoteSources.get(deviceId);
+  if (!source) {
+    source = { deviceId };
+    remoteSources.set(deviceId, source);
+  }
+  if (header.type === PACKET_TYPE_SILENCE) {
+    forEachSubscriber(source, (client) => sendAudio(client, data));
+    meterAudio(deviceId, data, header);
+  } else if (header.type === PACKET_TYPE_VIDEO) {
+    forwardVideo(source, data);
+  } else {
+    forwardAudio(source, data, header);
+    mixAudio(deviceId, data, header);
+    meterAudio(deviceId, data, header);
+  }
+});
+
+backplane.on("command", (device, command) => {
+  sendCommandToDevices(device, command);
+});
+
+backplane.on("status", (origin, status) => {
+  remoteStatus.set(origin, { status, at: Date.now() });
+});
+
+backplane.on("error", (error) => {
+  log(`Backplane error: ${error.message}`);
+});
+
+// UDP audio transport - datagrams carry the same packets as the WebSocket path.
+// A lost datagram is simply a gap the browser conceals; nothing is retransmitted.
+// Every sender address gets its own state, like a WebSocket connection would.
+const UDP_SOURCE_TIMEOUT = 30000; // Forget a sender after this long without packets
+const udpSources = new Map(); // "address:port" -> per-sender state
+const udpServer = dgram.createSocket("udp4");
+
+udpServer.on("message", (message, rinfo) => {
+  const key = `${rinfo.address}:${rinfo.port}`;
+  let source = udpSources.get(key);
+  if (!source) {
+    // UDP has only a 16-bit checksum, so "auto" verifies the CRC.
+    // The device ID comes from the WebSocket control connection at that address.
+    const address = normalizeAddress(rinfo.address);
+    let deviceId = key;
+    wss.clients.forEach((client) => {
+      if (client.isESP32 && client.deviceId && client.address === address) {
+        deviceId = client.deviceId;
+      }
+    });
+    // In a cluster the control connection may sit in another process
+    remoteStatus.forEach(({ status }) => {
+      status.devices.forEach((device) => {
+        if (deviceId === key && device.address === address) {
+          deviceId = device.id;
+        }
+      });
+    });
+    source = {
+      isESP32: true,
+      jitter: 0,
+      rx: { packets: 0, bytes: 0 },
+      metricsBase: { packets: 0, bytes: 0, lost: 0 },
+      verifyCrc: CRC_VERIFY !== "never",
+      address,
+      deviceId,
+    };
+    source.captureId = capture.open("udp", key);
+    udpSources.set(key, source);
+    log(`UDP audio source ${key} (device ${deviceId})`);
+  }
+  source.lastSeen = Date.now();
+  capture.frame(source.captureId, capture.KIND_UDP, message);
+  processAudioData(source, message);
+});
+
+udpServer.on("error", (error) => {
+  log(`UDP error: ${error.message}`);
+});
+
+udpServer.bind(udpPort, () => {
+  log(`UDP audio listener on port ${udpPort}`);
+});
+
 // Heartbeat to check for dead connections
 const intervalId = setInterval(() => {
   wss.clients.forEach((ws) => {
@@ -314,12 +2437,87 @@ const intervalId = setInterval(() => {
   });
 }, 30000);
 
-// Clean up interval on server close
+// Forget UDP senders that went quiet
+const udpIntervalId = setInterval(() => {
+  const now = Date.now();
+  udpSources.forEach((source, key) => {
+    if (now - source.lastSeen > UDP_SOURCE_TIMEOUT) {
+      udpSources.delete(key);
+      if (source.reorder) {
+        source.reorder.close();
+      }
+      log(`UDP audio source ${key} timed out`);
+    }
+  });
+}, 5000);
+
+// Latency measurement tick: clock probes to the local devices, and the last
+// window's per-device report to the subscribed browsers that asked for it.
+// Nothing is tracked while no browser has the mode on.
+function latencyTick() {
+  const browsers = [];
+  wss.clients.forEach((client) => {
+    if (client.isBrowser && client.latencyMode && client.readyState === WebSocket.OPEN) {
+      browsers.push(client);
+    }
+  });
+  if (browsers.length === 0) {
+    deviceLatency.clear();
+    return;
+  }
+  wss.clients.forEach((client) => {
+    if (client.isESP32 && client.deviceId && client.readyState === WebSocket.OPEN) {
+      client.send(JSON.stringify({ command: "clock_sync", t0: relayNow() }));
+    }
+  });
+  deviceLatency.forEach((latency, deviceId) => {
+    const report = JSON.stringify(latency.report(deviceId));
+    browsers.forEach((client) => {
+      if (client.subscriptions.has(deviceId) || client.subscriptions.has(SUBSCRIBE_ALL)) {
+        queueSend(client, report);
+      }
+    });
+  });
+}
+
+const latencyIntervalId = setInterval(latencyTick, CLOCK_SYNC_INTERVAL_MS);
+
+const levelsIntervalId = setInterval(levelsTick, LEVELS_INTERVAL_MS);
+
+// Status tick, see broadcastStatus(). Clustered relays also report in here so
+// the others can aggregate.
+const statusIntervalId = setInterval(broadcastStatus, STATUS_INTERVAL_MS);
+
+// Clean up intervals on server close
 wss.on("close", () => {
   clearInterval(intervalId);
+  clearInterval(statusIntervalId);
+  clearInterval(udpIntervalId);
+  clearInterval(latencyIntervalId);
+  clearInterval(levelsIntervalId);
+  udpServer.close();
+  mixRooms.forEach(({ mixer }) => mixer.stop());
+  backplane.close();
+  recorder.closeAll();
+  capture.close();
+  webrtc.closeAll();
 });
 
 // Start the server
 server.listen(port, () => {
-  log(`Server started on port ${port}`);
+  log(`Server started on port ${port} (backplane: ${backplane.kind})`);
+  if (recorder.enabled) {
+    log(`Recording device audio to ${process.env.RECORD_DIR}`);
+  }
+  if (opusAddon) {
+    log(`Transcoding 16 kHz PCM/ADPCM to Opus at ${TRANSCODE_BITRATE} bit/s (${opusAddon.version})`);
+  }
+  log(
+    relayCore
+      ? `Native relay core loaded (${relayCore.simd})`
+      : "Native relay core not built - using JavaScript packet checks"
+  );
+  if (!levels.nativeSpectrum) {
+    log("Native spectrum not built - the level feed uses the JavaScript FFT");
+  }
 });
@@ -0,0 +1,119 @@
+/**
+ * Binary status frames for browsers on the "devices" status detail level
+ *
+ * The relay builds one status per tick (STATUS_INTERVAL_MS) and encodes it
+ * once; every subscribed browser gets the same bytes. A keyframe carries every
+ * device, a delta only the devices whose entry changed since the previous tick
+ * plus removals, and no delta is sent at all when nothing changed. All fields
+ * are big-endian, like the audio packets.
+ *
+ * Frame header (16 bytes):
+ *   0  u8   STATUS_FRAME_MAGIC
+ *   1  u8   flags - STATUS_FLAG_KEYFRAME: replaces the receiver's device table
+ *   2  u16  entry count
+ *   4  u32  sequence, +1 per tick that produced a frame
+ *   8  u16  clients
+ *  10  u16  browser clients
+ *  12  u16  ESP32 devices
+ *  14  u16  worst device jitter, 0.1 ms
+ * Entry:
+ *   u8 flags (ENTRY_FLAG_REMOVED), u8 id length, id (UTF-8),
+ *   then unless removed: u8 name length, name (UTF-8),
+ *   u16 packets/s, u16 loss (0.01 %), i8 RSSI (dBm, 0 unknown),
+ *   u32 bitrate (bit/s), u16 jitter (0.1 ms), u16 subscribers
+ */
+
+const STATUS_FRAME_MAGIC = 0xa7; // Next to the packet magics 0xA5/0xA6
+const STATUS_FLAG_KEYFRAME = 0x01;
+const ENTRY_FLAG_REMOVED = 0x01;
+const FRAME_HEADER_SIZE = 16;
+const ENTRY_METRICS_SIZE = 15;
+const MAX_STRING = 255;
+
+const u16 = (value) => Math.max(0, Math.min(0xffff, Math.round(value)));
+
+function encodeString(value) {
+  const bytes = Buffer.from(String(value), "utf8");
+  return bytes.length > MAX_STRING ? bytes.subarray(0, MAX_STRING) : bytes;
+}
+
+function encodeEntry(device) {
+  const id = encodeString(device.id);
+  const name = encodeString(device.name || device.id);
+  const entry = Buffer.alloc(3 + id.length + name.length + ENTRY_METRICS_SIZE);
+  let offset = 0;
+  entry[offset++] = 0;
+  entry[offset++] = id.length;
+  offset += id.copy(entry, offset);
+  entry[offset++] = name.length;
+  offset += name.copy(entry, offset);
+  entry.writeUInt16BE(u16(device.packetRate || 0), offset);
+  entry.writeUInt16BE(u16((device.lossPct || 0) * 100), offset + 2);
+  entry.writeInt8(Math.max(-128, Math.min(0, Math.round(device.rssi || 0))), offset + 4);
+  entry.writeUInt32BE(Math.max(0, Math.round(device.bitrate || 0)) >>> 0, offset + 5);
+  entry.writeUInt16BE(u16((device.jitterMs || 0) * 10), offset + 9);
+  entry.writeUInt16BE(u16(device.subscribers || 0), offset + 11);
+  return entry;
+}
+
+function encodeRemoval(id) {
+  const bytes = encodeString(id);
+  return Buffer.concat([Buffer.from([ENTRY_FLAG_REMOVED, bytes.length]), bytes]);
+}
+
+class StatusEncoder {
+  constructor() {
+    this.entries = new Map(); // device ID -> encoded entry from the last tick
+    this.summary = null;
+    this.sequence = 0;
+    this.keyframe = null;
+  }
+
+  // Encode this tick's status. Returns the delta against the previous tick, or
+  // null when nothing changed; this.keyframe is the full table afterwards.
+  update(status) {
+    const summary = Buffer.alloc(8);
+    summary.writeUInt16BE(u16(status.clients), 0);
+    summary.writeUInt16BE(u16(status.browserClients), 2);
+    summary.writeUInt16BE(u16(status.esp32Devices), 4);
+    summary.writeUInt16BE(u16(status.jitterMs * 10), 6);
+
+    const entries = new Map();
+    const changed = [];
+    status.devices.forEach((device) => {
+      const entry = encodeEntry(device);
+      entries.set(String(device.id), entry);
+      const previous = this.entries.get(String(device.id));
+      if (!previous || !previous.equals(entry)) {
+        changed.push(entry);
+      }
+    });
+    this.entries.forEach((_, id) => {
+      if (!entries.has(id)) {
+        changed.push(encodeRemoval(id));
+      }
+    });
+
+    const summaryChanged = !this.summary || !this.summary.equals(summary);
+    this.entries = entries;
+    this.summary = summary;
+    if (changed.length === 0 && !summaryChanged && this.keyframe) {
+      return null;
+    }
+    this.sequence = (this.sequence + 1) >>> 0;
+    this.keyframe = this.frame(STATUS_FLAG_KEYFRAME, [...entries.values()]);
+    return this.frame(0, changed);
+  }
+
+  frame(flags, entries) {
+    const header = Buffer.alloc(FRAME_HEADER_SIZE);
+    header[0] = STATUS_FRAME_MAGIC;
+    header[1] = flags;
+    header.writeUInt16BE(entries.length, 2);
+    header.writeUInt32BE(this.sequence, 4);
+    this.summary.copy(header, 8);
+    return Buffer.concat([header, ...entries]);
+  }
+}
+
+module.exports = { StatusEncoder, STATUS_FRAME_MAGIC };
@@ -0,0 +1,145 @@
+/**
+ * WebRTC egress - audio to a browser over an unreliable data channel
+ *
+ * On the WebSocket, a packet lost on the way to the browser holds up every
+ * packet behind it until TCP has resent it. On a lossy mobile link that is a
+ * playout stall of a few hundred milliseconds, every time. A browser can ask
+ * for its audio on a WebRTC data channel instead. The channel is unordered
+ * with no retransmissions (SCTP over DTLS over UDP), so a lost packet is just
+ * gone. The page's jitter buffer places each packet by its capture timestamp,
+ * so late and reordered packets still land in the right spot.
+ *
+ * The packets are the same version 3 packets the WebSocket carries: PCM,
+ * ADPCM, the relay's Opus (TRANSCODE=opus) or the device's Opus, and silence
+ * packets. Video, status and every JSON message stay on the WebSocket, which
+ * also carries the signalling:
+ *
+ *   browser -> relay  {"type":"webrtc","action":"start"} / "stop"
+ *   relay -> browser  {"type":"webrtc_offer","sdp":...,"iceServers":[...]}
+ *   browser -> relay  {"type":"webrtc_answer","sdp":...}
+ *   both ways         {"type":"webrtc_candidate","candidate":...,"mid":...}
+ *   relay -> browser  {"type":"webrtc_state","state":"open"|"closed"|"unavailable"}
+ *
+ * The relay is the offerer and opens the channel. Until it is open, and after
+ * it closes, audio goes over the WebSocket as before. A packet that would put
+ * more than WEBRTC_BUFFER_LIMIT bytes in the channel's send buffer is dropped
+ * rather than queued, because it would be too late to play anyway.
+ *
+ * Needs WEBRTC=on and the node-datachannel package (`npm install
+ * node-datachannel`, libdatachannel underneath). WEBRTC_ICE_SERVERS is a
+ * comma-separated list of STUN/TURN URLs that both ends use.
+ */
+
+const WEBRTC = process.env.WEBRTC || "off";
+const WEBRTC_ICE_SERVERS = (process.env.WEBRTC_ICE_SERVERS || "stun:stun.l.google.com:19302")
+  .split(",")
+  .map((url) => url.trim())
+  .filter(Boolean);
+const WEBRTC_BUFFER_LIMIT = 64 * 1024;
+const CHANNEL_LABEL = "audio";
+
+let datachannel = null;
+if (WEBRTC === "on") {
+  try {
+    datachannel = require("node-datachannel");
+  } catch (error) {
+    console.warn("WEBRTC=on but the node-datachannel package is not installed - WebRTC egress off");
+  }
+}
+
+let nextSession = 1;
+const totals = { sent: 0, dropped: 0 }; // All sessions, for /metrics
+
+// One browser's peer connection and audio channel. signal() sends a JSON
+// message to the browser over its WebSocket.
+class WebRtcSession {
+  constructor(signal) {
+    this.signal = signal;
+    this.channel = null;
+    this.open = false;
+    this.stats = { sent: 0, dropped: 0 };
+    this.peer = new datachannel.PeerConnection(`browser-${nextSession++}`, {
+      iceServers: WEBRTC_ICE_SERVERS,
+    });
+    this.peer.onLocalDescription((sdp, type) => {
+      if (type === "offer") {
+        this.signal({ type: "webrtc_offer", sdp, iceServers: WEBRTC_ICE_SERVERS });
+      }
+    });
+    this.peer.onLocalCandidate((candidate, mid) => {
+      this.signal({ type: "webrtc_candidate", candidate, mid });
+    });
+    this.peer.onStateChange((state) => {
+      if (state === "failed" || state === "closed") {
+        this.setOpen(false);
+      }
+    });
+
+    this.channel = this.peer.createDataChannel(CHANNEL_LABEL, {
+      unordered: true,
+      maxRetransmits: 0,
+    });
+    this.channel.onOpen(() => this.setOpen(true));
+    this.channel.onClosed(() => this.setOpen(false));
+    this.channel.onError(() => this.setOpen(false));
+  }
+
+  setOpen(open) {
+    if (open !== this.open) {
+      this.open = open;
+      this.signal({ type: "webrtc_state", state: open ? "open" : "closed" });
+    }
+  }
+
+  // Signalling message from the browser
+  onSignal(message) {
+    if (message.type === "webrtc_answer" && typeof message.sdp === "string") {
+      this.peer.setRemoteDescription(message.sdp, "answer");
+    } else if (message.type === "webrtc_candidate" && typeof message.candidate === "string") {
+      this.peer.addRemoteCandidate(message.candidate, String(message.mid || "0"));
+    }
+  }
+
+  // A packet for the browser. False when the channel is not open, so the
+  // caller sends it on the WebSocket; true once it is sent or dropped.
+  send(data) {
+    if (!this.open) {
+      return false;
+    }
+    if (this.channel.bufferedAmount() + data.length > WEBRTC_BUFFER_LIMIT) {
+      this.stats.dropped++;
+      totals.dropped++;
+      return true;
+    }
+    try {
+      this.channel.sendMessageBinary(data);
+      this.stats.sent++;
+      totals.sent++;
+    } catch (error) {
+      this.setOpen(false);
+      return false;
+    }
+    return true;
+  }
+
+  close() {
+    this.open = false;
+    try {
+      this.channel.close();
+      this.peer.close();
+    } catch (error) {
+      // Already closed by the other side
+    }
+  }
+}
+
+module.exports = {
+  available: datachannel !== null,
+  WebRtcSession,
+  totals,
+  closeAll() {
+    if (datachannel) {
+      datachannel.cleanup();
+    }
+  },
+};
@@ -0,0 +1,95 @@
+/*
+IMA-ADPCM Encoder
+=================
+
+Standard IMA/DVI step and index tables - must match the decoders in
+server/server.js and server/public/index.html.
+*/
+
+#include "adpcm.h"
+
+static const int16_t stepTable[89] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17, 19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118, 130, 143, 157, 173, 190, 209, 230,
+    253, 279, 307, 337, 371, 408, 449, 494, 544, 598, 658, 724, 796, 876, 963,
+    1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066, 2272, 2499, 2749, 3024, 3327,
+    3660, 4026, 4428, 4871, 5358, 5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487,
+    12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+static const int8_t indexTable[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8};
+
+void adpcmReset(AdpcmState *state)
+{
+    state->predictor = 0;
+    state->stepIndex = 0;
+}
+
+// Encode a single sample to a 4-bit code and advance the state
+static inline uint8_t encodeSample(int32_t &predictor, int &index, int16_t sample)
+{
+    int32_t step = stepTable[index];
+    int32_t diff = sample - predictor;
+    uint8_t code = 0;
+
+    if (diff < 0)
+    {
+        code = 8;
+        diff = -diff;
+    }
+
+    // Quantize the difference while building the same reconstruction the decoder will
+    int32_t vpdiff = step >> 3;
+    if (diff >= step)
+    {
+        code |= 4;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        code |= 2;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step)
+    {
+        code |= 1;
+        vpdiff += step;
+    }
+
+    predictor += (code & 8) ? -vpdiff : vpdiff;
+    if (predictor > 32767)
+        predictor = 32767;
+    else if (predictor < -32768)
+        predictor = -32768;
+
+    index += indexTable[code];
+    if (index < 0)
+        index = 0;
+    else if (index > 88)
+        index = 88;
+
+    return code;
+}
+
+size_t adpcmEncode(AdpcmState *state, const int16_t *samples, int numSamples, uint8_t *out)
+{
+    int32_t predictor = state->predictor;
+    int index = state->stepIndex;
+    size_t bytes = 0;
+
+    for (int i = 0; i < numSamples; i += 2)
+    {
+        uint8_t lo = encodeSample(predictor, index, samples[i]);
+        uint8_t hi = (i + 1 < numSamples) ? encodeSample(predictor, index, samples[i + 1]) : 0;
+        out[bytes++] = lo | (hi << 4);
+    }
+
+    state->predictor = (int16_t)predictor;
+    state->stepIndex = (uint8_t)index;
+    return bytes;
+}
@@ -0,0 +1,36 @@
+/*
+IMA-ADPCM Encoder
+=================
+
+Streaming 4-bit IMA-ADPCM encoder (4:1 against 16-bit PCM). The encoder state
+carries over from one packet to the next; each packet records the state it
+started from so the receiver can decode any packet on its own.
+
+Nibble order matches WAV/IMA: the first sample goes in the low nibble.
+*/
+
+#ifndef ADPCM_H
+#define ADPCM_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <stddef.h>
+#include <stdint.h>
+#endif
+
+// Encoder/decoder state
+struct AdpcmState
+{
+    int16_t predictor; // Last reconstructed sample
+    uint8_t stepIndex; // Index into the step size table (0-88)
+};
+
+// Start a fresh stream
+void adpcmReset(AdpcmState *state);
+
+// Encode numSamples samples into (numSamples + 1) / 2 bytes, updating state.
+// Returns the number of bytes written.
+size_t adpcmEncode(AdpcmState *state, const int16_t *samples, int numSamples, uint8_t *out);
+
+#endif // ADPCM_H
@@ -0,0 +1,178 @@
+/*
+Automatic Gain Control
+======================
+
+See agc.h.
+*/
+
+#include "agc.h"
+#include "audio_dsp.h"
+#include <atomic>
+#include <math.h>
+
+#define GAIN_SHIFT 24 // Per-sample gain ramp, Q24
+#define SAMPLE_MAX ((1 << 23) - 1)
+#define SAMPLE_MIN (-(1 << 23))
+#define FULL_SCALE_16 32768.0f
+#define FULL_SCALE_24 8388608.0f
+
+static std::atomic<bool> enabled(AUDIO_USE_AGC);
+static std::atomic<uint32_t> reportedGainQ16(AUDIO_DEFAULT_GAIN << 16);
+
+// Per-block constants for one sample rate and block length, see design()
+struct AgcDesign
+{
+    uint32_t sampleRate;
+    int numFrames;
+    int32_t attackQ15, releaseQ15; // Envelope coefficients per block
+    uint32_t riseQ16;              // Largest gain increase per block, as a fraction
+    uint32_t targetRms16, limitPeak16, gateRms24;
+    uint32_t minGainQ16, maxGainQ16;
+};
+
+// Capture task only
+static AgcDesign params = {};
+static bool wasEnabled = false;
+static uint32_t envelope24 = 0; // Smoothed block RMS, 0 until the first block over the gate
+static uint32_t gainQ16 = AUDIO_DEFAULT_GAIN << 16; // Total gain: out16 = in24 / 256 * gain
+
+static float dbToRatio(float db)
+{
+    return powf(10, db / 20);
+}
+
+static void design(uint32_t sampleRate, int numFrames)
+{
+    float blockMs = numFrames * 1000.0f / sampleRate;
+    params.sampleRate = sampleRate;
+    params.numFrames = numFrames;
+    params.attackQ15 = (int32_t)((1 - expf(-blockMs / AGC_ATTACK_MS)) * 32768);
+    params.releaseQ15 = (int32_t)((1 - expf(-blockMs / AGC_RELEASE_MS)) * 32768);
+    params.riseQ16 = (uint32_t)((dbToRatio(AGC_RISE_DB_PER_S * blockMs / 1000) - 1) * 65536);
+    params.targetRms16 = (uint32_t)(FULL_SCALE_16 * dbToRatio(AGC_TARGET_DBFS));
+    params.limitPeak16 = (uint32_t)(FULL_SCALE_16 * dbToRatio(AGC_LIMIT_DBFS));
+    params.gateRms24 = (uint32_t)(FULL_SCALE_24 * dbToRatio(AGC_GATE_DBFS));
+    params.minGainQ16 = (uint32_t)(dbToRatio(AGC_MIN_GAIN_DB) * 65536);
+    params.maxGainQ16 = (uint32_t)(dbToRatio(AGC_MAX_GAIN_DB) * 65536);
+}
+
+static uint32_t isqrt64(uint64_t value)
+{
+    uint64_t root = 0;
+    uint64_t bit = (uint64_t)1 << 62;
+    while (bit > value)
+        bit >>= 2;
+    while (bit)
+    {
+        if (value >= root + bit)
+        {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        }
+        else
+            root >>= 1;
+        bit >>= 2;
+    }
+    return (uint32_t)root;
+}
+
+void agcSetEnabled(bool on)
+{
+    if (on && !agcEnabled())
+        reportedGainQ16.store(audioDspGain() << 16, std::memory_order_relaxed); // Where the AGC starts
+    enabled.store(on, std::memory_order_release);
+    audioDspSetGain(on ? 1 : AUDIO_DEFAULT_GAIN);
+}
+
+bool agcEnabled()
+{
+    return enabled.load(std::memory_order_acquire);
+}
+
+uint16_t agcGainQ8()
+{
+    uint32_t gain = agcEnabled() ? reportedGainQ16.load(std::memory_order_relaxed) >> 8 : audioDspGain() << 8;
+    return (uint16_t)min(gain, (uint32_t)0xFFFF);
+}
+
+void agcProcess(int32_t *samples32, int numFrames, int channels, uint32_t sampleRate)
+{
+    int numSamples = numFrames * channels;
+    int conversionGain = audioDspGain();
+    if (!agcEnabled())
+    {
+        wasEnabled = false;
+        return;
+    }
+    if (!wasEnabled)
+    {
+        gainQ16 = reportedGainQ16.load(std::memory_order_relaxed); // The fixed gain it takes over from
+        wasEnabled = true;
+    }
+    if (numSamples <= 0)
+        return;
+    if (sampleRate != params.sampleRate || numFrames != params.numFrames)
+        design(sampleRate, numFrames);
+
+    // Level and peak of the block, before any gain
+    uint64_t sumSquared = 0;
+    uint32_t peak = 0;
+    int peakIndex = 0;
+    for (int i = 0; i < numSamples; i++)
+    {
+        int32_t sample = samples32[i] >> 8; // 24-bit
+        uint32_t magnitude = sample < 0 ? -sample : sample;
+        sumSquared += (uint64_t)((int64_t)sample * sample);
+        if (magnitude > peak)
+        {
+            peak = magnitude;
+            peakIndex = i;
+        }
+    }
+    uint32_t rms = isqrt64(sumSquared / numSamples);
+
+    // Envelope and the gain it asks for; the gate holds both through silence
+    uint32_t target = gainQ16;
+    if (rms >= params.gateRms24)
+    {
+        if (envelope24 == 0)
+            envelope24 = rms;
+        int64_t delta = (int64_t)rms - envelope24;
+        envelope24 += (int32_t)((delta * (delta > 0 ? params.attackQ15 : params.releaseQ15)) >> 15);
+        envelope24 = max(envelope24, (uint32_t)1);
+
+        uint64_t wanted = ((uint64_t)params.targetRms16 << 24) / envelope24;
+        wanted = min(max(wanted, (uint64_t)params.minGainQ16), (uint64_t)params.maxGainQ16);
+        uint64_t ceiling = gainQ16 + (((uint64_t)gainQ16 * params.riseQ16) >> 16);
+        target = (uint32_t)min(wanted, ceiling);
+    }
+
+    // The limiter has the last word
+    bool limited = false;
+    if (peak > 0)
+    {
+        uint64_t limit = ((uint64_t)params.limitPeak16 << 24) / peak;
+        if (limit < target)
+        {
+            target = (uint32_t)limit;
+            limited = true;
+        }
+    }
+
+    // Ramp from the previous gain to the new one - by the peak when limiting
+    int64_t start = ((int64_t)gainQ16 << (GAIN_SHIFT - 16)) / conversionGain;
+    int64_t end = ((int64_t)target << (GAIN_SHIFT - 16)) / conversionGain;
+    int rampLength = limited && target < gainQ16 ? peakIndex + 1 : numSamples;
+    int64_t step = (end - start) / rampLength;
+    int64_t gain = start;
+    for (int i = 0; i < numSamples; i++)
+    {
+        gain = i < rampLength - 1 ? gain + step : end;
+        int64_t sample = ((int64_t)(samples32[i] >> 8) * gain) >> GAIN_SHIFT;
+        int32_t out = sample > SAMPLE_MAX ? SAMPLE_MAX : sample < SAMPLE_MIN ? SAMPLE_MIN : (int32_t)sample;
+        samples32[i] = (int32_t)((uint32_t)out << 8);
+    }
+
+    gainQ16 = target;
+    reportedGainQ16.store(target, std::memory_order_relaxed);
+}
@@ -0,0 +1,57 @@
+/*
+Automatic Gain Control
+======================
+
+Block-based AGC and peak limiter, replacing the fixed voice gain. It runs on
+the capture task after the voice filter, in place on the 24-bit samples in
+the I2S block, all in fixed point:
+
+- Level detector: block RMS into an envelope with AGC_ATTACK_MS /
+  AGC_RELEASE_MS time constants. Blocks under AGC_GATE_DBFS (room noise) do
+  not move the envelope, so silence is not pumped up.
+- Gain: brings the envelope to AGC_TARGET_DBFS at the 16-bit output, between
+  AGC_MIN_GAIN_DB and AGC_MAX_GAIN_DB. It rises by at most
+  AGC_RISE_DB_PER_S, so it recovers slowly after a loud passage.
+- Limiter: the block is its own look-ahead. Its peak is known before any
+  gain is applied, so the gain never takes the peak past AGC_LIMIT_DBFS.
+  When it has to fall, it reaches the new value by the peak sample. All
+  other changes ramp across the block, so there is no zipper noise.
+
+While the AGC is on, the conversion gain (audioDspSetGain) is held at 1.
+That keeps the full 16-bit resolution instead of steps of the integer
+gain. Turning it off restores AUDIO_DEFAULT_GAIN. The total gain is
+reported in every telemetry packet. Build with -DAUDIO_USE_AGC=0 to start
+on the fixed gain; {"command":"config","agc":true} switches at runtime.
+*/
+
+#ifndef AGC_H
+#define AGC_H
+
+#include <stdint.h>
+
+#ifndef AUDIO_USE_AGC
+#define AUDIO_USE_AGC 1
+#endif
+
+#define AGC_TARGET_DBFS -18   // Speech RMS at the 16-bit output
+#define AGC_LIMIT_DBFS -1     // Output peak ceiling
+#define AGC_GATE_DBFS -70     // Input RMS below this holds the gain
+#define AGC_MIN_GAIN_DB -12
+#define AGC_MAX_GAIN_DB 30
+#define AGC_ATTACK_MS 20
+#define AGC_RELEASE_MS 400
+#define AGC_RISE_DB_PER_S 12
+
+// Any task. Switches the conversion gain along with it (see above).
+void agcSetEnabled(bool enabled);
+bool agcEnabled();
+
+// Capture task: level, gain and limit one block of 32-bit I2S slots in place,
+// numFrames frames of 1 or 2 interleaved channels. Stereo channels share one
+// gain, which keeps the image.
+void agcProcess(int32_t *samples32, int numFrames, int channels, uint32_t sampleRate);
+
+// Total voice gain in Q8 (AGC and conversion gain), for telemetry
+uint16_t agcGainQ8();
+
+#endif // AGC_H
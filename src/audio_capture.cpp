@@ -0,0 +1,205 @@
+/*
+Audio Capture Engine
+====================
+
+See audio_capture.h.
+*/
+
+#include "audio_capture.h"
+#include "audio_dsp.h"
+#include <esp_heap_caps.h>
+
+AudioCapture::AudioCapture(i2s_port_t port, int sckPin, int wsPin, int sdPin)
+    : port(port), sckPin(sckPin), wsPin(wsPin), sdPin(sdPin)
+{
+}
+
+bool AudioCapture::isValidConfig(const AudioCaptureConfig &config)
+{
+    bool validRate = config.sampleRate == 8000 || config.sampleRate == 16000 || config.sampleRate == 44100;
+    int maxBlock = config.channelMode == AUDIO_CHANNELS_MONO ? AUDIO_CAPTURE_MAX_BLOCK : AUDIO_CAPTURE_MAX_STEREO_BLOCK;
+    return validRate && config.channelMode <= AUDIO_CHANNELS_BEAM &&
+           config.dmaBufCount >= 2 && config.dmaBufCount <= AUDIO_CAPTURE_MAX_DMA_BUFS &&
+           config.dmaBufLen >= AUDIO_CAPTURE_MIN_BLOCK && config.dmaBufLen <= maxBlock &&
+           config.dmaBufLen % 8 == 0; // Whole groups for the SIMD kernel
+}
+
+bool AudioCapture::begin(const AudioCaptureConfig &config)
+{
+    if (!isValidConfig(config))
+    {
+        Serial.println("Invalid audio capture config");
+        return false;
+    }
+    sampleClock = 0;
+    return install(config);
+}
+
+void AudioCapture::end()
+{
+    uninstall();
+}
+
+bool AudioCapture::install(const AudioCaptureConfig &config)
+{
+    // Configure I2S for INMP441 microphones - 32-bit slots, left only or both
+    bool mono = config.channelMode == AUDIO_CHANNELS_MONO;
+    i2s_config_t i2s_config = {
+        .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
+        .sample_rate = config.sampleRate,
+        .bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT,
+        .channel_format = mono ? I2S_CHANNEL_FMT_ONLY_LEFT : I2S_CHANNEL_FMT_RIGHT_LEFT,
+        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+        .dma_buf_count = config.dmaBufCount,
+        .dma_buf_len = config.dmaBufLen,
+        .use_apll = config.useApll,
+        .tx_desc_auto_clear = false,
+        .fixed_mclk = 0};
+
+    i2s_pin_config_t pin_config = {
+        .bck_io_num = sckPin,
+        .ws_io_num = wsPin,
+        .data_out_num = I2S_PIN_NO_CHANGE,
+        .data_in_num = sdPin};
+
+    // Block buffer - one descriptor's worth of 32-bit slots, aligned for the SIMD kernel
+    size_t bytes = config.dmaBufLen * (mono ? 1 : 2) * sizeof(int32_t);
+    bool internal = config.placement == AUDIO_BUFFER_INTERNAL ||
+                    (config.placement == AUDIO_BUFFER_AUTO && bytes <= AUDIO_CAPTURE_INTERNAL_BYTES);
+    if (!internal)
+        buffer = (int32_t *)heap_caps_aligned_alloc(AUDIO_DSP_ALIGN, bytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!buffer)
+        buffer = (int32_t *)heap_caps_aligned_alloc(AUDIO_DSP_ALIGN, bytes, MALLOC_CAP_DMA | MALLOC_CAP_8BIT);
+    if (!buffer)
+    {
+        Serial.println("Failed to allocate audio capture buffer");
+        return false;
+    }
+
+    // Install and start the driver with an event queue so we wake up on DMA completion
+    esp_err_t err = i2s_driver_install(port, &i2s_config, AUDIO_CAPTURE_EVENT_QUEUE_LEN, &eventQueue);
+    if (err != ESP_OK)
+    {
+        Serial.printf("Error installing I2S driver: %d\n", err);
+        heap_caps_free(buffer);
+        buffer = NULL;
+        return false;
+    }
+
+    err = i2s_set_pin(port, &pin_config);
+    if (err != ESP_OK)
+    {
+        Serial.printf("Error setting I2S pins: %d\n", err);
+        i2s_driver_uninstall(port);
+        heap_caps_free(buffer);
+        buffer = NULL;
+        return false;
+    }
+
+    current = config;
+    installed = true;
+    static const char *const modeNames[] = {"mono", "stereo", "beam"};
+    Serial.printf("I2S capture: %u Hz %s, %d x %d frames, APLL %s, buffer in %s\n",
+                  config.sampleRate, modeNames[config.channelMode], config.dmaBufCount, config.dmaBufLen,
+                  config.useApll ? "on" : "off", internal ? "internal RAM" : "PSRAM");
+    return true;
+}
+
+void AudioCapture::uninstall()
+{
+    if (installed)
+    {
+        i2s_driver_uninstall(port);
+        installed = false;
+        eventQueue = NULL;
+    }
+    if (buffer)
+    {
+        heap_caps_free(buffer);
+        buffer = NULL;
+    }
+}
+
+bool AudioCapture::requestConfig(const AudioCaptureConfig &config)
+{
+    if (!isValidConfig(config) || configPending.load(std::memory_order_acquire))
+        return false;
+    pending = config;
+    configPending.store(true, std::memory_order_release);
+    return true;
+}
+
+bool AudioCapture::applyPendingConfig()
+{
+    if (!configPending.load(std::memory_order_acquire))
+        return false;
+
+    AudioCaptureConfig next = pending;
+    configPending.store(false, std::memory_order_release);
+    if (memcmp(&next, &current, sizeof(next)) == 0)
+        return false;
+
+    AudioCaptureConfig previous = current;
+    uninstall();
+    if (!install(next))
+    {
+        Serial.println("Audio capture reconfiguration failed - restoring previous format");
+        if (!install(previous))
+        {
+            readErrors++;
+            Serial.println("Restoring the previous capture format failed - retrying");
+        }
+        return false;
+    }
+    reconfigurations++;
+    return true;
+}
+
+bool AudioCapture::read(AudioBlock *block)
+{
+    if (!installed)
+    {
+        // A reconfiguration and its restore both failed. Retry the last good
+        // format at a slow pace, so the capture task never spins at its priority.
+        vTaskDelay(pdMS_TO_TICKS(AUDIO_CAPTURE_RETRY_MS));
+        if (!isValidConfig(current) || !install(current))
+        {
+            readErrors++;
+            return false;
+        }
+        Serial.println("Audio capture reinstalled");
+    }
+
+    i2s_event_t event;
+    if (xQueueReceive(eventQueue, &event, portMAX_DELAY) != pdTRUE)
+        return false;
+
+    if (event.type == I2S_EVENT_RX_Q_OVF)
+    {
+        // DMA wrapped before we consumed a descriptor - audio was lost
+        overruns++;
+        sampleClock += current.dmaBufLen; // Keep timestamps on the capture timeline
+        return false;
+    }
+    if (event.type != I2S_EVENT_RX_DONE)
+        return false;
+
+    // Exactly one descriptor is ready, so this read never blocks
+    int channels = current.channelMode == AUDIO_CHANNELS_MONO ? 1 : 2;
+    size_t bytesRead = 0;
+    esp_err_t result = i2s_read(port, buffer, current.dmaBufLen * channels * sizeof(int32_t), &bytesRead, 0);
+    if (result != ESP_OK)
+    {
+        readErrors++;
+        Serial.printf("I2S read error: %d\n", result);
+        return false;
+    }
+
+    block->samples = buffer;
+    block->numSamples = bytesRead / (channels * sizeof(int32_t));
+    block->channels = channels;
+    block->timestamp = sampleClock;
+    sampleClock += block->numSamples;
+    return block->numSamples > 0;
+}
@@ -0,0 +1,131 @@
+/*
+Audio Capture Engine
+====================
+
+Owns the I2S RX driver, its DMA descriptors and the block buffer the capture
+task reads into. One DMA descriptor is one block: the driver's RX_DONE event
+wakes read(), which copies exactly that descriptor without blocking.
+
+The format can be changed at runtime without a reboot. Any task calls
+requestConfig(); the capture task picks the new settings up with
+applyPendingConfig() between blocks and reinstalls the driver.
+
+- sampleRate: 8000, 16000 or 44100 Hz
+- dmaBufCount / dmaBufLen: descriptor count and frames per descriptor.
+  Short descriptors mean low latency and more wakeups, long ones the opposite.
+  The legacy I2S driver limits a descriptor to 4092 bytes and silently
+  shortens a longer one, after which reads straddle descriptors. The caps
+  below keep dmaBufLen within it, rounded down to whole groups of 8.
+- useApll: the audio PLL gives an accurate 44.1 kHz clock
+- channelMode: MONO reads the left slot only (one INMP441, L/R to GND).
+  STEREO and BEAM read both slots of every frame, for two INMP441s on the
+  same SCK/WS/SD lines: one with L/R to GND (left), one with L/R to VDD
+  (right). The block then holds interleaved L, R frames (channels = 2), and
+  dmaBufLen is capped at AUDIO_CAPTURE_MAX_STEREO_BLOCK, since a frame is
+  twice the bytes. BEAM is read the same way as STEREO; the
+  capture task folds it to one channel (beamformer.h).
+- placement: where the block buffer lives. AUTO keeps short blocks in
+  internal DMA-capable RAM and moves long ones to PSRAM, leaving internal
+  RAM for TLS.
+
+The sample clock counts frames since begin() at the current rate, including
+frames lost to DMA overruns, and stamps every block.
+*/
+
+#ifndef AUDIO_CAPTURE_H
+#define AUDIO_CAPTURE_H
+
+#include <Arduino.h>
+#include <driver/i2s.h>
+#include <atomic>
+
+#define AUDIO_CAPTURE_MAX_DMA_BYTES 4092 // Largest descriptor the legacy I2S driver builds
+#define AUDIO_CAPTURE_MAX_BLOCK ((AUDIO_CAPTURE_MAX_DMA_BYTES / 4) & ~7)        // Mono frames, 1016
+#define AUDIO_CAPTURE_MAX_STEREO_BLOCK ((AUDIO_CAPTURE_MAX_DMA_BYTES / 8) & ~7) // Two-slot frames, 504
+#define AUDIO_CAPTURE_MIN_BLOCK 64
+#define AUDIO_CAPTURE_MAX_DMA_BUFS 32
+#define AUDIO_CAPTURE_EVENT_QUEUE_LEN 16
+#define AUDIO_CAPTURE_INTERNAL_BYTES 1024 // AUTO placement: larger blocks go to PSRAM
+#define AUDIO_CAPTURE_RETRY_MS 500        // Pause before reinstalling a driver that failed to install
+
+enum AudioBufferPlacement : uint8_t
+{
+    AUDIO_BUFFER_AUTO,
+    AUDIO_BUFFER_INTERNAL,
+    AUDIO_BUFFER_PSRAM
+};
+
+enum AudioChannelMode : uint8_t
+{
+    AUDIO_CHANNELS_MONO,
+    AUDIO_CHANNELS_STEREO, // Interleaved L/R packets
+    AUDIO_CHANNELS_BEAM    // Both mics, delay-and-sum to one channel
+};
+
+struct AudioCaptureConfig
+{
+    uint32_t sampleRate;            // 8000, 16000 or 44100
+    int dmaBufCount;                // 2 - AUDIO_CAPTURE_MAX_DMA_BUFS
+    int dmaBufLen;                  // AUDIO_CAPTURE_MIN_BLOCK - AUDIO_CAPTURE_MAX_BLOCK (mono) frames
+    bool useApll;                   // Audio PLL clock source
+    AudioBufferPlacement placement; // Block buffer memory
+    AudioChannelMode channelMode;   // One or both I2S slots
+};
+
+// One captured block, valid until the next read()
+struct AudioBlock
+{
+    int32_t *samples; // 32-bit I2S slots, 16-byte aligned; may be filtered in place
+    int numSamples;   // Frames - numSamples * channels slots
+    int channels;     // 1, or 2 for interleaved L/R
+    uint32_t timestamp; // Sample clock of the first frame
+};
+
+class AudioCapture
+{
+public:
+    AudioCapture(i2s_port_t port, int sckPin, int wsPin, int sdPin);
+
+    // Install the driver and allocate the block buffer
+    bool begin(const AudioCaptureConfig &config);
+    void end();
+
+    // Any task: queue a new format for the capture task. False if invalid.
+    bool requestConfig(const AudioCaptureConfig &config);
+
+    // Capture task: apply a queued format. Returns true if the format changed;
+    // on failure the previous format is restored. If that fails too, read()
+    // keeps retrying it.
+    bool applyPendingConfig();
+
+    // Capture task: wait for the next DMA descriptor. False for events that
+    // carry no block (overruns are counted) and read errors. Without an
+    // installed driver it waits AUDIO_CAPTURE_RETRY_MS, reinstalls the last
+    // good format and returns false, so it always blocks.
+    bool read(AudioBlock *block);
+
+    const AudioCaptureConfig &config() const { return current; }
+    static bool isValidConfig(const AudioCaptureConfig &config);
+
+    volatile uint32_t overruns = 0;   // RX queue overflows reported by the driver
+    volatile uint32_t readErrors = 0; // i2s_read failures and failed driver reinstalls
+    volatile uint32_t reconfigurations = 0;
+
+private:
+    bool install(const AudioCaptureConfig &config);
+    void uninstall();
+
+    i2s_port_t port;
+    int sckPin, wsPin, sdPin;
+
+    AudioCaptureConfig current = {};
+    AudioCaptureConfig pending = {};
+    std::atomic<bool> configPending{false};
+
+    QueueHandle_t eventQueue = NULL;
+    int32_t *buffer = NULL;
+    uint32_t sampleClock = 0;
+    bool installed = false;
+};
+
+#endif // AUDIO_CAPTURE_H
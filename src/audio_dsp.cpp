@@ -0,0 +1,233 @@
+/*
+Audio DSP Kernels
+=================
+
+Scalar reference code and the C side of the ESP32-S3 PIE kernel.
+*/
+
+#include "audio_dsp.h"
+#include "esp_rom_crc.h"
+
+#if AUDIO_DSP_HAS_PIE
+// PIE kernel in audio_dsp_s3.S.
+// Converts numGroups * 8 samples: out = sat16((in >> 16) * gain).
+// peaks holds 8 lane maxima followed by 8 lane minima and is updated in place.
+// accx receives the 40-bit sum of squares as {low 32 bits, high 8 bits}.
+extern "C" void audio_pie_convert_s3(const int32_t *in, int16_t *out, int numGroups,
+                                     const int16_t *gain, int16_t *peaks, uint32_t *accx);
+
+// The 40-bit accumulator holds 511 full-scale squares, so chunk below that
+#define PIE_CHUNK_GROUPS 32 // 256 samples per kernel call
+
+// The byte swap and CRC run over this many payload bytes at a time, so the ROM
+// CRC reads each piece straight after the swap wrote it
+#define CRC_CHUNK_BYTES 128
+#endif
+
+// Gain lanes for the PIE kernel; the scalar path reads lane 0
+static int16_t gainLanes[8] __attribute__((aligned(16))) = {
+    AUDIO_DEFAULT_GAIN, AUDIO_DEFAULT_GAIN, AUDIO_DEFAULT_GAIN, AUDIO_DEFAULT_GAIN,
+    AUDIO_DEFAULT_GAIN, AUDIO_DEFAULT_GAIN, AUDIO_DEFAULT_GAIN, AUDIO_DEFAULT_GAIN};
+
+bool audioDspSetGain(int gain)
+{
+    if (gain < 1 || gain > AUDIO_MAX_GAIN)
+        return false;
+    for (int i = 0; i < 8; i++)
+        ((volatile int16_t *)gainLanes)[i] = gain;
+    return true;
+}
+
+int audioDspGain()
+{
+    return ((volatile int16_t *)gainLanes)[0];
+}
+
+// Convert sample to 16-bit with the voice gain. The high-pass and presence EQ
+// run before this, on the whole block (voice_filter.h).
+void processAudioSample(int32_t sample32, int16_t *sample16)
+{
+    // Get the high 16 bits from the 32-bit sample (shift right by 16)
+    int32_t processed = sample32 >> 16;
+
+    processed = processed * gainLanes[0]; // Increase overall gain
+
+    // Clip to 16-bit range to prevent overflow
+    if (processed > 32767)
+        processed = 32767;
+    if (processed < -32768)
+        processed = -32768;
+
+    // Store as 16-bit
+    *sample16 = (int16_t)processed;
+}
+
+void packAudioBlockScalar(const int32_t *samples32, int numSamples, uint8_t *payload, AudioBlockStats *stats)
+{
+    int32_t maxAbs = 0;
+    uint64_t sumSquared = 0;
+
+    for (int i = 0; i < numSamples; i++)
+    {
+        int16_t sample;
+        processAudioSample(samples32[i], &sample);
+
+        int32_t absSample = abs(sample);
+        if (absSample > maxAbs)
+            maxAbs = absSample;
+        sumSquared += (int32_t)sample * sample;
+
+        // Store in big-endian format (network byte order)
+        payload[i * 2] = (sample >> 8) & 0xFF; // High byte
+        payload[i * 2 + 1] = sample & 0xFF;    // Low byte
+    }
+
+    stats->maxAbs = (int16_t)min(maxAbs, (int32_t)32767);
+    stats->sumSquared = sumSquared;
+    stats->crc = esp_rom_crc32_le(0, payload, numSamples * 2);
+}
+
+static void convertAudioBlockScalar(const int32_t *samples32, int numSamples, int16_t *samples16, AudioBlockStats *stats)
+{
+    int32_t maxAbs = 0;
+    uint64_t sumSquared = 0;
+
+    for (int i = 0; i < numSamples; i++)
+    {
+        processAudioSample(samples32[i], &samples16[i]);
+
+        int32_t absSample = abs(samples16[i]);
+        if (absSample > maxAbs)
+            maxAbs = absSample;
+        sumSquared += (int32_t)samples16[i] * samples16[i];
+    }
+
+    stats->maxAbs = (int16_t)min(maxAbs, (int32_t)32767);
+    stats->sumSquared = sumSquared;
+    stats->crc = 0;
+}
+
+#if AUDIO_DSP_HAS_PIE
+// Vector conversion of the first numSamples & ~7 samples. Returns how many were done.
+static int convertAudioBlockPie(const int32_t *samples32, int numSamples, int16_t *out, int32_t *maxAbsOut, uint64_t *sumSquaredOut)
+{
+    int16_t peaks[16] __attribute__((aligned(16)));
+    for (int i = 0; i < 8; i++)
+    {
+        peaks[i] = 0;     // Lane maxima
+        peaks[i + 8] = 0; // Lane minima
+    }
+
+    int groups = numSamples / 8;
+    uint64_t sumSquared = 0;
+    for (int g = 0; g < groups; g += PIE_CHUNK_GROUPS)
+    {
+        int n = min(groups - g, PIE_CHUNK_GROUPS);
+        uint32_t accx[2];
+        audio_pie_convert_s3(samples32 + g * 8, out + g * 8, n, gainLanes, peaks, accx);
+        sumSquared += ((uint64_t)(accx[1] & 0xFF) << 32) | accx[0];
+    }
+
+    int32_t maxAbs = 0;
+    for (int i = 0; i < 8; i++)
+    {
+        maxAbs = max(maxAbs, (int32_t)peaks[i]);
+        maxAbs = max(maxAbs, -(int32_t)peaks[i + 8]);
+    }
+
+    *maxAbsOut = maxAbs;
+    *sumSquaredOut = sumSquared;
+    return groups * 8;
+}
+
+void packAudioBlockVector(const int32_t *samples32, int numSamples, uint8_t *payload, AudioBlockStats *stats)
+{
+    // Native-endian 16-bit samples land in the payload
+    int32_t maxAbs;
+    uint64_t sumSquared;
+    int done = convertAudioBlockPie(samples32, numSamples, (int16_t *)payload, &maxAbs, &sumSquared);
+
+    // Byte swap to network order, two samples per 32-bit word, and CRC each piece
+    uint32_t crc = 0;
+    uint32_t *words = (uint32_t *)payload;
+    int doneBytes = done * 2;
+    for (int start = 0; start < doneBytes; start += CRC_CHUNK_BYTES)
+    {
+        int bytes = min(doneBytes - start, CRC_CHUNK_BYTES);
+        for (int i = start / 4; i < (start + bytes) / 4; i++)
+        {
+            uint32_t w = words[i];
+            words[i] = ((w & 0x00FF00FF) << 8) | ((w >> 8) & 0x00FF00FF);
+        }
+        crc = esp_rom_crc32_le(crc, payload + start, bytes);
+    }
+
+    stats->maxAbs = (int16_t)min(maxAbs, (int32_t)32767);
+    stats->sumSquared = sumSquared;
+    stats->crc = crc;
+}
+
+void convertAudioBlockVector(const int32_t *samples32, int numSamples, int16_t *samples16, AudioBlockStats *stats)
+{
+    int32_t maxAbs;
+    uint64_t sumSquared;
+    convertAudioBlockPie(samples32, numSamples, samples16, &maxAbs, &sumSquared);
+    stats->maxAbs = (int16_t)min(maxAbs, (int32_t)32767);
+    stats->sumSquared = sumSquared;
+    stats->crc = 0;
+}
+
+void packAudioBlock(const int32_t *samples32, int numSamples, uint8_t *payload, AudioBlockStats *stats)
+{
+    // The vector loads/stores ignore the low address bits, so fall back if unaligned
+    if (((uintptr_t)samples32 | (uintptr_t)payload) & (AUDIO_DSP_ALIGN - 1))
+    {
+        packAudioBlockScalar(samples32, numSamples, payload, stats);
+        return;
+    }
+
+    int done = numSamples & ~7;
+    packAudioBlockVector(samples32, done, payload, stats);
+
+    // Scalar tail
+    if (done < numSamples)
+    {
+        AudioBlockStats tail;
+        int doneBytes = done * 2;
+        packAudioBlockScalar(samples32 + done, numSamples - done, payload + doneBytes, &tail);
+        stats->maxAbs = max(stats->maxAbs, tail.maxAbs);
+        stats->sumSquared += tail.sumSquared;
+        stats->crc = esp_rom_crc32_le(stats->crc, payload + doneBytes, (numSamples - done) * 2);
+    }
+}
+
+void convertAudioBlock(const int32_t *samples32, int numSamples, int16_t *samples16, AudioBlockStats *stats)
+{
+    if (((uintptr_t)samples32 | (uintptr_t)samples16) & (AUDIO_DSP_ALIGN - 1))
+    {
+        convertAudioBlockScalar(samples32, numSamples, samples16, stats);
+        return;
+    }
+
+    int done = numSamples & ~7;
+    convertAudioBlockVector(samples32, done, samples16, stats);
+
+    if (done < numSamples)
+    {
+        AudioBlockStats tail;
+        convertAudioBlockScalar(samples32 + done, numSamples - done, samples16 + done, &tail);
+        stats->maxAbs = max(stats->maxAbs, tail.maxAbs);
+        stats->sumSquared += tail.sumSquared;
+    }
+}
+#else
+void packAudioBlock(const int32_t *samples32, int numSamples, uint8_t *payload, AudioBlockStats *stats)
+{
+    packAudioBlockScalar(samples32, numSamples, payload, stats);
+}
+
+void convertAudioBlock(const int32_t *samples32, int numSamples, int16_t *samples16, AudioBlockStats *stats)
+{
+    convertAudioBlockScalar(samples32, numSamples, samples16, stats);
+}
+#endif
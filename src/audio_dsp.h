@@ -0,0 +1,75 @@
+/*
+Audio DSP Kernels
+=================
+
+Sample conversion, gain, clipping and block metrics for the INMP441 capture path.
+On ESP32-S3 the hot loop runs on the PIE 128-bit vector unit (8 samples per
+iteration, see audio_dsp_s3.S). Other targets, unaligned buffers and block
+tails use the scalar path.
+*/
+
+#ifndef AUDIO_DSP_H
+#define AUDIO_DSP_H
+
+// Host builds (the native benchmark env) get the same integer types and min/max
+#ifdef ARDUINO
+#include <Arduino.h>
+#else
+#include <algorithm>
+#include <stdint.h>
+#include <stdlib.h>
+using std::max;
+using std::min;
+#endif
+
+// Voice gain applied after taking the high 16 bits of the I2S sample
+#define AUDIO_DEFAULT_GAIN 5
+#define AUDIO_MAX_GAIN 32
+
+// Use the ESP32-S3 PIE kernel unless the build asks for scalar code only
+#if defined(CONFIG_IDF_TARGET_ESP32S3) && !defined(AUDIO_DSP_SCALAR_ONLY)
+#define AUDIO_DSP_HAS_PIE 1
+#else
+#define AUDIO_DSP_HAS_PIE 0
+#endif
+
+// Buffers handed to packAudioBlock should be aligned to this for the SIMD path
+#define AUDIO_DSP_ALIGN 16
+
+// Per-block audio metrics gathered while packing a packet
+struct AudioBlockStats
+{
+    int16_t maxAbs;      // Peak absolute sample value (saturated to 32767)
+    uint64_t sumSquared; // Sum of squared samples (for RMS)
+    uint32_t crc;        // CRC32 of the packed payload (packAudioBlock only)
+};
+
+// Runtime gain, 1 - AUDIO_MAX_GAIN. Safe to call from any task; blocks being
+// converted at that moment may mix the old and new gain. False if out of range.
+bool audioDspSetGain(int gain);
+int audioDspGain();
+
+// Convert sample to 16-bit: high 16 bits, voice gain, clip
+void processAudioSample(int32_t sample32, int16_t *sample16);
+
+// Convert, measure and pack one DMA block.
+// Writes big-endian 16-bit samples straight into the packet payload and
+// computes peak, sum of squares and the payload CRC32 on the way.
+void packAudioBlock(const int32_t *samples32, int numSamples, uint8_t *payload, AudioBlockStats *stats);
+
+// Scalar reference implementation of packAudioBlock
+void packAudioBlockScalar(const int32_t *samples32, int numSamples, uint8_t *payload, AudioBlockStats *stats);
+
+// Convert and measure one DMA block into native-endian 16-bit samples for a codec.
+// Fills maxAbs and sumSquared only - the CRC is left at 0.
+void convertAudioBlock(const int32_t *samples32, int numSamples, int16_t *samples16, AudioBlockStats *stats);
+
+#if AUDIO_DSP_HAS_PIE
+// The vector body of packAudioBlock / convertAudioBlock, without the alignment
+// check and scalar tail: both buffers AUDIO_DSP_ALIGN aligned and numSamples
+// a multiple of 8. Used by the fixed-size kernels in audio_pipeline.h.
+void packAudioBlockVector(const int32_t *samples32, int numSamples, uint8_t *payload, AudioBlockStats *stats);
+void convertAudioBlockVector(const int32_t *samples32, int numSamples, int16_t *samples16, AudioBlockStats *stats);
+#endif
+
+#endif // AUDIO_DSP_H
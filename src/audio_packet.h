@@ -0,0 +1,186 @@
+/*
+Audio Packet Format
+===================
+
+Standard audio packet format - consistent across all components
+(src/, server/server.js and server/public/index.html).
+
+Header (20 bytes, network/big-endian):
+  [magic(1), type(1), seqNum(2), samples(2), checksum(2),
+   version(1), headerSize(1), flags(1), rate(1), timestamp(4), crc32(4)]
+
+Version 3 replaces the additive checksum with a CRC32 (IEEE, as zlib) over the
+whole payload; the checksum field is 0 and flags has PACKET_FLAG_CRC32 set.
+Version 2 headers (16 bytes, no CRC, additive checksum) are still accepted.
+
+magic PACKET_HEADER_MAGIC_V2 marks the versioned header; parsers take the
+payload offset from headerSize so later versions can append fields. The legacy
+8-byte header (magic PACKET_HEADER_MAGIC, fields up to checksum) is still
+accepted by the server and browser.
+
+timestamp is the capture sample clock: the index of the packet's first sample
+counted from boot at the capture rate, advanced for every DMA block including
+dropped ones. It wraps after ~74 hours at 16 kHz.
+
+flags PACKET_FLAG_STEREO (PCM only) marks a two-channel payload of
+interleaved L, R samples. samples then counts both channels, so sizes and the
+CRC work as for mono, and a packet holds samples / 2 frames. The timestamp
+counts frames either way.
+
+rate is the capture sample rate code (PACKET_RATE_*). 0 is 16 kHz, so headers
+written before the rate became configurable still decode correctly. The rate
+applies to the samples and the timestamp of the packet.
+
+Payload by type:
+  PACKET_TYPE_AUDIO        samples * 16-bit big-endian PCM
+  PACKET_TYPE_AUDIO_ADPCM  [predictor(2), stepIndex(1), reserved(1)] + (samples + 1) / 2 bytes
+                           of 4-bit IMA codes
+  PACKET_TYPE_AUDIO_OPUS   one Opus packet decoding to `samples` samples
+  PACKET_TYPE_SILENCE      control packet from the VAD, samples = 0,
+                           [state(1), reserved(1), noiseRms(2)].
+                           state SILENCE_START: no audio follows until SILENCE_STOP,
+                           noiseRms is the background level for comfort noise.
+  PACKET_TYPE_BATCH        several packets in one WebSocket frame, seqNum/timestamp = first packet's,
+                           samples = packet count, no CRC (each packet has its own).
+                           Each entry is [length(2)] followed by a complete packet.
+  PACKET_TYPE_STATS        device telemetry, samples = 0, payload layout in telemetry.h
+  PACKET_TYPE_BACKLOG      audio stored during an outage (backlog_store.h), laid out like
+                           PACKET_TYPE_BATCH. The entries keep their original sequence numbers
+                           and timestamps; they are for the recording, not for live playout.
+  PACKET_TYPE_VIDEO        one JPEG camera frame (video_capture.h), samples = 0, own seqNum
+                           sequence. [width(2), height(2), quality(1), personScore(1),
+                           reserved(2)] + JPEG. personScore is 0-255 from the person
+                           detection gate (person_detect.h), 0 when the gate is off.
+                           timestamp and rate are the audio sample clock at the frame's capture,
+                           so video lines up with the audio packets.
+*/
+
+#ifndef AUDIO_PACKET_H
+#define AUDIO_PACKET_H
+
+#include <Arduino.h>
+#include "esp_rom_crc.h"
+
+#define PACKET_HEADER_MAGIC 0xA5     // Magic byte of the legacy 8-byte header
+#define PACKET_HEADER_MAGIC_V2 0xA6  // Magic byte of the versioned header
+#define PACKET_HEADER_VERSION 3
+#define PACKET_FLAG_CRC32 0x01       // crc32 field is valid
+#define PACKET_FLAG_STEREO 0x02      // Interleaved L/R samples
+#define PACKET_TYPE_AUDIO 0x01       // Audio packet type
+#define PACKET_TYPE_AUDIO_ADPCM 0x02 // IMA-ADPCM audio packet type
+#define PACKET_TYPE_AUDIO_OPUS 0x03  // Opus audio packet type
+#define PACKET_TYPE_SILENCE 0x04     // VAD silence start/stop control packet
+#define PACKET_TYPE_BATCH 0x05       // Coalesced packets
+#define PACKET_TYPE_STATS 0x06       // Telemetry report
+#define PACKET_TYPE_BACKLOG 0x07     // Stored packets uploaded after an outage
+#define PACKET_TYPE_VIDEO 0x08       // JPEG camera frame
+#define PACKET_HEADER_SIZE 20        // Versioned header with capture timestamp and CRC32
+#define ADPCM_HEADER_SIZE 4          // Predictor + step index
+#define SILENCE_PAYLOAD_SIZE 4       // State + reserved + noise RMS
+#define BATCH_ENTRY_HEADER_SIZE 2    // Length in front of each batched packet
+#define VIDEO_HEADER_SIZE 8          // Width + height + quality + person score + reserved
+#define SILENCE_START 0x01
+#define SILENCE_STOP 0x00
+#define PACKET_RATE_16000 0x00       // Sample rate codes for the rate field
+#define PACKET_RATE_8000 0x01
+#define PACKET_RATE_44100 0x02
+#define PACKET_DEFAULT_RATE 16000
+
+// Packet ring slot layout:
+// [room for WebSocket frame header][packet header][payload, 16-byte aligned]
+#define SLOT_PAYLOAD_OFFSET 48 // Keeps the payload aligned for the SIMD kernel
+#define SLOT_PACKET_OFFSET (SLOT_PAYLOAD_OFFSET - PACKET_HEADER_SIZE)
+
+// Rate code for the header; unknown rates fall back to the 16 kHz default
+inline uint8_t packetRateCode(uint32_t sampleRate)
+{
+    if (sampleRate == 8000)
+        return PACKET_RATE_8000;
+    if (sampleRate == 44100)
+        return PACKET_RATE_44100;
+    return PACKET_RATE_16000;
+}
+
+// Sample rate of a header's rate code, the inverse of packetRateCode()
+inline uint32_t packetSampleRate(const uint8_t *packet)
+{
+    if (packet[11] == PACKET_RATE_8000)
+        return 8000;
+    if (packet[11] == PACKET_RATE_44100)
+        return 44100;
+    return PACKET_DEFAULT_RATE;
+}
+
+// Fill in the header at the start of a packet - crc covers the payload, see packetCrc32()
+inline void writePacketHeader(uint8_t *packet, uint8_t type, uint16_t seqNum, uint16_t samples, uint32_t crc,
+                              uint32_t timestamp, uint32_t sampleRate = PACKET_DEFAULT_RATE, int channels = 1)
+{
+    // 1. Magic byte and packet type
+    packet[0] = PACKET_HEADER_MAGIC_V2;
+    packet[1] = type;
+
+    // 2. Sequence number (2 bytes, network/big-endian)
+    packet[2] = (seqNum >> 8) & 0xFF; // High byte
+    packet[3] = seqNum & 0xFF;        // Low byte
+
+    // 3. Sample count (2 bytes, network/big-endian)
+    packet[4] = (samples >> 8) & 0xFF; // High byte
+    packet[5] = samples & 0xFF;        // Low byte
+
+    // 4. Legacy additive checksum - superseded by the CRC
+    packet[6] = 0;
+    packet[7] = 0;
+
+    // 5. Version and size, so the payload can be found past unknown fields
+    packet[8] = PACKET_HEADER_VERSION;
+    packet[9] = PACKET_HEADER_SIZE;
+    packet[10] = PACKET_FLAG_CRC32 | (channels == 2 ? PACKET_FLAG_STEREO : 0);
+    packet[11] = packetRateCode(sampleRate);
+
+    // 6. Capture timestamp (4 bytes, network/big-endian)
+    packet[12] = (timestamp >> 24) & 0xFF;
+    packet[13] = (timestamp >> 16) & 0xFF;
+    packet[14] = (timestamp >> 8) & 0xFF;
+    packet[15] = timestamp & 0xFF;
+
+    // 7. CRC32 of the payload (4 bytes, network/big-endian)
+    packet[16] = (crc >> 24) & 0xFF;
+    packet[17] = (crc >> 16) & 0xFF;
+    packet[18] = (crc >> 8) & 0xFF;
+    packet[19] = crc & 0xFF;
+}
+
+// Capture timestamp of a packet built by writePacketHeader()
+inline uint32_t packetTimestamp(const uint8_t *packet)
+{
+    return ((uint32_t)packet[12] << 24) | ((uint32_t)packet[13] << 16) | ((uint32_t)packet[14] << 8) | packet[15];
+}
+
+// Patch the sequence number of an already built packet
+inline void setPacketSequence(uint8_t *packet, uint16_t seqNum)
+{
+    packet[2] = (seqNum >> 8) & 0xFF;
+    packet[3] = seqNum & 0xFF;
+}
+
+// Payload CRC32 via the ROM table routine - pass the previous result to extend it
+inline uint32_t packetCrc32(const uint8_t *data, size_t length, uint32_t crc = 0)
+{
+    return esp_rom_crc32_le(crc, data, length);
+}
+
+// Build a complete PACKET_TYPE_SILENCE packet, returns its size
+inline size_t writeSilencePacket(uint8_t *packet, uint16_t seqNum, uint8_t state, uint16_t noiseRms, uint32_t timestamp,
+                                 uint32_t sampleRate = PACKET_DEFAULT_RATE)
+{
+    uint8_t *payload = packet + PACKET_HEADER_SIZE;
+    payload[0] = state;
+    payload[1] = 0;
+    payload[2] = (noiseRms >> 8) & 0xFF;
+    payload[3] = noiseRms & 0xFF;
+    writePacketHeader(packet, PACKET_TYPE_SILENCE, seqNum, 0, packetCrc32(payload, SILENCE_PAYLOAD_SIZE), timestamp,
+                      sampleRate);
+    return PACKET_HEADER_SIZE + SILENCE_PAYLOAD_SIZE;
+}
+
+#endif // AUDIO_PACKET_H
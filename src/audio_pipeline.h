@@ -0,0 +1,144 @@
+/*
+Audio Pipeline Profile
+======================
+
+The build's capture format at compile time, from the platformio.ini flags:
+
+  -DAUDIO_SAMPLE_RATE=16000   8000, 16000 or 44100 Hz
+  -DAUDIO_BITS_PER_SAMPLE=32  I2S slot width
+  -DAUDIO_BUFFER_SIZE=512     frames per DMA descriptor (one packet)
+  -DAUDIO_I2S_BUFFERS=8       DMA descriptor count
+  -DAUDIO_CHANNELS=1          1, or 2 for two INMP441s on one bus (stereo
+                              packets, or beamformed with -DAUDIO_BEAMFORM=1)
+
+AudioPipeline<Rate, Bits, Block> turns a profile into constexpr sizes and
+block kernels with the block length as a constant. The scalar kernels unroll
+without a tail loop. On ESP32-S3, the PIE vector body runs with no alignment
+check and no scalar tail, because the callers' buffers are static or ring
+slots aligned to AUDIO_DSP_ALIGN. AudioProfile is the build's own profile.
+
+The capture format can still change at runtime (the "capture" and "config"
+commands). packBlock() and convertBlock() therefore check the block length
+once per block: blocks in the build profile take the fixed kernels, and any
+other length takes the generic ones in audio_dsp.h. Both give the same bytes.
+*/
+
+#ifndef AUDIO_PIPELINE_H
+#define AUDIO_PIPELINE_H
+
+#include "audio_dsp.h"
+#include "esp_rom_crc.h"
+#include <stddef.h>
+
+#ifndef AUDIO_SAMPLE_RATE
+#define AUDIO_SAMPLE_RATE 16000
+#endif
+#ifndef AUDIO_BITS_PER_SAMPLE
+#define AUDIO_BITS_PER_SAMPLE 32
+#endif
+#ifndef AUDIO_BUFFER_SIZE
+#define AUDIO_BUFFER_SIZE 512
+#endif
+#ifndef AUDIO_I2S_BUFFERS
+#define AUDIO_I2S_BUFFERS 8
+#endif
+#ifndef AUDIO_CHANNELS
+#define AUDIO_CHANNELS 1
+#endif
+#ifndef AUDIO_BEAMFORM
+#define AUDIO_BEAMFORM 0
+#endif
+
+static_assert(AUDIO_CHANNELS == 1 || AUDIO_CHANNELS == 2, "AUDIO_CHANNELS must be 1 or 2 (one INMP441 per I2S slot)");
+
+template <uint32_t Rate, int Bits, int Block>
+struct AudioPipeline
+{
+    static_assert(Rate == 8000 || Rate == 16000 || Rate == 44100,
+                  "AUDIO_SAMPLE_RATE must be 8000, 16000 or 44100");
+    static_assert(Bits == 32, "The INMP441 delivers 24-bit samples in 32-bit I2S slots");
+    static_assert(Block > 0 && Block % 8 == 0, "AUDIO_BUFFER_SIZE must be a multiple of 8 (PIE lanes)");
+
+    static constexpr uint32_t sampleRate = Rate;
+    static constexpr int bitsPerSample = Bits;
+    static constexpr int blockSamples = Block;
+    static constexpr size_t dmaBlockBytes = (size_t)Block * Bits / 8;
+    static constexpr size_t pcmPayloadBytes = (size_t)Block * 2;
+    static constexpr uint32_t blockDurationMs = (uint32_t)Block * 1000 / Rate;
+
+    // Convert, measure and pack one block of exactly Block frames, as packAudioBlock
+    static void pack(const int32_t *samples32, uint8_t *payload, AudioBlockStats *stats)
+    {
+#if AUDIO_DSP_HAS_PIE
+        packAudioBlockVector(samples32, Block, payload, stats);
+#else
+        int32_t gain = audioDspGain();
+        int32_t maxAbs = 0;
+        uint64_t sumSquared = 0;
+#pragma GCC unroll 8
+        for (int i = 0; i < Block; i++)
+        {
+            int32_t sample = toSample16(samples32[i], gain);
+            maxAbs = max(maxAbs, sample < 0 ? -sample : sample);
+            sumSquared += (uint32_t)(sample * sample);
+            payload[i * 2] = (uint8_t)(sample >> 8); // Big-endian
+            payload[i * 2 + 1] = (uint8_t)sample;
+        }
+        stats->maxAbs = (int16_t)min(maxAbs, (int32_t)32767);
+        stats->sumSquared = sumSquared;
+        stats->crc = esp_rom_crc32_le(0, payload, pcmPayloadBytes);
+#endif
+    }
+
+    // Convert and measure one block of exactly Block frames, as convertAudioBlock
+    static void convert(const int32_t *samples32, int16_t *samples16, AudioBlockStats *stats)
+    {
+#if AUDIO_DSP_HAS_PIE
+        convertAudioBlockVector(samples32, Block, samples16, stats);
+#else
+        int32_t gain = audioDspGain();
+        int32_t maxAbs = 0;
+        uint64_t sumSquared = 0;
+#pragma GCC unroll 8
+        for (int i = 0; i < Block; i++)
+        {
+            int32_t sample = toSample16(samples32[i], gain);
+            maxAbs = max(maxAbs, sample < 0 ? -sample : sample);
+            sumSquared += (uint32_t)(sample * sample);
+            samples16[i] = (int16_t)sample;
+        }
+        stats->maxAbs = (int16_t)min(maxAbs, (int32_t)32767);
+        stats->sumSquared = sumSquared;
+        stats->crc = 0;
+#endif
+    }
+
+    // Any block length: the fixed kernel for the profile's, generic otherwise
+    static void packBlock(const int32_t *samples32, int numSamples, uint8_t *payload, AudioBlockStats *stats)
+    {
+        if (numSamples == Block)
+            pack(samples32, payload, stats);
+        else
+            packAudioBlock(samples32, numSamples, payload, stats);
+    }
+
+    static void convertBlock(const int32_t *samples32, int numSamples, int16_t *samples16, AudioBlockStats *stats)
+    {
+        if (numSamples == Block)
+            convert(samples32, samples16, stats);
+        else
+            convertAudioBlock(samples32, numSamples, samples16, stats);
+    }
+
+private:
+    // processAudioSample() with the gain read once per block
+    static inline int32_t toSample16(int32_t sample32, int32_t gain)
+    {
+        int32_t sample = (sample32 >> (Bits - 16)) * gain;
+        return sample > 32767 ? 32767 : sample < -32768 ? -32768 : sample;
+    }
+};
+
+using AudioProfile = AudioPipeline<AUDIO_SAMPLE_RATE, AUDIO_BITS_PER_SAMPLE, AUDIO_BUFFER_SIZE>;
+
+#endif // AUDIO_PIPELINE_H
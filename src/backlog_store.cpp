@@ -0,0 +1,253 @@
+/*
+Backlog Store
+=============
+
+See backlog_store.h.
+*/
+
+#include "backlog_store.h"
+
+#if AUDIO_BACKLOG
+
+#include "esp_partition.h"
+
+#define SECTOR_SIZE 4096     // Flash erase unit
+#define RECORD_HEADER_SIZE 2 // Little-endian packet length in front of each record
+#define SECTOR_END 0xFFFF    // Erased flash or padding: no more records in the sector
+
+// PSRAM tier: records may wrap around the end. Positions run free, modulo size.
+// They are 64-bit: the size is not a power of two, so a 32-bit position would
+// jump back to offset 0 when it wraps, after 4 GiB through the store.
+static uint8_t *memory = NULL;
+static size_t memorySize = 0;
+static uint64_t memoryHead = 0;   // Next write
+static uint64_t memoryTail = 0;   // Oldest unacknowledged record
+static uint64_t memoryCursor = 0; // Next read
+
+// Flash tier: a circular log of sectors. Sector numbers run free, modulo sectorCount.
+static const esp_partition_t *partition = NULL;
+static uint32_t sectorCount = 0;
+static uint8_t *writeSector = NULL; // Sector being filled, not on flash yet
+static size_t writeFill = 0;
+static uint32_t flashHead = 0; // Sectors written
+static uint32_t flashTail = 0; // Sector of the oldest unacknowledged record
+static size_t tailOffset = 0;
+static uint32_t cursorSector = 0;
+static size_t cursorOffset = 0;
+static uint8_t *readSector = NULL; // Copy of cursorSector, once it is on flash
+static uint32_t loadedSector = 0;
+static bool sectorLoaded = false;
+
+static BacklogStats stats;
+static uint32_t unacked = 0; // Packets read since the last backlogAck()
+
+static void memoryWrite(uint64_t position, const uint8_t *data, size_t length)
+{
+    size_t start = (size_t)(position % memorySize);
+    size_t first = min(length, memorySize - start);
+    memcpy(memory + start, data, first);
+    memcpy(memory, data + first, length - first);
+}
+
+static void memoryRead(uint64_t position, uint8_t *data, size_t length)
+{
+    size_t start = (size_t)(position % memorySize);
+    size_t first = min(length, memorySize - start);
+    memcpy(data, memory + start, first);
+    memcpy(data + first, memory, length - first);
+}
+
+static bool flashEmpty()
+{
+    return flashTail == flashHead && tailOffset >= writeFill;
+}
+
+// Write out the filled sector; false when the partition is full
+static bool commitSector()
+{
+    if (flashHead - flashTail >= sectorCount)
+        return false;
+    memset(writeSector + writeFill, 0xFF, SECTOR_SIZE - writeFill);
+    size_t offset = (size_t)(flashHead % sectorCount) * SECTOR_SIZE;
+    if (esp_partition_erase_range(partition, offset, SECTOR_SIZE) != ESP_OK ||
+        esp_partition_write(partition, offset, writeSector, SECTOR_SIZE) != ESP_OK)
+    {
+        Serial.println("Backlog flash write failed");
+        return false;
+    }
+    flashHead++;
+    writeFill = 0;
+    return true;
+}
+
+static bool flashPush(const uint8_t *packet, size_t length)
+{
+    if (!partition || RECORD_HEADER_SIZE + length > SECTOR_SIZE)
+        return false;
+    if (writeFill + RECORD_HEADER_SIZE + length > SECTOR_SIZE && !commitSector())
+        return false;
+    writeSector[writeFill] = length & 0xFF;
+    writeSector[writeFill + 1] = length >> 8;
+    memcpy(writeSector + writeFill + RECORD_HEADER_SIZE, packet, length);
+    writeFill += RECORD_HEADER_SIZE + length;
+    return true;
+}
+
+static size_t flashRead(uint8_t *packet, size_t capacity)
+{
+    while (true)
+    {
+        // The sector being filled is read straight from RAM. Its offsets stay
+        // valid once it is written out, so the cursor does not care.
+        const uint8_t *sector;
+        size_t limit;
+        if (cursorSector == flashHead)
+        {
+            sector = writeSector;
+            limit = writeFill;
+        }
+        else
+        {
+            if (!sectorLoaded || loadedSector != cursorSector)
+            {
+                size_t offset = (size_t)(cursorSector % sectorCount) * SECTOR_SIZE;
+                if (esp_partition_read(partition, offset, readSector, SECTOR_SIZE) != ESP_OK)
+                    return 0;
+                loadedSector = cursorSector;
+                sectorLoaded = true;
+            }
+            sector = readSector;
+            limit = SECTOR_SIZE;
+        }
+
+        size_t length = cursorOffset + RECORD_HEADER_SIZE <= limit
+                            ? sector[cursorOffset] | (sector[cursorOffset + 1] << 8)
+                            : SECTOR_END;
+        if (length == SECTOR_END || cursorOffset + RECORD_HEADER_SIZE + length > limit)
+        {
+            if (cursorSector == flashHead)
+                return 0; // Read everything there is
+            cursorSector++;
+            cursorOffset = 0;
+            continue;
+        }
+        if (length > capacity)
+            return 0;
+        memcpy(packet, sector + cursorOffset + RECORD_HEADER_SIZE, length);
+        cursorOffset += RECORD_HEADER_SIZE + length;
+        return length;
+    }
+}
+
+bool backlogBegin(size_t memoryBytes)
+{
+    memory = (uint8_t *)heap_caps_malloc(memoryBytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    memorySize = memory ? memoryBytes : 0;
+
+    partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_ANY,
+                                         BACKLOG_PARTITION_LABEL);
+    if (partition)
+    {
+        // Flash writes and reads go through internal RAM
+        writeSector = (uint8_t *)heap_caps_malloc(SECTOR_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        readSector = (uint8_t *)heap_caps_malloc(SECTOR_SIZE, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        sectorCount = partition->size / SECTOR_SIZE;
+        if (!writeSector || !readSector || sectorCount < 2)
+        {
+            free(writeSector);
+            free(readSector);
+            partition = NULL;
+        }
+    }
+    stats.flashCapacity = partition ? (size_t)sectorCount * SECTOR_SIZE : 0;
+    return memory || partition;
+}
+
+bool backlogEmpty()
+{
+    return memoryTail == memoryHead && flashEmpty();
+}
+
+bool backlogPush(const uint8_t *packet, size_t length)
+{
+    bool stored = false;
+    size_t used = (size_t)(memoryHead - memoryTail);
+    if (flashEmpty() && memory && used + RECORD_HEADER_SIZE + length <= memorySize)
+    {
+        uint8_t header[RECORD_HEADER_SIZE] = {(uint8_t)(length & 0xFF), (uint8_t)(length >> 8)};
+        memoryWrite(memoryHead, header, RECORD_HEADER_SIZE);
+        memoryWrite(memoryHead + RECORD_HEADER_SIZE, packet, length);
+        memoryHead += RECORD_HEADER_SIZE + length;
+        stored = true;
+    }
+    else
+        stored = flashPush(packet, length); // Also once PSRAM has room again, until flash drains
+
+    if (stored)
+        stats.stored++;
+    else
+        stats.dropped++;
+    return stored;
+}
+
+static size_t readNext(uint8_t *packet, size_t capacity)
+{
+    if (memoryCursor != memoryHead)
+    {
+        uint8_t header[RECORD_HEADER_SIZE];
+        memoryRead(memoryCursor, header, RECORD_HEADER_SIZE);
+        size_t length = header[0] | (header[1] << 8);
+        if (length > capacity)
+            return 0;
+        memoryRead(memoryCursor + RECORD_HEADER_SIZE, packet, length);
+        memoryCursor += RECORD_HEADER_SIZE + length;
+        return length;
+    }
+    return partition ? flashRead(packet, capacity) : 0;
+}
+
+size_t backlogRead(uint8_t *packet, size_t capacity)
+{
+    size_t length = readNext(packet, capacity);
+    if (length)
+        unacked++;
+    return length;
+}
+
+void backlogAck()
+{
+    memoryTail = memoryCursor;
+    flashTail = cursorSector;
+    tailOffset = cursorOffset;
+    if (partition && flashEmpty())
+        writeFill = tailOffset = cursorOffset = 0; // Start the RAM sector over
+    stats.sent += unacked;
+    unacked = 0;
+}
+
+void backlogRewind()
+{
+    unacked = 0;
+    memoryCursor = memoryTail;
+    cursorSector = flashTail;
+    cursorOffset = tailOffset;
+}
+
+BacklogStats backlogGetStats()
+{
+    stats.memoryBytes = (size_t)(memoryHead - memoryTail);
+    stats.flashBytes = (size_t)(flashHead - flashTail) * SECTOR_SIZE + writeFill - tailOffset;
+    return stats;
+}
+
+#else // !AUDIO_BACKLOG
+
+bool backlogBegin(size_t memoryBytes) { return false; }
+bool backlogEmpty() { return true; }
+bool backlogPush(const uint8_t *packet, size_t length) { return false; }
+size_t backlogRead(uint8_t *packet, size_t capacity) { return 0; }
+void backlogAck() {}
+void backlogRewind() {}
+BacklogStats backlogGetStats() { return BacklogStats(); }
+
+#endif
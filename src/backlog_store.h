@@ -0,0 +1,73 @@
+/*
+Backlog Store
+=============
+
+Store-and-forward for network outages. The packet ring holds ~4 s, so
+anything longer used to lose audio. While the WebSocket is down, the network
+task moves the oldest packets out of the ring (everything past
+BACKLOG_SPILL_DEPTH) into this store. Packets are stored exactly as built,
+so each keeps its sequence number, capture timestamp and codec.
+
+Two tiers, one FIFO:
+- PSRAM: a byte ring of BACKLOG_MEMORY_BYTES. This is most of the N16R8's
+  8 MB; about 20 minutes of ADPCM at 16 kHz.
+- Flash: once PSRAM is full, packets go to the "backlog" data partition
+  (see partitions_backlog.csv), written a 4 KB sector at a time. New packets
+  keep going to flash until it has drained, so the order is kept.
+When both are full, new packets are dropped and counted.
+
+After reconnect, live audio goes first. The backlog goes out between live
+packets as PACKET_TYPE_BACKLOG frames, at most BACKLOG_DEFAULT_RATE bytes/s,
+and the relay writes it into the device's recording. A frame leaves the
+store only once it has been sent (backlogAck()); after a failed send,
+backlogRewind() reads it again.
+
+Network task only - there is no locking. The store is empty after a reboot.
+*/
+
+#ifndef BACKLOG_STORE_H
+#define BACKLOG_STORE_H
+
+#include <Arduino.h>
+
+#ifndef AUDIO_BACKLOG
+#define AUDIO_BACKLOG 1
+#endif
+
+#define BACKLOG_MEMORY_BYTES (6 * 1024 * 1024) // PSRAM tier, leaves room for the rings and Opus
+#define BACKLOG_PARTITION_LABEL "backlog"      // Flash tier, optional
+#define BACKLOG_DEFAULT_RATE 48000             // Upload bytes/s, 1.5x 16 kHz PCM
+#define BACKLOG_MIN_RATE 4000
+#define BACKLOG_MAX_RATE 512000
+
+struct BacklogStats
+{
+    uint32_t stored;      // Packets taken in
+    uint32_t sent;        // Packets acknowledged as sent
+    uint32_t dropped;     // Packets refused because both tiers were full
+    size_t memoryBytes;   // PSRAM tier in use
+    size_t flashBytes;    // Flash tier in use, including the sector being filled
+    size_t flashCapacity; // 0 without the partition
+};
+
+// Allocate the PSRAM ring and find the flash partition. False if neither is available.
+bool backlogBegin(size_t memoryBytes);
+
+bool backlogEmpty();
+
+// Append a complete packet. False (and counted) if it does not fit anywhere.
+bool backlogPush(const uint8_t *packet, size_t length);
+
+// Copy the next packet past the read cursor into packet and return its length;
+// 0 when there is nothing left or the next one is larger than capacity
+size_t backlogRead(uint8_t *packet, size_t capacity);
+
+// Everything read so far was sent - release it
+void backlogAck();
+
+// The packets read since the last backlogAck() were not sent - read them again
+void backlogRewind();
+
+BacklogStats backlogGetStats();
+
+#endif // BACKLOG_STORE_H
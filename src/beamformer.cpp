@@ -0,0 +1,60 @@
+/*
+Two-Microphone Beamformer
+=========================
+
+See beamformer.h.
+*/
+
+#include "beamformer.h"
+#include <atomic>
+
+#define HISTORY_SIZE 16 // Power of two, more than BEAMFORMER_MAX_DELAY
+#define HISTORY_MASK (HISTORY_SIZE - 1)
+
+static std::atomic<int> steeringDelay(0);
+
+// Capture task only: the last HISTORY_SIZE samples of each mic, across blocks
+static int32_t historyLeft[HISTORY_SIZE];
+static int32_t historyRight[HISTORY_SIZE];
+static unsigned historyIndex = 0;
+
+bool beamformerSetDelay(int delay)
+{
+    if (delay < -BEAMFORMER_MAX_DELAY || delay > BEAMFORMER_MAX_DELAY)
+        return false;
+    steeringDelay.store(delay, std::memory_order_relaxed);
+    return true;
+}
+
+int beamformerDelay()
+{
+    return steeringDelay.load(std::memory_order_relaxed);
+}
+
+void beamformerReset()
+{
+    for (int i = 0; i < HISTORY_SIZE; i++)
+        historyLeft[i] = historyRight[i] = 0;
+}
+
+void beamformerProcess(int32_t *samples32, int numFrames)
+{
+    int delay = beamformerDelay();
+    unsigned delayLeft = delay > 0 ? delay : 0;
+    unsigned delayRight = delay < 0 ? -delay : 0;
+    unsigned index = historyIndex;
+
+    // Frame i is read from slots 2i and 2i+1 before slot i is written, and
+    // i <= 2i, so the output never overtakes the input. Delayed samples come
+    // from the history rings.
+    for (int i = 0; i < numFrames; i++)
+    {
+        historyLeft[index] = samples32[i * 2];
+        historyRight[index] = samples32[i * 2 + 1];
+        int32_t left = historyLeft[(index - delayLeft) & HISTORY_MASK];
+        int32_t right = historyRight[(index - delayRight) & HISTORY_MASK];
+        samples32[i] = (left >> 1) + (right >> 1); // 24-bit data in 32-bit slots: no overflow
+        index = (index + 1) & HISTORY_MASK;
+    }
+    historyIndex = index;
+}
@@ -0,0 +1,40 @@
+/*
+Two-Microphone Beamformer
+=========================
+
+Delay-and-sum over the two INMP441s of the beam capture mode (see
+audio_capture.h). The interleaved L/R block is de-multiplexed, aligned and
+averaged in one pass, in place. The result is a mono block in the first
+numFrames slots, so the filter, AGC, codecs and packets downstream work as
+with one mic.
+
+Speech from the steered direction adds up in phase. The mics' self-noise and
+diffuse room noise are uncorrelated between them, so they add in power only:
+about +3 dB SNR from the second mic.
+
+The delay steers the beam in whole samples. 0 points broadside, at a talker
+facing the mics. A positive delay holds the left mic back, which aims the
+beam toward the left mic's side of the array. A negative delay holds the
+right mic back. The useful range is the mic spacing in samples: 2 cm is
+about 1 sample at 16 kHz.
+*/
+
+#ifndef BEAMFORMER_H
+#define BEAMFORMER_H
+
+#include <stdint.h>
+
+#define BEAMFORMER_MAX_DELAY 8 // Samples, +-
+
+// Any task. False if out of range.
+bool beamformerSetDelay(int delay);
+int beamformerDelay();
+
+// Capture task: numFrames interleaved L/R frames in, numFrames mono samples
+// out at the start of the same buffer
+void beamformerProcess(int32_t *samples32, int numFrames);
+
+// Capture task: forget the previous block, e.g. after a format change
+void beamformerReset();
+
+#endif // BEAMFORMER_H
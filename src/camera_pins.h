@@ -35,4 +35,26 @@
 #define VSYNC_GPIO_NUM 25 // VSYNC
 #define HREF_GPIO_NUM 23  // HREF
 #define PCLK_GPIO_NUM 22  // PCLK
-#endif
\ No newline at end of file
+#endif
+#if defined(CAMERA_MODEL_ESP32S3_DEVKIT)
+// OV2640 module wired to an ESP32-S3-DevKitC-1 next to the INMP441 (GPIO10-12),
+// the monitor output (GPIO13-15) and the status LED (GPIO48, GPIO38 on v1.1
+// boards, so 38 is kept free). GPIO26-37 belong to the N16R8's flash and
+// octal PSRAM, so the ESP32 maps above do not fit.
+#define PWDN_GPIO_NUM -1
+#define RESET_GPIO_NUM -1
+#define XCLK_GPIO_NUM 17
+#define SIOD_GPIO_NUM 4 // SDA
+#define SIOC_GPIO_NUM 5 // SCL
+#define Y9_GPIO_NUM 41
+#define Y8_GPIO_NUM 40
+#define Y7_GPIO_NUM 39
+#define Y6_GPIO_NUM 8
+#define Y5_GPIO_NUM 21
+#define Y4_GPIO_NUM 42
+#define Y3_GPIO_NUM 2
+#define Y2_GPIO_NUM 18
+#define VSYNC_GPIO_NUM 6 // VSYNC
+#define HREF_GPIO_NUM 7  // HREF
+#define PCLK_GPIO_NUM 16 // PCLK
+#endif
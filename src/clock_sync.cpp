@@ -0,0 +1,85 @@
+/*
+Clock Sync for Latency Measurement
+==================================
+
+See clock_sync.h.
+*/
+
+#include "clock_sync.h"
+#include "audio_packet.h"
+#include <esp_timer.h>
+
+#define SEND_LATENCY_WEIGHT 0.1f // Smoothing of sendMs, ~10 packets
+
+// Written by the capture task, read by the network task
+struct CaptureAnchor
+{
+    uint32_t timestamp;
+    int64_t captureUs; // esp_timer time of the frame at `timestamp`
+    uint32_t sampleRate;
+    bool valid;
+};
+
+static CaptureAnchor anchor = {};
+static portMUX_TYPE anchorLock = portMUX_INITIALIZER_UNLOCKED;
+static float sendLatencyMs = -1; // Network task only, -1 until measured
+
+static CaptureAnchor readAnchor()
+{
+    portENTER_CRITICAL(&anchorLock);
+    CaptureAnchor copy = anchor;
+    portEXIT_CRITICAL(&anchorLock);
+    return copy;
+}
+
+void clockSyncRecordCapture(uint32_t timestamp, int numSamples, uint32_t sampleRate, int64_t readUs)
+{
+    CaptureAnchor update = {
+        .timestamp = timestamp,
+        .captureUs = readUs - (int64_t)numSamples * 1000000 / sampleRate,
+        .sampleRate = sampleRate,
+        .valid = true};
+    portENTER_CRITICAL(&anchorLock);
+    anchor = update;
+    portEXIT_CRITICAL(&anchorLock);
+}
+
+void clockSyncRecordSend(const uint8_t *packet)
+{
+    if (packet[0] != PACKET_HEADER_MAGIC_V2 || packet[1] == PACKET_TYPE_STATS)
+        return;
+    CaptureAnchor current = readAnchor();
+    if (!current.valid || packetSampleRate(packet) != current.sampleRate)
+        return; // Queued before a rate change
+
+    // Signed distance on the sample clock - the packet is older than the anchor
+    int32_t frames = (int32_t)(packetTimestamp(packet) - current.timestamp);
+    int64_t capturedUs = current.captureUs + (int64_t)frames * 1000000 / current.sampleRate;
+    float latencyMs = (esp_timer_get_time() - capturedUs) / 1000.0f;
+    if (latencyMs < 0 || latencyMs > 60000)
+        return; // Stale anchor or the device restarted its clock
+    sendLatencyMs = sendLatencyMs < 0 ? latencyMs : sendLatencyMs + (latencyMs - sendLatencyMs) * SEND_LATENCY_WEIGHT;
+}
+
+bool clockSyncSampleClock(int64_t us, uint32_t *timestamp, uint32_t *sampleRate)
+{
+    CaptureAnchor current = readAnchor();
+    if (!current.valid)
+        return false;
+    *timestamp = current.timestamp + (int32_t)((us - current.captureUs) * current.sampleRate / 1000000);
+    *sampleRate = current.sampleRate;
+    return true;
+}
+
+size_t clockSyncBuildReply(char *reply, size_t size, double t0, int64_t receivedUs)
+{
+    CaptureAnchor current = readAnchor();
+    if (!current.valid)
+        return 0;
+    int length = snprintf(reply, size,
+                          "{\"type\":\"clock_sync\",\"t0\":%.3f,\"t1\":%.3f,\"t2\":%.3f,\"sampleClock\":%u,"
+                          "\"sampleTime\":%.3f,\"rate\":%u,\"sendMs\":%.2f}",
+                          t0, receivedUs / 1000.0, esp_timer_get_time() / 1000.0, current.timestamp,
+                          current.captureUs / 1000.0, current.sampleRate, max(sendLatencyMs, 0.0f));
+    return length > 0 && (size_t)length < size ? length : 0;
+}
@@ -0,0 +1,52 @@
+/*
+Clock Sync for Latency Measurement
+==================================
+
+The device's half of the relay's latency measurement mode. Every packet header
+already carries a capture stamp: the sample clock of its first sample (see
+audio_packet.h). This module maps that clock to esp_timer time and answers
+the relay's NTP-style probes, so the relay and browsers can place each packet
+on their own clocks.
+
+An exchange works like this:
+- The relay sends {"command":"clock_sync","t0":<relay ms>}.
+- The device answers right away:
+    {"type":"clock_sync","t0":..,"t1":<device ms at receive>,"t2":<device ms at send>,
+     "sampleClock":S,"sampleTime":<device ms of sample S>,"rate":R,"sendMs":..}
+- The relay keeps the exchange with the lowest round trip out of the last
+  few, as NTP's clock filter does, and derives the offset from it.
+
+The capture anchor (sampleClock, sampleTime) is set from every block. It is
+the time the DMA wakeup for the block's last frame was seen, minus the block
+length. sendMs is the smoothed capture-to-send time of the packets that
+went out: ring, coalescing and the socket write. It is measured entirely on
+the device, so it needs no sync.
+
+Device times are esp_timer milliseconds since boot, so light sleep does not
+stop them.
+*/
+
+#ifndef CLOCK_SYNC_H
+#define CLOCK_SYNC_H
+
+#include <Arduino.h>
+
+#define CLOCK_SYNC_REPLY_SIZE 224
+
+// Capture task: the block whose first frame has sample clock `timestamp` was
+// read at esp_timer time `readUs`
+void clockSyncRecordCapture(uint32_t timestamp, int numSamples, uint32_t sampleRate, int64_t readUs);
+
+// Network task: a packet built by writePacketHeader() was just written to the
+// socket. Ignores packets without a capture stamp (stats reports).
+void clockSyncRecordSend(const uint8_t *packet);
+
+// Any task: the capture sample clock at esp_timer time `us`, for stamping other
+// streams (camera frames) on the audio timeline. False before the first block.
+bool clockSyncSampleClock(int64_t us, uint32_t *timestamp, uint32_t *sampleRate);
+
+// Network task: reply to a probe. receivedUs is the esp_timer time the probe
+// came in. Returns the message length, 0 before the first captured block.
+size_t clockSyncBuildReply(char *reply, size_t size, double t0, int64_t receivedUs);
+
+#endif // CLOCK_SYNC_H
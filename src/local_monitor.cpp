@@ -0,0 +1,245 @@
+/*
+Local Monitor
+=============
+
+See local_monitor.h.
+*/
+
+#include "local_monitor.h"
+
+#if AUDIO_LOCAL_MONITOR
+
+#include <atomic>
+#include "audio_pipeline.h"
+#include "packet_ring.h"
+
+#define BLOCK_META_SIZE 16 // [capturedUs(8) | sampleRate(4) | padding][samples], samples aligned for the SIMD kernel
+
+struct BlockMeta
+{
+    int64_t capturedUs;
+    uint32_t sampleRate;
+};
+
+static i2s_port_t port = I2S_NUM_1;
+static TaskHandle_t monitorTask = NULL;
+static PacketRing pcmRing;
+
+static std::atomic<bool> enabled(false);
+static std::atomic<bool> restartPending(false);
+
+// Monitor task only
+static uint32_t outputRate = 0;
+static int64_t playoutEndUs = 0; // When the last block written finishes playing, 0 when idle
+
+// Counters: blocks and underruns written by the monitor task, ring drops by the capture task
+static volatile uint32_t blocksPlayed = 0;
+static volatile uint32_t underruns = 0;
+static volatile uint32_t trimmed = 0;
+
+// Latency window, shared with the network task
+static portMUX_TYPE latencyLock = portMUX_INITIALIZER_UNLOCKED;
+static uint64_t latencySumUs = 0;
+static uint32_t latencyCount = 0;
+static uint32_t latencyMaxUs = 0;
+
+static void recordLatency(int64_t us)
+{
+    uint32_t latency = us > 0 ? (uint32_t)us : 0;
+    portENTER_CRITICAL(&latencyLock);
+    latencySumUs += latency;
+    latencyCount++;
+    latencyMaxUs = max(latencyMaxUs, latency);
+    portEXIT_CRITICAL(&latencyLock);
+}
+
+static void playBlock(const uint8_t *block, size_t length)
+{
+    BlockMeta meta;
+    memcpy(&meta, block, sizeof(meta));
+    const int16_t *samples = (const int16_t *)(block + BLOCK_META_SIZE);
+    int frames = length / (2 * sizeof(int16_t));
+    if (frames == 0 || meta.sampleRate == 0)
+        return;
+
+    if (meta.sampleRate != outputRate)
+    {
+        i2s_set_clk(port, meta.sampleRate, I2S_BITS_PER_SAMPLE_16BIT, I2S_CHANNEL_STEREO);
+        outputRate = meta.sampleRate;
+        playoutEndUs = 0;
+    }
+    if (restartPending.exchange(false))
+    {
+        i2s_zero_dma_buffer(port);
+        playoutEndUs = 0;
+    }
+
+    // The block starts when the audio already queued has played out. After an
+    // underrun the DMA is cycling silent descriptors, so about one more.
+    int64_t now = esp_timer_get_time();
+    int64_t blockUs = (int64_t)frames * 1000000 / meta.sampleRate;
+    int64_t start = playoutEndUs;
+    if (playoutEndUs == 0 || now >= playoutEndUs)
+    {
+        if (playoutEndUs != 0)
+            underruns++;
+        start = now + (int64_t)LOCAL_MONITOR_DMA_BUF_LEN * 1000000 / meta.sampleRate;
+    }
+    recordLatency(start - (meta.capturedUs - blockUs));
+
+    size_t written = 0;
+    i2s_write(port, samples, length, &written, portMAX_DELAY);
+    playoutEndUs = start + blockUs;
+    blocksPlayed++;
+}
+
+static void monitorTaskLoop(void *parameter)
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        size_t length;
+        uint8_t *block;
+        while ((block = pcmRing.peek(&length)) != NULL)
+        {
+            // Stay close to live: play the newest blocks, not a backlog
+            if (pcmRing.depth() > LOCAL_MONITOR_MAX_QUEUED)
+            {
+                trimmed++;
+                pcmRing.release();
+                continue;
+            }
+            playBlock(block, length);
+            pcmRing.release();
+        }
+    }
+}
+
+bool localMonitorBegin(const LocalMonitorConfig &config)
+{
+    port = config.port;
+    i2s_config_t i2s_config = {
+        .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_TX),
+        .sample_rate = 16000, // Follows the capture rate from the first block
+        .bits_per_sample = I2S_BITS_PER_SAMPLE_16BIT,
+        .channel_format = I2S_CHANNEL_FMT_RIGHT_LEFT,
+        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
+        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
+        .dma_buf_count = LOCAL_MONITOR_DMA_BUF_COUNT,
+        .dma_buf_len = LOCAL_MONITOR_DMA_BUF_LEN,
+        .use_apll = false,
+        .tx_desc_auto_clear = true, // Silence, not the last descriptor again, when starved
+        .fixed_mclk = 0};
+
+    i2s_pin_config_t pin_config = {
+        .bck_io_num = config.bckPin,
+        .ws_io_num = config.wsPin,
+        .data_out_num = config.dataPin,
+        .data_in_num = I2S_PIN_NO_CHANGE};
+
+    // Slots hold the block as 16-bit stereo, so mono blocks need twice their samples
+    if (!pcmRing.begin(LOCAL_MONITOR_RING_SLOTS, BLOCK_META_SIZE + config.blockSamples * 2 * sizeof(int16_t)))
+    {
+        Serial.println("Failed to allocate monitor buffers");
+        return false;
+    }
+
+    esp_err_t err = i2s_driver_install(port, &i2s_config, 0, NULL);
+    if (err != ESP_OK)
+    {
+        Serial.printf("Failed to install monitor I2S driver: %d\n", err);
+        return false;
+    }
+    err = i2s_set_pin(port, &pin_config);
+    if (err != ESP_OK)
+    {
+        Serial.printf("Failed to set monitor I2S pins: %d\n", err);
+        i2s_driver_uninstall(port);
+        return false;
+    }
+    i2s_zero_dma_buffer(port);
+    outputRate = i2s_config.sample_rate;
+
+    if (xTaskCreatePinnedToCore(monitorTaskLoop, "Monitor", config.stackSize, NULL,
+                                config.priority, &monitorTask, config.core) != pdPASS)
+    {
+        Serial.println("Failed to start monitor task");
+        i2s_driver_uninstall(port);
+        return false;
+    }
+    return true;
+}
+
+bool localMonitorAvailable()
+{
+    return monitorTask != NULL;
+}
+
+bool localMonitorSetEnabled(bool on)
+{
+    if (on && !monitorTask)
+        return false;
+    if (on && !localMonitorEnabled())
+        restartPending.store(true); // The gap before this is not an underrun
+    enabled.store(on, std::memory_order_release);
+    return true;
+}
+
+bool localMonitorEnabled()
+{
+    return enabled.load(std::memory_order_acquire);
+}
+
+void localMonitorWrite(const int32_t *samples32, int numFrames, int channels, uint32_t sampleRate,
+                       int64_t capturedUs)
+{
+    if (!localMonitorEnabled())
+        return;
+    uint8_t *slot = pcmRing.acquire();
+    if (!slot)
+        return; // Counted by the ring
+
+    BlockMeta meta = {capturedUs, sampleRate};
+    memcpy(slot, &meta, sizeof(meta));
+    int16_t *samples = (int16_t *)(slot + BLOCK_META_SIZE);
+    AudioBlockStats stats;
+    AudioProfile::convertBlock(samples32, numFrames * channels, samples, &stats);
+    if (channels == 1)
+    {
+        // Spread to L/R in place, from the end so nothing is overwritten before it is read
+        for (int i = numFrames - 1; i >= 0; i--)
+            samples[2 * i] = samples[2 * i + 1] = samples[i];
+    }
+    pcmRing.commit(numFrames * 2 * sizeof(int16_t));
+    xTaskNotifyGive(monitorTask);
+}
+
+LocalMonitorStats localMonitorTakeStats()
+{
+    LocalMonitorStats stats;
+    stats.blocks = blocksPlayed;
+    stats.drops = pcmRing.overruns + trimmed;
+    stats.underruns = underruns;
+
+    portENTER_CRITICAL(&latencyLock);
+    stats.latencyUs = latencyCount ? (uint32_t)(latencySumUs / latencyCount) : 0;
+    stats.latencyMaxUs = latencyMaxUs;
+    latencySumUs = 0;
+    latencyCount = 0;
+    latencyMaxUs = 0;
+    portEXIT_CRITICAL(&latencyLock);
+    return stats;
+}
+
+#else // !AUDIO_LOCAL_MONITOR
+
+bool localMonitorBegin(const LocalMonitorConfig &config) { return false; }
+bool localMonitorAvailable() { return false; }
+bool localMonitorSetEnabled(bool enabled) { return !enabled; }
+bool localMonitorEnabled() { return false; }
+void localMonitorWrite(const int32_t *samples32, int numFrames, int channels, uint32_t sampleRate,
+                       int64_t capturedUs) {}
+LocalMonitorStats localMonitorTakeStats() { return LocalMonitorStats(); }
+
+#endif
@@ -0,0 +1,84 @@
+/*
+Local Monitor
+=============
+
+Optional low-latency local output: the processed capture audio (after the
+voice filter and AGC, the same samples the codecs get) played on a second
+I2S port into an I2S DAC or amplifier such as a MAX98357A or PCM5102. For
+checking the microphone on site with headphones or a small speaker, while
+the uplink keeps running.
+
+The ESP32-S3 has Bluetooth LE only - no Classic, so no A2DP source. A wired
+I2S output is what this chip can do at a known, low latency.
+
+The capture task copies each block into the monitor's ring, the same way it
+feeds the Opus stage, and never waits: a full ring drops the block and
+counts it. The monitor task (core 1) writes the blocks to the TX DMA.
+- Latency is bounded. Blocks queued beyond LOCAL_MONITOR_MAX_QUEUED are
+  dropped, so a stall does not leave the output seconds behind.
+- A block that reaches the DMA after the previous one has finished playing
+  is an underrun. The DMA plays silence in the gap (tx_desc_auto_clear).
+- Latency is the capture time of a block's first sample (the DMA read time
+  minus the block length) to its estimated playout start, from a playout
+  clock the task keeps for the blocks it writes.
+
+Output is 16-bit stereo at the capture rate; mono blocks go to both sides.
+
+Needs -DAUDIO_LOCAL_MONITOR=1. Without it every function is a no-op and
+localMonitorBegin() returns false. {"command":"monitor","enabled":true}
+switches it at runtime.
+*/
+
+#ifndef LOCAL_MONITOR_H
+#define LOCAL_MONITOR_H
+
+#include <Arduino.h>
+#include <driver/i2s.h>
+
+#ifndef AUDIO_LOCAL_MONITOR
+#define AUDIO_LOCAL_MONITOR 0
+#endif
+
+#define LOCAL_MONITOR_RING_SLOTS 4  // Capture blocks queued ahead of the output (power of two)
+#define LOCAL_MONITOR_MAX_QUEUED 2  // More than this waiting and the oldest is dropped
+#define LOCAL_MONITOR_DMA_BUF_COUNT 4
+#define LOCAL_MONITOR_DMA_BUF_LEN 128 // Frames per descriptor, 8 ms at 16 kHz
+
+struct LocalMonitorConfig
+{
+    i2s_port_t port;      // Not the capture port
+    int bckPin, wsPin, dataPin;
+    int blockSamples;     // Largest capture block, in samples
+    BaseType_t core;      // Core the monitor task is pinned to
+    UBaseType_t priority; // Monitor task priority
+    uint32_t stackSize;   // Monitor task stack
+};
+
+struct LocalMonitorStats
+{
+    uint32_t blocks;       // Blocks played
+    uint32_t drops;        // Blocks dropped: ring full or over LOCAL_MONITOR_MAX_QUEUED
+    uint32_t underruns;    // Blocks that arrived after the output ran dry
+    uint32_t latencyUs;    // Mean capture-to-playout latency since the last localMonitorTakeStats()
+    uint32_t latencyMaxUs; // Worst one in the same window
+};
+
+// Install the output port and start the monitor task. The output starts disabled.
+bool localMonitorBegin(const LocalMonitorConfig &config);
+
+bool localMonitorAvailable();
+
+// Any task. Enabling fails when the monitor is not available.
+bool localMonitorSetEnabled(bool enabled);
+bool localMonitorEnabled();
+
+// Capture side: queue a processed block for playback. numFrames frames of
+// `channels` interleaved 32-bit samples; capturedUs is esp_timer_get_time()
+// when the DMA delivered the block. Never blocks.
+void localMonitorWrite(const int32_t *samples32, int numFrames, int channels, uint32_t sampleRate,
+                       int64_t capturedUs);
+
+// Counters, plus the latency over the window since the previous call. Network task.
+LocalMonitorStats localMonitorTakeStats();
+
+#endif // LOCAL_MONITOR_H
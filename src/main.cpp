@@ -6,13 +6,14 @@ Description:
 -----------
 1. WiFi:
    - Connection to specified WiFi network
-   - Auto-reconnect on disconnection
+   - Non-blocking bring-up and reconnect with backoff (see wifi_link.h)
+   - Audio keeps buffering through outages and is uploaded afterwards (see backlog_store.h)
 
 2. Microphone Features:
    - Electrobot INMP441 I2S MEMS microphone integration
-   - 44.1KHz sample rate, 16-bit samples
-   - Audio level visualization with built-in LED
-   - Audio streaming via WebSocket
+   - 16KHz sample rate by default (8/16/44.1KHz at runtime), 16-bit samples
+   - Status and audio level on the RGB LED (own task, see status_led.h)
+   - Audio streaming via WebSocket or UDP
 
 3. WebSocket Features:
    - Live audio streaming to Node.js server
@@ -43,10 +44,35 @@ Usage:
 #include <Arduino.h>
 #include <WiFi.h>
 #include <WebSocketsClient.h>
+#include <WiFiUdp.h>
 #include <driver/i2s.h>
 #include <algorithm>
 #include <cmath>
 #include <ArduinoJson.h>
+#include "audio_packet.h"
+#include "audio_dsp.h"
+#include "audio_pipeline.h"
+#include "packet_ring.h"
+#include "adpcm.h"
+#include "opus_stage.h"
+#include "vad.h"
+#include "audio_capture.h"
+#include "wifi_link.h"
+#include "power_manager.h"
+#include "telemetry.h"
+#include "status_led.h"
+#include "clock_sync.h"
+#include "voice_filter.h"
+#include "agc.h"
+#include "beamformer.h"
+#include "wake_word.h"
+#include "backlog_store.h"
+#include "local_monitor.h"
+#include "relay_endpoint.h"
+#include "video_capture.h"
+#include "person_detect.h"
+#include "net_arena.h"
+#include "task_topology.h"
 
 // INMP441 Microphone pins - Using the pins specified by the user
 #define I2S_SD 10
@@ -54,16 +80,42 @@ Usage:
 #define I2S_SCK 12
 #define I2S_PORT I2S_NUM_0
 
-// Audio buffer settings
-#define BUFFER_COUNT 10
-#define BUFFER_LENGTH 1024
-#define SAMPLE_RATE 16000
-int16_t sBuffer[BUFFER_LENGTH];
-int16_t testBuffer[BUFFER_LENGTH];
-
-// WebSocket server details - Using SSL on port 443
+// Local monitor output to an I2S DAC/amp, e.g. MAX98357A - see local_monitor.h
+#define MONITOR_BCK 13
+#define MONITOR_WS 14
+#define MONITOR_DATA 15
+#define MONITOR_PORT I2S_NUM_1
+
+// Default capture format - the build profile (AUDIO_SAMPLE_RATE, AUDIO_BUFFER_SIZE,
+// AUDIO_I2S_BUFFERS, see audio_pipeline.h), reconfigurable at runtime, see audio_capture.h
+#define AUDIO_CAPTURE_RATE AudioProfile::sampleRate
+#define I2S_DMA_BUF_COUNT AUDIO_I2S_BUFFERS      // Number of DMA descriptors
+#define I2S_DMA_BUF_LEN AudioProfile::blockSamples // Frames per descriptor (32 ms at 16 kHz)
+static_assert(I2S_DMA_BUF_LEN >= AUDIO_CAPTURE_MIN_BLOCK && I2S_DMA_BUF_LEN <= AUDIO_CAPTURE_MAX_BLOCK,
+              "AUDIO_BUFFER_SIZE outside the capture engine's descriptor range");
+#define AUDIO_CAPTURE_CHANNELS                                               \
+    (AUDIO_CHANNELS == 1 ? AUDIO_CHANNELS_MONO : AUDIO_BEAMFORM ? AUDIO_CHANNELS_BEAM \
+                                                                : AUDIO_CHANNELS_STEREO)
+static_assert(AUDIO_CHANNELS == 1 || I2S_DMA_BUF_LEN <= AUDIO_CAPTURE_MAX_STEREO_BLOCK,
+              "Two-mic capture takes at most AUDIO_CAPTURE_MAX_STEREO_BLOCK frames per descriptor");
+static_assert(I2S_DMA_BUF_COUNT >= 2 && I2S_DMA_BUF_COUNT <= AUDIO_CAPTURE_MAX_DMA_BUFS,
+              "AUDIO_I2S_BUFFERS outside the capture engine's descriptor count range");
+AudioCapture audioCapture(I2S_PORT, I2S_SCK, I2S_WS, I2S_SD);
+volatile uint32_t blockDurationMs = AudioProfile::blockDurationMs; // Follows the capture format
+
+// WebSocket server details - TLS on port 443 unless the build selects plain ws://
+// (-DWS_USE_TLS=0) for LAN deployments behind an encrypted tunnel
+#ifndef WS_USE_TLS
+#define WS_USE_TLS 1
+#endif
+#ifndef WS_PLAIN_PORT
+#define WS_PLAIN_PORT 80
+#endif
+#ifndef RELAY_FALLBACK_HOSTS
+#define RELAY_FALLBACK_HOSTS "" // "host[:port],..." - IPs or mDNS names, see relay_endpoint.h
+#endif
 const char *wsHost = "patr.ppcandles.in";
-const int wsPort = 443;
+const int wsPort = WS_USE_TLS ? 443 : WS_PLAIN_PORT;
 const char *wsPath = "/";
 
 // WiFi credentials
@@ -74,55 +126,123 @@ const char *password = "ashish20032300";
 WebSocketsClient webSocket;
 bool isWebSocketConnected = false;
 bool isMicrophoneEnabled = false;
-bool isMicrophoneConnected = false;
-const int LED_PIN = 2;
 unsigned long lastReconnectAttempt = 0;
+unsigned long lastConnectedTime = 0;
 const unsigned long RECONNECT_INTERVAL = 5000;
+const unsigned long RECONNECT_JITTER = 5000; // Random extra per device, spreads a fleet's reconnects
+const unsigned long RECONNECT_STALL = 60000; // Restart the client only if it got nowhere this long
+bool reconnectIntervalPending = false;       // Set after begin(), see beginWebSocket()
+bool webSocketPending = false;               // Endpoint probe running, the client starts after it
 
-// Standard audio packet format - consistent across all components
-#define PACKET_HEADER_MAGIC 0xA5 // Magic byte to identify our packets
-#define PACKET_TYPE_AUDIO 0x01   // Audio packet type
-#define PACKET_HEADER_SIZE 8     // 8-byte header for more robustness
+// Codec selection - requested from the command channel, applied by the capture task
+enum AudioCodec : uint8_t
+{
+    AUDIO_CODEC_PCM,
+    AUDIO_CODEC_ADPCM,
+    AUDIO_CODEC_OPUS
+};
+
+#ifndef AUDIO_USE_ADPCM
+#define AUDIO_USE_ADPCM 0 // Raw PCM unless the build selects ADPCM
+#endif
+volatile AudioCodec requestedCodec = AUDIO_USE_ADPCM ? AUDIO_CODEC_ADPCM : AUDIO_CODEC_PCM;
+bool isOpusAvailable = false;
+
+// Task cores, priorities and stacks are in task_topology.h
+
+// Capture -> network packet ring
+// Slot layout is in audio_packet.h; the WebSocket frame header goes in front of the packet.
+// The capture task only enqueues; loop() drains the ring and owns all socket I/O.
+#define PACKET_RING_SLOTS 128 // ~4 s of audio at 32 ms per packet, rides out short outages (power of two)
+#define SLOT_FRAME_OFFSET (SLOT_PACKET_OFFSET - WEBSOCKETS_MAX_HEADER_SIZE)
+#define PACKET_SLOT_SIZE (SLOT_PAYLOAD_OFFSET + AUDIO_CAPTURE_MAX_BLOCK * 2) // Largest block the capture engine delivers
+#define PREROLL_RING_SLOTS (AUDIO_USE_WAKEWORD ? 64 : 4) // Power of two, more than VAD_PREROLL_BLOCKS
+                                                         // and the wake-word pre-roll
+#define MAX_SENDS_PER_LOOP 8 // Bound the burst so webSocket.loop() stays responsive
+#define BACKLOG_SPILL_DEPTH (PACKET_RING_SLOTS / 2) // Outage audio past this goes to the backlog store
+PacketRing packetRing;
+TaskHandle_t networkTaskHandle = NULL;
+uint32_t sendFailures = 0;
+
+// Coalescing - up to K queued packets per WebSocket frame (PACKET_TYPE_BATCH).
+// K follows the measured RTT and grows while the ring backs up; a packet is never
+// held back longer than K block durations. 1 sends every packet on its own.
+#ifndef AUDIO_BATCH_MAX_BLOCKS
+#define AUDIO_BATCH_MAX_BLOCKS 4
+#endif
+#define BATCH_LIMIT 8                // Largest K, sizes the batch buffer
+#define BATCH_RTT_PER_BLOCK_MS 40    // One more block per this much round-trip time
+#define RTT_PROBE_INTERVAL 2000      // Timestamped WebSocket ping period (ms)
+#define BATCH_BUFFER_SIZE (WEBSOCKETS_MAX_HEADER_SIZE + PACKET_HEADER_SIZE + BATCH_LIMIT * (BATCH_ENTRY_HEADER_SIZE + PACKET_SLOT_SIZE))
+volatile int batchMaxBlocks = AUDIO_BATCH_MAX_BLOCKS; // Set with the "batch" command
+int batchBlocks = 1;                                  // Current K
+float linkRttMs = 0;                                  // Smoothed ping round trip, 0 until measured
+uint8_t *batchBuffer = NULL;
+unsigned long batchPendingSince = 0;
+uint32_t batchesSent = 0;
+volatile uint16_t packetSequence = 0; // Shared by the capture task and the Opus stage
+
+// Store-and-forward - see backlog_store.h. The upload budget is set with the
+// "backlog" command.
+bool isBacklogReady = false;
+volatile uint32_t backlogRate = BACKLOG_DEFAULT_RATE; // Bytes/s
+float backlogTokens = 0;
+unsigned long backlogRefillTime = 0;
+
+// Audio transport - the WebSocket stays the control plane either way. UDP trades
+// retransmission for latency: a lost datagram is a gap the browser conceals instead
+// of a TCP stall that holds back all the audio behind it.
+enum AudioTransport : uint8_t
+{
+    AUDIO_TRANSPORT_WEBSOCKET,
+    AUDIO_TRANSPORT_UDP
+};
+
+#ifndef AUDIO_USE_UDP
+#define AUDIO_USE_UDP 0
+#endif
+#ifndef AUDIO_UDP_PORT
+#define AUDIO_UDP_PORT 3013 // UDP_PORT of server/server.js
+#endif
+#define UDP_MAX_DATAGRAM 1460 // WiFiUDP transmit buffer - larger packets use the WebSocket
+AudioTransport audioTransport = AUDIO_USE_UDP ? AUDIO_TRANSPORT_UDP : AUDIO_TRANSPORT_WEBSOCKET;
+WiFiUDP audioUdp;
+IPAddress udpServerAddress;
+uint16_t udpServerPort = AUDIO_UDP_PORT;
+bool udpServerResolved = false; // Relay endpoint address known for the UDP path
+uint32_t udpDatagrams = 0;
+
+// Power-aware capture for battery use - see power_manager.h. Switchable at runtime
+// with the "power" command.
+#ifndef POWER_SAVE
+#define POWER_SAVE 0
+#endif
+
+// Server commands are small flat objects, parsed without touching the heap
+#define COMMAND_JSON_CAPACITY 256
+int64_t commandReceivedUs = 0; // esp_timer time of the command being handled, for clock_sync
+
+// Text replies and reports are framed in place: the library writes the
+// WebSocket header into the room in front instead of copying the message
+#define TEXT_FRAME_CAPACITY 384
+static uint8_t textFrame[WEBSOCKETS_MAX_HEADER_SIZE + TEXT_FRAME_CAPACITY];
 
 // Function prototypes
 void webSocketEvent(WStype_t type, uint8_t *payload, size_t length);
-void setupMicrophone();
+void beginWebSocket();
+void startWebSocketClient();
 void microphoneTask(void *parameter);
-bool checkMicrophoneConnection();
-
-// Convert sample to 16-bit with optimizations for voice clarity
-void processAudioSample(int32_t sample32, int16_t *sample16)
-{
-    // Get the high 16 bits from the 32-bit sample (shift right by 16)
-    int32_t processed = sample32 >> 16;
-
-    // Apply EQ curve for voice - boost mid frequencies (1-3kHz)
-    // This is a simple high-pass filter to remove rumble
-    // Boost mid frequencies slightly
-    processed = processed * 5; // Increase overall gain
-
-    // Clip to 16-bit range to prevent overflow
-    if (processed > 32767)
-        processed = 32767;
-    if (processed < -32768)
-        processed = -32768;
-
-    // Store as 16-bit
-    *sample16 = (int16_t)processed;
-}
-
-// Calculate checksum for consistent operation
-uint16_t calculateAudioChecksum(int16_t *samples, int numSamples)
-{
-    uint32_t sum = 0;
-    for (int i = 0; i < numSamples; i++)
-    {
-        // Simple absolute value sum for checksum
-        sum += abs(samples[i]);
-    }
-    // Reduce to 16-bit value with modulo to ensure consistency
-    return (uint16_t)(sum % 65536);
-}
+void drainPacketRing();
+void sendBatch(int count);
+void sendUdpPackets();
+void spillToBacklog();
+void sendBacklog();
+void sendVideoFrame();
+void updateBatchBlocks();
+void handleCommand(const JsonDocument &doc);
+bool selectCodec(const char *codec, uint32_t sampleRate);
+bool setBatchMaxBlocks(int maxBlocks);
+bool sendText(const char *text);
 
 void setup()
 {
@@ -132,41 +252,128 @@ void setup()
     Serial.println("\n\nESP32-S3 Audio WebSocket Client");
     Serial.println("--------------------------------");
 
-    // Set LED pin mode
-    pinMode(LED_PIN, OUTPUT);
-    analogWrite(LED_PIN, 255); // Turn off LED initially
-
-    // Connect to Wi-Fi
-    Serial.printf("Connecting to WiFi network: %s\n", ssid);
-    WiFi.begin(ssid, password);
+    // TLS allocations from a fixed arena, before anything connects - see net_arena.h
+    if (netArenaBegin())
+        Serial.printf("Network arena: %u KB\n", (unsigned)(netArenaGetStats().capacity / 1024));
+    else if (AUDIO_NET_ARENA)
+        Serial.println("Network arena unavailable - TLS allocates from the heap");
+
+    // Status LED - rendered by its own task from the states published below
+    if (!statusLedBegin(STATUS_LED_CORE, STATUS_LED_PRIORITY))
+        Serial.println("Failed to start status LED task");
+
+    // Connect to Wi-Fi - returns at once, loop() finishes the bring-up
+    wifiLinkBegin(ssid, password);
+
+    // Set up WebSocket client - it connects once the link is up and an
+    // endpoint has been picked
+    RelayEndpointConfig relayConfig = {
+        .host = wsHost,
+        .port = (uint16_t)wsPort,
+        .fallbacks = RELAY_FALLBACK_HOSTS,
+        .tls = WS_USE_TLS};
+    relayEndpointBegin(relayConfig);
+    beginWebSocket();
+    webSocket.onEvent(webSocketEvent);
+    webSocket.enableHeartbeat(15000, 3000, 2);
 
-    // Wait for connection
-    while (WiFi.status() != WL_CONNECTED)
+    // Preallocate packet slots before capture starts producing into them
+    if (!packetRing.begin(PACKET_RING_SLOTS, PACKET_SLOT_SIZE))
     {
-        delay(500);
-        Serial.print(".");
+        Serial.println("Failed to allocate packet ring");
     }
+    batchBuffer = (uint8_t *)heap_caps_malloc(BATCH_BUFFER_SIZE, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    if (!batchBuffer)
+        batchBuffer = (uint8_t *)heap_caps_malloc(BATCH_BUFFER_SIZE, MALLOC_CAP_8BIT);
+    if (!batchBuffer)
+    {
+        Serial.println("Failed to allocate batch buffer - sending packets individually");
+        batchMaxBlocks = 1;
+    }
+    networkTaskHandle = xTaskGetCurrentTaskHandle(); // setup() and loop() share the loop task
+    taskTopologyBegin();
+    isBacklogReady = backlogBegin(BACKLOG_MEMORY_BYTES);
+    Serial.printf("Backlog store: %s, flash %u KB\n", isBacklogReady ? "ready" : "not available",
+                  (unsigned)(backlogGetStats().flashCapacity / 1024));
+    powerManagerBegin(POWER_SAVE ? POWER_MODE_SAVE : POWER_MODE_PERFORMANCE);
+    agcSetEnabled(AUDIO_USE_AGC);
+
+    // Opus encoder stage - optional, selected at runtime with the "codec" command
+    OpusStageConfig opusConfig = {
+        .packets = &packetRing,
+        .networkTask = networkTaskHandle,
+        .sequence = &packetSequence,
+        .sampleRate = AUDIO_CAPTURE_RATE,
+        .blockSamples = AUDIO_CAPTURE_MAX_BLOCK,
+        .maxPayload = AUDIO_CAPTURE_MAX_BLOCK * 2,
+        .core = OPUS_TASK_CORE,
+        .priority = OPUS_TASK_PRIORITY,
+        .stackSize = OPUS_TASK_STACK};
+    isOpusAvailable = opusStageBegin(opusConfig);
+    Serial.printf("Opus encoder: %s\n", isOpusAvailable ? "available" : "not built in");
+
+    // Wake-word gate - on from boot when it is built in and a model loads
+    WakeWordConfig wakeConfig = {
+        .blockSamples = AUDIO_CAPTURE_MAX_BLOCK,
+        .core = WAKE_WORD_CORE,
+        .priority = WAKE_WORD_PRIORITY,
+        .stackSize = WAKE_WORD_STACK};
+    if (wakeWordBegin(wakeConfig))
+    {
+        wakeWordSetEnabled(true);
+        Serial.printf("Wake word gate: %s\n", wakeWordModel());
+    }
+    else
+        Serial.println("Wake word gate: not available");
+
+    // Local monitor - installed when built in, switched on with the "monitor" command
+    LocalMonitorConfig monitorConfig = {
+        .port = MONITOR_PORT,
+        .bckPin = MONITOR_BCK,
+        .wsPin = MONITOR_WS,
+        .dataPin = MONITOR_DATA,
+        .blockSamples = AUDIO_CAPTURE_MAX_BLOCK,
+        .core = MONITOR_TASK_CORE,
+        .priority = MONITOR_TASK_PRIORITY,
+        .stackSize = MONITOR_TASK_STACK};
+    Serial.printf("Local monitor: %s\n", localMonitorBegin(monitorConfig) ? "available" : "not built in");
+
+    // Camera - streams from boot when it is built in and the sensor answers
+    VideoCaptureConfig videoConfig = {
+        .networkTask = networkTaskHandle,
+        .fps = VIDEO_DEFAULT_FPS,
+        .quality = VIDEO_DEFAULT_QUALITY,
+        .core = VIDEO_TASK_CORE,
+        .priority = VIDEO_TASK_PRIORITY,
+        .stackSize = VIDEO_TASK_STACK};
+    if (videoCaptureBegin(videoConfig))
+    {
+        videoCaptureSetEnabled(true);
+        Serial.printf("Camera: %d fps, quality %d\n", videoCaptureFps(), videoCaptureQuality());
+
+        // Person gate - only frames with someone in them go out
+        PersonDetectConfig personConfig = {
+            .core = PERSON_TASK_CORE,
+            .priority = PERSON_TASK_PRIORITY,
+            .stackSize = PERSON_TASK_STACK};
+        if (personDetectBegin(personConfig))
+        {
+            personDetectSetEnabled(true);
+            Serial.printf("Person gate: threshold %d%%\n", personDetectThreshold());
+        }
+    }
+    else
+        Serial.println("Camera: not available");
 
-    Serial.println();
-    Serial.print("WiFi connected, IP address: ");
-    Serial.println(WiFi.localIP());
-
-    // Set up WebSocket client
-    Serial.printf("Connecting to WebSocket server: %s:%d%s\n", wsHost, wsPort, wsPath);
-    webSocket.beginSSL(wsHost, wsPort, wsPath);
-    webSocket.onEvent(webSocketEvent);
-    webSocket.setReconnectInterval(5000);
-    webSocket.enableHeartbeat(15000, 3000, 2);
-
-    // Start microphone task on core 0
+    // Start microphone task
     xTaskCreatePinnedToCore(
-        microphoneTask,   // Task function
-        "MicrophoneTask", // Task name
-        10000,            // Stack size (bytes)
-        NULL,             // Task parameters
-        1,                // Task priority
-        NULL,             // Task handle
-        0                 // Core ID (0)
+        microphoneTask,                        // Task function
+        taskTopology[TASK_MICROPHONE].name,    // Task name
+        MIC_TASK_STACK,                        // Stack size (bytes)
+        NULL,                                  // Task parameters
+        MIC_TASK_PRIORITY,                     // Task priority
+        NULL,                                  // Task handle
+        MIC_TASK_CORE                          // Core ID
     );
 
     Serial.println("Setup complete");
@@ -174,357 +381,822 @@ void setup()
 
 void loop()
 {
-    if (WiFi.status() != WL_CONNECTED)
+    wifiLinkLoop();
+    powerManagerLoop(wifiLinkUp());
+    static bool linkWasUp = false;
+    if (!wifiLinkUp())
     {
-        Serial.println("WiFi disconnected, reconnecting...");
-        WiFi.reconnect();
-        delay(1000);
+        // The socket died with the link - close it now rather than waiting for the
+        // heartbeat to notice, so the client reconnects as soon as the link is back.
+        // Capture keeps queueing into the ring; the newest packets go out as a burst
+        // and older ones are spilled to the backlog store (backlog_store.h).
+        if (linkWasUp)
+            webSocket.disconnect();
+        linkWasUp = false;
+        isWebSocketConnected = false;
+        statusLedSetLink(false);
+        lastConnectedTime = millis(); // Outage time does not count as a stalled reconnect
+        spillToBacklog();
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(20));
         return;
     }
 
-    webSocket.loop();
+    // Link is back: pick the endpoint again and connect now, rather than after
+    // the library's reconnect interval
+    if (!linkWasUp)
+        beginWebSocket();
+    linkWasUp = true;
+
+    if (webSocketPending && relayEndpointLoop())
+        startWebSocketClient();
+    if (!webSocketPending)
+        webSocket.loop();
+    if (reconnectIntervalPending)
+    {
+        // Every device waits a different time, so after an AP restart the fleet does
+        // not hit the server (and its TLS handshakes) all at once
+        webSocket.setReconnectInterval(RECONNECT_INTERVAL + esp_random() % RECONNECT_JITTER);
+        reconnectIntervalPending = false;
+    }
+    drainPacketRing();
+    sendBacklog();
+    sendVideoFrame();
+
+#if AUDIO_TELEMETRY
+    // Binary stats report on the control connection, see telemetry.h
+    static unsigned long lastTelemetryTime = 0;
+    if (isWebSocketConnected && millis() - lastTelemetryTime > TELEMETRY_INTERVAL_MS)
+    {
+        lastTelemetryTime = millis();
+        static uint8_t report[WEBSOCKETS_MAX_HEADER_SIZE + PACKET_HEADER_SIZE + TELEMETRY_PAYLOAD_SIZE];
+        TelemetryCounters counters = {
+            .dmaOverruns = audioCapture.overruns,
+            .ringDrops = packetRing.overruns,
+            .sendFailures = sendFailures,
+            .readErrors = audioCapture.readErrors,
+            .gainQ8 = agcGainQ8()};
+        webSocket.sendBIN(report, telemetryBuildPacket(report + WEBSOCKETS_MAX_HEADER_SIZE, counters), true);
+    }
+#endif
+
+    // Timestamped ping - the pong echoes the payload, see webSocketEvent()
+    static unsigned long lastRttProbe = 0;
+    if (isWebSocketConnected && millis() - lastRttProbe > RTT_PROBE_INTERVAL)
+    {
+        lastRttProbe = millis();
+        uint8_t stamp[4] = {(uint8_t)(lastRttProbe >> 24), (uint8_t)(lastRttProbe >> 16),
+                            (uint8_t)(lastRttProbe >> 8), (uint8_t)lastRttProbe};
+        webSocket.sendPing(stamp, sizeof(stamp));
+    }
 
     static unsigned long lastStatusTime = 0;
     if (millis() - lastStatusTime > 10000)
     { // Reduced frequency of status messages
         lastStatusTime = millis();
-        Serial.printf("WS:%s | Mic:%s | RSSI:%d\n",
+        PowerStats power = powerManagerGetStats();
+        BacklogStats backlog = backlogGetStats();
+        Serial.printf("WS:%s | Audio:%s | Mic:%s | RSSI:%d | WiFi drops:%u | Ring:%u/%u | Dropped:%u | DMA overruns:%u | Send fails:%u | Batch:%d (%u sent) | UDP:%u | Backlog:%uKB | RTT:%.0fms | Power:%s ~%.0fmA\n",
                       isWebSocketConnected ? "ON" : "OFF",
+                      audioTransport == AUDIO_TRANSPORT_UDP ? "UDP" : "WS",
                       isMicrophoneEnabled ? "ON" : "OFF",
-                      WiFi.RSSI());
+                      WiFi.RSSI(), wifiLinkGetStats().drops,
+                      packetRing.depth(), packetRing.size(),
+                      packetRing.overruns, audioCapture.overruns, sendFailures,
+                      batchBlocks, batchesSent, udpDatagrams,
+                      (unsigned)((backlog.memoryBytes + backlog.flashBytes) / 1024), linkRttMs,
+                      powerModeName(power.mode), power.estimatedMa);
+        NetArenaStats arena = netArenaGetStats();
+        Serial.printf("Heap: %uKB free | %uKB min | %uKB largest | Arena:%s %u/%uKB (peak %uKB) | Fallbacks:%u\n",
+                      (unsigned)(heap_caps_get_free_size(MALLOC_CAP_INTERNAL) / 1024),
+                      (unsigned)(heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL) / 1024),
+                      (unsigned)(heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL) / 1024),
+                      arena.active ? "ON" : "OFF", arena.inUse / 1024, arena.capacity / 1024,
+                      arena.highWater / 1024, arena.fallbacks);
+        if (videoCaptureEnabled())
+        {
+            VideoCaptureStats video = videoCaptureGetStats();
+            Serial.printf("Video: %ux%u | %u frames | %u dropped | %u oversize | Last:%uKB\n", video.width,
+                          video.height, video.frames, video.drops, video.oversize, video.lastBytes / 1024);
+            if (personDetectEnabled())
+            {
+                PersonDetectStats person = personDetectGetStats();
+                Serial.printf("Person: %u runs | %u positive | %u gated | Score:%u%% | Decode:%.1fms Infer:%.1fms\n",
+                              person.runs, person.positives, video.gated, person.lastScore * 100 / 255,
+                              person.decodeUs / 1000.0f, person.inferUs / 1000.0f);
+            }
+        }
+        if (localMonitorEnabled())
+        {
+            LocalMonitorStats monitor = localMonitorTakeStats();
+            Serial.printf("Monitor: %u played | %u dropped | %u underruns | Latency:%.1fms (max %.1fms)\n",
+                          monitor.blocks, monitor.drops, monitor.underruns,
+                          monitor.latencyUs / 1000.0f, monitor.latencyMaxUs / 1000.0f);
+        }
+
+        // Estimated draw for the mode in use, see power_manager.h, plus the link's
+        // RSSI for the relay's per-device status
+        if (isWebSocketConnected)
+        {
+            char report[192];
+            snprintf(report, sizeof(report),
+                     "{\"type\":\"power\",\"mode\":\"%s\",\"lightSleep\":%s,\"cpuActivePct\":%.1f,\"modemSleepPct\":%.1f,\"estimatedMa\":%.1f,\"windowMs\":%u,\"rssi\":%d}",
+                     powerModeName(power.mode), power.lightSleep ? "true" : "false", power.cpuActivePct,
+                     power.modemSleepPct, power.estimatedMa, power.windowMs, WiFi.RSSI());
+            sendText(report);
+        }
 
-        if (!isWebSocketConnected && millis() - lastReconnectAttempt > RECONNECT_INTERVAL)
+        // The library reconnects on its own. Tearing the client down while it is
+        // mid-handshake only starts another full TLS handshake, so restart it only
+        // when it has made no progress for a long time.
+        if (isWebSocketConnected)
+        {
+            lastConnectedTime = millis();
+        }
+        else if (millis() - lastConnectedTime > RECONNECT_STALL && millis() - lastReconnectAttempt > RECONNECT_STALL)
         {
             lastReconnectAttempt = millis();
-            Serial.println("Reconnecting WebSocket...");
+            Serial.println("WebSocket reconnect stalled, restarting client...");
             webSocket.disconnect();
-            delay(100);
-            webSocket.beginSSL(wsHost, wsPort, wsPath);
+            beginWebSocket();
         }
     }
+
+    // Sleep until the capture task queues a packet (or a few ms pass for webSocket.loop())
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(5));
 }
 
-// Function to check if microphone is properly connected and working
-bool checkMicrophoneConnection()
+// Start (or restart) the WebSocket client: probe the relay endpoints first,
+// loop() starts the client with the winner, see relay_endpoint.h
+void beginWebSocket()
 {
-    size_t bytesRead = 0;
-    bool hasMic = false;
-    int retries = 3;
+    relayEndpointProbe();
+    webSocketPending = true;
+}
 
-    Serial.println("Checking microphone connection...");
+// Second half of beginWebSocket(), on the configured transport
+void startWebSocketClient()
+{
+    const RelayChoice &relay = relayEndpointChoice();
+    webSocketPending = false;
+    udpServerAddress = relay.address;
+    udpServerResolved = relay.index >= 0; // Otherwise looked up on the first UDP send
+
+    Serial.printf("Connecting to WebSocket server: %s://%s:%d%s\n", WS_USE_TLS ? "wss" : "ws", relay.connectHost,
+                  relay.port, wsPath);
+#if WS_USE_TLS
+    webSocket.beginSSL(relay.connectHost, relay.port, wsPath);
+#else
+    webSocket.begin(relay.connectHost, relay.port, wsPath);
+#endif
+
+    // The library waits a full reconnect interval after begin() before its first
+    // attempt. Connect on the first loop() instead; loop() sets the real interval.
+    webSocket.setReconnectInterval(0);
+    reconnectIntervalPending = true;
+}
 
-    // Try multiple times to account for initialization
-    for (int attempt = 0; attempt < retries; attempt++)
+// Send everything the capture task queued - the only place audio touches the socket
+void drainPacketRing()
+{
+    size_t length;
+    uint8_t *slot;
+    int sent = 0;
+
+    // Hold the newest packets through an outage, older ones go to the backlog store
+    if (!isWebSocketConnected)
     {
-        // Read some data from the microphone
-        esp_err_t result = i2s_read(I2S_PORT, testBuffer, sizeof(testBuffer), &bytesRead, 100);
+        spillToBacklog();
+        return;
+    }
 
-        if (result == ESP_OK && bytesRead > 0)
+    // UDP sends every packet on its own - a batch would only lose more at once
+    if (audioTransport == AUDIO_TRANSPORT_UDP && isWebSocketConnected)
+    {
+        if (!udpServerResolved)
         {
-            // Check if we have any non-zero values (indicating a working mic)
-            int nonZeroCount = 0;
-            int16_t maxValue = 0;
+            udpServerResolved = WiFi.hostByName(relayEndpointChoice().host, udpServerAddress) == 1;
+            if (!udpServerResolved)
+                return; // Packets wait in the ring; retried on the next pass
+            Serial.printf("UDP audio to %s:%u\n", udpServerAddress.toString().c_str(), udpServerPort);
+        }
+        sendUdpPackets();
+        return;
+    }
 
-            for (int i = 0; i < bytesRead / 2; i++)
-            {
-                if (testBuffer[i] != 0)
-                {
-                    nonZeroCount++;
-                    int16_t absVal = abs(testBuffer[i]);
-                    if (absVal > maxValue)
-                        maxValue = absVal;
-                }
-            }
+    if (batchMaxBlocks > 1 && isWebSocketConnected)
+    {
+        updateBatchBlocks();
+        size_t depth = packetRing.depth();
+        if (depth == 0)
+        {
+            batchPendingSince = 0;
+            return;
+        }
+        if (batchPendingSince == 0)
+            batchPendingSince = millis();
 
-            if (nonZeroCount > 10)
-            { // Require at least 10 non-zero samples
-                Serial.printf("Microphone OK: %d non-zero samples\n", nonZeroCount);
-                hasMic = true;
-                break;
-            }
-            else
-            {
-                Serial.printf("Attempt %d: Not enough samples (%d)\n", attempt + 1, nonZeroCount);
-            }
+        // Wait for a full batch, but never hold a packet past the coalescing window
+        bool windowExpired = millis() - batchPendingSince >= (unsigned long)batchBlocks * blockDurationMs;
+        while (sent < MAX_SENDS_PER_LOOP && (depth >= (size_t)batchBlocks || (windowExpired && depth > 0)))
+        {
+            uint32_t sendStart = telemetryStart();
+            sendBatch(min(depth, (size_t)batchBlocks));
+            telemetryRecord(TELEMETRY_SEND, sendStart);
+            depth = packetRing.depth();
+            sent++;
         }
-        else
+        batchPendingSince = depth ? millis() : 0;
+        return;
+    }
+
+    while (sent < MAX_SENDS_PER_LOOP && (slot = packetRing.peek(&length)) != NULL)
+    {
+        if (isWebSocketConnected)
         {
-            Serial.printf("Attempt %d: Failed to read from mic\n", attempt + 1);
+            // The slot reserves room in front of the packet, so the library writes
+            // the frame header (and masks) in place instead of copying the payload
+            uint32_t sendStart = telemetryStart();
+            if (!webSocket.sendBIN(slot + SLOT_FRAME_OFFSET, length, true))
+                sendFailures++;
+            telemetryRecord(TELEMETRY_SEND, sendStart);
+            clockSyncRecordSend(slot + SLOT_PACKET_OFFSET);
         }
+        packetRing.release();
+        sent++;
+    }
+}
 
-        delay(100); // Wait a bit before retrying
+// The newest camera frame, on the WebSocket whatever the audio transport. Audio
+// goes first: with audio queued the frame waits, and a newer one may replace it.
+// Frames are live only - nothing is kept through an outage.
+void sendVideoFrame()
+{
+    size_t length;
+    uint8_t *slot = videoCapturePeek(&length);
+    if (!slot)
+        return;
+    if (isWebSocketConnected)
+    {
+        if (packetRing.depth() > (size_t)batchBlocks)
+            return;
+        if (!webSocket.sendBIN(slot + SLOT_FRAME_OFFSET, length, true))
+            sendFailures++;
     }
+    videoCaptureRelease();
+}
 
-    return hasMic;
+// Move the oldest queued packets into the backlog store, keeping the newest in
+// the ring so a short outage still ends in a live burst
+void spillToBacklog()
+{
+    size_t length;
+    uint8_t *slot;
+    backlogRefillTime = millis(); // No upload budget builds up while offline
+    if (!isBacklogReady)
+        return; // The ring drops new blocks once it is full
+    while (packetRing.depth() > BACKLOG_SPILL_DEPTH && (slot = packetRing.peek(&length)) != NULL)
+    {
+        backlogPush(slot + SLOT_PACKET_OFFSET, length);
+        packetRing.release();
+    }
 }
 
-// Function to initialize I2S for INMP441 microphone
-void setupMicrophone()
+// Stored outage audio as PACKET_TYPE_BACKLOG frames - only while the live ring
+// is drained and within the upload budget, so live latency does not suffer
+void sendBacklog()
 {
-    Serial.println("Initializing INMP441 MEMS microphone...");
-
-    // Configure I2S
-    const i2s_config_t i2s_config = {
-        .mode = i2s_mode_t(I2S_MODE_MASTER | I2S_MODE_RX),
-        .sample_rate = SAMPLE_RATE,
-        .bits_per_sample = i2s_bits_per_sample_t(16),
-        .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
-        .communication_format = i2s_comm_format_t(I2S_COMM_FORMAT_STAND_I2S),
-        .intr_alloc_flags = 0,
-        .dma_buf_count = BUFFER_COUNT,
-        .dma_buf_len = BUFFER_LENGTH,
-        .use_apll = false,
-        .tx_desc_auto_clear = false,
-        .fixed_mclk = 0};
-
-    // Install I2S driver
-    esp_err_t result = i2s_driver_install(I2S_PORT, &i2s_config, 0, NULL);
-    if (result != ESP_OK)
-    {
-        Serial.printf("Failed to install I2S driver: %d\n", result);
+    unsigned long now = millis();
+    backlogTokens = min(backlogTokens + (now - backlogRefillTime) * (float)backlogRate / 1000, (float)backlogRate / 4);
+    backlogRefillTime = now;
+    if (!isBacklogReady || !batchBuffer || !isWebSocketConnected || backlogTokens <= 0 ||
+        packetRing.depth() > (size_t)batchBlocks || backlogEmpty())
         return;
+
+    uint8_t *frame = batchBuffer + WEBSOCKETS_MAX_HEADER_SIZE;
+    const size_t capacity = BATCH_BUFFER_SIZE - WEBSOCKETS_MAX_HEADER_SIZE;
+    size_t pos = PACKET_HEADER_SIZE;
+    size_t length;
+    int packets = 0;
+    while (packets < BATCH_LIMIT &&
+           (length = backlogRead(frame + pos + BATCH_ENTRY_HEADER_SIZE, capacity - pos - BATCH_ENTRY_HEADER_SIZE)) > 0)
+    {
+        frame[pos] = (length >> 8) & 0xFF;
+        frame[pos + 1] = length & 0xFF;
+        pos += BATCH_ENTRY_HEADER_SIZE + length;
+        packets++;
     }
+    if (packets == 0)
+        return;
 
-    // Configure I2S pins
-    const i2s_pin_config_t pin_config = {
-        .bck_io_num = I2S_SCK,
-        .ws_io_num = I2S_WS,
-        .data_out_num = -1,
-        .data_in_num = I2S_SD};
+    const uint8_t *first = frame + PACKET_HEADER_SIZE + BATCH_ENTRY_HEADER_SIZE;
+    writePacketHeader(frame, PACKET_TYPE_BACKLOG, (first[2] << 8) | first[3], packets, 0, packetTimestamp(first));
+    frame[10] = 0;        // No frame CRC - every entry carries its own
+    frame[11] = first[11]; // First packet's rate
+    uint32_t sendStart = telemetryStart();
+    if (webSocket.sendBIN(batchBuffer, pos, true))
+    {
+        backlogAck();
+        backlogTokens -= pos;
+    }
+    else
+    {
+        backlogRewind(); // Kept for the next attempt
+        sendFailures++;
+    }
+    telemetryRecord(TELEMETRY_SEND, sendStart);
+}
 
-    // Set I2S pins
-    result = i2s_set_pin(I2S_PORT, &pin_config);
-    if (result != ESP_OK)
+// One datagram per packet, same format as the WebSocket path
+void sendUdpPackets()
+{
+    size_t length;
+    uint8_t *slot;
+    int sent = 0;
+    while (sent < MAX_SENDS_PER_LOOP && (slot = packetRing.peek(&length)) != NULL)
     {
-        Serial.printf("Failed to set I2S pins: %d\n", result);
+        uint8_t *packet = slot + SLOT_PACKET_OFFSET;
+        uint32_t sendStart = telemetryStart();
+        if (length > UDP_MAX_DATAGRAM)
+        {
+            // Too big for one datagram (long blocks) - fall back to the WebSocket
+            if (!webSocket.sendBIN(slot + SLOT_FRAME_OFFSET, length, true))
+                sendFailures++;
+        }
+        else if (audioUdp.beginPacket(udpServerAddress, udpServerPort) && audioUdp.write(packet, length) == length &&
+                 audioUdp.endPacket())
+        {
+            udpDatagrams++;
+        }
+        else
+        {
+            sendFailures++; // Not retried - late audio is worthless
+        }
+        telemetryRecord(TELEMETRY_SEND, sendStart);
+        clockSyncRecordSend(packet);
+        packetRing.release();
+        sent++;
+    }
+}
+
+// Pack up to `count` queued packets into one PACKET_TYPE_BATCH frame
+void sendBatch(int count)
+{
+    size_t length;
+    uint8_t *slot;
+
+    // A lone packet goes out as-is, zero-copy
+    if (count == 1)
+    {
+        if ((slot = packetRing.peek(&length)) == NULL)
+            return;
+        if (!webSocket.sendBIN(slot + SLOT_FRAME_OFFSET, length, true))
+            sendFailures++;
+        clockSyncRecordSend(slot + SLOT_PACKET_OFFSET);
+        packetRing.release();
         return;
     }
 
-    // Start I2S
-    result = i2s_start(I2S_PORT);
-    if (result != ESP_OK)
+    uint8_t *frame = batchBuffer + WEBSOCKETS_MAX_HEADER_SIZE;
+    size_t pos = PACKET_HEADER_SIZE;
+    uint16_t firstSequence = 0;
+    uint32_t firstTimestamp = 0;
+    int packets = 0;
+    while (packets < count && (slot = packetRing.peek(&length)) != NULL)
     {
-        Serial.printf("Failed to start I2S: %d\n", result);
+        const uint8_t *packet = slot + SLOT_PACKET_OFFSET;
+        if (packets == 0)
+        {
+            firstSequence = (packet[2] << 8) | packet[3];
+            firstTimestamp = packetTimestamp(packet);
+        }
+
+        // Sub-header: packet length, then the packet with its own header
+        frame[pos] = (length >> 8) & 0xFF;
+        frame[pos + 1] = length & 0xFF;
+        memcpy(frame + pos + BATCH_ENTRY_HEADER_SIZE, packet, length);
+        pos += BATCH_ENTRY_HEADER_SIZE + length;
+
+        packetRing.release();
+        packets++;
+    }
+
+    writePacketHeader(frame, PACKET_TYPE_BATCH, firstSequence, packets, 0, firstTimestamp);
+    frame[10] = 0; // No batch CRC - every entry carries its own
+    frame[11] = frame[PACKET_HEADER_SIZE + BATCH_ENTRY_HEADER_SIZE + 11]; // First packet's rate
+    if (!webSocket.sendBIN(batchBuffer, pos, true))
+        sendFailures++;
+    clockSyncRecordSend(frame); // Stamped with the first packet's capture time
+    batchesSent++;
+}
+
+// Pick K from the round-trip time, one step larger while the ring is backing up
+void updateBatchBlocks()
+{
+    int target = 1 + (int)(linkRttMs / BATCH_RTT_PER_BLOCK_MS);
+    if (packetRing.depth() > (size_t)batchBlocks * 2)
+        target = max(target, batchBlocks + 1);
+    batchBlocks = constrain(target, 1, min((int)batchMaxBlocks, BATCH_LIMIT));
+}
+
+// RMS of a converted block - used for silence detection and the LED
+float blockRms(const AudioBlockStats &stats, int numSamples)
+{
+    if (numSamples <= 0)
+        return 0;
+    return sqrt((float)stats.sumSquared / numSamples);
+}
+
+// Publish the VAD gate for the status LED and the modem power save - stores only,
+// the indicator task and loop() act on them
+void publishVadState(bool sending, float rms)
+{
+    statusLedSetAudio(sending ? STATUS_LED_SPEECH : STATUS_LED_SILENT, (uint16_t)min(rms, 32767.0f));
+    powerSetVoiceActive(sending);
+}
+
+// The send gate: the VAD alone, or in wake-word mode the VAD inside a wake
+// window. Its edges come back as VAD events, so the send paths do not care which.
+VadEvent updateSendGate(bool &gateOpen, const VadState &vad, bool wakeGated, uint32_t timestamp)
+{
+    bool open = vad.active;
+    if (wakeGated)
+    {
+        open = open && wakeWordListening(timestamp);
+        if (open)
+            wakeWordHold(timestamp);
+    }
+    VadEvent event = open == gateOpen ? VAD_NONE : open ? VAD_SPEECH_START : VAD_SPEECH_END;
+    gateOpen = open;
+    return event;
+}
+
+// Copy a mono block to the wake-word spotter, converted the same way as for the codecs
+void feedWakeWord(const int32_t *samples32, int numSamples, uint32_t timestamp)
+{
+    int16_t *block = wakeWordAcquireBlock();
+    if (!block)
+        return; // Counted by the spotter
+    AudioBlockStats stats;
+    AudioProfile::convertBlock(samples32, numSamples, block, &stats);
+    wakeWordCommitBlock(numSamples, timestamp);
+}
+
+// Keep a silent block for pre-roll, dropping the oldest beyond `limit`. Entries are
+// [timestamp(4)][data]. Only the capture task touches the pre-roll ring, so it is
+// both producer and consumer.
+void stashPreroll(PacketRing &preroll, const uint8_t *data, size_t length, uint32_t timestamp, size_t limit)
+{
+    size_t oldLength;
+    while (preroll.depth() >= limit && preroll.peek(&oldLength))
+        preroll.release();
+
+    uint8_t *slot = preroll.acquire();
+    if (!slot)
         return;
+    memcpy(slot, &timestamp, sizeof(timestamp));
+    memcpy(slot + sizeof(timestamp), data, length);
+    preroll.commit(sizeof(timestamp) + length);
+}
+
+void clearPreroll(PacketRing &preroll)
+{
+    size_t length;
+    while (preroll.peek(&length))
+        preroll.release();
+}
+
+// Send the stashed PCM/ADPCM packets, renumbered to follow the silence stop
+void flushPrerollPackets(PacketRing &preroll)
+{
+    size_t length;
+    uint8_t *entry;
+    while ((entry = preroll.peek(&length)) != NULL)
+    {
+        // The packet header already holds the timestamp
+        const uint8_t *packet = entry + sizeof(uint32_t);
+        length -= sizeof(uint32_t);
+
+        uint8_t *slot = packetRing.acquire();
+        if (slot)
+        {
+            memcpy(slot + SLOT_PACKET_OFFSET, packet, length);
+            setPacketSequence(slot + SLOT_PACKET_OFFSET, packetSequence);
+            packetRing.commit(length);
+        }
+        packetSequence++;
+        preroll.release();
     }
+}
 
-    Serial.println("I2S microphone initialized successfully");
+// Hand the stashed PCM blocks to the Opus stage
+void flushPrerollOpus(PacketRing &preroll)
+{
+    size_t length;
+    uint8_t *entry;
+    while ((entry = preroll.peek(&length)) != NULL)
+    {
+        uint32_t timestamp;
+        memcpy(&timestamp, entry, sizeof(timestamp));
+        length -= sizeof(timestamp);
+
+        int16_t *slot = opusStageAcquireBlock();
+        if (slot)
+        {
+            memcpy(slot, entry + sizeof(timestamp), length);
+            opusStageCommitBlock(length / sizeof(int16_t), timestamp);
+        }
+        preroll.release();
+    }
 }
 
 // Microphone task - runs on core 0
 void microphoneTask(void *parameter)
 {
     // Initialize microphone
-    esp_err_t err;
-
-    // Configure I2S for INMP441 microphone - fixed format
-    i2s_config_t i2s_config = {
-        .mode = (i2s_mode_t)(I2S_MODE_MASTER | I2S_MODE_RX),
-        .sample_rate = 16000, // 16KHz fixed sample rate
-        .bits_per_sample = I2S_BITS_PER_SAMPLE_32BIT,
-        .channel_format = I2S_CHANNEL_FMT_ONLY_LEFT,
-        .communication_format = I2S_COMM_FORMAT_STAND_I2S,
-        .intr_alloc_flags = ESP_INTR_FLAG_LEVEL1,
-        .dma_buf_count = 8,
-        .dma_buf_len = 512,
-        .use_apll = false,
-        .tx_desc_auto_clear = false,
-        .fixed_mclk = 0};
-
-    // I2S pin configuration - fixed pins
-    i2s_pin_config_t pin_config = {
-        .bck_io_num = I2S_SCK,
-        .ws_io_num = I2S_WS,
-        .data_out_num = I2S_PIN_NO_CHANGE,
-        .data_in_num = I2S_SD};
-
-    // Install and start I2S driver
-    err = i2s_driver_install(I2S_PORT, &i2s_config, 0, NULL);
-    if (err != ESP_OK)
-    {
-        Serial.printf("Error installing I2S driver: %d\n", err);
-        vTaskDelete(NULL);
-        return;
-    }
-
-    // Set I2S pins
-    err = i2s_set_pin(I2S_PORT, &pin_config);
-    if (err != ESP_OK)
+    AudioCaptureConfig captureConfig = {
+        .sampleRate = AUDIO_CAPTURE_RATE,
+        .dmaBufCount = I2S_DMA_BUF_COUNT,
+        .dmaBufLen = I2S_DMA_BUF_LEN,
+        .useApll = false,
+        .placement = AUDIO_BUFFER_AUTO,
+        .channelMode = AUDIO_CAPTURE_CHANNELS};
+    if (!audioCapture.begin(captureConfig))
     {
-        Serial.printf("Error setting I2S pins: %d\n", err);
         vTaskDelete(NULL);
         return;
     }
 
     Serial.println("I2S microphone initialized");
 
-    // Fixed buffer sizes for consistency
-    const int bufferLen = 512;             // Smaller buffer for less latency
-    const int bufferBytes = bufferLen * 4; // 4 bytes per sample for 32-bit
-    const size_t bytesPerSample = 2;       // 2 bytes per sample for 16-bit output
+    const size_t bytesPerSample = 2; // 2 bytes per sample for 16-bit output
 
-    // Buffer for audio samples (32-bit I2S data)
-    int32_t *audioBuffer32 = (int32_t *)malloc(bufferBytes);
-    int16_t *audioBuffer16 = (int16_t *)malloc(bufferLen * bytesPerSample);
+    // Native-endian 16-bit samples for the ADPCM encoder, sized for the largest block
+    static int16_t audioBuffer16[AUDIO_CAPTURE_MAX_BLOCK] __attribute__((aligned(AUDIO_DSP_ALIGN)));
 
-    // WebSocket buffer (header + audio data)
-    // Header: [magic(1), type(1), seqNum(2), samples(2), checksum(2)]
-    const size_t wsBufferSize = PACKET_HEADER_SIZE + (bufferLen * bytesPerSample);
-    uint8_t *wsBuffer = (uint8_t *)malloc(wsBufferSize);
+    // Recent silent blocks, sent ahead of the block that opens the VAD gate
+    PacketRing prerollRing;
+    bool prerollReady = prerollRing.begin(PREROLL_RING_SLOTS, SLOT_PAYLOAD_OFFSET + AUDIO_CAPTURE_MAX_BLOCK * bytesPerSample);
 
-    if (!audioBuffer32 || !audioBuffer16 || !wsBuffer)
+    if (!prerollReady)
     {
         Serial.println("Failed to allocate memory for audio buffers");
-        if (audioBuffer32)
-            free(audioBuffer32);
-        if (audioBuffer16)
-            free(audioBuffer16);
-        if (wsBuffer)
-            free(wsBuffer);
+        audioCapture.end();
         vTaskDelete(NULL);
         return;
     }
 
     Serial.println("Starting microphone task");
     int64_t lastStatusTime = 0;
-    uint16_t packetSequence = 0; // Sequence number for packets
-
-    // Main audio loop
+    AudioCodec activeCodec = AUDIO_CODEC_PCM; // Switched to requestedCodec below
+    AdpcmState adpcmState;                    // Carried across packets
+    adpcmReset(&adpcmState);
+    VadState vad;
+    vadReset(&vad, AUDIO_CAPTURE_RATE);
+    bool gateOpen = false; // Blocks are being sent, see updateSendGate()
+    uint32_t sampleRate = AUDIO_CAPTURE_RATE;
+
+    // Main audio loop - blocks until the driver signals a completed DMA descriptor
     while (true)
     {
-        // Check if WebSocket is connected and microphone is enabled
-        if (isWebSocketConnected && isMicrophoneEnabled)
+        // Apply a new capture format between blocks
+        if (audioCapture.applyPendingConfig())
         {
-            size_t bytesRead = 0;
-
-            // Read audio data from I2S - fixed timeout
-            esp_err_t result = i2s_read(I2S_PORT, audioBuffer32, bufferBytes, &bytesRead, 100);
+            const AudioCaptureConfig &config = audioCapture.config();
+            sampleRate = config.sampleRate;
+            blockDurationMs = config.dmaBufLen * 1000 / sampleRate;
+            vadReset(&vad, sampleRate);
+            adpcmReset(&adpcmState);
+            voiceFilterReset();
+            beamformerReset();
+            wakeWordReset();
+            gateOpen = false;
+            clearPreroll(prerollRing); // Holds blocks in the old format
+            if (activeCodec == AUDIO_CODEC_OPUS)
+                opusStageReset();
+
+            // The Opus stage encodes at a fixed rate
+            if (sampleRate != AUDIO_CAPTURE_RATE && requestedCodec == AUDIO_CODEC_OPUS)
+            {
+                Serial.println("Opus needs 16 kHz capture - switching to PCM");
+                requestedCodec = AUDIO_CODEC_PCM;
+            }
+        }
 
-            if (result == ESP_OK && bytesRead > 0)
+        // The block's timestamp is the sample clock at its first sample - the clock
+        // advances even when nothing is sent
+        AudioBlock captured;
+        int64_t waitStart = esp_timer_get_time();
+        if (!audioCapture.read(&captured))
+            continue;
+        int64_t readUs = esp_timer_get_time();
+        telemetryRecordUs(TELEMETRY_I2S_WAIT, readUs - waitStart);
+        clockSyncRecordCapture(captured.timestamp, captured.numSamples, sampleRate, readUs);
+        PowerActiveScope active; // Full clock from the DMA wakeup until this block is handed off
+        int32_t *audioBuffer32 = captured.samples;
+        uint32_t blockTimestamp = captured.timestamp;
+
+        // Keep capturing while the link is down - packets wait in the ring
+        if (isMicrophoneEnabled)
+        {
+            // Beam mode folds the two mics to one channel first; stereo blocks
+            // stay interleaved L/R all the way into the packet
+            int channels = captured.channels;
+            if (audioCapture.config().channelMode == AUDIO_CHANNELS_BEAM)
             {
-                // Calculate number of samples
-                int samplesRead = bytesRead / 4; // 4 bytes per 32-bit sample
+                beamformerProcess(audioBuffer32, captured.numSamples);
+                channels = 1;
+            }
+            int frames = captured.numSamples;
+            int samplesRead = frames * channels; // 16-bit samples in the payload
+
+            // Apply a codec change at a block boundary. Leaving Opus waits until the
+            // encoder task has drained, so only one task produces into the packet ring.
+            // The codecs are mono, so stereo goes out as PCM.
+            AudioCodec codec = channels == 2 ? AUDIO_CODEC_PCM : (AudioCodec)requestedCodec;
+            if (codec != activeCodec)
+            {
+                if (activeCodec == AUDIO_CODEC_OPUS && !opusStageIdle())
+                    continue;
+                activeCodec = codec;
+                clearPreroll(prerollRing); // Holds blocks in the old codec's format
+                if (activeCodec == AUDIO_CODEC_ADPCM)
+                    adpcmReset(&adpcmState);
+                else if (activeCodec == AUDIO_CODEC_OPUS)
+                    opusStageReset();
+            }
 
-                // Process each sample with optimized processing
-                int16_t maxAbs = 0;
-                float sumSquared = 0;
+            // High-pass and presence EQ, then the AGC - in place, ahead of every codec
+            voiceFilterProcess(audioBuffer32, frames, channels, sampleRate);
+            agcProcess(audioBuffer32, frames, channels, sampleRate);
+            localMonitorWrite(audioBuffer32, frames, channels, sampleRate, readUs);
 
-                // Convert 32-bit to 16-bit with consistent scaling
-                for (int i = 0; i < samplesRead; i++)
-                {
-                    // Process audio sample using our specialized function
-                    processAudioSample(audioBuffer32[i], &audioBuffer16[i]);
-
-                    // Calculate audio metrics
-                    int16_t abs_sample = abs(audioBuffer16[i]);
-                    if (abs_sample > maxAbs)
-                        maxAbs = abs_sample;
-                    sumSquared += (float)audioBuffer16[i] * audioBuffer16[i];
-                }
+            // Wake-word mode: the spotter hears every block, and the pre-roll
+            // is long enough to carry the keyword out ahead of the command
+            bool wakeGated = wakeWordEnabled() && channels == 1 && sampleRate == WAKE_WORD_SAMPLE_RATE;
+            size_t prerollBlocks = VAD_PREROLL_BLOCKS;
+            if (wakeGated)
+            {
+                feedWakeWord(audioBuffer32, samplesRead, blockTimestamp);
+                uint32_t blockMs = blockDurationMs ? blockDurationMs : 1;
+                prerollBlocks = min((size_t)(WAKE_WORD_PREROLL_MS / blockMs + 1), (size_t)PREROLL_RING_SLOTS - 1);
+            }
 
-                // Calculate RMS - will be used for silence detection
-                float rms = 0;
-                if (samplesRead > 0)
+            AudioBlockStats stats;
+            if (activeCodec == AUDIO_CODEC_OPUS)
+            {
+                // Convert straight into the encoder stage's PCM ring
+                int16_t *block = opusStageAcquireBlock();
+                if (!block)
+                    continue; // Counted by the stage
+                uint32_t stageStart = telemetryStart();
+                AudioProfile::convertBlock(audioBuffer32, samplesRead, block, &stats);
+                telemetryRecord(TELEMETRY_CONVERT, stageStart);
+
+                float rms = blockRms(stats, samplesRead);
+                int crossings = vadZeroCrossings((const uint8_t *)block + 1, samplesRead);
+                VadEvent vadEvent = vadProcess(&vad, rms, crossings, samplesRead);
+                vadEvent = updateSendGate(gateOpen, vad, wakeGated, blockTimestamp);
+                size_t blockBytes = samplesRead * bytesPerSample;
+                uint16_t noiseRms = (uint16_t)vad.noiseFloor;
+
+                // Silence markers reuse the acquired block, so stash it first
+                stageStart = telemetryStart();
+                if (vadEvent == VAD_SPEECH_START)
                 {
-                    rms = sqrt(sumSquared / samplesRead);
+                    stashPreroll(prerollRing, (const uint8_t *)block, blockBytes, blockTimestamp, PREROLL_RING_SLOTS);
+                    opusStageSilence(SILENCE_STOP, noiseRms, blockTimestamp);
+                    flushPrerollOpus(prerollRing);
                 }
-
-                // Only send if we have meaningful audio (not silence)
-                if (maxAbs > 500 || rms > 200)
-                { // Increased thresholds for better audio
-                    // Create standardized audio packet with header
-                    // Header: [magic(1), type(1), seqNum-high(1), seqNum-low(1),
-                    //          samples-high(1), samples-low(1), checksum-high(1), checksum-low(1)]
-
-                    // 1. Magic byte and packet type
-                    wsBuffer[0] = PACKET_HEADER_MAGIC; // Fixed magic byte
-                    wsBuffer[1] = PACKET_TYPE_AUDIO;   // Audio packet type
-
-                    // 2. Sequence number (2 bytes, network/big-endian)
-                    wsBuffer[2] = (packetSequence >> 8) & 0xFF; // High byte
-                    wsBuffer[3] = packetSequence & 0xFF;        // Low byte
-
-                    // 3. Sample count (2 bytes, network/big-endian)
-                    wsBuffer[4] = (samplesRead >> 8) & 0xFF; // High byte
-                    wsBuffer[5] = samplesRead & 0xFF;        // Low byte
-
-                    // 4. Copy audio data after header - in network byte order (big-endian)
-                    for (int i = 0; i < samplesRead; i++)
-                    {
-                        int offset = PACKET_HEADER_SIZE + (i * 2);
-                        // Store in big-endian format
-                        wsBuffer[offset] = (audioBuffer16[i] >> 8) & 0xFF; // High byte
-                        wsBuffer[offset + 1] = audioBuffer16[i] & 0xFF;    // Low byte
-                    }
-
-                    // 5. Calculate checksum using our consistent function
-                    uint16_t checksum = calculateAudioChecksum(audioBuffer16, samplesRead);
-
-                    // 6. Store checksum in header (2 bytes, network/big-endian)
-                    wsBuffer[6] = (checksum >> 8) & 0xFF; // High byte
-                    wsBuffer[7] = checksum & 0xFF;        // Low byte
-
-                    // Debug output - detailed packet info
-                    Serial.printf("Sending packet #%u: %d samples, max=%d, rms=%.1f, checksum=%u\n",
-                                  packetSequence, samplesRead, maxAbs, rms, checksum);
-
-                    // Send the complete packet over WebSocket
-                    size_t packetSize = PACKET_HEADER_SIZE + (samplesRead * bytesPerSample);
-                    webSocket.sendBIN(wsBuffer, packetSize);
-
-                    // Visual feedback - LED brightness shows audio level
-                    int brightness = map(min((int)rms, 5000), 0, 5000, 0, 255);
-                    analogWrite(LED_PIN, 255 - brightness);
-
-                    // Increment sequence number for next packet
-                    packetSequence++;
-
-                    // Status logging (every 2 seconds)
-                    int64_t now = esp_timer_get_time() / 1000;
-                    if (now - lastStatusTime > 2000)
-                    {
-                        Serial.printf("Audio packet #%u: %d samples, Max: %d, RMS: %.1f\n",
-                                      packetSequence, samplesRead, maxAbs, rms);
-                        lastStatusTime = now;
-                    }
+                else if (gateOpen)
+                {
+                    opusStageCommitBlock(samplesRead, blockTimestamp);
                 }
                 else
                 {
-                    // No significant audio - ensure the LED shows this state
-                    analogWrite(LED_PIN, 200); // Dim LED when silent
+                    stashPreroll(prerollRing, (const uint8_t *)block, blockBytes, blockTimestamp, prerollBlocks);
+                    if (vadEvent == VAD_SPEECH_END)
+                        opusStageSilence(SILENCE_START, noiseRms, blockTimestamp);
                 }
+                telemetryRecord(TELEMETRY_ENQUEUE, stageStart);
+                publishVadState(gateOpen, rms);
+                continue;
             }
-            else if (result != ESP_OK)
+
+            // Claim a ring slot to pack into - if the sender is behind, drop this block
+            uint8_t *slot = packetRing.acquire();
+            if (!slot)
             {
-                // Error reading from microphone
-                Serial.printf("I2S read error: %d\n", result);
-                delay(10);
+                if (gateOpen)
+                    packetSequence++; // Leave a gap so the server sees the loss
+                continue;
             }
-        }
-        else
-        {
-            // Not connected or microphone disabled - update LED
-            if (!isWebSocketConnected)
+
+            // WebSocket packet (header + audio data) inside the slot
+            // Header layout in audio_packet.h
+            uint8_t *wsBuffer = slot + SLOT_PACKET_OFFSET;
+
+            // Convert and measure - PCM is packed straight into the packet payload,
+            // ADPCM goes through the 16-bit buffer first
+            bool adpcm = activeCodec == AUDIO_CODEC_ADPCM;
+            const uint8_t *signBytes;
+            uint32_t stageStart = telemetryStart();
+            if (adpcm)
+            {
+                AudioProfile::convertBlock(audioBuffer32, samplesRead, audioBuffer16, &stats);
+                signBytes = (const uint8_t *)audioBuffer16 + 1; // Little-endian
+            }
+            else
             {
-                analogWrite(LED_PIN, 64); // Red - not connected
+                AudioProfile::packBlock(audioBuffer32, samplesRead, wsBuffer + PACKET_HEADER_SIZE, &stats);
+                signBytes = wsBuffer + PACKET_HEADER_SIZE; // Big-endian
             }
-            else if (!isMicrophoneEnabled)
+            telemetryRecord(TELEMETRY_CONVERT, stageStart);
+            int16_t maxAbs = stats.maxAbs;
+
+            // Calculate RMS and zero crossings for the voice activity detector
+            float rms = blockRms(stats, samplesRead);
+            int crossings = vadZeroCrossings(signBytes, frames, channels); // Left channel
+            VadEvent vadEvent = vadProcess(&vad, rms, crossings, frames);
+            vadEvent = updateSendGate(gateOpen, vad, wakeGated, blockTimestamp);
+
+            // Every block is encoded - silent ones may still go out as pre-roll
+            size_t payloadSize = samplesRead * bytesPerSample;
+            uint32_t crc = stats.crc; // PCM: computed while packing
+            if (adpcm)
             {
-                analogWrite(LED_PIN, 0); // Blue - connected but mic disabled
+                // Record the state this block starts from, then encode behind it
+                stageStart = telemetryStart();
+                uint8_t *adpcmHeader = wsBuffer + PACKET_HEADER_SIZE;
+                adpcmHeader[0] = (adpcmState.predictor >> 8) & 0xFF;
+                adpcmHeader[1] = adpcmState.predictor & 0xFF;
+                adpcmHeader[2] = adpcmState.stepIndex;
+                adpcmHeader[3] = 0;
+
+                uint8_t *codes = adpcmHeader + ADPCM_HEADER_SIZE;
+                size_t codeBytes = adpcmEncode(&adpcmState, audioBuffer16, samplesRead, codes);
+                payloadSize = ADPCM_HEADER_SIZE + codeBytes;
+                crc = packetCrc32(adpcmHeader, payloadSize);
+                telemetryRecord(TELEMETRY_ENCODE, stageStart);
             }
 
-            delay(100);
-        }
+            // Fill in the standardized header in front of the payload
+            writePacketHeader(wsBuffer, adpcm ? PACKET_TYPE_AUDIO_ADPCM : PACKET_TYPE_AUDIO,
+                              packetSequence, samplesRead, crc, blockTimestamp, sampleRate, channels);
+            size_t packetSize = PACKET_HEADER_SIZE + payloadSize;
+            uint16_t noiseRms = (uint16_t)vad.noiseFloor;
+            stageStart = telemetryStart();
 
-        // Small delay to prevent task watchdog timeouts
-        delay(1);
+            if (vadEvent == VAD_SPEECH_START)
+            {
+                // Silence stop goes first in this slot, then the pre-roll and this block
+                stashPreroll(prerollRing, wsBuffer, packetSize, blockTimestamp, PREROLL_RING_SLOTS);
+                packetRing.commit(writeSilencePacket(wsBuffer, packetSequence++, SILENCE_STOP, noiseRms, blockTimestamp, sampleRate));
+                flushPrerollPackets(prerollRing);
+                xTaskNotifyGive(networkTaskHandle);
+            }
+            else if (gateOpen)
+            {
+                // Hand the complete packet to the network task
+                packetRing.commit(packetSize);
+                xTaskNotifyGive(networkTaskHandle);
+
+                // Increment sequence number for next packet
+                packetSequence++;
+            }
+            else
+            {
+                // Silence - keep the block for pre-roll, tell the server when it starts
+                stashPreroll(prerollRing, wsBuffer, packetSize, blockTimestamp, prerollBlocks);
+                if (vadEvent == VAD_SPEECH_END)
+                {
+                    packetRing.commit(writeSilencePacket(wsBuffer, packetSequence++, SILENCE_START, noiseRms, blockTimestamp, sampleRate));
+                    xTaskNotifyGive(networkTaskHandle);
+                }
+            }
+            telemetryRecord(TELEMETRY_ENQUEUE, stageStart);
+            publishVadState(gateOpen, rms);
+
+            // Status logging (every 2 seconds)
+            int64_t now = esp_timer_get_time() / 1000;
+            if (now - lastStatusTime > 2000)
+            {
+                Serial.printf("Audio packet #%u: %d samples, Max: %d, RMS: %.1f, Noise: %.1f, DMA overruns: %u\n",
+                              packetSequence, samplesRead, maxAbs, rms, vad.noiseFloor, audioCapture.overruns);
+                lastStatusTime = now;
+            }
+        }
+        else
+        {
+            // Microphone disabled - the descriptor was drained
+            // above so DMA keeps running, just update the indicator
+            statusLedSetAudio(STATUS_LED_MIC_OFF, 0);
+            powerSetVoiceActive(false); // Nothing to send - the radio can sleep
+        }
     }
 
     // Cleanup (though this task should never end)
-    free(audioBuffer32);
-    free(audioBuffer16);
-    free(wsBuffer);
-    i2s_driver_uninstall(I2S_PORT);
+    prerollRing.end();
+    audioCapture.end();
     vTaskDelete(NULL);
 }
 
@@ -535,13 +1207,16 @@ void webSocketEvent(WStype_t type, uint8_t *payload, size_t length)
     {
     case WStype_DISCONNECTED:
         Serial.println("WebSocket disconnected!");
-        isWebSocketConnected = false;
-        isMicrophoneEnabled = false; // Disable mic when disconnected
+        if (isWebSocketConnected)
+            beginWebSocket(); // The relay may be gone - probe again, a fallback may answer
+        isWebSocketConnected = false; // Mic stays as it was - capture buffers until we are back
+        statusLedSetLink(false);
         break;
 
     case WStype_CONNECTED:
         Serial.println("WebSocket connected!");
         isWebSocketConnected = true;
+        statusLedSetLink(true);
 
         // Automatically enable microphone when connected
         Serial.println("Automatically enabling microphone");
@@ -549,40 +1224,55 @@ void webSocketEvent(WStype_t type, uint8_t *payload, size_t length)
 
         // Send identification message to server
         Serial.println("Sending device identification");
-        webSocket.sendTXT("{\"type\":\"hello\",\"client\":\"esp32\",\"device\":\"ESP32-AUDIO\"}");
+        {
+            // The relay routes our audio to the browsers subscribed to this ID
+            uint64_t mac = ESP.getEfuseMac();
+            char hello[96];
+            snprintf(hello, sizeof(hello), "{\"type\":\"hello\",\"client\":\"esp32\",\"device\":\"ESP32-AUDIO\",\"id\":\"%06llx\"}",
+                     (unsigned long long)((mac >> 24) & 0xFFFFFF));
+            sendText(hello);
+
+            // How the endpoint was picked, for the relay's reconnect logs
+            const RelayChoice &relay = relayEndpointChoice();
+            RelayEndpointStats probe = relayEndpointGetStats();
+            char report[224];
+            snprintf(report, sizeof(report),
+                     "{\"type\":\"relay\",\"host\":\"%s\",\"probeMs\":%u,\"probes\":%u,\"cacheHits\":%u,"
+                     "\"lookups\":%u,\"staleWins\":%u,\"timeouts\":%u}",
+                     relay.host, relay.probeMs, probe.probes, probe.cacheHits, probe.lookups, probe.staleWins,
+                     probe.timeouts);
+            sendText(report);
+        }
         break;
 
     case WStype_TEXT:
     {
-        // We still handle commands in case the server sends them
-        String message = String((char *)payload);
-        Serial.printf("Received text message: %s\n", message.c_str());
+        commandReceivedUs = esp_timer_get_time(); // Before the serial print, for clock_sync replies
 
-        // Try to parse as JSON
-        DynamicJsonDocument doc(256);
-        DeserializationError error = deserializeJson(doc, message);
-        if (!error)
-        {
-            // Handle commands if any
-            if (doc.containsKey("command"))
-            {
-                String command = doc["command"].as<String>();
+        // We still handle commands in case the server sends them
+        Serial.printf("Received text message: %.*s\n", (int)length, (const char *)payload);
 
-                if (command == "mic_on")
-                {
-                    Serial.println("Received mic_on command");
-                    isMicrophoneEnabled = true;
-                }
-                else if (command == "mic_off")
-                {
-                    Serial.println("Received mic_off command");
-                    isMicrophoneEnabled = false;
-                }
-            }
-        }
+        // Parse in place - strings stay in the library's receive buffer, no heap use
+        StaticJsonDocument<COMMAND_JSON_CAPACITY> doc;
+        DeserializationError error = deserializeJson(doc, (char *)payload, length);
+        if (error)
+            Serial.printf("Invalid command JSON: %s\n", error.c_str());
+        else
+            handleCommand(doc);
     }
     break;
 
+    case WStype_PONG:
+        // Our RTT probes carry a 4-byte millis() stamp; library heartbeats are empty
+        if (length == 4)
+        {
+            uint32_t stamp = ((uint32_t)payload[0] << 24) | ((uint32_t)payload[1] << 16) |
+                             ((uint32_t)payload[2] << 8) | payload[3];
+            float rtt = millis() - stamp;
+            linkRttMs = linkRttMs == 0 ? rtt : linkRttMs * 0.8f + rtt * 0.2f;
+        }
+        break;
+
     case WStype_BIN:
         // We don't expect binary data from server
         Serial.printf("Received unexpected binary data: %u bytes\n", length);
@@ -595,4 +1285,326 @@ void webSocketEvent(WStype_t type, uint8_t *payload, size_t length)
     default:
         break;
     }
-}
\ No newline at end of file
+}
+
+// Text message to the relay, framed in textFrame without a heap copy
+bool sendText(const char *text)
+{
+    size_t length = strlen(text);
+    if (length > TEXT_FRAME_CAPACITY)
+    {
+        Serial.printf("Text message too long for the frame buffer: %u bytes\n", (unsigned)length);
+        return false;
+    }
+    memcpy(textFrame + WEBSOCKETS_MAX_HEADER_SIZE, text, length);
+    return webSocket.sendTXT(textFrame, length, true);
+}
+
+// Server command, see webSocketEvent()
+void handleCommand(const JsonDocument &doc)
+{
+    const char *command = doc["command"];
+    if (!command)
+        return;
+
+    if (strcmp(command, "mic_on") == 0)
+    {
+        Serial.println("Received mic_on command");
+        isMicrophoneEnabled = true;
+    }
+    else if (strcmp(command, "mic_off") == 0)
+    {
+        Serial.println("Received mic_off command");
+        isMicrophoneEnabled = false;
+    }
+    else if (strcmp(command, "codec") == 0)
+    {
+        // {"command":"codec","codec":"pcm"|"adpcm"|"opus"}
+        selectCodec(doc["codec"] | "", audioCapture.config().sampleRate);
+    }
+    else if (strcmp(command, "batch") == 0)
+    {
+        // {"command":"batch","maxBlocks":4} - 1 turns coalescing off
+        setBatchMaxBlocks(doc["maxBlocks"] | 0);
+    }
+    else if (strcmp(command, "capture") == 0)
+    {
+        // {"command":"capture","sampleRate":44100,"dmaBufLen":1016,"dmaBufCount":8,"apll":true,
+        //  "channels":"mono"|"stereo"|"beam","beamDelay":0}
+        // Missing fields keep their current value; applied by the capture task
+        AudioCaptureConfig config = audioCapture.config();
+        config.sampleRate = doc["sampleRate"] | config.sampleRate;
+        config.dmaBufLen = doc["dmaBufLen"] | config.dmaBufLen;
+        config.dmaBufCount = doc["dmaBufCount"] | config.dmaBufCount;
+        config.useApll = doc["apll"] | config.useApll;
+        const char *channels = doc["channels"] | "";
+        if (strcmp(channels, "mono") == 0)
+            config.channelMode = AUDIO_CHANNELS_MONO;
+        else if (strcmp(channels, "stereo") == 0)
+            config.channelMode = AUDIO_CHANNELS_STEREO;
+        else if (strcmp(channels, "beam") == 0)
+            config.channelMode = AUDIO_CHANNELS_BEAM;
+        else if (*channels)
+            Serial.printf("Unsupported channels: %s\n", channels);
+        if (doc.containsKey("beamDelay") && !beamformerSetDelay(doc["beamDelay"] | 0))
+            Serial.printf("Rejected beamDelay (-%d-%d samples)\n", BEAMFORMER_MAX_DELAY, BEAMFORMER_MAX_DELAY);
+        if (!audioCapture.requestConfig(config))
+            Serial.printf("Rejected capture config (rate 8000/16000/44100, dmaBufLen %d-%d, %d in stereo/beam, "
+                          "dmaBufCount 2-%d)\n",
+                          AUDIO_CAPTURE_MIN_BLOCK, AUDIO_CAPTURE_MAX_BLOCK, AUDIO_CAPTURE_MAX_STEREO_BLOCK,
+                          AUDIO_CAPTURE_MAX_DMA_BUFS);
+    }
+    else if (strcmp(command, "config") == 0)
+    {
+        // {"command":"config","sampleRate":8000,"gain":5,"agc":false,"blockSize":256,"codec":"adpcm","maxBlocks":4}
+        // Every field is optional. Each one is checked and applied on its own, and
+        // the device answers with the resulting settings. A fixed gain turns the AGC off.
+        bool ok = true;
+        AudioCaptureConfig config = audioCapture.config();
+        config.sampleRate = doc["sampleRate"] | config.sampleRate;
+        config.dmaBufLen = doc["blockSize"] | config.dmaBufLen;
+        if (doc.containsKey("sampleRate") || doc.containsKey("blockSize"))
+        {
+            if (!audioCapture.requestConfig(config))
+            {
+                Serial.printf("Rejected config sampleRate %u / blockSize %d\n", config.sampleRate, config.dmaBufLen);
+                config = audioCapture.config();
+                ok = false;
+            }
+        }
+        if (doc.containsKey("agc"))
+            agcSetEnabled(doc["agc"] | false);
+        if (doc.containsKey("gain"))
+        {
+            int gain = doc["gain"] | 0;
+            if (gain >= 1 && gain <= AUDIO_MAX_GAIN)
+            {
+                agcSetEnabled(false);
+                audioDspSetGain(gain);
+            }
+            else
+            {
+                Serial.printf("Rejected config gain (1-%d)\n", AUDIO_MAX_GAIN);
+                ok = false;
+            }
+        }
+        if (doc.containsKey("codec"))
+            ok &= selectCodec(doc["codec"] | "", config.sampleRate);
+        if (doc.containsKey("maxBlocks"))
+            ok &= setBatchMaxBlocks(doc["maxBlocks"] | 0);
+
+        static const char *const codecNames[] = {"pcm", "adpcm", "opus"};
+        char reply[160];
+        snprintf(reply, sizeof(reply),
+                 "{\"type\":\"config\",\"ok\":%s,\"sampleRate\":%u,\"gain\":%d,\"agc\":%s,\"blockSize\":%d,\"codec\":\"%s\",\"maxBlocks\":%d}",
+                 ok ? "true" : "false", config.sampleRate, audioDspGain(), agcEnabled() ? "true" : "false", config.dmaBufLen,
+                 codecNames[requestedCodec], (int)batchMaxBlocks);
+        sendText(reply);
+    }
+    else if (strcmp(command, "transport") == 0)
+    {
+        // {"command":"transport","transport":"udp"|"websocket","port":3013} - port optional
+        const char *transport = doc["transport"] | "";
+        int port = doc["port"] | (int)udpServerPort;
+        if (port < 1 || port > 65535)
+            Serial.printf("Rejected UDP port %d\n", port);
+        else if (strcmp(transport, "udp") == 0)
+        {
+            udpServerPort = port;
+            udpServerResolved = false; // Look the server up again
+            audioTransport = AUDIO_TRANSPORT_UDP;
+        }
+        else if (strcmp(transport, "websocket") == 0)
+            audioTransport = AUDIO_TRANSPORT_WEBSOCKET;
+        else
+            Serial.printf("Unsupported transport: %s\n", transport);
+    }
+    else if (strcmp(command, "power") == 0)
+    {
+        // {"command":"power","mode":"save"|"performance"}
+        const char *mode = doc["mode"] | "";
+        if (strcmp(mode, "save") == 0)
+            powerManagerSetMode(POWER_MODE_SAVE);
+        else if (strcmp(mode, "performance") == 0)
+            powerManagerSetMode(POWER_MODE_PERFORMANCE);
+        else
+            Serial.printf("Unsupported power mode: %s\n", mode);
+    }
+    else if (strcmp(command, "clock_sync") == 0)
+    {
+        // {"command":"clock_sync","t0":<relay ms>} - latency measurement probe, see clock_sync.h
+        char reply[CLOCK_SYNC_REPLY_SIZE];
+        if (clockSyncBuildReply(reply, sizeof(reply), doc["t0"] | 0.0, commandReceivedUs))
+            sendText(reply);
+    }
+    else if (strcmp(command, "filter") == 0)
+    {
+        // {"command":"filter","highpassHz":100,"presenceHz":2500,"presenceDb":3,"presenceQ":1}
+        // Missing fields keep their current value; highpassHz 0 / presenceDb 0 bypass a stage
+        VoiceFilterConfig config = voiceFilterConfig();
+        config.highpassHz = doc["highpassHz"] | (int)config.highpassHz;
+        config.presenceHz = doc["presenceHz"] | (int)config.presenceHz;
+        config.presenceDb = doc["presenceDb"] | config.presenceDb;
+        config.presenceQ = doc["presenceQ"] | config.presenceQ;
+        bool ok = voiceFilterRequest(config);
+        if (!ok)
+            Serial.println("Rejected filter (highpassHz 0/20-1000, presenceHz 200-8000, presenceDb -12-12, presenceQ 0.3-4)");
+
+        config = voiceFilterConfig();
+        char reply[160];
+        snprintf(reply, sizeof(reply),
+                 "{\"type\":\"filter\",\"ok\":%s,\"highpassHz\":%u,\"presenceHz\":%u,\"presenceDb\":%.1f,\"presenceQ\":%.2f}",
+                 ok ? "true" : "false", config.highpassHz, config.presenceHz, config.presenceDb, config.presenceQ);
+        sendText(reply);
+    }
+    else if (strcmp(command, "wake") == 0)
+    {
+        // {"command":"wake","enabled":true} - no field just reports the state
+        bool ok = true;
+        if (doc.containsKey("enabled") && !wakeWordSetEnabled(doc["enabled"] | false))
+        {
+            Serial.println("Rejected wake - no wake word model (build with -DAUDIO_USE_WAKEWORD=1)");
+            ok = false;
+        }
+
+        WakeWordStats wake = wakeWordGetStats();
+        char reply[160];
+        snprintf(reply, sizeof(reply),
+                 "{\"type\":\"wake\",\"ok\":%s,\"enabled\":%s,\"model\":\"%s\",\"detections\":%u,\"overruns\":%u}",
+                 ok ? "true" : "false", wakeWordEnabled() ? "true" : "false", wakeWordModel(),
+                 wake.detections, wake.overruns);
+        sendText(reply);
+    }
+    else if (strcmp(command, "monitor") == 0)
+    {
+        // {"command":"monitor","enabled":true} - no field just reports; latency
+        // covers the time since the previous report
+        bool ok = true;
+        if (doc.containsKey("enabled") && !localMonitorSetEnabled(doc["enabled"] | false))
+        {
+            Serial.println("Rejected monitor - not built in (build with -DAUDIO_LOCAL_MONITOR=1)");
+            ok = false;
+        }
+
+        LocalMonitorStats monitor = localMonitorTakeStats();
+        char reply[192];
+        snprintf(reply, sizeof(reply),
+                 "{\"type\":\"monitor\",\"ok\":%s,\"enabled\":%s,\"blocks\":%u,\"drops\":%u,"
+                 "\"underruns\":%u,\"latencyUs\":%u,\"latencyMaxUs\":%u}",
+                 ok ? "true" : "false", localMonitorEnabled() ? "true" : "false", monitor.blocks,
+                 monitor.drops, monitor.underruns, monitor.latencyUs, monitor.latencyMaxUs);
+        sendText(reply);
+    }
+    else if (strcmp(command, "video") == 0)
+    {
+        // {"command":"video","enabled":true,"fps":10,"quality":12} - every field optional
+        bool ok = true;
+        if (doc.containsKey("enabled") && !videoCaptureSetEnabled(doc["enabled"] | false))
+        {
+            Serial.println("Rejected video - no camera (build with -DAUDIO_USE_CAMERA=1)");
+            ok = false;
+        }
+        if ((doc.containsKey("fps") || doc.containsKey("quality")) &&
+            !videoCaptureSetParams(doc["fps"] | 0, doc["quality"] | 0))
+        {
+            Serial.printf("Rejected video settings (fps %d-%d, quality %d-%d)\n", VIDEO_MIN_FPS, VIDEO_MAX_FPS,
+                          VIDEO_MIN_QUALITY, VIDEO_MAX_QUALITY);
+            ok = false;
+        }
+
+        VideoCaptureStats video = videoCaptureGetStats();
+        char reply[224];
+        snprintf(reply, sizeof(reply),
+                 "{\"type\":\"video\",\"ok\":%s,\"enabled\":%s,\"fps\":%d,\"quality\":%d,\"width\":%u,"
+                 "\"height\":%u,\"frames\":%u,\"drops\":%u,\"oversize\":%u,\"lastBytes\":%u}",
+                 ok ? "true" : "false", videoCaptureEnabled() ? "true" : "false", videoCaptureFps(),
+                 videoCaptureQuality(), video.width, video.height, video.frames, video.drops, video.oversize,
+                 video.lastBytes);
+        sendText(reply);
+    }
+    else if (strcmp(command, "person") == 0)
+    {
+        // {"command":"person","enabled":true,"threshold":60} - every field optional
+        bool ok = true;
+        if (doc.containsKey("enabled") && !personDetectSetEnabled(doc["enabled"] | false))
+        {
+            Serial.println("Rejected person - no detector (build with -DAUDIO_PERSON_DETECT=1)");
+            ok = false;
+        }
+        if (doc.containsKey("threshold") && !personDetectSetThreshold(doc["threshold"] | 0))
+        {
+            Serial.printf("Rejected person threshold (%d-%d%%)\n", PERSON_DETECT_MIN_THRESHOLD,
+                          PERSON_DETECT_MAX_THRESHOLD);
+            ok = false;
+        }
+
+        PersonDetectStats person = personDetectGetStats();
+        char reply[224];
+        snprintf(reply, sizeof(reply),
+                 "{\"type\":\"person\",\"ok\":%s,\"enabled\":%s,\"threshold\":%d,\"runs\":%u,"
+                 "\"positives\":%u,\"gated\":%u,\"score\":%u,\"decodeUs\":%u,\"inferUs\":%u}",
+                 ok ? "true" : "false", personDetectEnabled() ? "true" : "false", personDetectThreshold(),
+                 person.runs, person.positives, videoCaptureGetStats().gated, person.lastScore, person.decodeUs,
+                 person.inferUs);
+        sendText(reply);
+    }
+    else if (strcmp(command, "backlog") == 0)
+    {
+        // {"command":"backlog","rateBytes":48000} - upload budget; no field just reports
+        bool ok = true;
+        if (doc.containsKey("rateBytes"))
+        {
+            uint32_t rate = doc["rateBytes"] | 0;
+            if (rate >= BACKLOG_MIN_RATE && rate <= BACKLOG_MAX_RATE)
+                backlogRate = rate;
+            else
+            {
+                Serial.printf("Rejected backlog rateBytes (%d-%d)\n", BACKLOG_MIN_RATE, BACKLOG_MAX_RATE);
+                ok = false;
+            }
+        }
+
+        BacklogStats backlog = backlogGetStats();
+        char reply[192];
+        snprintf(reply, sizeof(reply),
+                 "{\"type\":\"backlog\",\"ok\":%s,\"rateBytes\":%u,\"stored\":%u,\"sent\":%u,\"dropped\":%u,"
+                 "\"memoryBytes\":%u,\"flashBytes\":%u}",
+                 ok ? "true" : "false", (unsigned)backlogRate, backlog.stored, backlog.sent, backlog.dropped,
+                 (unsigned)backlog.memoryBytes, (unsigned)backlog.flashBytes);
+        sendText(reply);
+    }
+    else if (strcmp(command, "opus_config") == 0)
+    {
+        // {"command":"opus_config","frameMs":20,"bitrate":16000} - either field optional
+        if (!opusStageSetParams(doc["frameMs"] | 0, doc["bitrate"] | 0))
+            Serial.println("Rejected opus_config (frameMs 10/20/40/60, bitrate 6000-64000)");
+    }
+}
+
+// Request a codec for the capture task; Opus only runs at its fixed rate
+bool selectCodec(const char *codec, uint32_t sampleRate)
+{
+    if (strcmp(codec, "pcm") == 0)
+        requestedCodec = AUDIO_CODEC_PCM;
+    else if (strcmp(codec, "adpcm") == 0)
+        requestedCodec = AUDIO_CODEC_ADPCM;
+    else if (strcmp(codec, "opus") == 0 && isOpusAvailable && sampleRate == AUDIO_CAPTURE_RATE)
+        requestedCodec = AUDIO_CODEC_OPUS;
+    else
+    {
+        Serial.printf("Unsupported codec: %s\n", codec);
+        return false;
+    }
+    return true;
+}
+
+bool setBatchMaxBlocks(int maxBlocks)
+{
+    if (maxBlocks < 1 || maxBlocks > BATCH_LIMIT || !batchBuffer)
+    {
+        Serial.printf("Rejected batch maxBlocks %d (1-%d)\n", maxBlocks, BATCH_LIMIT);
+        return false;
+    }
+    batchMaxBlocks = maxBlocks;
+    return true;
+}
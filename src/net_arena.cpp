@@ -0,0 +1,157 @@
+/*
+Network Arena
+=============
+
+See net_arena.h.
+*/
+
+#include "net_arena.h"
+
+#if AUDIO_NET_ARENA
+
+#include "esp_heap_caps.h"
+#include "mbedtls/platform.h"
+
+#if defined(MBEDTLS_PLATFORM_MEMORY) && !defined(MBEDTLS_PLATFORM_CALLOC_MACRO)
+
+struct SlabClass
+{
+    uint32_t slotSize;
+    uint16_t slots;
+    uint8_t *base;        // First slot
+    uint16_t *freeSlots;  // Stack of free slot indices
+    uint16_t freeCount;
+};
+
+// Sized from a TLS 1.2 session with a certificate chain: many small
+// structures, a few handshake buffers, and the two record buffers. Room for
+// two sessions, the second for the overlap while a dropped one is torn
+// down. About 184 KB of PSRAM.
+static SlabClass classes[] = {
+    {64, 192},
+    {256, 96},
+    {1024, 32},
+    {4096, 12},
+    {NET_ARENA_RECORD_BYTES, 4},
+};
+#define CLASS_COUNT (sizeof(classes) / sizeof(classes[0]))
+
+static uint8_t *arenaStart = NULL;
+static uint8_t *arenaEnd = NULL;
+static portMUX_TYPE arenaLock = portMUX_INITIALIZER_UNLOCKED;
+static NetArenaStats stats;
+
+static void *arenaCalloc(size_t count, size_t size)
+{
+    size_t bytes = count * size;
+    if (size && bytes / size != count)
+        return NULL;
+
+    uint8_t *slot = NULL;
+    portENTER_CRITICAL(&arenaLock);
+    for (size_t c = 0; c < CLASS_COUNT && !slot; c++)
+    {
+        SlabClass &slab = classes[c];
+        if (bytes > slab.slotSize || slab.freeCount == 0)
+            continue;
+        slot = slab.base + (size_t)slab.freeSlots[--slab.freeCount] * slab.slotSize;
+        stats.inUse += slab.slotSize;
+        if (stats.inUse > stats.highWater)
+            stats.highWater = stats.inUse;
+        stats.allocations++;
+    }
+    if (!slot)
+        stats.fallbacks++;
+    portEXIT_CRITICAL(&arenaLock);
+
+    if (!slot)
+        return heap_caps_calloc(count, size, MALLOC_CAP_8BIT);
+    memset(slot, 0, bytes);
+    return slot;
+}
+
+static void arenaFree(void *pointer)
+{
+    uint8_t *slot = (uint8_t *)pointer;
+    if (slot < arenaStart || slot >= arenaEnd)
+    {
+        heap_caps_free(pointer); // From the heap: a fallback, or from before netArenaBegin()
+        return;
+    }
+    portENTER_CRITICAL(&arenaLock);
+    for (size_t c = 0; c < CLASS_COUNT; c++)
+    {
+        SlabClass &slab = classes[c];
+        if (slot >= slab.base && slot < slab.base + (size_t)slab.slots * slab.slotSize)
+        {
+            slab.freeSlots[slab.freeCount++] = (slot - slab.base) / slab.slotSize;
+            stats.inUse -= slab.slotSize;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&arenaLock);
+}
+
+bool netArenaBegin()
+{
+    if (stats.active)
+        return true;
+    size_t slotBytes = 0, indexBytes = 0;
+    for (size_t c = 0; c < CLASS_COUNT; c++)
+    {
+        slotBytes += (size_t)classes[c].slotSize * classes[c].slots;
+        indexBytes += classes[c].slots * sizeof(uint16_t);
+    }
+    // Slots in PSRAM; the free lists are small and hot, so internal
+    arenaStart = (uint8_t *)heap_caps_aligned_alloc(16, slotBytes, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+    uint16_t *index = (uint16_t *)heap_caps_malloc(indexBytes, MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+    if (!arenaStart || !index)
+    {
+        heap_caps_free(arenaStart);
+        heap_caps_free(index);
+        arenaStart = NULL;
+        return false;
+    }
+    arenaEnd = arenaStart + slotBytes;
+
+    uint8_t *next = arenaStart;
+    for (size_t c = 0; c < CLASS_COUNT; c++)
+    {
+        SlabClass &slab = classes[c];
+        slab.base = next;
+        slab.freeSlots = index;
+        slab.freeCount = slab.slots;
+        for (uint16_t i = 0; i < slab.slots; i++)
+            slab.freeSlots[i] = slab.slots - 1 - i; // Lowest slot first
+        next += (size_t)slab.slotSize * slab.slots;
+        index += slab.slots;
+    }
+    stats.capacity = slotBytes;
+
+    if (mbedtls_platform_set_calloc_free(arenaCalloc, arenaFree) != 0)
+        return false;
+    stats.active = true;
+    return true;
+}
+
+NetArenaStats netArenaGetStats()
+{
+    portENTER_CRITICAL(&arenaLock);
+    NetArenaStats copy = stats;
+    portEXIT_CRITICAL(&arenaLock);
+    return copy;
+}
+
+#else // mbedTLS without MBEDTLS_PLATFORM_MEMORY: nothing to hook
+
+bool netArenaBegin() { return false; }
+NetArenaStats netArenaGetStats() { return NetArenaStats(); }
+
+#endif
+
+#else // !AUDIO_NET_ARENA
+
+bool netArenaBegin() { return false; }
+NetArenaStats netArenaGetStats() { return NetArenaStats(); }
+
+#endif
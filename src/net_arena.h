@@ -0,0 +1,62 @@
+/*
+Network Arena
+=============
+
+Fixed slab allocator for the TLS stack, so weeks of reconnects do not carve
+up the internal heap.
+
+Each connect over TLS allocates a new mbedTLS session: two record buffers of
+about 16 KB, the handshake state, and dozens of small certificate and key
+structures. All of it is freed again when the link drops. In between, Wi-Fi,
+lwIP and the libraries make long-lived allocations, so every session lands in
+different holes. After enough reconnects the largest free block is smaller
+than a record buffer, and beginSSL() fails with plenty of heap free in total.
+
+netArenaBegin() reserves one block in PSRAM at boot and splits it into slab
+classes of fixed sizes (net_arena.cpp). mbedTLS then allocates from the arena
+through mbedtls_platform_set_calloc_free(). A request takes the smallest
+class that fits, O(1) from that class's free list, under a spinlock. A
+request too large for any class, or whose class is full, goes to the heap
+and is counted as a fallback. The arena is never returned, so every session
+gets the same layout as the first.
+
+Needs PSRAM and mbedTLS built with MBEDTLS_PLATFORM_MEMORY, as the ESP32
+Arduino core's is. Without them, or with -DAUDIO_NET_ARENA=0, TLS uses the
+heap as before and netArenaBegin() returns false. Call it before the first
+TLS connection; blocks allocated earlier still free to the heap.
+
+The rest of the network path makes no per-message heap allocations:
+- command JSON is parsed in place (main.cpp);
+- replies and reports go out of one static frame buffer with room for the
+  WebSocket header in front;
+- audio is sent from the packet ring slots the same way.
+The stats show the balance: arena use and high water, and fallbacks. The
+largest free internal block rides in the telemetry packet (telemetry.h).
+*/
+
+#ifndef NET_ARENA_H
+#define NET_ARENA_H
+
+#include <Arduino.h>
+
+#ifndef AUDIO_NET_ARENA
+#define AUDIO_NET_ARENA 1
+#endif
+
+#define NET_ARENA_RECORD_BYTES (17 * 1024) // One TLS record buffer: 16 KB of content plus header and MAC
+
+struct NetArenaStats
+{
+    bool active;          // mbedTLS allocates from the arena
+    uint32_t capacity;    // Bytes of slots
+    uint32_t inUse;       // Bytes of slots handed out
+    uint32_t highWater;   // Most bytes in use at once
+    uint32_t allocations; // Served from the arena, since boot
+    uint32_t fallbacks;   // Went to the heap: too large, or their class full
+};
+
+bool netArenaBegin();
+
+NetArenaStats netArenaGetStats();
+
+#endif // NET_ARENA_H
@@ -0,0 +1,294 @@
+/*
+Opus Encoder Stage
+==================
+
+See opus_stage.h.
+*/
+
+#include "opus_stage.h"
+#include "audio_packet.h"
+#include "telemetry.h"
+
+#if AUDIO_USE_OPUS
+
+#include <opus.h>
+
+static OpusStageConfig stageConfig;
+static OpusEncoder *encoder = NULL;
+static TaskHandle_t encoderTask = NULL;
+static PacketRing pcmRing;
+
+// Frame being assembled from capture blocks
+static int16_t *frame = NULL;
+static int frameSamples = 0;
+static int frameFill = 0;
+static uint32_t frameTimestamp = 0; // Capture timestamp of the frame's first sample
+
+// Capture side: slot returned by the last opusStageAcquireBlock()
+static uint8_t *acquiredSlot = NULL;
+
+// Parameters requested from other tasks, applied at a frame boundary
+static volatile int pendingFrameMs = OPUS_DEFAULT_FRAME_MS;
+static volatile int pendingBitrate = OPUS_DEFAULT_BITRATE;
+static volatile bool paramsPending = false;
+static volatile bool resetPending = false;
+static volatile bool encoding = false;
+
+static OpusStageStats stats;
+
+// PCM ring entries: [timestamp(4), marker fields | padding][samples]. Entries
+// with this length bit set carry a silence state instead of samples.
+#define SILENCE_MARKER 0x80000000u
+#define BLOCK_META_SIZE 16 // Keeps the samples aligned for the SIMD kernel
+
+static uint32_t readU32(const uint8_t *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void writeU32(uint8_t *p, uint32_t value)
+{
+    p[0] = (value >> 24) & 0xFF;
+    p[1] = (value >> 16) & 0xFF;
+    p[2] = (value >> 8) & 0xFF;
+    p[3] = value & 0xFF;
+}
+
+static bool validFrameMs(int frameMs)
+{
+    return frameMs == 10 || frameMs == 20 || frameMs == 40 || frameMs == OPUS_MAX_FRAME_MS;
+}
+
+// Encode the assembled frame into a packet ring slot
+static void encodeFrame()
+{
+    uint16_t seq = (*stageConfig.sequence)++;
+
+    uint8_t *slot = stageConfig.packets->acquire();
+    if (!slot)
+    {
+        stats.ringOverruns++; // Sequence already advanced, so the gap is visible
+        return;
+    }
+
+    uint8_t *payload = slot + SLOT_PAYLOAD_OFFSET;
+    uint32_t encodeStart = telemetryStart();
+    opus_int32 bytes = opus_encode(encoder, frame, frameSamples, payload, stageConfig.maxPayload);
+    telemetryRecord(TELEMETRY_ENCODE, encodeStart);
+    if (bytes < 0)
+    {
+        stats.errors++;
+        return;
+    }
+
+    writePacketHeader(slot + SLOT_PACKET_OFFSET, PACKET_TYPE_AUDIO_OPUS, seq, frameSamples,
+                      packetCrc32(payload, bytes), frameTimestamp);
+    stageConfig.packets->commit(PACKET_HEADER_SIZE + bytes);
+    xTaskNotifyGive(stageConfig.networkTask);
+    stats.frames++;
+}
+
+// Pass a VAD silence state through in order with the audio around it
+static void emitSilence(uint8_t state, uint16_t noiseRms, uint32_t timestamp)
+{
+    // Finish the frame in progress so the word tail goes out before the marker
+    if (frameFill > 0)
+    {
+        memset(frame + frameFill, 0, (frameSamples - frameFill) * sizeof(int16_t));
+        encodeFrame();
+        frameFill = 0;
+    }
+
+    uint16_t seq = (*stageConfig.sequence)++;
+    uint8_t *slot = stageConfig.packets->acquire();
+    if (!slot)
+    {
+        stats.ringOverruns++;
+        return;
+    }
+    stageConfig.packets->commit(writeSilencePacket(slot + SLOT_PACKET_OFFSET, seq, state, noiseRms, timestamp));
+    xTaskNotifyGive(stageConfig.networkTask);
+}
+
+static void applyPendingParams()
+{
+    if (resetPending)
+    {
+        resetPending = false;
+        frameFill = 0;
+        opus_encoder_ctl(encoder, OPUS_RESET_STATE);
+    }
+
+    // Frame size may only change between frames
+    if (!paramsPending || frameFill != 0)
+        return;
+    paramsPending = false;
+
+    stats.frameMs = pendingFrameMs;
+    stats.bitrate = pendingBitrate;
+    frameSamples = stageConfig.sampleRate / 1000 * stats.frameMs;
+    opus_encoder_ctl(encoder, OPUS_SET_BITRATE(stats.bitrate));
+}
+
+static void opusEncoderTask(void *parameter)
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        size_t length;
+        uint8_t *block;
+        while ((block = pcmRing.peek(&length)) != NULL)
+        {
+            encoding = true;
+            applyPendingParams();
+
+            uint32_t timestamp = readU32(block);
+            if (length & SILENCE_MARKER)
+            {
+                emitSilence(block[4], (block[5] << 8) | block[6], timestamp);
+                pcmRing.release();
+                continue;
+            }
+
+            // Re-frame capture blocks into Opus frames
+            const int16_t *samples = (const int16_t *)(block + BLOCK_META_SIZE);
+            int remaining = length / sizeof(int16_t);
+            while (remaining > 0)
+            {
+                if (frameFill == 0)
+                    frameTimestamp = timestamp + (samples - (const int16_t *)(block + BLOCK_META_SIZE));
+                int take = min(remaining, frameSamples - frameFill);
+                memcpy(frame + frameFill, samples, take * sizeof(int16_t));
+                frameFill += take;
+                samples += take;
+                remaining -= take;
+
+                if (frameFill == frameSamples)
+                {
+                    encodeFrame();
+                    frameFill = 0;
+                    applyPendingParams();
+                }
+            }
+
+            pcmRing.release();
+        }
+        encoding = false;
+    }
+}
+
+bool opusStageBegin(const OpusStageConfig &config)
+{
+    stageConfig = config;
+
+    int err;
+    encoder = opus_encoder_create(config.sampleRate, 1, OPUS_APPLICATION_VOIP, &err);
+    if (err != OPUS_OK || !encoder)
+    {
+        Serial.printf("Failed to create Opus encoder: %d\n", err);
+        return false;
+    }
+    opus_encoder_ctl(encoder, OPUS_SET_VBR(1));
+    opus_encoder_ctl(encoder, OPUS_SET_SIGNAL(OPUS_SIGNAL_VOICE));
+    opus_encoder_ctl(encoder, OPUS_SET_COMPLEXITY(3)); // Keeps a 20 ms frame well inside real time
+    opus_encoder_ctl(encoder, OPUS_SET_BITRATE(OPUS_DEFAULT_BITRATE));
+
+    frame = (int16_t *)malloc(config.sampleRate / 1000 * OPUS_MAX_FRAME_MS * sizeof(int16_t));
+    if (!frame || !pcmRing.begin(OPUS_PCM_RING_SLOTS, BLOCK_META_SIZE + config.blockSamples * sizeof(int16_t)))
+    {
+        Serial.println("Failed to allocate Opus stage buffers");
+        return false;
+    }
+
+    stats.frameMs = OPUS_DEFAULT_FRAME_MS;
+    stats.bitrate = OPUS_DEFAULT_BITRATE;
+    frameSamples = config.sampleRate / 1000 * OPUS_DEFAULT_FRAME_MS;
+
+    if (xTaskCreatePinnedToCore(opusEncoderTask, "OpusEncoder", config.stackSize, NULL,
+                                config.priority, &encoderTask, config.core) != pdPASS)
+    {
+        Serial.println("Failed to start Opus encoder task");
+        return false;
+    }
+    return true;
+}
+
+int16_t *opusStageAcquireBlock()
+{
+    if (!encoderTask)
+        return NULL;
+    acquiredSlot = pcmRing.acquire();
+    if (!acquiredSlot)
+    {
+        stats.pcmOverruns++;
+        return NULL;
+    }
+    return (int16_t *)(acquiredSlot + BLOCK_META_SIZE);
+}
+
+void opusStageCommitBlock(int numSamples, uint32_t timestamp)
+{
+    writeU32(acquiredSlot, timestamp);
+    pcmRing.commit(numSamples * sizeof(int16_t));
+    xTaskNotifyGive(encoderTask);
+}
+
+void opusStageSilence(uint8_t state, uint16_t noiseRms, uint32_t timestamp)
+{
+    uint8_t *slot = encoderTask ? pcmRing.acquire() : NULL;
+    if (!slot)
+    {
+        stats.pcmOverruns++;
+        return;
+    }
+    writeU32(slot, timestamp);
+    slot[4] = state;
+    slot[5] = (noiseRms >> 8) & 0xFF;
+    slot[6] = noiseRms & 0xFF;
+    pcmRing.commit(SILENCE_MARKER);
+    xTaskNotifyGive(encoderTask);
+}
+
+void opusStageReset()
+{
+    resetPending = true;
+}
+
+bool opusStageSetParams(int frameMs, int bitrate)
+{
+    if (frameMs == 0)
+        frameMs = pendingFrameMs;
+    if (bitrate == 0)
+        bitrate = pendingBitrate;
+    if (!validFrameMs(frameMs) || bitrate < OPUS_MIN_BITRATE || bitrate > OPUS_MAX_BITRATE)
+        return false;
+
+    pendingFrameMs = frameMs;
+    pendingBitrate = bitrate;
+    paramsPending = true;
+    return true;
+}
+
+bool opusStageIdle()
+{
+    return !encoding && pcmRing.depth() == 0;
+}
+
+OpusStageStats opusStageGetStats()
+{
+    return stats;
+}
+
+#else // !AUDIO_USE_OPUS
+
+bool opusStageBegin(const OpusStageConfig &config) { return false; }
+int16_t *opusStageAcquireBlock() { return NULL; }
+void opusStageCommitBlock(int numSamples, uint32_t timestamp) {}
+void opusStageSilence(uint8_t state, uint16_t noiseRms, uint32_t timestamp) {}
+void opusStageReset() {}
+bool opusStageSetParams(int frameMs, int bitrate) { return false; }
+bool opusStageIdle() { return true; }
+OpusStageStats opusStageGetStats() { return OpusStageStats(); }
+
+#endif
@@ -0,0 +1,86 @@
+/*
+Opus Encoder Stage
+==================
+
+Low-latency Opus voice encoding in its own FreeRTOS task.
+
+The capture task converts each DMA block straight into a slot of the stage's
+PCM ring and commits it. The encoder task re-frames the samples into Opus
+frames (10/20/40/60 ms), encodes them at the configured VBR bitrate and writes
+PACKET_TYPE_AUDIO_OPUS packets into the shared packet ring for the network task.
+
+While Opus is the active codec the encoder task is the only producer on the
+packet ring; the capture task waits for opusStageIdle() before producing
+into it again after switching away.
+
+Needs the arduino-libopus library and -DAUDIO_USE_OPUS=1. Without it every
+function is a no-op and opusStageBegin() returns false.
+*/
+
+#ifndef OPUS_STAGE_H
+#define OPUS_STAGE_H
+
+#include <Arduino.h>
+#include "packet_ring.h"
+
+#ifndef AUDIO_USE_OPUS
+#define AUDIO_USE_OPUS 0
+#endif
+
+#define OPUS_DEFAULT_FRAME_MS 20    // Opus frame duration
+#define OPUS_DEFAULT_BITRATE 16000  // VBR target in bit/s
+#define OPUS_MIN_BITRATE 6000
+#define OPUS_MAX_BITRATE 64000
+#define OPUS_MAX_FRAME_MS 60
+#define OPUS_PCM_RING_SLOTS 8       // Capture blocks queued ahead of the encoder
+
+struct OpusStageConfig
+{
+    PacketRing *packets;          // Output ring shared with the capture task
+    TaskHandle_t networkTask;     // Notified after each committed packet
+    volatile uint16_t *sequence;  // Shared packet sequence counter
+    uint32_t sampleRate;          // 8000, 12000, 16000, 24000 or 48000
+    int blockSamples;             // Largest capture block handed to the stage
+    size_t maxPayload;            // Payload bytes available in a packet slot
+    BaseType_t core;              // Core the encoder task is pinned to
+    UBaseType_t priority;         // Encoder task priority
+    uint32_t stackSize;           // Encoder task stack (Opus needs a deep one)
+};
+
+struct OpusStageStats
+{
+    uint32_t frames;       // Opus packets committed
+    uint32_t pcmOverruns;  // Capture blocks dropped because the stage was behind
+    uint32_t ringOverruns; // Frames dropped because the packet ring was full
+    uint32_t errors;       // opus_encode failures
+    int frameMs;           // Current frame duration
+    int bitrate;           // Current bitrate
+};
+
+// Create the encoder and its task
+bool opusStageBegin(const OpusStageConfig &config);
+
+// Capture side: slot for up to blockSamples native-endian samples, or NULL if full
+int16_t *opusStageAcquireBlock();
+
+// Capture side: publish the slot from opusStageAcquireBlock() and wake the encoder.
+// timestamp is the capture sample clock of the block's first sample.
+void opusStageCommitBlock(int numSamples, uint32_t timestamp);
+
+// Capture side: queue a VAD silence start/stop behind the blocks already committed.
+// The encoder task flushes the partial frame and emits a PACKET_TYPE_SILENCE packet.
+void opusStageSilence(uint8_t state, uint16_t noiseRms, uint32_t timestamp);
+
+// Drop any partial frame and encoder history before the next block (on codec switch)
+void opusStageReset();
+
+// Change frame duration and/or bitrate (0 keeps the current value).
+// Applied by the encoder task at the next frame boundary. Returns false if invalid.
+bool opusStageSetParams(int frameMs, int bitrate);
+
+// True when no PCM is queued and no frame is being encoded
+bool opusStageIdle();
+
+OpusStageStats opusStageGetStats();
+
+#endif // OPUS_STAGE_H
@@ -0,0 +1,112 @@
+/*
+Packet Ring
+===========
+
+Fixed-capacity lock-free single-producer/single-consumer ring of preallocated
+packet slots. The capture task is the only producer and the network task is
+the only consumer, so plain acquire/release atomics on the two indices are
+enough - no locks, no allocation after begin().
+
+Slots live in PSRAM when available and are 16-byte aligned.
+*/
+
+#ifndef PACKET_RING_H
+#define PACKET_RING_H
+
+#include <Arduino.h>
+#include <atomic>
+
+#define PACKET_RING_ALIGN 16
+
+class PacketRing
+{
+public:
+    // Allocate slotCount slots of slotSize bytes each (rounded up to the alignment).
+    // slotCount must be a power of two so the free-running indices wrap cleanly.
+    bool begin(size_t slotCount, size_t slotSize)
+    {
+        if (slotCount == 0 || (slotCount & (slotCount - 1)) != 0)
+            return false;
+        slotStride = (slotSize + PACKET_RING_ALIGN - 1) & ~(size_t)(PACKET_RING_ALIGN - 1);
+        capacity = slotCount;
+
+        storage = (uint8_t *)heap_caps_aligned_alloc(PACKET_RING_ALIGN, slotStride * capacity, MALLOC_CAP_SPIRAM);
+        if (!storage)
+            storage = (uint8_t *)heap_caps_aligned_alloc(PACKET_RING_ALIGN, slotStride * capacity, MALLOC_CAP_8BIT);
+        lengths = (size_t *)calloc(capacity, sizeof(size_t));
+        if (!storage || !lengths)
+        {
+            end();
+            return false;
+        }
+        head.store(0);
+        tail.store(0);
+        return true;
+    }
+
+    void end()
+    {
+        if (storage)
+            heap_caps_free(storage);
+        free(lengths);
+        storage = NULL;
+        lengths = NULL;
+        capacity = 0;
+    }
+
+    // Producer: get the next free slot, or NULL (and count an overrun) if full
+    uint8_t *acquire()
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        if (h - tail.load(std::memory_order_acquire) >= capacity)
+        {
+            overruns++;
+            return NULL;
+        }
+        return slotAt(h);
+    }
+
+    // Producer: publish the slot returned by acquire()
+    void commit(size_t length)
+    {
+        uint32_t h = head.load(std::memory_order_relaxed);
+        lengths[h & (capacity - 1)] = length;
+        head.store(h + 1, std::memory_order_release);
+        pushed++;
+    }
+
+    // Consumer: oldest published slot, or NULL if empty
+    uint8_t *peek(size_t *length)
+    {
+        uint32_t t = tail.load(std::memory_order_relaxed);
+        if (t == head.load(std::memory_order_acquire))
+            return NULL;
+        *length = lengths[t & (capacity - 1)];
+        return slotAt(t);
+    }
+
+    // Consumer: hand the slot returned by peek() back to the producer
+    void release()
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    size_t depth() const { return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire); }
+    size_t size() const { return capacity; }
+
+    // Counters - written by the producer only, read anywhere
+    volatile uint32_t pushed = 0;   // Slots committed
+    volatile uint32_t overruns = 0; // Packets dropped because the ring was full
+
+private:
+    uint8_t *slotAt(uint32_t index) const { return storage + (index & (capacity - 1)) * slotStride; }
+
+    uint8_t *storage = NULL;
+    size_t *lengths = NULL;
+    size_t slotStride = 0;
+    size_t capacity = 0;
+    std::atomic<uint32_t> head{0}; // Next slot to write (producer)
+    std::atomic<uint32_t> tail{0}; // Next slot to read (consumer)
+};
+
+#endif // PACKET_RING_H
@@ -0,0 +1,265 @@
+/*
+Person Detection Gate
+=====================
+
+See person_detect.h.
+*/
+
+#include "person_detect.h"
+#include "video_capture.h"
+
+#if AUDIO_PERSON_DETECT && AUDIO_USE_CAMERA
+
+#include <atomic>
+#include "esp_heap_caps.h"
+#include "esp_timer.h"
+#include "img_converters.h"
+#include "tensorflow/lite/micro/micro_interpreter.h"
+#include "tensorflow/lite/micro/micro_mutable_op_resolver.h"
+#include "tensorflow/lite/schema/schema_generated.h"
+
+#define PERSON_INDEX 1 // Model output: [no person, person]
+
+extern const unsigned char g_person_detect_model_data[]; // person_detect_model_data.cc
+
+static TaskHandle_t detectorTask = NULL;
+static tflite::MicroInterpreter *interpreter = NULL;
+static uint8_t *arena = NULL;
+
+// Frame handed over by the camera task. Its owner is whoever busy says.
+static uint8_t *jpegCopy = NULL;
+static size_t jpegLength = 0;
+static uint16_t jpegWidth = 0, jpegHeight = 0;
+static std::atomic<bool> busy(false);
+static uint32_t lastOffer = 0; // Camera task only
+
+// Detector task only: the decoded, downscaled frame
+static uint8_t *rgb = NULL;
+static size_t rgbSize = 0;
+
+static std::atomic<bool> enabled(false);
+static std::atomic<int> threshold(PERSON_DETECT_DEFAULT_THRESHOLD);
+static std::atomic<uint8_t> lastScore(0);
+static std::atomic<uint32_t> lastDetected(0); // millis() of the last detection
+static std::atomic<bool> detectedOnce(false);
+
+static PersonDetectStats stats; // Detector task
+
+// Sample the centre square of the RGB565 frame into the model's int8 input
+static void fillInput(int8_t *input, int width, int height)
+{
+    int side = min(width, height);
+    int x0 = (width - side) / 2;
+    int y0 = (height - side) / 2;
+    for (int y = 0; y < PERSON_DETECT_INPUT_SIZE; y++)
+    {
+        const uint8_t *row = rgb + (size_t)(y0 + y * side / PERSON_DETECT_INPUT_SIZE) * width * 2;
+        for (int x = 0; x < PERSON_DETECT_INPUT_SIZE; x++)
+        {
+            const uint8_t *pixel = row + (x0 + x * side / PERSON_DETECT_INPUT_SIZE) * 2;
+            int r = pixel[0] & 0xF8; // High byte first, as jpg2rgb565 writes it
+            int g = ((pixel[0] & 0x07) << 5) | ((pixel[1] & 0xE0) >> 3);
+            int b = (pixel[1] & 0x1F) << 3;
+            int gray = (r * 77 + g * 150 + b * 29) >> 8;
+            *input++ = (int8_t)(gray - 128);
+        }
+    }
+}
+
+// Decode the copied frame at the smallest scale that still covers the input
+static bool decodeFrame(int *width, int *height)
+{
+    int shift = 3;
+    while (shift > 0 && ((jpegWidth >> shift) < PERSON_DETECT_INPUT_SIZE ||
+                         (jpegHeight >> shift) < PERSON_DETECT_INPUT_SIZE))
+        shift--;
+    *width = jpegWidth >> shift;
+    *height = jpegHeight >> shift;
+    if (*width < PERSON_DETECT_INPUT_SIZE || *height < PERSON_DETECT_INPUT_SIZE)
+        return false;
+
+    size_t needed = (size_t)*width * *height * 2;
+    if (needed > rgbSize)
+    {
+        uint8_t *grown = (uint8_t *)heap_caps_realloc(rgb, needed, MALLOC_CAP_SPIRAM);
+        if (!grown)
+            return false;
+        rgb = grown;
+        rgbSize = needed;
+    }
+    return jpg2rgb565(jpegCopy, jpegLength, rgb, (jpg_scale_t)shift);
+}
+
+static void runDetection()
+{
+    int64_t start = esp_timer_get_time();
+    int width, height;
+    bool decoded = decodeFrame(&width, &height);
+    busy.store(false, std::memory_order_release); // The copy is free for the next frame
+    if (!decoded)
+    {
+        stats.failures++;
+        return;
+    }
+    TfLiteTensor *input = interpreter->input(0);
+    fillInput(input->data.int8, width, height);
+    int64_t decodedAt = esp_timer_get_time();
+
+    if (interpreter->Invoke() != kTfLiteOk)
+    {
+        stats.failures++;
+        return;
+    }
+    TfLiteTensor *output = interpreter->output(0);
+    float probability = (output->data.int8[PERSON_INDEX] - output->params.zero_point) * output->params.scale;
+    int score = constrain((int)(probability * 255.0f + 0.5f), 0, 255);
+
+    stats.decodeUs = decodedAt - start;
+    stats.inferUs = esp_timer_get_time() - decodedAt;
+    stats.runs++;
+    stats.lastScore = score;
+    lastScore.store(score, std::memory_order_relaxed);
+    if (score * 100 >= threshold.load(std::memory_order_relaxed) * 255)
+    {
+        stats.positives++;
+        lastDetected.store(millis(), std::memory_order_relaxed);
+        detectedOnce.store(true, std::memory_order_release);
+    }
+}
+
+static void detectorTaskLoop(void *parameter)
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        if (busy.load(std::memory_order_acquire))
+            runDetection();
+    }
+}
+
+bool personDetectBegin(const PersonDetectConfig &config)
+{
+    const tflite::Model *model = tflite::GetModel(g_person_detect_model_data);
+    if (model->version() != TFLITE_SCHEMA_VERSION)
+    {
+        Serial.printf("Person model schema %u, expected %d\n", model->version(), TFLITE_SCHEMA_VERSION);
+        return false;
+    }
+
+    // Only the ops the person-detection model uses; the ESP-NN build swaps in its kernels
+    static tflite::MicroMutableOpResolver<5> resolver;
+    resolver.AddAveragePool2D();
+    resolver.AddConv2D();
+    resolver.AddDepthwiseConv2D();
+    resolver.AddReshape();
+    resolver.AddSoftmax();
+
+    arena = (uint8_t *)heap_caps_aligned_alloc(16, PERSON_DETECT_ARENA_BYTES, MALLOC_CAP_SPIRAM);
+    jpegCopy = (uint8_t *)heap_caps_malloc(VIDEO_MAX_FRAME_BYTES, MALLOC_CAP_SPIRAM);
+    if (!arena || !jpegCopy)
+    {
+        Serial.println("Failed to allocate person detection buffers");
+        return false;
+    }
+    static tflite::MicroInterpreter staticInterpreter(model, resolver, arena, PERSON_DETECT_ARENA_BYTES);
+    interpreter = &staticInterpreter;
+    if (interpreter->AllocateTensors() != kTfLiteOk)
+    {
+        Serial.println("Person model does not fit the tensor arena");
+        interpreter = NULL;
+        return false;
+    }
+    TfLiteTensor *input = interpreter->input(0);
+    if (input->type != kTfLiteInt8 || input->bytes != PERSON_DETECT_INPUT_SIZE * PERSON_DETECT_INPUT_SIZE)
+    {
+        Serial.println("Person model is not 96x96 int8 grayscale");
+        interpreter = NULL;
+        return false;
+    }
+
+    if (xTaskCreatePinnedToCore(detectorTaskLoop, "PersonDetect", config.stackSize, NULL,
+                                config.priority, &detectorTask, config.core) != pdPASS)
+    {
+        Serial.println("Failed to start person detection task");
+        interpreter = NULL;
+        return false;
+    }
+    return true;
+}
+
+bool personDetectAvailable()
+{
+    return detectorTask != NULL;
+}
+
+bool personDetectSetEnabled(bool on)
+{
+    if (on && !detectorTask)
+        return false;
+    if (on && !personDetectEnabled())
+        detectedOnce.store(false); // Closed until the model has seen someone
+    enabled.store(on, std::memory_order_release);
+    return true;
+}
+
+bool personDetectEnabled()
+{
+    return enabled.load(std::memory_order_acquire);
+}
+
+bool personDetectSetThreshold(int percent)
+{
+    if (percent < PERSON_DETECT_MIN_THRESHOLD || percent > PERSON_DETECT_MAX_THRESHOLD)
+        return false;
+    threshold.store(percent);
+    return true;
+}
+
+int personDetectThreshold()
+{
+    return threshold.load();
+}
+
+void personDetectOffer(const uint8_t *jpeg, size_t length, uint16_t width, uint16_t height)
+{
+    if (!personDetectEnabled() || length > VIDEO_MAX_FRAME_BYTES || busy.load(std::memory_order_acquire) ||
+        millis() - lastOffer < PERSON_DETECT_INTERVAL_MS)
+        return;
+    lastOffer = millis();
+    memcpy(jpegCopy, jpeg, length);
+    jpegLength = length;
+    jpegWidth = width;
+    jpegHeight = height;
+    busy.store(true, std::memory_order_release);
+    xTaskNotifyGive(detectorTask);
+}
+
+bool personDetectPresent(uint8_t *score)
+{
+    *score = lastScore.load(std::memory_order_relaxed);
+    return detectedOnce.load(std::memory_order_acquire) &&
+           millis() - lastDetected.load(std::memory_order_relaxed) < PERSON_DETECT_HOLD_MS;
+}
+
+PersonDetectStats personDetectGetStats()
+{
+    return stats;
+}
+
+#else // !(AUDIO_PERSON_DETECT && AUDIO_USE_CAMERA)
+
+bool personDetectBegin(const PersonDetectConfig &config) { return false; }
+bool personDetectAvailable() { return false; }
+bool personDetectSetEnabled(bool enabled) { return !enabled; }
+bool personDetectEnabled() { return false; }
+bool personDetectSetThreshold(int percent) { return false; }
+int personDetectThreshold() { return 0; }
+void personDetectOffer(const uint8_t *jpeg, size_t length, uint16_t width, uint16_t height) {}
+bool personDetectPresent(uint8_t *score)
+{
+    *score = 0;
+    return true;
+}
+PersonDetectStats personDetectGetStats() { return PersonDetectStats(); }
+
+#endif
@@ -0,0 +1,91 @@
+/*
+Person Detection Gate
+=====================
+
+Optional on-device check that someone is in the picture, so the camera
+stream carries people and not foliage, shadows and lighting changes.
+
+The camera task offers each JPEG frame with personDetectOffer(). When the
+detector is idle and PERSON_DETECT_INTERVAL_MS has passed, the frame is
+copied out and the detector task is woken. The frame buffer goes back to the
+driver right after that, as before. The detector task (core 0, next to the
+camera task) then:
+- decodes the JPEG at 1/2, 1/4 or 1/8 scale, whichever is smallest but still
+  at least 96 pixels on both sides,
+- takes the centre square to 96x96 grayscale, as the model expects,
+- runs the int8 person-detection model with TensorFlow Lite Micro. On the
+  S3 the ESP-NN kernels do the convolutions with the vector instructions.
+
+The score is the model's person probability, scaled to 0-255. A score at or
+above the threshold counts as a detection. Frames are sent while a detection
+is less than PERSON_DETECT_HOLD_MS old, and the gate closes after that. The
+frame that triggers a detection is not sent, because the model runs after it
+has gone, but the frames that follow are. Each video packet carries the
+latest score in the byte after quality (audio_packet.h), or 0 when the gate
+is off.
+
+Needs esp-tflite-micro (with ESP-NN), the camera (-DAUDIO_USE_CAMERA=1) and
+-DAUDIO_PERSON_DETECT=1. The model is g_person_detect_model_data[]: copy
+person_detect_model_data.cc from the TFLM person_detection example into src/.
+Without it every function is a no-op and personDetectBegin() returns false.
+{"command":"person","enabled":true,"threshold":60} switches the gate at
+runtime; the threshold is a percentage.
+*/
+
+#ifndef PERSON_DETECT_H
+#define PERSON_DETECT_H
+
+#include <Arduino.h>
+
+#ifndef AUDIO_PERSON_DETECT
+#define AUDIO_PERSON_DETECT 0
+#endif
+
+#define PERSON_DETECT_INPUT_SIZE 96            // Model input, square grayscale
+#define PERSON_DETECT_ARENA_BYTES (128 * 1024) // TFLM tensor arena, in PSRAM
+#define PERSON_DETECT_INTERVAL_MS 200          // At most 5 inferences a second
+#define PERSON_DETECT_HOLD_MS 3000             // Frames keep going this long after a detection
+#define PERSON_DETECT_DEFAULT_THRESHOLD 60     // Percent
+#define PERSON_DETECT_MIN_THRESHOLD 1
+#define PERSON_DETECT_MAX_THRESHOLD 99
+
+struct PersonDetectConfig
+{
+    BaseType_t core;      // Core the detector task is pinned to
+    UBaseType_t priority; // Detector task priority
+    uint32_t stackSize;   // Detector task stack
+};
+
+struct PersonDetectStats
+{
+    uint32_t runs;      // Inferences
+    uint32_t positives; // Inferences at or above the threshold
+    uint32_t failures;  // Frames that did not decode, or a failed inference
+    uint32_t decodeUs;  // JPEG decode and downscale of the last run
+    uint32_t inferUs;   // Model run of the last run
+    uint8_t lastScore;  // 0-255
+};
+
+// Load the model, allocate the arena and start the detector task
+bool personDetectBegin(const PersonDetectConfig &config);
+
+bool personDetectAvailable();
+
+// Any task. Enabling fails without a model. The gate starts closed.
+bool personDetectSetEnabled(bool enabled);
+bool personDetectEnabled();
+
+// Any task; false if out of range
+bool personDetectSetThreshold(int percent);
+int personDetectThreshold();
+
+// Camera task: a JPEG frame, copied for the detector when it is idle and due
+void personDetectOffer(const uint8_t *jpeg, size_t length, uint16_t width, uint16_t height);
+
+// Camera task: true while the last detection is within the hold time.
+// *score is the latest score either way.
+bool personDetectPresent(uint8_t *score);
+
+PersonDetectStats personDetectGetStats();
+
+#endif // PERSON_DETECT_H
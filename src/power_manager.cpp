@@ -0,0 +1,144 @@
+/*
+Power Manager
+=============
+
+See power_manager.h.
+*/
+
+#include "power_manager.h"
+#include <esp_pm.h>
+#include <esp_timer.h>
+#include <esp_wifi.h>
+#include <atomic>
+
+static esp_pm_lock_handle_t captureLock = NULL;
+static std::atomic<PowerMode> mode{POWER_MODE_PERFORMANCE};
+static bool lightSleep = false;
+
+// Capture task -> loop()
+static std::atomic<bool> voiceActive{false};
+static std::atomic<uint32_t> activeUs{0}; // Lock held time in the current window
+static int64_t activeSince = 0;            // Capture task only
+
+// loop() only
+static bool modemSleeping = false;
+static bool psApplied = false; // Driver setting matches modemSleeping
+static int64_t modemSleepSince = 0;
+static int64_t modemSleepUs = 0;
+static int64_t windowStart = 0;
+
+static bool configure(PowerMode next)
+{
+    esp_pm_config_esp32s3_t config = {
+        .max_freq_mhz = POWER_CPU_MAX_MHZ,
+        .min_freq_mhz = next == POWER_MODE_SAVE ? POWER_CPU_MIN_MHZ : POWER_CPU_MAX_MHZ,
+        .light_sleep_enable = next == POWER_MODE_SAVE};
+    esp_err_t err = esp_pm_configure(&config);
+    lightSleep = err == ESP_OK && config.light_sleep_enable;
+    if (err == ESP_ERR_NOT_SUPPORTED && config.light_sleep_enable)
+    {
+        // No tickless idle in this build - frequency scaling only
+        config.light_sleep_enable = false;
+        err = esp_pm_configure(&config);
+    }
+    if (err != ESP_OK)
+    {
+        Serial.printf("Power: PM config rejected: %s\n", esp_err_to_name(err));
+        return false;
+    }
+    Serial.printf("Power: %s mode, CPU %d-%d MHz, light sleep %s\n", powerModeName(next),
+                  config.min_freq_mhz, config.max_freq_mhz, lightSleep ? "on" : "off");
+    return true;
+}
+
+void powerManagerBegin(PowerMode initial)
+{
+    if (esp_pm_lock_create(ESP_PM_CPU_FREQ_MAX, 0, "capture", &captureLock) != ESP_OK)
+        Serial.println("Power: failed to create the capture PM lock");
+    windowStart = esp_timer_get_time();
+    powerManagerSetMode(initial);
+}
+
+bool powerManagerSetMode(PowerMode next)
+{
+    if (!configure(next))
+        return false;
+    mode.store(next);
+    psApplied = false; // loop() brings the modem in line
+    return true;
+}
+
+PowerMode powerManagerMode()
+{
+    return mode.load();
+}
+
+void powerActiveBegin()
+{
+    if (captureLock)
+        esp_pm_lock_acquire(captureLock);
+    activeSince = esp_timer_get_time();
+}
+
+void powerActiveEnd()
+{
+    activeUs.fetch_add((uint32_t)(esp_timer_get_time() - activeSince));
+    if (captureLock)
+        esp_pm_lock_release(captureLock);
+}
+
+void powerSetVoiceActive(bool active)
+{
+    voiceActive.store(active, std::memory_order_relaxed);
+}
+
+void powerManagerLoop(bool linkUp)
+{
+    // Performance mode keeps the core's default (WIFI_PS_MIN_MODEM)
+    bool sleep = mode.load() == POWER_MODE_SAVE && !voiceActive.load(std::memory_order_relaxed);
+    if (!linkUp || (psApplied && sleep == modemSleeping))
+        return;
+
+    if (esp_wifi_set_ps(sleep ? WIFI_PS_MAX_MODEM : WIFI_PS_MIN_MODEM) != ESP_OK)
+        return; // Retried on the next pass
+    int64_t now = esp_timer_get_time();
+    if (modemSleeping && !sleep)
+        modemSleepUs += now - modemSleepSince;
+    else if (sleep && !modemSleeping)
+        modemSleepSince = now;
+    modemSleeping = sleep;
+    psApplied = true;
+}
+
+PowerStats powerManagerGetStats()
+{
+    int64_t now = esp_timer_get_time();
+    int64_t window = max(now - windowStart, (int64_t)1);
+    if (modemSleeping)
+    {
+        modemSleepUs += now - modemSleepSince;
+        modemSleepSince = now;
+    }
+
+    PowerStats stats = {};
+    stats.mode = mode.load();
+    stats.lightSleep = lightSleep;
+    stats.windowMs = window / 1000;
+    float active = min(activeUs.exchange(0) / (float)window, 1.0f);
+    float modemSleep = min(modemSleepUs / (float)window, 1.0f);
+    stats.cpuActivePct = active * 100;
+    stats.modemSleepPct = modemSleep * 100;
+
+    float idleMa = stats.mode == POWER_MODE_SAVE ? POWER_MA_CPU_IDLE_MIN : POWER_MA_CPU_IDLE_MAX;
+    stats.estimatedMa = active * POWER_MA_CPU_MAX + (1 - active) * idleMa +
+                        modemSleep * POWER_MA_RADIO_SLEEP + (1 - modemSleep) * POWER_MA_RADIO_AWAKE;
+
+    modemSleepUs = 0;
+    windowStart = now;
+    return stats;
+}
+
+const char *powerModeName(PowerMode mode)
+{
+    return mode == POWER_MODE_SAVE ? "save" : "performance";
+}
@@ -0,0 +1,97 @@
+/*
+Power Manager
+=============
+
+Power-aware capture for battery deployments. The default (performance) mode
+leaves the clocks and Wi-Fi power save exactly as the Arduino core sets them.
+Save mode does the following:
+
+- Dynamic frequency scaling: the CPU runs at POWER_CPU_MIN_MHZ unless a PM lock
+  is held. The capture task holds a CPU_FREQ_MAX lock only from the DMA wakeup
+  to the end of encoding a block (powerActiveBegin / powerActiveEnd). Between
+  blocks it idles at the low clock.
+- Automatic light sleep is requested as well. The prebuilt Arduino core has no
+  tickless idle, so it usually falls back to DFS alone (see lightSleep in the
+  stats). The legacy I2S driver also holds an APB lock while it runs, so light
+  sleep can only engage while capture is stopped.
+- Modem sleep follows the VAD. While the gate is closed or the mic is off,
+  nothing is sent, so the radio goes to WIFI_PS_MAX_MODEM and wakes every few
+  beacons. Speech switches it back to WIFI_PS_MIN_MODEM. The capture task only
+  records the VAD state. loop() owns the Wi-Fi calls and applies it.
+
+There is no current sensor on the board. powerManagerGetStats() estimates the
+draw from the time spent in each state, using the POWER_MA_* figures. These
+are rough datasheet numbers; calibrate them with a meter for your board and
+override them with -D.
+*/
+
+#ifndef POWER_MANAGER_H
+#define POWER_MANAGER_H
+
+#include <Arduino.h>
+
+#define POWER_CPU_MAX_MHZ 240
+#define POWER_CPU_MIN_MHZ 80
+
+#ifndef POWER_MA_CPU_MAX
+#define POWER_MA_CPU_MAX 50.0f // CPU busy at POWER_CPU_MAX_MHZ
+#endif
+#ifndef POWER_MA_CPU_IDLE_MAX
+#define POWER_MA_CPU_IDLE_MAX 40.0f // Idle at POWER_CPU_MAX_MHZ (performance mode)
+#endif
+#ifndef POWER_MA_CPU_IDLE_MIN
+#define POWER_MA_CPU_IDLE_MIN 20.0f // Idle at POWER_CPU_MIN_MHZ (save mode)
+#endif
+#ifndef POWER_MA_RADIO_AWAKE
+#define POWER_MA_RADIO_AWAKE 60.0f // Average with WIFI_PS_MIN_MODEM while streaming
+#endif
+#ifndef POWER_MA_RADIO_SLEEP
+#define POWER_MA_RADIO_SLEEP 8.0f // Average with WIFI_PS_MAX_MODEM
+#endif
+
+enum PowerMode : uint8_t
+{
+    POWER_MODE_PERFORMANCE,
+    POWER_MODE_SAVE
+};
+
+struct PowerStats
+{
+    PowerMode mode;
+    bool lightSleep;     // Automatic light sleep was accepted by the PM driver
+    float cpuActivePct;  // Time the capture lock was held
+    float modemSleepPct; // Time the radio spent in WIFI_PS_MAX_MODEM
+    float estimatedMa;   // Average draw over the window, from the POWER_MA_* figures
+    uint32_t windowMs;   // Time covered by this sample
+};
+
+// Create the PM lock and apply the mode. Call once from setup().
+void powerManagerBegin(PowerMode mode);
+
+// Any task: switch modes. Returns false if the PM driver refused the config.
+bool powerManagerSetMode(PowerMode mode);
+PowerMode powerManagerMode();
+
+// Capture task: hold the CPU at full speed for one block
+void powerActiveBegin();
+void powerActiveEnd();
+
+// powerActiveBegin/End for one scope, so every early exit releases the lock
+struct PowerActiveScope
+{
+    PowerActiveScope() { powerActiveBegin(); }
+    ~PowerActiveScope() { powerActiveEnd(); }
+};
+
+// Capture task: VAD gate state (false also when the mic is off)
+void powerSetVoiceActive(bool active);
+
+// loop(): apply the modem power save that matches the VAD state
+void powerManagerLoop(bool linkUp);
+
+// Statistics since the previous call
+PowerStats powerManagerGetStats();
+
+const char *powerModeName(PowerMode mode);
+
+#endif // POWER_MANAGER_H
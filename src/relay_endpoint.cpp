@@ -0,0 +1,361 @@
+/*
+Relay Endpoint Selection
+========================
+
+See relay_endpoint.h.
+*/
+
+#include "relay_endpoint.h"
+#include <Preferences.h>
+#include <atomic>
+#include "lwip/dns.h"
+#include "lwip/sockets.h"
+
+#define RELAY_CACHE_MAGIC 0x52444331 // "RDC1"
+#define RELAY_CACHE_NAMESPACE "relaydns"
+#define MAX_PROBES (RELAY_MAX_ENDPOINTS * 2) // Cached and looked-up address of each
+
+struct RelayCacheEntry
+{
+    uint32_t magic;
+    char host[RELAY_HOST_MAX];
+    uint32_t ip;
+};
+
+struct Endpoint
+{
+    char host[RELAY_HOST_MAX];
+    uint16_t port;
+    bool literal;        // IP given in the list, never looked up
+    uint32_t ip;         // Last good address, 0 when unknown
+    uint32_t resolvedAt; // millis() of the lookup that gave ip, see fresh
+    bool fresh;          // ip came from a lookup this boot, not from NVS
+    bool lookupPending;
+};
+
+struct Probe
+{
+    int fd;
+    int endpoint;
+    bool fresh; // Address from a lookup, not the cache
+};
+
+static Endpoint endpoints[RELAY_MAX_ENDPOINTS];
+static int endpointCount = 0;
+static bool useTls = false;
+
+// Lookup results, written on the lwIP thread
+static std::atomic<uint32_t> lookupIp[RELAY_MAX_ENDPOINTS];
+static std::atomic<bool> lookupDone[RELAY_MAX_ENDPOINTS];
+
+static Probe probes[MAX_PROBES];
+static int probeCount = 0;
+static bool probeRequested = false;
+static bool probing = false;
+static uint32_t probeStart = 0;
+
+static RelayChoice choice;
+static char connectText[RELAY_HOST_MAX];
+static RelayEndpointStats stats;
+
+static void cacheKey(int index, char *key, size_t size)
+{
+    snprintf(key, size, "ep%d", index);
+}
+
+static void loadCache(int index)
+{
+    Endpoint &endpoint = endpoints[index];
+    char key[8];
+    cacheKey(index, key, sizeof(key));
+    RelayCacheEntry entry;
+    Preferences prefs;
+    if (prefs.begin(RELAY_CACHE_NAMESPACE, true))
+    {
+        if (prefs.getBytes(key, &entry, sizeof(entry)) == sizeof(entry) && entry.magic == RELAY_CACHE_MAGIC &&
+            strncmp(entry.host, endpoint.host, sizeof(entry.host)) == 0)
+            endpoint.ip = entry.ip;
+        prefs.end();
+    }
+}
+
+// A lookup answered: keep it, and write NVS only if the address changed
+static void storeAddress(int index, uint32_t ip)
+{
+    Endpoint &endpoint = endpoints[index];
+    endpoint.resolvedAt = millis();
+    endpoint.fresh = true;
+    if (endpoint.ip == ip)
+        return;
+    endpoint.ip = ip;
+
+    RelayCacheEntry entry = {};
+    entry.magic = RELAY_CACHE_MAGIC;
+    strncpy(entry.host, endpoint.host, sizeof(entry.host) - 1);
+    entry.ip = ip;
+    char key[8];
+    cacheKey(index, key, sizeof(key));
+    Preferences prefs;
+    if (prefs.begin(RELAY_CACHE_NAMESPACE, false))
+    {
+        prefs.putBytes(key, &entry, sizeof(entry));
+        prefs.end();
+    }
+}
+
+static void addEndpoint(const char *text, size_t length, uint16_t defaultPort)
+{
+    while (length > 0 && *text == ' ')
+    {
+        text++;
+        length--;
+    }
+    while (length > 0 && text[length - 1] == ' ')
+        length--;
+    if (length == 0 || length >= RELAY_HOST_MAX || endpointCount >= RELAY_MAX_ENDPOINTS)
+        return;
+
+    Endpoint &endpoint = endpoints[endpointCount];
+    memset(&endpoint, 0, sizeof(endpoint));
+    memcpy(endpoint.host, text, length);
+    endpoint.port = defaultPort;
+    char *colon = strrchr(endpoint.host, ':');
+    if (colon)
+    {
+        *colon = '\0';
+        endpoint.port = atoi(colon + 1);
+    }
+    IPAddress address;
+    if (address.fromString(endpoint.host))
+    {
+        endpoint.literal = true;
+        endpoint.ip = address;
+    }
+    else
+        loadCache(endpointCount);
+    endpointCount++;
+}
+
+void relayEndpointBegin(const RelayEndpointConfig &config)
+{
+    useTls = config.tls;
+    endpointCount = 0;
+    addEndpoint(config.host, strlen(config.host), config.port);
+    for (const char *item = config.fallbacks; item && *item;)
+    {
+        const char *comma = strchr(item, ',');
+        size_t length = comma ? (size_t)(comma - item) : strlen(item);
+        addEndpoint(item, length, config.port);
+        item += length + (comma ? 1 : 0);
+    }
+    for (int i = 0; i < RELAY_MAX_ENDPOINTS; i++)
+        lookupDone[i].store(false);
+}
+
+static void lookupFound(const char *name, const ip_addr_t *address, void *argument)
+{
+    int index = (int)(intptr_t)argument;
+    lookupIp[index].store(address ? ip4_addr_get_u32(ip_2_ip4(address)) : 0, std::memory_order_relaxed);
+    lookupDone[index].store(true, std::memory_order_release);
+}
+
+static void startLookup(int index)
+{
+    Endpoint &endpoint = endpoints[index];
+    ip_addr_t address;
+    lookupDone[index].store(false);
+    endpoint.lookupPending = true;
+    stats.lookups++;
+    err_t err = dns_gethostbyname(endpoint.host, &address, lookupFound, (void *)(intptr_t)index);
+    if (err == ERR_OK)
+        lookupFound(endpoint.host, &address, (void *)(intptr_t)index); // In lwIP's table already
+    else if (err != ERR_INPROGRESS)
+        lookupFound(endpoint.host, NULL, (void *)(intptr_t)index);
+}
+
+static void openProbe(int index, uint32_t ip, bool fresh)
+{
+    if (probeCount >= MAX_PROBES || ip == 0)
+        return;
+    int fd = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (fd < 0)
+        return;
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+
+    struct sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(endpoints[index].port);
+    address.sin_addr.s_addr = ip;
+    if (connect(fd, (struct sockaddr *)&address, sizeof(address)) < 0 && errno != EINPROGRESS)
+    {
+        close(fd);
+        return;
+    }
+    probes[probeCount++] = {fd, index, fresh};
+}
+
+static void closeProbes()
+{
+    for (int i = 0; i < probeCount; i++)
+        close(probes[i].fd);
+    probeCount = 0;
+}
+
+// Take in the lookups that have answered, probing any new address while a probe runs
+static void collectLookups()
+{
+    for (int i = 0; i < endpointCount; i++)
+    {
+        Endpoint &endpoint = endpoints[i];
+        if (!endpoint.lookupPending || !lookupDone[i].load(std::memory_order_acquire))
+            continue;
+        endpoint.lookupPending = false;
+        uint32_t ip = lookupIp[i].load(std::memory_order_relaxed);
+        if (ip == 0)
+            continue;
+        bool changed = ip != endpoint.ip;
+        storeAddress(i, ip);
+        if (probing && changed)
+            openProbe(i, ip, true);
+    }
+}
+
+static void startProbe()
+{
+    stats.probes++;
+    probeStart = millis();
+    for (int i = 0; i < endpointCount; i++)
+    {
+        Endpoint &endpoint = endpoints[i];
+        bool fresh = endpoint.literal || (endpoint.fresh && millis() - endpoint.resolvedAt < RELAY_DNS_TTL_MS);
+        if (fresh && !endpoint.literal)
+            stats.cacheHits++;
+        if (!fresh && !endpoint.lookupPending)
+            startLookup(i);
+        openProbe(i, endpoint.ip, fresh);
+    }
+}
+
+// Index into probes[] of the connected probe earliest in the endpoint list, or -1
+static int pollProbes()
+{
+    if (probeCount == 0)
+        return -1;
+    fd_set writable;
+    FD_ZERO(&writable);
+    int maxFd = -1;
+    for (int i = 0; i < probeCount; i++)
+    {
+        FD_SET(probes[i].fd, &writable);
+        maxFd = max(maxFd, probes[i].fd);
+    }
+    struct timeval noWait = {0, 0};
+    if (select(maxFd + 1, NULL, &writable, NULL, &noWait) <= 0)
+        return -1;
+
+    int winner = -1;
+    for (int i = 0; i < probeCount;)
+    {
+        if (!FD_ISSET(probes[i].fd, &writable))
+        {
+            i++;
+            continue;
+        }
+        int error = 0;
+        socklen_t length = sizeof(error);
+        getsockopt(probes[i].fd, SOL_SOCKET, SO_ERROR, &error, &length);
+        if (error == 0)
+        {
+            if (winner < 0 || probes[i].endpoint < probes[winner].endpoint)
+                winner = i;
+            i++;
+            continue;
+        }
+        // Refused or unreachable - out of the race
+        close(probes[i].fd);
+        probes[i] = probes[--probeCount];
+        if (winner == probeCount)
+            winner = i;
+    }
+    return winner;
+}
+
+static bool lookupsPending()
+{
+    for (int i = 0; i < endpointCount; i++)
+        if (endpoints[i].lookupPending)
+            return true;
+    return false;
+}
+
+static void finishProbe(int winner)
+{
+    choice.probeMs = millis() - probeStart;
+    if (winner >= 0)
+    {
+        const Probe &probe = probes[winner];
+        const Endpoint &endpoint = endpoints[probe.endpoint];
+        if (!probe.fresh && endpoint.lookupPending)
+            stats.staleWins++;
+        choice.index = probe.endpoint;
+        choice.host = endpoint.host;
+        choice.port = endpoint.port;
+        choice.address = IPAddress(endpoint.ip);
+        if (useTls && !endpoint.literal)
+            choice.connectHost = endpoint.host;
+        else
+        {
+            strncpy(connectText, choice.address.toString().c_str(), sizeof(connectText) - 1);
+            choice.connectHost = connectText;
+        }
+        Serial.printf("Relay endpoint: %s (%s%s) in %u ms\n", endpoint.host, choice.address.toString().c_str(),
+                      probe.fresh ? "" : ", cached", choice.probeMs);
+    }
+    else
+    {
+        stats.timeouts++;
+        choice.index = -1;
+        choice.host = choice.connectHost = endpoints[0].host;
+        choice.port = endpoints[0].port;
+        choice.address = IPAddress((uint32_t)0);
+        Serial.println("Relay endpoint: no probe answered, connecting to the primary by name");
+    }
+    closeProbes();
+    probing = false;
+}
+
+void relayEndpointProbe()
+{
+    if (!probing)
+        probeRequested = true;
+}
+
+bool relayEndpointLoop()
+{
+    collectLookups();
+    if (probeRequested)
+    {
+        probeRequested = false;
+        probing = true;
+        startProbe();
+    }
+    if (!probing)
+        return false;
+
+    int winner = pollProbes();
+    bool exhausted = probeCount == 0 && !lookupsPending(); // Nothing left that could answer
+    if (winner < 0 && !exhausted && millis() - probeStart < RELAY_PROBE_TIMEOUT_MS)
+        return false;
+    finishProbe(winner);
+    return true;
+}
+
+const RelayChoice &relayEndpointChoice()
+{
+    return choice;
+}
+
+RelayEndpointStats relayEndpointGetStats()
+{
+    return stats;
+}
@@ -0,0 +1,90 @@
+/*
+Relay Endpoint Selection
+========================
+
+Picks where the WebSocket client connects, so a reconnect does not start
+with a cold DNS lookup of the relay's name, and a dead relay does not hold
+the device offline.
+
+Endpoints are the primary host followed by RELAY_FALLBACK_HOSTS, in order:
+DNS names, IP literals, or mDNS names (name.local, resolved by lwIP's
+built-in mDNS query). Every (re)start of the client runs a probe from loop(),
+without blocking:
+- Each endpoint gets its address from the cache, and a lookup runs unless the
+  cached address is still fresh. All lookups run in parallel.
+- A non-blocking TCP connect goes to every address known, that is the cached
+  one right away and the looked-up one as soon as it arrives. The first
+  connect to complete wins and the probe sockets are closed. A tie goes to
+  the earlier endpoint in the list.
+- If nothing answers within RELAY_PROBE_TIMEOUT_MS, the client goes to the
+  primary host by name, as before.
+
+The cache holds the last good address of every endpoint:
+- In RAM it is fresh for RELAY_DNS_TTL_MS. lwIP does not hand record TTLs to
+  callers, but its own table honours them, and a lookup inside the TTL is
+  answered from that table.
+- NVS keeps it across reboots and power cycles, written only when it
+  changes. There is no wall clock at boot, so an address from NVS is never
+  trusted alone. It is probed while the lookup runs, which takes DNS off the
+  critical path, and it is replaced if the lookup disagrees.
+
+With TLS the client still connects by name, for SNI and the Host header. Its
+lookup is then answered from lwIP's table, which the probe has just filled.
+Plain ws:// connects straight to the winning address.
+
+Network task only.
+*/
+
+#ifndef RELAY_ENDPOINT_H
+#define RELAY_ENDPOINT_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+#define RELAY_MAX_ENDPOINTS 3         // Primary + fallbacks; up to two probe sockets each
+#define RELAY_HOST_MAX 64
+#define RELAY_DNS_TTL_MS 300000       // RAM cache entry skips the lookup this long
+#define RELAY_PROBE_TIMEOUT_MS 3000   // Nothing connected by then: use the primary host by name
+
+struct RelayEndpointConfig
+{
+    const char *host;      // Primary
+    uint16_t port;         // Port for endpoints given without one
+    const char *fallbacks; // "host[:port],host[:port]", may be empty
+    bool tls;              // Connect by name, see above
+};
+
+struct RelayChoice
+{
+    const char *host;        // Endpoint name as configured
+    const char *connectHost; // What to hand the WebSocket client
+    uint16_t port;
+    IPAddress address;       // 0.0.0.0 when the probe timed out
+    int index;               // Position in the list, -1 after a timeout
+    uint32_t probeMs;        // Time to the winning connect, or the timeout
+};
+
+struct RelayEndpointStats
+{
+    uint32_t probes;     // Probes run since boot
+    uint32_t cacheHits;  // Endpoints resolved from the fresh RAM cache
+    uint32_t lookups;    // DNS/mDNS queries started
+    uint32_t staleWins;  // Probes won by a cached address before its lookup finished
+    uint32_t timeouts;   // Probes where nothing answered
+};
+
+// Parse the endpoint list and load the NVS cache
+void relayEndpointBegin(const RelayEndpointConfig &config);
+
+// Ask for a new probe; it starts on the next relayEndpointLoop()
+void relayEndpointProbe();
+
+// Advance the probe; call from loop() while the link is up. True once, when
+// the probe has finished and relayEndpointChoice() holds its result.
+bool relayEndpointLoop();
+
+const RelayChoice &relayEndpointChoice();
+
+RelayEndpointStats relayEndpointGetStats();
+
+#endif // RELAY_ENDPOINT_H
@@ -0,0 +1,70 @@
+/*
+Status LED
+==========
+
+See status_led.h.
+*/
+
+#include "status_led.h"
+#include <FastLED.h>
+#include <atomic>
+
+#define LEVEL_FULL_SCALE 5000 // Block RMS shown at full brightness
+
+static std::atomic<uint8_t> audioState{STATUS_LED_MIC_OFF};
+static std::atomic<uint16_t> audioLevel{0};
+static std::atomic<bool> linkUp{false};
+static CRGB led;
+
+static CRGB renderColor()
+{
+    if (!linkUp.load(std::memory_order_relaxed))
+        return CRGB(255, 0, 0);
+
+    switch (audioState.load(std::memory_order_relaxed))
+    {
+    case STATUS_LED_MIC_OFF:
+        return CRGB(0, 0, 255);
+    case STATUS_LED_SILENT:
+        return CRGB(0, 24, 0);
+    default:
+    {
+        uint16_t level = min(audioLevel.load(std::memory_order_relaxed), (uint16_t)LEVEL_FULL_SCALE);
+        return CRGB(0, 24 + level * (255 - 24) / LEVEL_FULL_SCALE, 0);
+    }
+    }
+}
+
+static void statusLedTask(void *parameter)
+{
+    TickType_t lastWake = xTaskGetTickCount();
+    CRGB shown(1, 1, 1); // Anything but the first color, so it is written once
+    while (true)
+    {
+        led = renderColor();
+        if (led != shown)
+        {
+            FastLED.show();
+            shown = led;
+        }
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(STATUS_LED_PERIOD_MS));
+    }
+}
+
+bool statusLedBegin(int core, UBaseType_t priority)
+{
+    FastLED.addLeds<WS2812, STATUS_LED_PIN, GRB>(&led, 1);
+    FastLED.setBrightness(STATUS_LED_BRIGHTNESS);
+    return xTaskCreatePinnedToCore(statusLedTask, "StatusLed", STATUS_LED_STACK, NULL, priority, NULL, core) == pdPASS;
+}
+
+void statusLedSetAudio(StatusLedAudio audio, uint16_t level)
+{
+    audioState.store(audio, std::memory_order_relaxed);
+    audioLevel.store(level, std::memory_order_relaxed);
+}
+
+void statusLedSetLink(bool connected)
+{
+    linkUp.store(connected, std::memory_order_relaxed);
+}
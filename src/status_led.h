@@ -0,0 +1,49 @@
+/*
+Status LED
+==========
+
+Drives the DevKitC-1's addressable RGB LED from its own low-priority task, so
+the capture path never touches a peripheral. Producers only store atomics:
+
+- the capture task publishes the VAD gate and the block level
+  (statusLedSetAudio)
+- the network side publishes the connection state (statusLedSetLink)
+
+The indicator task renders about every STATUS_LED_PERIOD_MS and writes the
+LED only when the color changes.
+
+  red    not connected (audio buffers in the ring)
+  blue   connected, mic off
+  dim    connected, VAD gate closed
+  green  speech, brightness follows the level
+*/
+
+#ifndef STATUS_LED_H
+#define STATUS_LED_H
+
+#include <Arduino.h>
+
+#ifndef STATUS_LED_PIN
+#define STATUS_LED_PIN 48 // WS2812 on DevKitC-1 v1.0; v1.1 boards use 38
+#endif
+#define STATUS_LED_PERIOD_MS 50 // ~20 Hz
+#define STATUS_LED_BRIGHTNESS 64
+#define STATUS_LED_STACK 2048
+
+enum StatusLedAudio : uint8_t
+{
+    STATUS_LED_MIC_OFF,
+    STATUS_LED_SILENT,
+    STATUS_LED_SPEECH
+};
+
+// Start the indicator task
+bool statusLedBegin(int core, UBaseType_t priority);
+
+// Capture task: gate state and block RMS (0 - 32767)
+void statusLedSetAudio(StatusLedAudio audio, uint16_t level);
+
+// Network side: WebSocket connected
+void statusLedSetLink(bool connected);
+
+#endif // STATUS_LED_H
@@ -0,0 +1,103 @@
+/*
+Task Topology
+=============
+
+See task_topology.h.
+*/
+
+#include "task_topology.h"
+#include "status_led.h"
+
+#ifndef CONFIG_ARDUINO_RUNNING_CORE
+#define CONFIG_ARDUINO_RUNNING_CORE 1
+#endif
+#ifndef CONFIG_ARDUINO_LOOP_STACK_SIZE
+#define CONFIG_ARDUINO_LOOP_STACK_SIZE 8192
+#endif
+#ifndef CONFIG_FREERTOS_IDLE_TASK_STACKSIZE
+#define CONFIG_FREERTOS_IDLE_TASK_STACKSIZE 1536
+#endif
+
+const TaskTopologyEntry taskTopology[TASK_COUNT] = {
+    {"MicrophoneTask", MIC_TASK_CORE, MIC_TASK_PRIORITY, MIC_TASK_STACK},
+    {"loopTask", CONFIG_ARDUINO_RUNNING_CORE, NETWORK_TASK_PRIORITY, CONFIG_ARDUINO_LOOP_STACK_SIZE},
+    {"OpusEncoder", OPUS_TASK_CORE, OPUS_TASK_PRIORITY, OPUS_TASK_STACK},
+    {"WakeWord", WAKE_WORD_CORE, WAKE_WORD_PRIORITY, WAKE_WORD_STACK},
+    {"Monitor", MONITOR_TASK_CORE, MONITOR_TASK_PRIORITY, MONITOR_TASK_STACK},
+    {"Camera", VIDEO_TASK_CORE, VIDEO_TASK_PRIORITY, VIDEO_TASK_STACK},
+    {"PersonDetect", PERSON_TASK_CORE, PERSON_TASK_PRIORITY, PERSON_TASK_STACK},
+    {"StatusLed", STATUS_LED_CORE, STATUS_LED_PRIORITY, STATUS_LED_STACK},
+    {"IDLE", 0, 0, CONFIG_FREERTOS_IDLE_TASK_STACKSIZE},
+    {"IDLE", 1, 0, CONFIG_FREERTOS_IDLE_TASK_STACKSIZE},
+};
+
+void taskTopologyBegin()
+{
+    if (uxTaskPriorityGet(NULL) != NETWORK_TASK_PRIORITY)
+        vTaskPrioritySet(NULL, NETWORK_TASK_PRIORITY);
+}
+
+#if configUSE_TRACE_FACILITY
+
+#define TASK_TOPOLOGY_MAX_TASKS 40 // All tasks in the system, the Wi-Fi and lwIP ones included
+
+typedef decltype(TaskStatus_t::ulRunTimeCounter) RunTimeCounter;
+
+static TaskStatus_t systemTasks[TASK_TOPOLOGY_MAX_TASKS];
+#if configGENERATE_RUN_TIME_STATS
+static RunTimeCounter lastRunTime[TASK_COUNT];
+static RunTimeCounter lastTotalRunTime = 0;
+#endif
+
+// Table entry of a task in the system list, TASK_COUNT if it is not one of ours
+static int taskIdOf(const TaskStatus_t &task)
+{
+    for (int core = 0; core < 2; core++)
+        if (task.xHandle == xTaskGetIdleTaskHandleForCPU(core))
+            return TASK_IDLE_CORE0 + core;
+    for (int id = 0; id < TASK_IDLE_CORE0; id++)
+        if (strcmp(task.pcTaskName, taskTopology[id].name) == 0)
+            return id;
+    return TASK_COUNT;
+}
+
+int taskTopologySample(TaskSample *samples)
+{
+    RunTimeCounter totalRunTime = 0;
+    UBaseType_t taskCount = uxTaskGetSystemState(systemTasks, TASK_TOPOLOGY_MAX_TASKS, &totalRunTime);
+#if configGENERATE_RUN_TIME_STATS
+    RunTimeCounter window = totalRunTime - lastTotalRunTime;
+    lastTotalRunTime = totalRunTime;
+#endif
+
+    int count = 0;
+    for (UBaseType_t t = 0; t < taskCount; t++)
+    {
+        const TaskStatus_t &task = systemTasks[t];
+        int id = taskIdOf(task);
+        if (id == TASK_COUNT)
+            continue;
+        TaskSample &sample = samples[count++];
+        sample.id = (TaskId)id;
+        sample.core = taskTopology[id].core;
+        sample.priority = task.uxCurrentPriority;
+        sample.stackSize = taskTopology[id].stackSize;
+        sample.stackFreeMin = task.usStackHighWaterMark * sizeof(StackType_t);
+#if configGENERATE_RUN_TIME_STATS
+        // Run time counts on both cores against one clock, so a task pinned
+        // to one core reaches 1000 at most
+        RunTimeCounter ran = task.ulRunTimeCounter - lastRunTime[id];
+        lastRunTime[id] = task.ulRunTimeCounter;
+        sample.cpuPermille = window ? (uint16_t)min<uint64_t>((uint64_t)ran * 1000 / window, 1000) : 0;
+#else
+        sample.cpuPermille = TASK_CPU_UNKNOWN;
+#endif
+    }
+    return count;
+}
+
+#else // No uxTaskGetSystemState(): nothing to sample
+
+int taskTopologySample(TaskSample *) { return 0; }
+
+#endif
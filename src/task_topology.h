@@ -0,0 +1,164 @@
+/*
+Task Topology
+=============
+
+Where every firmware task runs: its core, priority and stack size, in one
+table, and how each of them actually behaves in the field.
+
+The placement of each task is a build flag with the default below, so a
+firmware profile sets its own split in platformio.ini, for example
+-DMIC_TASK_CORE=1 -DOPUS_TASK_CORE=0. main.cpp and the modules create their
+tasks from these values. The network side is Arduino's loop task: its core and
+stack come from the Arduino core's build (CONFIG_ARDUINO_RUNNING_CORE and
+CONFIG_ARDUINO_LOOP_STACK_SIZE), only NETWORK_TASK_PRIORITY can be set here.
+The two idle tasks are in the table too: their CPU share is the headroom left
+on each core.
+
+taskTopologySample() finds the tasks by name in the FreeRTOS task list
+(uxTaskGetSystemState(), which vTaskGetRunTimeStats() formats as text) and
+returns for each:
+- the priority it runs at, and the core it is pinned to;
+- the stack high-water mark: the fewest bytes of its stack ever left unused;
+- its CPU time since the previous sample, in permille of one core.
+A task that is not built in or not started is left out. The telemetry packet
+carries the samples (telemetry.h), so the relay can compare splits from data.
+
+The CPU share needs FreeRTOS run-time stats (CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS,
+on in the ESP32 Arduino core). Without them it reads TASK_CPU_UNKNOWN, and
+without the trace facility no task is found at all.
+*/
+
+#ifndef TASK_TOPOLOGY_H
+#define TASK_TOPOLOGY_H
+
+#include <Arduino.h>
+
+// Microphone capture task - I2S DMA, conversion, VAD and enqueue (main.cpp)
+#ifndef MIC_TASK_CORE
+#define MIC_TASK_CORE 0
+#endif
+#ifndef MIC_TASK_PRIORITY
+#define MIC_TASK_PRIORITY 1
+#endif
+#ifndef MIC_TASK_STACK
+#define MIC_TASK_STACK 10000
+#endif
+
+// Network: Arduino's loop task drains the packet ring and owns all socket I/O
+#ifndef NETWORK_TASK_PRIORITY
+#define NETWORK_TASK_PRIORITY 1 // Arduino's own
+#endif
+
+// Opus encoder task - see opus_stage.h
+#ifndef OPUS_TASK_CORE
+#define OPUS_TASK_CORE 1
+#endif
+#ifndef OPUS_TASK_PRIORITY
+#define OPUS_TASK_PRIORITY 2
+#endif
+#ifndef OPUS_TASK_STACK
+#define OPUS_TASK_STACK 32768
+#endif
+
+// Wake-word spotter task - see wake_word.h
+#ifndef WAKE_WORD_CORE
+#define WAKE_WORD_CORE 1
+#endif
+#ifndef WAKE_WORD_PRIORITY
+#define WAKE_WORD_PRIORITY 1 // Below the Opus encoder, which has a frame deadline
+#endif
+#ifndef WAKE_WORD_STACK
+#define WAKE_WORD_STACK 8192
+#endif
+
+// Local monitor output task - see local_monitor.h
+#ifndef MONITOR_TASK_CORE
+#define MONITOR_TASK_CORE 1
+#endif
+#ifndef MONITOR_TASK_PRIORITY
+#define MONITOR_TASK_PRIORITY 3 // Above the codec stages: a late block is an audible gap
+#endif
+#ifndef MONITOR_TASK_STACK
+#define MONITOR_TASK_STACK 4096
+#endif
+
+// Camera task - see video_capture.h. Core 0 with the I2S capture, so core 1 is
+// left to the encoders and the network.
+#ifndef VIDEO_TASK_CORE
+#define VIDEO_TASK_CORE 0
+#endif
+#ifndef VIDEO_TASK_PRIORITY
+#define VIDEO_TASK_PRIORITY 1 // As the microphone task; both mostly wait on their DMA
+#endif
+#ifndef VIDEO_TASK_STACK
+#define VIDEO_TASK_STACK 4096
+#endif
+
+// Person detection task - see person_detect.h. Next to the camera task, off
+// the encoders' core; an inference is ~100 ms of CPU a few times a second.
+#ifndef PERSON_TASK_CORE
+#define PERSON_TASK_CORE 0
+#endif
+#ifndef PERSON_TASK_PRIORITY
+#define PERSON_TASK_PRIORITY 1 // As the microphone task, which mostly waits on its DMA
+#endif
+#ifndef PERSON_TASK_STACK
+#define PERSON_TASK_STACK 8192
+#endif
+
+// Status LED task - see status_led.h
+#ifndef STATUS_LED_CORE
+#define STATUS_LED_CORE 1
+#endif
+#ifndef STATUS_LED_PRIORITY
+#define STATUS_LED_PRIORITY 0 // Idle priority, never competes with audio or the network
+#endif
+
+#define TASK_CORE_ANY 0xFF       // Not pinned
+#define TASK_CPU_UNKNOWN 0xFFFF  // No run-time stats in this FreeRTOS build
+
+// Also the task IDs in the telemetry packet - append only
+enum TaskId : uint8_t
+{
+    TASK_MICROPHONE,
+    TASK_NETWORK,
+    TASK_OPUS,
+    TASK_WAKE_WORD,
+    TASK_MONITOR,
+    TASK_CAMERA,
+    TASK_PERSON,
+    TASK_STATUS_LED,
+    TASK_IDLE_CORE0,
+    TASK_IDLE_CORE1,
+    TASK_COUNT
+};
+
+struct TaskTopologyEntry
+{
+    const char *name; // As given to xTaskCreatePinnedToCore()
+    uint8_t core;     // Or TASK_CORE_ANY
+    uint8_t priority;
+    uint32_t stackSize; // Bytes
+};
+
+// The configured topology, indexed by TaskId
+extern const TaskTopologyEntry taskTopology[TASK_COUNT];
+
+struct TaskSample
+{
+    TaskId id;
+    uint8_t core;           // Configured, TASK_CORE_ANY if not pinned
+    uint8_t priority;       // Current, which a held mutex can raise
+    uint32_t stackSize;     // Bytes
+    uint32_t stackFreeMin;  // High-water mark: fewest stack bytes ever unused
+    uint16_t cpuPermille;   // Of one core since the previous sample, or TASK_CPU_UNKNOWN
+};
+
+// Loop task: apply NETWORK_TASK_PRIORITY to the calling task
+void taskTopologyBegin();
+
+// Sample every running task of the table into `samples` (TASK_COUNT entries),
+// returns how many. Starts a new CPU window; call it from one task only.
+int taskTopologySample(TaskSample *samples);
+
+#endif // TASK_TOPOLOGY_H
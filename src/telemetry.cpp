@@ -0,0 +1,114 @@
+/*
+On-Device Telemetry
+===================
+
+See telemetry.h.
+*/
+
+#include "telemetry.h"
+
+#if AUDIO_TELEMETRY
+#include "audio_packet.h"
+#include "net_arena.h"
+#include <esp_heap_caps.h>
+#include <esp_rom_sys.h>
+
+// One histogram per stage. Different tasks and cores record into it, so updates
+// and the snapshot take a short spinlock.
+static TelemetryHistogram stages[TELEMETRY_STAGE_COUNT];
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t windowStart = 0;
+static uint16_t reportSequence = 0;
+
+void telemetryRecordUs(TelemetryStage stage, uint32_t us)
+{
+    int bucket = us < 2 ? 0 : min(31 - __builtin_clz(us), TELEMETRY_BUCKETS - 1);
+
+    portENTER_CRITICAL(&statsLock);
+    TelemetryHistogram &histogram = stages[stage];
+    histogram.count++;
+    histogram.sumUs += us;
+    if (us > histogram.maxUs)
+        histogram.maxUs = us;
+    if (histogram.buckets[bucket] != UINT16_MAX)
+        histogram.buckets[bucket]++;
+    portEXIT_CRITICAL(&statsLock);
+}
+
+void telemetryRecord(TelemetryStage stage, uint32_t startCycles)
+{
+    uint32_t cycles = esp_cpu_get_ccount() - startCycles;
+    telemetryRecordUs(stage, cycles / esp_rom_get_cpu_ticks_per_us());
+}
+
+static uint8_t *put16(uint8_t *p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+    return p + 2;
+}
+
+static uint8_t *put32(uint8_t *p, uint32_t value)
+{
+    p[0] = value >> 24;
+    p[1] = (value >> 16) & 0xFF;
+    p[2] = (value >> 8) & 0xFF;
+    p[3] = value & 0xFF;
+    return p + 4;
+}
+
+size_t telemetryBuildPacket(uint8_t *packet, const TelemetryCounters &counters)
+{
+    TelemetryHistogram snapshot[TELEMETRY_STAGE_COUNT];
+    portENTER_CRITICAL(&statsLock);
+    memcpy(snapshot, stages, sizeof(snapshot));
+    memset(stages, 0, sizeof(stages));
+    portEXIT_CRITICAL(&statsLock);
+
+    uint32_t now = millis();
+    uint8_t *payload = packet + PACKET_HEADER_SIZE;
+    uint8_t *p = payload;
+    *p++ = TELEMETRY_STAGE_COUNT;
+    *p++ = TELEMETRY_BUCKETS;
+    p = put16(p, counters.gainQ8);
+    p = put32(p, now);
+    p = put32(p, now - windowStart);
+    p = put32(p, counters.dmaOverruns);
+    p = put32(p, counters.ringDrops);
+    p = put32(p, counters.sendFailures);
+    p = put32(p, counters.readErrors);
+    p = put32(p, heap_caps_get_free_size(MALLOC_CAP_INTERNAL));
+    p = put32(p, heap_caps_get_minimum_free_size(MALLOC_CAP_INTERNAL));
+    for (int i = 0; i < TELEMETRY_STAGE_COUNT; i++)
+    {
+        p = put32(p, snapshot[i].count);
+        p = put32(p, snapshot[i].sumUs);
+        p = put32(p, snapshot[i].maxUs);
+        for (int b = 0; b < TELEMETRY_BUCKETS; b++)
+            p = put16(p, snapshot[i].buckets[b]);
+    }
+    NetArenaStats arena = netArenaGetStats();
+    p = put32(p, heap_caps_get_largest_free_block(MALLOC_CAP_INTERNAL));
+    p = put32(p, arena.inUse);
+    p = put32(p, arena.highWater);
+    p = put32(p, arena.fallbacks);
+    TaskSample tasks[TASK_COUNT];
+    int taskCount = taskTopologySample(tasks);
+    *p++ = taskCount;
+    for (int i = 0; i < taskCount; i++)
+    {
+        *p++ = tasks[i].id;
+        *p++ = tasks[i].core;
+        *p++ = tasks[i].priority;
+        *p++ = 0;
+        p = put32(p, tasks[i].stackSize);
+        p = put32(p, tasks[i].stackFreeMin);
+        p = put16(p, tasks[i].cpuPermille);
+    }
+    windowStart = now;
+
+    size_t payloadSize = p - payload;
+    writePacketHeader(packet, PACKET_TYPE_STATS, reportSequence++, 0, packetCrc32(payload, payloadSize), 0);
+    return PACKET_HEADER_SIZE + payloadSize;
+}
+#endif // AUDIO_TELEMETRY
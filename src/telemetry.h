@@ -0,0 +1,118 @@
+/*
+On-Device Telemetry
+===================
+
+Per-stage latency histograms and error counters. They are reported as a
+binary PACKET_TYPE_STATS packet every TELEMETRY_INTERVAL_MS on the WebSocket,
+and nothing is printed per packet. Build with -DAUDIO_TELEMETRY=0 to compile
+the instrumentation out entirely.
+
+Stages:
+- TELEMETRY_I2S_WAIT: capture task blocked on the DMA event queue. Measured
+  with esp_timer, because the cycle counter stops in light sleep.
+- TELEMETRY_CONVERT: I2S frames to 16-bit PCM (packing and CRC for PCM)
+- TELEMETRY_ENCODE: ADPCM or Opus encode
+- TELEMETRY_ENQUEUE: VAD decision, pre-roll and committing to the packet ring
+- TELEMETRY_SEND: one send call on the network side (frame, batch or datagram)
+
+The other stages use the CPU cycle counter, converted at the clock in effect.
+Each histogram has TELEMETRY_BUCKETS power-of-two buckets: bucket 0 holds
+times under 2 us, bucket i holds [2^i, 2^(i+1)) us, and the last bucket is open
+ended. Histograms cover one report interval and restart after every report.
+Counters run from boot.
+
+Stats payload (network/big-endian), after the standard header:
+  [stageCount(1), bucketCount(1), gainQ8(2),
+   uptimeMs(4), windowMs(4),
+   dmaOverruns(4), ringDrops(4), sendFailures(4), readErrors(4),
+   heapFree(4), heapMin(4)]
+  then per stage: [count(4), sumUs(4), maxUs(4), buckets(2 each, saturating)]
+  then [heapLargest(4), arenaInUse(4), arenaHighWater(4), arenaFallbacks(4)]
+  then [taskCount(1)] and per task: [id(1), core(1), priority(1), reserved(1),
+   stackSize(4), stackFreeMin(4), cpuPermille(2)]
+gainQ8 is the voice gain at report time in Q8, AGC included (agc.h).
+heapFree, heapMin and heapLargest are the internal heap: free now, the low
+water since boot, and the largest free block. A heap that degrades shows as
+heapLargest shrinking while heapFree holds. The arena fields are the TLS slab
+arena in bytes and its heap fallbacks (net_arena.h), 0 without it. Firmware
+from before the heap fields ends after the stages; the CRC covers them.
+The tasks are the running ones of the task topology (task_topology.h): id is
+a TaskId, core 0xFF is not pinned, and cpuPermille is the share of one core
+over the report interval, 0xFFFF without run-time stats. Firmware from before
+ends after the heap fields. The payload is at most TELEMETRY_PAYLOAD_SIZE.
+Header samples = 0, seqNum counts stats packets, and timestamp = 0.
+*/
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <Arduino.h>
+#include "task_topology.h"
+
+#ifndef AUDIO_TELEMETRY
+#define AUDIO_TELEMETRY 1
+#endif
+#ifndef TELEMETRY_INTERVAL_MS
+#define TELEMETRY_INTERVAL_MS 10000
+#endif
+
+#define TELEMETRY_BUCKETS 16
+#define TELEMETRY_COUNTERS_SIZE 36
+#define TELEMETRY_STAGE_SIZE (12 + TELEMETRY_BUCKETS * 2)
+#define TELEMETRY_HEAP_SIZE 16
+#define TELEMETRY_TASK_SIZE 14
+
+enum TelemetryStage : uint8_t
+{
+    TELEMETRY_I2S_WAIT,
+    TELEMETRY_CONVERT,
+    TELEMETRY_ENCODE,
+    TELEMETRY_ENQUEUE,
+    TELEMETRY_SEND,
+    TELEMETRY_STAGE_COUNT
+};
+
+#define TELEMETRY_PAYLOAD_SIZE (TELEMETRY_COUNTERS_SIZE + TELEMETRY_STAGE_COUNT * TELEMETRY_STAGE_SIZE + \
+                                TELEMETRY_HEAP_SIZE + 1 + TASK_COUNT * TELEMETRY_TASK_SIZE)
+
+struct TelemetryHistogram
+{
+    uint32_t count;
+    uint32_t sumUs;
+    uint32_t maxUs;
+    uint16_t buckets[TELEMETRY_BUCKETS];
+};
+
+// Counters owned elsewhere, sampled when the report is built
+struct TelemetryCounters
+{
+    uint32_t dmaOverruns;
+    uint32_t ringDrops; // Packets that found the ring full
+    uint32_t sendFailures;
+    uint32_t readErrors;
+    uint16_t gainQ8; // Current voice gain, agcGainQ8()
+};
+
+#if AUDIO_TELEMETRY
+#include <esp_cpu.h>
+
+// Start of a timed section - pass the result to telemetryRecord()
+inline uint32_t telemetryStart()
+{
+    return esp_cpu_get_ccount();
+}
+
+// Any task: add the time since telemetryStart() to a stage
+void telemetryRecord(TelemetryStage stage, uint32_t startCycles);
+void telemetryRecordUs(TelemetryStage stage, uint32_t us);
+
+// Build a PACKET_TYPE_STATS packet for the interval since the previous one,
+// returns its size. `packet` needs PACKET_HEADER_SIZE + TELEMETRY_PAYLOAD_SIZE bytes.
+size_t telemetryBuildPacket(uint8_t *packet, const TelemetryCounters &counters);
+#else
+inline uint32_t telemetryStart() { return 0; }
+inline void telemetryRecord(TelemetryStage, uint32_t) {}
+inline void telemetryRecordUs(TelemetryStage, uint32_t) {}
+#endif
+
+#endif // TELEMETRY_H
@@ -0,0 +1,72 @@
+/*
+Voice Activity Detector
+=======================
+
+See vad.h.
+*/
+
+#include "vad.h"
+
+void vadReset(VadState *state, uint32_t sampleRate)
+{
+    state->noiseFloor = VAD_INITIAL_FLOOR;
+    state->speechRun = 0;
+    state->hangoverSamples = 0;
+    state->sampleRate = sampleRate;
+    state->active = false;
+}
+
+int vadZeroCrossings(const uint8_t *signBytes, int numSamples, int stride)
+{
+    int crossings = 0;
+    uint8_t previous = signBytes[0] & 0x80;
+    for (int i = 1; i < numSamples; i++)
+    {
+        uint8_t sign = signBytes[i * 2 * stride] & 0x80;
+        crossings += sign != previous;
+        previous = sign;
+    }
+    return crossings;
+}
+
+VadEvent vadProcess(VadState *state, float rms, int zeroCrossings, int numSamples)
+{
+    if (numSamples <= 0)
+        return VAD_NONE;
+
+    // Classify the block
+    float zcr = (float)zeroCrossings / numSamples;
+    float ratio = zcr > VAD_MAX_ZCR ? VAD_NOISY_RATIO : VAD_ONSET_RATIO;
+    bool speechLike = rms > VAD_MIN_RMS && rms > state->noiseFloor * ratio;
+
+    // Track the background mostly while nobody is talking - the slow creep during
+    // speech stops a sudden permanent noise source from holding the gate open
+    float rate = rms < state->noiseFloor ? VAD_FLOOR_FALL : VAD_FLOOR_RISE;
+    if (speechLike)
+        rate = VAD_FLOOR_SPEECH_RISE;
+    state->noiseFloor += (rms - state->noiseFloor) * rate;
+
+    state->speechRun = speechLike ? state->speechRun + 1 : 0;
+
+    if (!state->active)
+    {
+        if (state->speechRun < VAD_ONSET_BLOCKS)
+            return VAD_NONE;
+        state->active = true;
+        state->hangoverSamples = state->sampleRate / 1000 * VAD_HANGOVER_MS;
+        return VAD_SPEECH_START;
+    }
+
+    // Gate open - speech refreshes the hangover, silence uses it up
+    if (speechLike)
+    {
+        state->hangoverSamples = state->sampleRate / 1000 * VAD_HANGOVER_MS;
+        return VAD_NONE;
+    }
+    state->hangoverSamples -= numSamples;
+    if (state->hangoverSamples > 0)
+        return VAD_NONE;
+
+    state->active = false;
+    return VAD_SPEECH_END;
+}
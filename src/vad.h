@@ -0,0 +1,64 @@
+/*
+Voice Activity Detector
+=======================
+
+Per-block speech/silence decision for the capture task, replacing the fixed
+maxAbs/RMS gate.
+
+- Adaptive noise floor: follows the block RMS down quickly and up slowly, and
+  barely moves while speech is detected.
+- Features: block energy relative to the noise floor plus the zero-crossing
+  rate. Broadband clicks and hiss cross zero far more often than voiced speech,
+  so a high-ZCR block needs a much larger energy margin to count as speech.
+- Onset needs VAD_ONSET_BLOCKS speech-like blocks in a row, so a single click
+  does not open the gate. The capture task keeps VAD_PREROLL_BLOCKS of silent
+  packets and sends them on onset, so the word start is not lost.
+- Hangover keeps the gate open for VAD_HANGOVER_MS after the last speech-like
+  block so word tails and short pauses are not chopped.
+*/
+
+#ifndef VAD_H
+#define VAD_H
+
+#include <Arduino.h>
+
+#define VAD_ONSET_RATIO 3.0f    // Block RMS over noise floor that counts as speech (~10 dB)
+#define VAD_NOISY_RATIO 8.0f    // Ratio required when the block looks like noise (high ZCR)
+#define VAD_MIN_RMS 200.0f      // Absolute floor - matches the old fixed gate
+#define VAD_MAX_ZCR 0.35f       // Zero crossings per sample above which a block looks like noise
+#define VAD_ONSET_BLOCKS 2      // Speech-like blocks in a row to open the gate
+#define VAD_HANGOVER_MS 300     // Gate stays open this long after the last speech block
+#define VAD_PREROLL_BLOCKS 3    // Silent blocks kept for sending on onset
+#define VAD_INITIAL_FLOOR 100.0f
+#define VAD_FLOOR_FALL 0.2f     // Noise floor tracking when the level drops
+#define VAD_FLOOR_RISE 0.02f    // Noise floor tracking when the level rises
+#define VAD_FLOOR_SPEECH_RISE 0.002f // Noise floor creep while speech is detected
+
+enum VadEvent : uint8_t
+{
+    VAD_NONE,
+    VAD_SPEECH_START, // Gate opened on this block - send the pre-roll first
+    VAD_SPEECH_END    // Hangover expired on this block - it is not sent
+};
+
+struct VadState
+{
+    float noiseFloor;        // Running RMS of the background
+    int speechRun;           // Consecutive speech-like blocks
+    int32_t hangoverSamples; // Samples left before the gate closes
+    uint32_t sampleRate;
+    bool active;             // Gate open - send this block
+};
+
+void vadReset(VadState *state, uint32_t sampleRate);
+
+// Zero crossings in a block of 16-bit samples. signBytes points at the most
+// significant byte of the first sample and samples are 2 bytes apart, so the
+// count works on both native (little-endian) and packed big-endian buffers.
+// With stride 2 it counts the first channel of interleaved stereo.
+int vadZeroCrossings(const uint8_t *signBytes, int numSamples, int stride = 1);
+
+// Update the detector with one block; state->active tells whether to send it
+VadEvent vadProcess(VadState *state, float rms, int zeroCrossings, int numSamples);
+
+#endif // VAD_H
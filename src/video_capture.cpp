@@ -0,0 +1,266 @@
+/*
+Video Capture
+=============
+
+See video_capture.h.
+*/
+
+#include "video_capture.h"
+
+#if AUDIO_USE_CAMERA
+
+#include <atomic>
+#include "esp_camera.h"
+#include "audio_packet.h"
+#include "clock_sync.h"
+#include "packet_ring.h"
+#include "person_detect.h"
+
+#if !defined(CAMERA_MODEL_AI_THINKER) && !defined(CAMERA_MODEL_RHYX_M12)
+#define CAMERA_MODEL_ESP32S3_DEVKIT // The ESP32 maps do not fit the S3, see camera_pins.h
+#endif
+#include "camera_pins.h"
+#include "status_led.h"
+
+// The LED task drives its pin continuously - a camera line on it would fight it
+constexpr bool cameraUsesPin(int pin)
+{
+    return pin == XCLK_GPIO_NUM || pin == SIOD_GPIO_NUM || pin == SIOC_GPIO_NUM || pin == Y9_GPIO_NUM ||
+           pin == Y8_GPIO_NUM || pin == Y7_GPIO_NUM || pin == Y6_GPIO_NUM || pin == Y5_GPIO_NUM ||
+           pin == Y4_GPIO_NUM || pin == Y3_GPIO_NUM || pin == Y2_GPIO_NUM || pin == VSYNC_GPIO_NUM ||
+           pin == HREF_GPIO_NUM || pin == PCLK_GPIO_NUM || pin == PWDN_GPIO_NUM || pin == RESET_GPIO_NUM;
+}
+static_assert(!cameraUsesPin(STATUS_LED_PIN), "STATUS_LED_PIN is one of the camera pins in camera_pins.h");
+
+#ifndef VIDEO_FRAME_SIZE
+#define VIDEO_FRAME_SIZE FRAMESIZE_VGA // 640x480
+#endif
+#define VIDEO_XCLK_HZ 20000000
+#define VIDEO_SLOT_SIZE (SLOT_PAYLOAD_OFFSET + VIDEO_HEADER_SIZE + VIDEO_MAX_FRAME_BYTES)
+
+static TaskHandle_t cameraTask = NULL;
+static TaskHandle_t networkTask = NULL;
+static PacketRing frameRing;
+static uint16_t videoSequence = 0; // Camera task only
+
+static std::atomic<bool> enabled(false);
+static std::atomic<int> fps(VIDEO_DEFAULT_FPS);
+static std::atomic<int> quality(VIDEO_DEFAULT_QUALITY);
+static std::atomic<bool> qualityPending(false);
+
+// Camera task counters; skipped is written by the network task
+static VideoCaptureStats stats;
+static volatile uint32_t skipped = 0;
+
+static void buildPacket(uint8_t *slot, const camera_fb_t *fb, uint8_t personScore)
+{
+    int64_t capturedUs = (int64_t)fb->timestamp.tv_sec * 1000000 + fb->timestamp.tv_usec;
+    uint32_t timestamp = 0;
+    uint32_t sampleRate = PACKET_DEFAULT_RATE;
+    clockSyncSampleClock(capturedUs, &timestamp, &sampleRate);
+
+    uint8_t *payload = slot + SLOT_PAYLOAD_OFFSET;
+    payload[0] = fb->width >> 8;
+    payload[1] = fb->width & 0xFF;
+    payload[2] = fb->height >> 8;
+    payload[3] = fb->height & 0xFF;
+    payload[4] = (uint8_t)quality.load(std::memory_order_relaxed);
+    payload[5] = personScore;
+    payload[6] = payload[7] = 0;
+    memcpy(payload + VIDEO_HEADER_SIZE, fb->buf, fb->len);
+
+    size_t payloadBytes = VIDEO_HEADER_SIZE + fb->len;
+    writePacketHeader(slot + SLOT_PACKET_OFFSET, PACKET_TYPE_VIDEO, videoSequence++, 0,
+                      packetCrc32(payload, payloadBytes), timestamp, sampleRate);
+    frameRing.commit(PACKET_HEADER_SIZE + payloadBytes);
+}
+
+static void cameraTaskLoop(void *parameter)
+{
+    TickType_t lastWake = xTaskGetTickCount();
+    while (true)
+    {
+        vTaskDelayUntil(&lastWake, pdMS_TO_TICKS(1000 / fps.load(std::memory_order_relaxed)));
+        if (!enabled.load(std::memory_order_acquire))
+            continue;
+        if (qualityPending.exchange(false))
+        {
+            sensor_t *sensor = esp_camera_sensor_get();
+            if (sensor)
+                sensor->set_quality(sensor, quality.load(std::memory_order_relaxed));
+        }
+
+        camera_fb_t *fb = esp_camera_fb_get();
+        if (!fb)
+        {
+            stats.failures++;
+            continue;
+        }
+        stats.lastBytes = fb->len;
+        stats.width = fb->width;
+        stats.height = fb->height;
+        bool wanted = fb->format == PIXFORMAT_JPEG && fb->len <= VIDEO_MAX_FRAME_BYTES;
+        uint8_t personScore = 0;
+        if (!wanted)
+            stats.oversize++;
+        else if (personDetectEnabled())
+        {
+            personDetectOffer(fb->buf, fb->len, fb->width, fb->height);
+            wanted = personDetectPresent(&personScore);
+            if (!wanted)
+                stats.gated++; // Nobody in the picture
+        }
+        if (wanted)
+        {
+            uint8_t *slot = frameRing.acquire();
+            if (slot)
+            {
+                buildPacket(slot, fb, personScore);
+                stats.frames++;
+                xTaskNotifyGive(networkTask);
+            }
+        }
+        esp_camera_fb_return(fb); // Back to the driver before the frame goes out
+    }
+}
+
+bool videoCaptureBegin(const VideoCaptureConfig &config)
+{
+    if (config.fps < VIDEO_MIN_FPS || config.fps > VIDEO_MAX_FPS || config.quality < VIDEO_MIN_QUALITY ||
+        config.quality > VIDEO_MAX_QUALITY)
+        return false;
+    fps.store(config.fps);
+    quality.store(config.quality);
+    networkTask = config.networkTask;
+
+    camera_config_t camera = {};
+    camera.pin_pwdn = PWDN_GPIO_NUM;
+    camera.pin_reset = RESET_GPIO_NUM;
+    camera.pin_xclk = XCLK_GPIO_NUM;
+    camera.pin_sccb_sda = SIOD_GPIO_NUM;
+    camera.pin_sccb_scl = SIOC_GPIO_NUM;
+    camera.pin_d7 = Y9_GPIO_NUM;
+    camera.pin_d6 = Y8_GPIO_NUM;
+    camera.pin_d5 = Y7_GPIO_NUM;
+    camera.pin_d4 = Y6_GPIO_NUM;
+    camera.pin_d3 = Y5_GPIO_NUM;
+    camera.pin_d2 = Y4_GPIO_NUM;
+    camera.pin_d1 = Y3_GPIO_NUM;
+    camera.pin_d0 = Y2_GPIO_NUM;
+    camera.pin_vsync = VSYNC_GPIO_NUM;
+    camera.pin_href = HREF_GPIO_NUM;
+    camera.pin_pclk = PCLK_GPIO_NUM;
+    camera.xclk_freq_hz = VIDEO_XCLK_HZ;
+    camera.ledc_timer = LEDC_TIMER_0;
+    camera.ledc_channel = LEDC_CHANNEL_0;
+    camera.pixel_format = PIXFORMAT_JPEG;
+    camera.frame_size = VIDEO_FRAME_SIZE;
+    camera.jpeg_quality = config.quality;
+    camera.fb_count = 2; // One filling while the task copies the other
+    camera.fb_location = CAMERA_FB_IN_PSRAM;
+    camera.grab_mode = CAMERA_GRAB_LATEST;
+
+    esp_err_t err = esp_camera_init(&camera);
+    if (err != ESP_OK)
+    {
+        Serial.printf("Camera init failed: 0x%x\n", err);
+        return false;
+    }
+    if (!frameRing.begin(VIDEO_RING_SLOTS, VIDEO_SLOT_SIZE))
+    {
+        Serial.println("Failed to allocate video ring");
+        esp_camera_deinit();
+        return false;
+    }
+
+    if (xTaskCreatePinnedToCore(cameraTaskLoop, "Camera", config.stackSize, NULL,
+                                config.priority, &cameraTask, config.core) != pdPASS)
+    {
+        Serial.println("Failed to start camera task");
+        esp_camera_deinit();
+        return false;
+    }
+    return true;
+}
+
+bool videoCaptureAvailable()
+{
+    return cameraTask != NULL;
+}
+
+bool videoCaptureSetEnabled(bool on)
+{
+    if (on && !cameraTask)
+        return false;
+    enabled.store(on, std::memory_order_release);
+    return true;
+}
+
+bool videoCaptureEnabled()
+{
+    return enabled.load(std::memory_order_acquire);
+}
+
+bool videoCaptureSetParams(int newFps, int newQuality)
+{
+    if ((newFps && (newFps < VIDEO_MIN_FPS || newFps > VIDEO_MAX_FPS)) ||
+        (newQuality && (newQuality < VIDEO_MIN_QUALITY || newQuality > VIDEO_MAX_QUALITY)))
+        return false;
+    if (newFps)
+        fps.store(newFps);
+    if (newQuality && newQuality != quality.load())
+    {
+        quality.store(newQuality);
+        qualityPending.store(true); // The sensor is only touched by the camera task
+    }
+    return true;
+}
+
+int videoCaptureFps()
+{
+    return fps.load();
+}
+
+int videoCaptureQuality()
+{
+    return quality.load();
+}
+
+uint8_t *videoCapturePeek(size_t *length)
+{
+    // Only the newest frame is worth sending
+    while (frameRing.depth() > 1)
+    {
+        frameRing.peek(length);
+        frameRing.release();
+        skipped++;
+    }
+    return frameRing.peek(length);
+}
+
+void videoCaptureRelease()
+{
+    frameRing.release();
+}
+
+VideoCaptureStats videoCaptureGetStats()
+{
+    VideoCaptureStats copy = stats;
+    copy.drops = frameRing.overruns + skipped;
+    return copy;
+}
+
+#else // !AUDIO_USE_CAMERA
+
+bool videoCaptureBegin(const VideoCaptureConfig &config) { return false; }
+bool videoCaptureAvailable() { return false; }
+bool videoCaptureSetEnabled(bool enabled) { return !enabled; }
+bool videoCaptureEnabled() { return false; }
+bool videoCaptureSetParams(int fps, int quality) { return false; }
+int videoCaptureFps() { return 0; }
+int videoCaptureQuality() { return 0; }
+uint8_t *videoCapturePeek(size_t *length) { return NULL; }
+void videoCaptureRelease() {}
+VideoCaptureStats videoCaptureGetStats() { return VideoCaptureStats(); }
+
+#endif
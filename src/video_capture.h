@@ -0,0 +1,96 @@
+/*
+Video Capture
+=============
+
+Optional camera stream next to the audio, so one ESP32-S3 board does what
+used to take an audio board and an ESP32-CAM.
+
+The camera task runs on core 0 with the I2S capture. It grabs JPEG frames
+from the sensor (the OV2640 encodes them itself) at the configured rate and
+builds each one into a complete PACKET_TYPE_VIDEO packet in a PSRAM ring
+slot. The frame buffer then goes straight back to the driver. The network
+task (loop(), core 1) sends the packets on the same WebSocket as the audio.
+Audio always goes first. When the link cannot keep up, older frames are
+dropped and the newest is sent.
+
+Lip-sync: the sensor driver stamps each frame with esp_timer at the start of
+the frame, and that time is put on the audio sample clock (clockSyncSampleClock()).
+The packet timestamp uses the same clock and rate code as the audio packets,
+so the relay and browsers line both streams up without any extra sync.
+Frames captured before the first audio block carry timestamp 0.
+
+Payload (audio_packet.h): [width(2), height(2), quality(1), personScore(1),
+reserved(2)] + JPEG. seqNum counts video packets on their own; samples is 0.
+
+With the person detection gate on (person_detect.h), frames are only built
+while someone is in the picture, and personScore is the detector's latest
+score; otherwise it is 0.
+
+Needs esp32-camera, a camera on the pins in camera_pins.h and
+-DAUDIO_USE_CAMERA=1. Without it every function is a no-op and
+videoCaptureBegin() returns false.
+{"command":"video","enabled":true,"fps":10,"quality":12} sets it at runtime.
+*/
+
+#ifndef VIDEO_CAPTURE_H
+#define VIDEO_CAPTURE_H
+
+#include <Arduino.h>
+
+#ifndef AUDIO_USE_CAMERA
+#define AUDIO_USE_CAMERA 0
+#endif
+
+#define VIDEO_RING_SLOTS 2                // Frames in flight to the network task (power of two)
+#define VIDEO_MAX_FRAME_BYTES (96 * 1024) // Larger JPEGs are dropped and counted
+#define VIDEO_DEFAULT_FPS 10
+#define VIDEO_MIN_FPS 1
+#define VIDEO_MAX_FPS 25
+#define VIDEO_DEFAULT_QUALITY 12 // JPEG quality, 0-63, lower is better
+#define VIDEO_MIN_QUALITY 4
+#define VIDEO_MAX_QUALITY 63
+
+struct VideoCaptureConfig
+{
+    TaskHandle_t networkTask; // Woken when a frame is ready
+    int fps;
+    int quality;
+    BaseType_t core;      // Core the camera task is pinned to
+    UBaseType_t priority; // Camera task priority
+    uint32_t stackSize;   // Camera task stack
+};
+
+struct VideoCaptureStats
+{
+    uint32_t frames;    // Frames captured into the ring
+    uint32_t drops;     // Ring full, or replaced by a newer frame before it went out
+    uint32_t oversize;  // Frames over VIDEO_MAX_FRAME_BYTES
+    uint32_t failures;  // No frame from the driver
+    uint32_t gated;     // Held back by the person detection gate
+    uint32_t lastBytes; // JPEG size of the last frame
+    uint16_t width, height;
+};
+
+// Initialise the camera and start the camera task. Capture starts disabled.
+bool videoCaptureBegin(const VideoCaptureConfig &config);
+
+bool videoCaptureAvailable();
+
+// Any task. Enabling fails when the camera is not available.
+bool videoCaptureSetEnabled(bool enabled);
+bool videoCaptureEnabled();
+
+// Any task; 0 keeps the current value. False if out of range.
+bool videoCaptureSetParams(int fps, int quality);
+int videoCaptureFps();
+int videoCaptureQuality();
+
+// Network task: the newest ready packet, laid out like a packet ring slot
+// (audio_packet.h), or NULL. Older ready frames are dropped. Hand it back with
+// videoCaptureRelease() once sent.
+uint8_t *videoCapturePeek(size_t *length);
+void videoCaptureRelease();
+
+VideoCaptureStats videoCaptureGetStats();
+
+#endif // VIDEO_CAPTURE_H
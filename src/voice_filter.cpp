@@ -0,0 +1,170 @@
+/*
+Voice Filter
+============
+
+See voice_filter.h.
+*/
+
+#include "voice_filter.h"
+#include <atomic>
+#include <math.h>
+
+#define COEFF_SHIFT 28 // Q28: peaking boosts of +12 dB need |b0| up to ~4
+#define SAMPLE_MAX ((1 << 23) - 1)
+#define SAMPLE_MIN (-(1 << 23))
+#define MAX_NYQUIST_FRACTION 0.45f // Presence stages above this are skipped
+#define MAX_CHANNELS 2
+
+// One direct form I section; x/y history in the 24-bit sample domain
+struct Biquad
+{
+    int32_t b0, b1, b2, a1, a2; // Q28, a0 normalised to 1
+    int32_t x1, x2, y1, y2;
+    bool enabled;
+};
+
+static const VoiceFilterConfig defaultConfig = {
+    .highpassHz = VOICE_FILTER_DEFAULT_HIGHPASS_HZ,
+    .presenceHz = VOICE_FILTER_DEFAULT_PRESENCE_HZ,
+    .presenceDb = VOICE_FILTER_DEFAULT_PRESENCE_DB,
+    .presenceQ = VOICE_FILTER_DEFAULT_PRESENCE_Q};
+
+// Handed from voiceFilterRequest() to the capture task
+static VoiceFilterConfig pending = defaultConfig;
+static VoiceFilterConfig accepted = defaultConfig;
+static std::atomic<bool> configPending(true);
+
+// Capture task only
+static VoiceFilterConfig active = defaultConfig;
+static uint32_t designedRate = 0;
+static Biquad stages[MAX_CHANNELS][2]; // High-pass, presence per channel
+
+static int32_t toQ28(double value)
+{
+    return (int32_t)lround(value * (1 << COEFF_SHIFT));
+}
+
+// Normalise by a0 and store; the history is kept so a retune does not click
+static void setCoefficients(Biquad *stage, double b0, double b1, double b2, double a0, double a1, double a2)
+{
+    stage->b0 = toQ28(b0 / a0);
+    stage->b1 = toQ28(b1 / a0);
+    stage->b2 = toQ28(b2 / a0);
+    stage->a1 = toQ28(a1 / a0);
+    stage->a2 = toQ28(a2 / a0);
+    stage->enabled = true;
+}
+
+// RBJ audio EQ cookbook designs, for one channel's stages
+static void design(Biquad *channel, const VoiceFilterConfig &config, uint32_t sampleRate)
+{
+    // A stage that was bypassed starts from silence
+    for (int i = 0; i < 2; i++)
+        if (!channel[i].enabled)
+            channel[i].x1 = channel[i].x2 = channel[i].y1 = channel[i].y2 = 0;
+
+    Biquad &highpass = channel[0];
+    highpass.enabled = false;
+    if (config.highpassHz > 0)
+    {
+        double w0 = 2 * M_PI * config.highpassHz / sampleRate;
+        double cosW0 = cos(w0);
+        double alpha = sin(w0) / (2 * M_SQRT1_2); // Butterworth, Q = 1/sqrt(2)
+        setCoefficients(&highpass, (1 + cosW0) / 2, -(1 + cosW0), (1 + cosW0) / 2, 1 + alpha, -2 * cosW0, 1 - alpha);
+    }
+
+    Biquad &presence = channel[1];
+    presence.enabled = false;
+    if (config.presenceDb != 0 && config.presenceHz < MAX_NYQUIST_FRACTION * sampleRate)
+    {
+        double a = pow(10, config.presenceDb / 40);
+        double w0 = 2 * M_PI * config.presenceHz / sampleRate;
+        double cosW0 = cos(w0);
+        double alpha = sin(w0) / (2 * config.presenceQ);
+        setCoefficients(&presence, 1 + alpha * a, -2 * cosW0, 1 - alpha * a, 1 + alpha / a, -2 * cosW0, 1 - alpha / a);
+    }
+}
+
+bool voiceFilterRequest(const VoiceFilterConfig &config)
+{
+    bool valid = (config.highpassHz == 0 || (config.highpassHz >= 20 && config.highpassHz <= 1000)) &&
+                 config.presenceHz >= 200 && config.presenceHz <= 8000 &&
+                 config.presenceDb >= -12 && config.presenceDb <= 12 &&
+                 config.presenceQ >= 0.3f && config.presenceQ <= 4;
+    if (!valid || configPending.load(std::memory_order_acquire))
+        return false;
+    pending = config;
+    accepted = config;
+    configPending.store(true, std::memory_order_release);
+    return true;
+}
+
+VoiceFilterConfig voiceFilterConfig()
+{
+    return accepted;
+}
+
+void voiceFilterReset()
+{
+    for (Biquad *channel : stages)
+        for (int i = 0; i < 2; i++)
+            channel[i].x1 = channel[i].x2 = channel[i].y1 = channel[i].y2 = 0;
+}
+
+static inline int32_t runStage(Biquad &s, int32_t x)
+{
+    int64_t acc = (int64_t)s.b0 * x + (int64_t)s.b1 * s.x1 + (int64_t)s.b2 * s.x2 -
+                  (int64_t)s.a1 * s.y1 - (int64_t)s.a2 * s.y2;
+    acc += (int64_t)1 << (COEFF_SHIFT - 1); // Round, so truncation adds no DC
+    int64_t y = acc >> COEFF_SHIFT;
+    int32_t out = y > SAMPLE_MAX ? SAMPLE_MAX : y < SAMPLE_MIN ? SAMPLE_MIN : (int32_t)y;
+    s.x2 = s.x1;
+    s.x1 = x;
+    s.y2 = s.y1;
+    s.y1 = out;
+    return out;
+}
+
+static void filterChannel(Biquad *channel, int32_t *samples32, int numFrames, int stride)
+{
+    // Local copies keep the coefficients and history in registers
+    bool highpassOn = channel[0].enabled;
+    bool presenceOn = channel[1].enabled;
+    if (!highpassOn && !presenceOn)
+        return;
+    Biquad highpass = channel[0];
+    Biquad presence = channel[1];
+
+    for (int i = 0; i < numFrames * stride; i += stride)
+    {
+        int32_t sample = samples32[i] >> 8; // INMP441: 24 bits, MSB aligned
+        if (highpassOn)
+            sample = runStage(highpass, sample);
+        if (presenceOn)
+            sample = runStage(presence, sample);
+        samples32[i] = (int32_t)((uint32_t)sample << 8);
+    }
+
+    channel[0] = highpass;
+    channel[1] = presence;
+}
+
+void voiceFilterProcess(int32_t *samples32, int numFrames, int channels, uint32_t sampleRate)
+{
+    if (configPending.load(std::memory_order_acquire))
+    {
+        active = pending;
+        configPending.store(false, std::memory_order_release);
+        designedRate = 0;
+    }
+    if (sampleRate != designedRate)
+    {
+        for (Biquad *channel : stages)
+            design(channel, active, sampleRate);
+        designedRate = sampleRate;
+    }
+
+    channels = channels > MAX_CHANNELS ? MAX_CHANNELS : channels;
+    for (int c = 0; c < channels; c++)
+        filterChannel(stages[c], samples32 + c, numFrames, channels);
+}
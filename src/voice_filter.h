@@ -0,0 +1,59 @@
+/*
+Voice Filter
+============
+
+Fixed-point voice EQ in front of the sample conversion, two cascaded biquads:
+- High-pass: 2nd-order Butterworth at highpassHz. It removes DC, handling
+  rumble and HVAC hum. That energy would otherwise eat into the gain headroom
+  and keep the VAD's RMS above its noise floor.
+- Presence: an RBJ peaking filter of presenceDb at presenceHz, with width
+  presenceQ, for intelligibility in the 2-4 kHz range.
+
+The filter works on the 24-bit INMP441 samples in place in the I2S block:
+Q30 coefficients, a 64-bit accumulator and rounding. Its output is written
+back into the 32-bit slots, so the convert/pack kernels after it (PIE on
+ESP32-S3) run unchanged. The biquad is a recurrence over samples, so it
+cannot be split across vector lanes. It is a tight scalar loop of 32x32->64
+multiply-accumulates, about 10 per sample.
+
+Settings come from any task through voiceFilterRequest(), the same way as
+AudioCapture::requestConfig(). The capture task picks them up at the next
+block, where it designs the coefficients for the current sample rate. A
+sample rate change redesigns them too. highpassHz = 0 or presenceDb = 0
+bypasses that stage. Stereo blocks are filtered per channel, each with its
+own history.
+*/
+
+#ifndef VOICE_FILTER_H
+#define VOICE_FILTER_H
+
+#include <stdint.h>
+
+#define VOICE_FILTER_DEFAULT_HIGHPASS_HZ 100
+#define VOICE_FILTER_DEFAULT_PRESENCE_HZ 2500
+#define VOICE_FILTER_DEFAULT_PRESENCE_DB 3.0f
+#define VOICE_FILTER_DEFAULT_PRESENCE_Q 1.0f
+
+struct VoiceFilterConfig
+{
+    uint16_t highpassHz; // 0 (off) or 20 - 1000
+    uint16_t presenceHz; // 200 - 8000, stage skipped above 0.45 * sample rate
+    float presenceDb;    // -12 - +12, 0 is off
+    float presenceQ;     // 0.3 - 4
+};
+
+// Any task. False if a setting is out of range or the previous request has
+// not been picked up yet.
+bool voiceFilterRequest(const VoiceFilterConfig &config);
+
+// The latest accepted settings
+VoiceFilterConfig voiceFilterConfig();
+
+// Capture task: filter one block of 32-bit I2S slots in place, numFrames
+// frames of 1 or 2 interleaved channels
+void voiceFilterProcess(int32_t *samples32, int numFrames, int channels, uint32_t sampleRate);
+
+// Capture task: clear the filter history, e.g. after a capture format change
+void voiceFilterReset();
+
+#endif // VOICE_FILTER_H
@@ -0,0 +1,226 @@
+/*
+Wake-Word Gate
+==============
+
+See wake_word.h.
+*/
+
+#include "wake_word.h"
+
+#if AUDIO_USE_WAKEWORD
+
+#include <atomic>
+#include "packet_ring.h"
+#include "esp_wn_iface.h"
+#include "esp_wn_models.h"
+#include "model_path.h"
+
+#define BLOCK_META_SIZE 16 // [timestamp(4) | padding][samples], samples aligned for the SIMD kernel
+#define WINDOW_SAMPLES (WAKE_WORD_WINDOW_MS * (WAKE_WORD_SAMPLE_RATE / 1000))
+#define HOLD_SAMPLES (WAKE_WORD_HOLD_MS * (WAKE_WORD_SAMPLE_RATE / 1000))
+
+static const esp_wn_iface_t *wakenet = NULL;
+static model_iface_data_t *model = NULL;
+static char *modelName = NULL;
+static TaskHandle_t spotterTask = NULL;
+static PacketRing pcmRing;
+
+// Chunk being assembled from capture blocks - WakeNet takes a fixed size
+static int16_t *chunk = NULL;
+static int chunkSamples = 0;
+static int chunkFill = 0;
+static uint32_t chunkTimestamp = 0; // Capture timestamp of the chunk's first sample
+
+// Capture side: slot returned by the last wakeWordAcquireBlock()
+static uint8_t *acquiredSlot = NULL;
+
+static std::atomic<bool> enabled(false);
+static std::atomic<bool> resetPending(false);
+
+// Listening window on the capture clock. Opened by the spotter task, held
+// open and closed again by the capture task.
+static std::atomic<bool> windowOpen(false);
+static std::atomic<uint32_t> windowEnd(0);
+
+static WakeWordStats stats;
+
+static void extendWindow(uint32_t end)
+{
+    uint32_t current = windowEnd.load(std::memory_order_relaxed);
+    while ((int32_t)(end - current) > 0 &&
+           !windowEnd.compare_exchange_weak(current, end, std::memory_order_relaxed))
+    {
+    }
+}
+
+static void detected(uint32_t timestamp)
+{
+    uint32_t end = timestamp + chunkSamples;
+    stats.detections++;
+    stats.lastDetected = end;
+    if (!windowOpen.load(std::memory_order_acquire))
+        windowEnd.store(end + WINDOW_SAMPLES, std::memory_order_relaxed);
+    else
+        extendWindow(end + WINDOW_SAMPLES);
+    windowOpen.store(true, std::memory_order_release);
+    Serial.printf("Wake word detected at %u (%u so far)\n", end, stats.detections);
+}
+
+static void spotterTaskLoop(void *parameter)
+{
+    while (true)
+    {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        size_t length;
+        uint8_t *block;
+        while ((block = pcmRing.peek(&length)) != NULL)
+        {
+            if (resetPending.exchange(false))
+                chunkFill = 0;
+
+            uint32_t timestamp;
+            memcpy(&timestamp, block, sizeof(timestamp));
+            const int16_t *samples = (const int16_t *)(block + BLOCK_META_SIZE);
+            int remaining = length / sizeof(int16_t);
+            while (remaining > 0)
+            {
+                if (chunkFill == 0)
+                    chunkTimestamp = timestamp + (samples - (const int16_t *)(block + BLOCK_META_SIZE));
+                int take = min(remaining, chunkSamples - chunkFill);
+                memcpy(chunk + chunkFill, samples, take * sizeof(int16_t));
+                chunkFill += take;
+                samples += take;
+                remaining -= take;
+
+                if (chunkFill == chunkSamples)
+                {
+                    // > 0: the index of the keyword heard
+                    if (wakenet->detect(model, chunk) > 0)
+                        detected(chunkTimestamp);
+                    chunkFill = 0;
+                }
+            }
+
+            pcmRing.release();
+        }
+    }
+}
+
+bool wakeWordBegin(const WakeWordConfig &config)
+{
+    srmodel_list_t *models = esp_srmodel_init("model");
+    modelName = models ? esp_srmodel_filter(models, ESP_WN_PREFIX, NULL) : NULL;
+    if (!modelName)
+    {
+        Serial.println("No WakeNet model in the model partition");
+        return false;
+    }
+    wakenet = esp_wn_handle_from_name(modelName);
+    model = wakenet ? wakenet->create(modelName, DET_MODE_90) : NULL;
+    if (!model)
+    {
+        Serial.printf("Failed to create WakeNet model %s\n", modelName);
+        modelName = NULL;
+        return false;
+    }
+
+    chunkSamples = wakenet->get_samp_chunksize(model);
+    chunk = (int16_t *)heap_caps_malloc(chunkSamples * sizeof(int16_t), MALLOC_CAP_8BIT);
+    if (!chunk || !pcmRing.begin(WAKE_WORD_RING_SLOTS, BLOCK_META_SIZE + config.blockSamples * sizeof(int16_t)))
+    {
+        Serial.println("Failed to allocate wake word buffers");
+        modelName = NULL;
+        return false;
+    }
+
+    if (xTaskCreatePinnedToCore(spotterTaskLoop, "WakeWord", config.stackSize, NULL,
+                                config.priority, &spotterTask, config.core) != pdPASS)
+    {
+        Serial.println("Failed to start wake word task");
+        modelName = NULL;
+        return false;
+    }
+    return true;
+}
+
+const char *wakeWordModel()
+{
+    return spotterTask ? modelName : "";
+}
+
+bool wakeWordSetEnabled(bool on)
+{
+    if (on && !spotterTask)
+        return false;
+    if (!on)
+        windowOpen.store(false, std::memory_order_release);
+    enabled.store(on, std::memory_order_release);
+    return true;
+}
+
+bool wakeWordEnabled()
+{
+    return enabled.load(std::memory_order_acquire);
+}
+
+int16_t *wakeWordAcquireBlock()
+{
+    if (!spotterTask)
+        return NULL;
+    acquiredSlot = pcmRing.acquire();
+    if (!acquiredSlot)
+    {
+        stats.overruns++;
+        return NULL;
+    }
+    return (int16_t *)(acquiredSlot + BLOCK_META_SIZE);
+}
+
+void wakeWordCommitBlock(int numSamples, uint32_t timestamp)
+{
+    memcpy(acquiredSlot, &timestamp, sizeof(timestamp));
+    pcmRing.commit(numSamples * sizeof(int16_t));
+    xTaskNotifyGive(spotterTask);
+}
+
+bool wakeWordListening(uint32_t timestamp)
+{
+    if (!windowOpen.load(std::memory_order_acquire))
+        return false;
+    if ((int32_t)(windowEnd.load(std::memory_order_relaxed) - timestamp) > 0)
+        return true;
+    windowOpen.store(false, std::memory_order_release); // Expired - wait for the next keyword
+    return false;
+}
+
+void wakeWordHold(uint32_t timestamp)
+{
+    extendWindow(timestamp + HOLD_SAMPLES);
+}
+
+void wakeWordReset()
+{
+    windowOpen.store(false, std::memory_order_release);
+    resetPending.store(true);
+}
+
+WakeWordStats wakeWordGetStats()
+{
+    return stats;
+}
+
+#else // !AUDIO_USE_WAKEWORD
+
+bool wakeWordBegin(const WakeWordConfig &config) { return false; }
+const char *wakeWordModel() { return ""; }
+bool wakeWordSetEnabled(bool enabled) { return !enabled; }
+bool wakeWordEnabled() { return false; }
+int16_t *wakeWordAcquireBlock() { return NULL; }
+void wakeWordCommitBlock(int numSamples, uint32_t timestamp) {}
+bool wakeWordListening(uint32_t timestamp) { return false; }
+void wakeWordHold(uint32_t timestamp) {}
+void wakeWordReset() {}
+WakeWordStats wakeWordGetStats() { return WakeWordStats(); }
+
+#endif
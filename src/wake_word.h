@@ -0,0 +1,87 @@
+/*
+Wake-Word Gate
+==============
+
+Optional keyword spotting with ESP-SR WakeNet, so an always-on device only
+streams after someone talks to it. Ambient noise can pass the VAD all day.
+
+The capture task hands every mono 16 kHz block to the spotter's ring, the
+same way it feeds the Opus stage. The spotter task (on core 1, next to the
+Opus stage) re-frames the blocks into WakeNet chunks and runs the model
+from PSRAM. On a detection it opens a window on the capture clock:
+- The send gate is then the VAD gate, but only inside the window. It opens
+  on the next speech block, and the pre-roll sent ahead of it covers the
+  keyword itself (WAKE_WORD_PREROLL_MS), so the relay hears the keyword and
+  the command after it.
+- Speech inside the window holds it open WAKE_WORD_HOLD_MS past the last
+  speech block. A conversation keeps streaming, and then the device goes
+  quiet until the next keyword.
+
+Stereo or non-16 kHz capture is not gated, because WakeNet takes 16 kHz mono
+only; the VAD gate alone applies there. Beam mode is mono and gated.
+
+Needs ESP-SR (esp_wn_iface.h, model_path.h) with a WakeNet model in the
+"model" partition, and -DAUDIO_USE_WAKEWORD=1. Without it every function is
+a no-op and wakeWordBegin() returns false. {"command":"wake","enabled":true}
+switches the gate at runtime.
+*/
+
+#ifndef WAKE_WORD_H
+#define WAKE_WORD_H
+
+#include <Arduino.h>
+
+#ifndef AUDIO_USE_WAKEWORD
+#define AUDIO_USE_WAKEWORD 0
+#endif
+
+#define WAKE_WORD_SAMPLE_RATE 16000
+#define WAKE_WORD_RING_SLOTS 8     // Capture blocks queued ahead of the spotter (power of two)
+#define WAKE_WORD_PREROLL_MS 1500  // Audio sent from before the detection - the keyword
+#define WAKE_WORD_WINDOW_MS 8000   // Listening window after a detection
+#define WAKE_WORD_HOLD_MS 2000     // Speech keeps the window open this much longer
+
+struct WakeWordConfig
+{
+    int blockSamples;     // Largest capture block handed to the spotter
+    BaseType_t core;      // Core the spotter task is pinned to
+    UBaseType_t priority; // Spotter task priority
+    uint32_t stackSize;   // Spotter task stack
+};
+
+struct WakeWordStats
+{
+    uint32_t detections;   // Keywords heard
+    uint32_t overruns;     // Capture blocks dropped because the spotter was behind
+    uint32_t lastDetected; // Capture clock at the last detection
+};
+
+// Load the model and start the spotter task
+bool wakeWordBegin(const WakeWordConfig &config);
+
+// Model name, or "" when no model is loaded
+const char *wakeWordModel();
+
+// Any task. Enabling fails without a model.
+bool wakeWordSetEnabled(bool enabled);
+bool wakeWordEnabled();
+
+// Capture side: slot for up to blockSamples native-endian samples, or NULL if full
+int16_t *wakeWordAcquireBlock();
+
+// Capture side: publish the slot from wakeWordAcquireBlock() and wake the
+// spotter. timestamp is the capture sample clock of the block's first sample.
+void wakeWordCommitBlock(int numSamples, uint32_t timestamp);
+
+// Capture side: true while the block at timestamp is inside a wake window
+bool wakeWordListening(uint32_t timestamp);
+
+// Capture side: speech at timestamp - keep the window open WAKE_WORD_HOLD_MS longer
+void wakeWordHold(uint32_t timestamp);
+
+// Close the window and drop the partial chunk, e.g. after a capture format change
+void wakeWordReset();
+
+WakeWordStats wakeWordGetStats();
+
+#endif // WAKE_WORD_H
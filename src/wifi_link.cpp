@@ -0,0 +1,276 @@
+/*
+Wi-Fi Link Manager
+==================
+
+See wifi_link.h.
+*/
+
+#include "wifi_link.h"
+#include <WiFi.h>
+#include <Preferences.h>
+#include <atomic>
+
+// Last AP that gave us an IP, see wifi_link.h
+#define LINK_CACHE_MAGIC 0x57464331 // "WFC1"
+#define LINK_CACHE_NAMESPACE "wifilink"
+#define LINK_CACHE_KEY "ap"
+
+struct LinkCache
+{
+    uint32_t magic;
+    char ssid[33];
+    uint8_t bssid[6];
+    int32_t channel;
+    uint32_t ip; // Lease, 0 when not cached (NVS copies never hold one)
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+};
+
+RTC_DATA_ATTR static LinkCache rtcCache; // Kept across deep sleep
+static LinkCache cache;                   // Entry for the next fast attempt
+static bool haveCache = false;
+static bool fastAttempt = false;          // Current attempt uses the cache
+static bool lastFast = false;
+
+static const char *linkSsid = NULL;
+static const char *linkPassword = NULL;
+
+static WifiLinkState state = WIFI_LINK_IDLE;
+static uint32_t stateSince = 0;  // millis() when the current state was entered
+static uint32_t backoffMs = 0;   // Delay before the next attempt in BACKOFF
+static uint32_t nextBackoffMs = WIFI_BACKOFF_MIN_MS;
+static uint32_t attempts = 0;
+static uint32_t drops = 0;
+static uint32_t lastConnectMs = 0;
+
+// Set by the event task, consumed by wifiLinkLoop()
+static std::atomic<bool> gotIp{false};
+static std::atomic<bool> lostLink{false};
+static std::atomic<uint32_t> lostLinkAt{0}; // millis() of the last disconnect event
+
+// Starting an attempt disconnects whatever the driver was doing, and that event
+// can land after the attempt began. Disconnects this soon after are not failures.
+#define WIFI_EVENT_GRACE_MS 250
+
+static void onWifiEvent(arduino_event_id_t event, arduino_event_info_t info)
+{
+    if (event == ARDUINO_EVENT_WIFI_STA_GOT_IP)
+        gotIp.store(true);
+    else if (event == ARDUINO_EVENT_WIFI_STA_DISCONNECTED || event == ARDUINO_EVENT_WIFI_STA_LOST_IP)
+    {
+        lostLinkAt.store(millis());
+        lostLink.store(true);
+    }
+}
+
+static void enterState(WifiLinkState next)
+{
+    state = next;
+    stateSince = millis();
+}
+
+static bool sameAp(const LinkCache &a, const LinkCache &b)
+{
+    return strcmp(a.ssid, b.ssid) == 0 && memcmp(a.bssid, b.bssid, sizeof(a.bssid)) == 0 && a.channel == b.channel;
+}
+
+// RTC copy after a deep sleep, otherwise the AP from NVS without a lease
+static void loadCache()
+{
+    haveCache = false;
+    if (rtcCache.magic == LINK_CACHE_MAGIC && strcmp(rtcCache.ssid, linkSsid) == 0)
+    {
+        cache = rtcCache;
+        haveCache = true;
+        return;
+    }
+
+    Preferences prefs;
+    if (prefs.begin(LINK_CACHE_NAMESPACE, true))
+    {
+        if (prefs.getBytes(LINK_CACHE_KEY, &cache, sizeof(cache)) == sizeof(cache) &&
+            cache.magic == LINK_CACHE_MAGIC && strcmp(cache.ssid, linkSsid) == 0)
+        {
+            cache.ip = cache.gateway = cache.subnet = cache.dns = 0;
+            haveCache = true;
+        }
+        prefs.end();
+    }
+}
+
+static void storeCache()
+{
+    LinkCache entry = {};
+    entry.magic = LINK_CACHE_MAGIC;
+    strncpy(entry.ssid, linkSsid, sizeof(entry.ssid) - 1);
+    const uint8_t *bssid = WiFi.BSSID();
+    if (bssid)
+        memcpy(entry.bssid, bssid, sizeof(entry.bssid));
+    entry.channel = WiFi.channel();
+    entry.ip = WiFi.localIP();
+    entry.gateway = WiFi.gatewayIP();
+    entry.subnet = WiFi.subnetMask();
+    entry.dns = WiFi.dnsIP(0);
+    rtcCache = entry;
+
+    // Flash only sees a write when the AP changed
+    if (haveCache && sameAp(cache, entry))
+        return;
+    cache = entry;
+    haveCache = true;
+    entry.ip = entry.gateway = entry.subnet = entry.dns = 0;
+    Preferences prefs;
+    if (prefs.begin(LINK_CACHE_NAMESPACE, false))
+    {
+        prefs.putBytes(LINK_CACHE_KEY, &entry, sizeof(entry));
+        prefs.end();
+    }
+}
+
+static void dropCache()
+{
+    haveCache = false;
+    rtcCache.magic = 0;
+    Preferences prefs;
+    if (prefs.begin(LINK_CACHE_NAMESPACE, false))
+    {
+        prefs.remove(LINK_CACHE_KEY);
+        prefs.end();
+    }
+}
+
+static void startAttempt()
+{
+    gotIp.store(false);
+    lostLink.store(false);
+    attempts++;
+
+    fastAttempt = haveCache;
+    if (fastAttempt)
+    {
+        // Straight to the known AP on its channel; reuse the lease if we still have it
+        if (cache.ip)
+            WiFi.config(IPAddress(cache.ip), IPAddress(cache.gateway), IPAddress(cache.subnet), IPAddress(cache.dns));
+        WiFi.begin(linkSsid, linkPassword, cache.channel, cache.bssid);
+    }
+    else
+    {
+        WiFi.config(IPAddress((uint32_t)0), IPAddress((uint32_t)0), IPAddress((uint32_t)0)); // DHCP
+        WiFi.begin(linkSsid, linkPassword);
+    }
+    enterState(WIFI_LINK_CONNECTING);
+}
+
+// The cached AP or lease did not work - forget it and scan right away, no backoff
+static void fallBackFromCache(const char *reason)
+{
+    Serial.printf("WiFi: cached AP %s, falling back to a full scan\n", reason);
+    dropCache();
+    startAttempt();
+}
+
+static void startBackoff()
+{
+    float jitter = (esp_random() % 1000) / 1000.0f * WIFI_BACKOFF_JITTER;
+    backoffMs = nextBackoffMs + (uint32_t)(nextBackoffMs * jitter);
+    nextBackoffMs = min(nextBackoffMs * 2, (uint32_t)WIFI_BACKOFF_MAX_MS);
+    Serial.printf("WiFi: retrying in %u ms\n", backoffMs);
+    enterState(WIFI_LINK_BACKOFF);
+}
+
+void wifiLinkBegin(const char *ssid, const char *password)
+{
+    linkSsid = ssid;
+    linkPassword = password;
+
+    WiFi.mode(WIFI_STA);
+    WiFi.persistent(false);       // Credentials come from the firmware, skip the flash writes
+    WiFi.setAutoReconnect(false); // Retries are ours, with backoff
+    WiFi.onEvent(onWifiEvent);
+
+    loadCache();
+    Serial.printf("Connecting to WiFi network: %s%s\n", ssid, haveCache ? " (cached AP)" : "");
+    startAttempt();
+}
+
+void wifiLinkLoop()
+{
+    uint32_t now = millis();
+    switch (state)
+    {
+    case WIFI_LINK_IDLE:
+        break;
+
+    case WIFI_LINK_CONNECTING:
+        if (lostLink.load() && (int32_t)(lostLinkAt.load() - stateSince) < WIFI_EVENT_GRACE_MS)
+            lostLink.store(false); // Our own disconnect from starting this attempt
+
+        if (gotIp.exchange(false))
+        {
+            lastConnectMs = now - stateSince;
+            lastFast = fastAttempt;
+            nextBackoffMs = WIFI_BACKOFF_MIN_MS;
+            lostLink.store(false);
+            storeCache();
+            enterState(WIFI_LINK_UP);
+            Serial.printf("WiFi connected in %u ms%s, IP address: %s\n", lastConnectMs, lastFast ? " (cached AP)" : "",
+                          WiFi.localIP().toString().c_str());
+        }
+        else if (fastAttempt && lostLink.exchange(false))
+        {
+            fallBackFromCache("refused");
+        }
+        else if (fastAttempt && now - stateSince > WIFI_FAST_TIMEOUT_MS)
+        {
+            fallBackFromCache("timed out");
+        }
+        else if (lostLink.exchange(false))
+        {
+            Serial.println("WiFi: connection attempt failed");
+            startBackoff();
+        }
+        else if (now - stateSince > WIFI_CONNECT_TIMEOUT_MS)
+        {
+            Serial.println("WiFi: connection attempt timed out");
+            WiFi.disconnect(); // Its event arrives during the backoff and is ignored
+            startBackoff();
+        }
+        break;
+
+    case WIFI_LINK_UP:
+        if (lostLink.exchange(false))
+        {
+            drops++;
+            Serial.println("WiFi disconnected, reconnecting...");
+            startBackoff(); // Starts at the minimum delay after a working link
+        }
+        break;
+
+    case WIFI_LINK_BACKOFF:
+        if (now - stateSince >= backoffMs)
+            startAttempt();
+        break;
+    }
+}
+
+bool wifiLinkUp()
+{
+    return state == WIFI_LINK_UP;
+}
+
+WifiLinkStats wifiLinkGetStats()
+{
+    WifiLinkStats stats = {};
+    stats.state = state;
+    stats.attempts = attempts;
+    stats.drops = drops;
+    stats.lastConnectMs = lastConnectMs;
+    stats.fastConnect = lastFast;
+    if (state == WIFI_LINK_BACKOFF)
+    {
+        uint32_t elapsed = millis() - stateSince;
+        stats.retryInMs = elapsed < backoffMs ? backoffMs - elapsed : 0;
+    }
+    return stats;
+}
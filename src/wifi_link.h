@@ -0,0 +1,77 @@
+/*
+Wi-Fi Link Manager
+==================
+
+Non-blocking station bring-up and reconnect, replacing the busy-wait loops in
+setup() and loop().
+
+WiFi.onEvent callbacks (run on the Arduino event task) only record what
+happened; wifiLinkLoop(), called from loop(), drives the state machine:
+
+  IDLE -> CONNECTING -> UP
+               |         |
+               v         v
+            BACKOFF <----+   (disconnect, or no IP within WIFI_CONNECT_TIMEOUT_MS)
+
+Retry delays double from WIFI_BACKOFF_MIN_MS up to WIFI_BACKOFF_MAX_MS, plus
+up to WIFI_BACKOFF_JITTER of random extra, so a fleet that lost the same AP
+does not come back in lockstep. The driver's own auto-reconnect is turned off
+so the two do not fight.
+
+Nothing here blocks: the capture task keeps filling the packet ring during an
+outage and loop() keeps running.
+
+Fast reconnect: after every successful bring-up the AP's BSSID and channel and
+the DHCP lease (IP, gateway, subnet, DNS) are cached. The next attempt
+associates directly with that AP on that channel, with no scan. After a deep
+sleep it also reuses the lease, with no DHCP.
+- RTC memory survives deep sleep but not power loss. It holds the full entry
+  and is the only source of the static IP, because the lease may have been
+  handed to someone else after a long power-off.
+- NVS keeps the BSSID and channel across power cycles and is written only when
+  they change.
+If the fast attempt does not get an IP within WIFI_FAST_TIMEOUT_MS, the cache
+is dropped and the normal scan + DHCP path runs.
+*/
+
+#ifndef WIFI_LINK_H
+#define WIFI_LINK_H
+
+#include <Arduino.h>
+
+#define WIFI_CONNECT_TIMEOUT_MS 15000 // Attempt without an IP counts as failed
+#define WIFI_BACKOFF_MIN_MS 500
+#define WIFI_BACKOFF_MAX_MS 30000
+#define WIFI_BACKOFF_JITTER 0.5f // Random extra, as a fraction of the delay
+#define WIFI_FAST_TIMEOUT_MS 3000 // Cached AP/lease attempt before falling back to a scan
+
+enum WifiLinkState : uint8_t
+{
+    WIFI_LINK_IDLE,
+    WIFI_LINK_CONNECTING,
+    WIFI_LINK_UP,
+    WIFI_LINK_BACKOFF
+};
+
+struct WifiLinkStats
+{
+    WifiLinkState state;
+    uint32_t attempts;       // Association attempts since boot
+    uint32_t drops;          // Times an established link went down
+    uint32_t lastConnectMs;  // Duration of the last successful bring-up
+    uint32_t retryInMs;      // Time left in BACKOFF
+    bool fastConnect;        // Last bring-up used the cached AP
+};
+
+// Start connecting - returns immediately
+void wifiLinkBegin(const char *ssid, const char *password);
+
+// Advance the state machine; call from loop(). Never blocks.
+void wifiLinkLoop();
+
+// Station associated and has an IP
+bool wifiLinkUp();
+
+WifiLinkStats wifiLinkGetStats();
+
+#endif // WIFI_LINK_H